@@ -31,7 +31,7 @@ Realtime verification utility
 __author__ = "Clark Williams <williams@redhat.com>, David Sommerseth <davids@redhat.com>"
 __license__ = "GPLv2 License"
 
-import os, signal, sys, threading, time
+import os, signal, sys, threading, time, uuid, libxml2
 from datetime import datetime
 from distutils import sysconfig
 from modules.loads import LoadModules
@@ -113,6 +113,11 @@ class RtEval(rtevalReport):
         else:
             self.__xmlrpc = None
 
+        # Snapshots of the run is only sent with --xmlrpc-submit
+        self.__snapshot_interval = self.__xmlrpc and int(self.__rtevcfg.snapshot_interval) or 0
+        self.__snapshot_runid = uuid.uuid4().hex
+        self.__snapshot_seq = 0
+
 
     def __show_remaining_time(self, remaining):
         r = int(remaining)
@@ -125,6 +130,18 @@ class RtEval(rtevalReport):
         print "rteval time remaining: %d days, %d hours, %d minutes, %d seconds" % (days, hours, minutes, r)
 
 
+    def __snapshot(self, measure_start, measurements, final):
+        "Queues a snapshot of the run for submission, and tries to send the queued snapshots"
+        self.__snapshot_seq += 1
+        self.__logger.log(Log.DEBUG, "Making snapshot %i of run %s" % (self.__snapshot_seq,
+                                                                      self.__snapshot_runid))
+        self.__xmlrpc.QueueSnapshot(self._snapshot_report(measure_start, self.__snapshot_runid,
+                                                          self.__snapshot_seq, final,
+                                                          measurements))
+        if not final:
+            self.__xmlrpc.SendSnapshots()
+
+
     def Prepare(self, onlyload = False):
         builddir = os.path.join(self.__rtevcfg.workdir, 'rteval-build')
         if not os.path.isdir(builddir): os.mkdir(builddir)
@@ -156,6 +173,16 @@ class RtEval(rtevalReport):
         self.__logger.log(Log.INFO, "Preparing measurement modules")
         self._measuremods.Setup(params)
 
+        # Snapshots must not silently change what is measured
+        interrupted = self.__snapshot_interval and self._measuremods.SnapshotInterrupts() or []
+        if interrupted and not self.__rtevcfg.snapshot_restart:
+            print "ERROR: Snapshots would restart the measurement module(s) %s, leaving gaps" \
+                " in the measurement.  Use --snapshot-restart to accept this." % ", ".join(interrupted)
+            sys.exit(2)
+        elif interrupted:
+            self.__logger.log(Log.WARN, "Each snapshot restarts %s, the measurement has gaps"
+                              % ", ".join(interrupted))
+
 
     def __RunMeasurementProfile(self, measure_profile):
         global earlystop
@@ -209,6 +236,7 @@ class RtEval(rtevalReport):
             stoptime = (time.time() + float(self.__rtevcfg.duration))
             currtime = time.time()
             rpttime = currtime + report_interval
+            snaptime = currtime + self.__snapshot_interval
             load_avg_checked = 5
             while (currtime <= stoptime) and not stopsig_received:
                 time.sleep(60.0)
@@ -233,6 +261,14 @@ class RtEval(rtevalReport):
                     self.__show_remaining_time(left_to_run)
                     rpttime = currtime + report_interval
                     print "load average: %.2f" % self._loadmods.GetLoadAvg()
+
+                if self.__snapshot_interval and currtime >= snaptime:
+                    snap_n = libxml2.newNode("Measurements")
+                    mprep_n = measure_profile.MakeSnapshot()
+                    if mprep_n:
+                        snap_n.addChild(mprep_n)
+                    self.__snapshot(measure_start, snap_n, False)
+                    snaptime = currtime + self.__snapshot_interval
                 currtime = time.time()
 
             self.__logger.log(Log.DEBUG, "out of measurement loop")
@@ -272,8 +308,12 @@ class RtEval(rtevalReport):
         if self.__rtevcfg.sysreport:
             self._sysinfo.run_sysreport(self.__reportdir)
 
-        # if --xmlrpc-submit | -X was given, send our report to the given host
-        if self.__xmlrpc:
+        # if --xmlrpc-submit | -X was given, send our report to the given host.
+        # With snapshots, the server has all but the last part of the run already
+        if self.__xmlrpc and self.__snapshot_interval:
+            self.__snapshot(measure_start, self._measuremods.MakeSnapshot(), True)
+            retvalres = self.__xmlrpc.FlushSnapshots()
+        elif self.__xmlrpc:
             retvalres = self.__xmlrpc.SendReport(self.GetXMLreport())
 
         if earlystop:
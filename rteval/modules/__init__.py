@@ -207,6 +207,19 @@ class rtevalModulePrototype(threading.Thread):
         raise NotImplementedError("MakeReport() method must be implemented in the%s module" % self._name)
 
 
+    def MakeSnapshot(self):
+        """Optional module method, returns an libxml2.xmlNode object with the results
+since the previous snapshot while the workload is still running.  Modules which
+cannot provide snapshots return None"""
+        return None
+
+
+    def SnapshotInterrupts(self):
+        """Optional module method, returns True if MakeSnapshot() has to interrupt
+the measurement, leaving a gap in the measured data"""
+        return False
+
+
     def GetTimestamps(self):
         "Return libxml2.xmlNode object with the gathered timestamps"
 
@@ -543,3 +556,23 @@ start their workloads yet"""
                 rep_n.addChild(modrep_n)
 
         return rep_n
+
+
+    def MakeSnapshot(self):
+        """Collects snapshots from all the loaded modules in a single libxml2.xmlNode() object.
+Returns None if no module provides snapshots"""
+
+        rep_n = None
+        for (modname, mod) in self.__modules:
+            modrep_n = mod.MakeSnapshot()
+            if modrep_n is not None:
+                if rep_n is None:
+                    rep_n = libxml2.newNode(self._report_tag)
+                rep_n.addChild(modrep_n)
+
+        return rep_n
+
+
+    def SnapshotInterrupts(self):
+        "Returns the names of the loaded modules which interrupt their workload for a snapshot"
+        return [modname for (modname, mod) in self.__modules if mod.SnapshotInterrupts()]
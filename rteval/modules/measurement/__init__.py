@@ -83,6 +83,15 @@ class MeasurementProfile(RtEvalModules):
         return rep_n
 
 
+    def MakeSnapshot(self):
+        "Generates a snapshot report for the measurement modules in this profile"
+        rep_n = RtEvalModules.MakeSnapshot(self)
+        if rep_n:
+            rep_n.newProp("loads", self.__with_load and "1" or "0")
+            rep_n.newProp("parallel", self.__run_parallel and "1" or "0")
+        return rep_n
+
+
     def isAlive(self):
         """Returns True if all modules which are supposed to run runs"""
 
@@ -197,6 +206,29 @@ measurement profiles, based on their characteristics"""
         return rep_n
 
 
+    def MakeSnapshot(self):
+        """Generates a snapshot report for all measurement profiles, containing
+the measurements since the previous snapshot"""
+
+        rep_n = libxml2.newNode("Measurements")
+        for mp in self.__measureprofiles:
+            mprep_n = mp.MakeSnapshot()
+            if mprep_n:
+                rep_n.addChild(mprep_n)
+
+        return rep_n
+
+
+    def SnapshotInterrupts(self):
+        """Returns the names of the measurement modules which have to interrupt
+their measurement to make a snapshot"""
+
+        modules = []
+        for mp in self.__measureprofiles:
+            modules += mp.SnapshotInterrupts()
+        return modules
+
+
     def __iter__(self):
         "Initiates an iteration loop for MeasurementProfile objects"
 
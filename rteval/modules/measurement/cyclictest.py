@@ -25,7 +25,7 @@
 #   are deemed to be part of the source code.
 #
 
-import os, sys, subprocess, signal, libxml2, shutil, tempfile, time
+import os, sys, subprocess, signal, libxml2, shutil, tempfile, time, threading
 from rteval.Log import Log
 from rteval.modules import rtevalModulePrototype
 from rteval.misc import expand_cpulist, online_cpus, cpuinfo
@@ -128,7 +128,9 @@ class RunData(object):
         self.__stddev = math.sqrt(varsum / (self.__numsamples - 1))
 
 
-    def MakeReport(self):
+    def MakeReport(self, histogram=None):
+        """Generates the report node.  If histogram is a RunData object, its
+        histogram is reported instead of the one of this object"""
         rep_n = libxml2.newNode(self.__type)
         if self.__type == 'system':
             rep_n.newProp('description', self.__description)
@@ -165,17 +167,21 @@ class RunData(object):
             n = stat_n.newTextChild(None, 'standard_deviation', str(self.__stddev))
             n.newProp('unit', 'us')
 
+            if histogram is not None:
+                samples = histogram.__samples
+            else:
+                samples = self.__samples
             hist_n = rep_n.newChild(None, 'histogram', None)
-            hist_n.newProp('nbuckets', str(len(self.__samples)))
-            keys = self.__samples.keys()
+            hist_n.newProp('nbuckets', str(len(samples)))
+            keys = samples.keys()
             keys.sort()
             for k in keys:
-                if self.__samples[k] == 0:
+                if samples[k] == 0:
                     # Don't report buckets without any samples
                     continue
                 b_n = hist_n.newChild(None, 'bucket', None)
                 b_n.newProp('index', str(k))
-                b_n.newProp('value', str(self.__samples[k]))
+                b_n.newProp('value', str(samples[k]))
 
         return rep_n
 
@@ -192,6 +198,8 @@ class Cyclictest(rtevalModulePrototype):
         self.__numcores = 0
         self.__cpus = []
         self.__cyclicdata = {}
+        self.__snapdata = {}
+        self.__lock = threading.Lock()
         self.__sparse = False
 
         if self.__cfg.cpulist:
@@ -203,18 +211,8 @@ class Cyclictest(rtevalModulePrototype):
 
         self.__numcores = len(self.__cpus)
 
-        info = cpuinfo()
-
-        # create a RunData object for each core we'll measure
-        for core in self.__cpus:
-            self.__cyclicdata[core] = RunData(core, 'core',self.__priority,
-                                              logfnc=self._log)
-            self.__cyclicdata[core].description = info[core]['model name']
-
-        # Create a RunData object for the overall system
-        self.__cyclicdata['system'] = RunData('system', 'system', self.__priority,
-                                              logfnc=self._log)
-        self.__cyclicdata['system'].description = ("(%d cores) " % self.__numcores) + info['0']['model name']
+        self.__cyclicdata = self.__newrundata()
+        self.__snapdata = self.__newrundata()
 
         if self.__sparse:
             self._log(Log.DEBUG, "system using %d cpu cores" % self.__numcores)
@@ -223,6 +221,23 @@ class Cyclictest(rtevalModulePrototype):
         self.__started = False
         self.__cyclicoutput = None
         self.__breaktraceval = None
+        self.__snapgaps = 0
+        self.__snapgaptime = 0.0
+
+
+    def __newrundata(self):
+        "Creates a RunData object for each core we'll measure, and one for the overall system"
+        info = cpuinfo()
+        rundata = {}
+        for core in self.__cpus:
+            rundata[core] = RunData(core, 'core',self.__priority,
+                                    logfnc=self._log)
+            rundata[core].description = info[core]['model name']
+
+        rundata['system'] = RunData('system', 'system', self.__priority,
+                                    logfnc=self._log)
+        rundata['system'].description = ("(%d cores) " % self.__numcores) + info['0']['model name']
+        return rundata
 
 
     def __getmode(self):
@@ -310,15 +325,18 @@ class Cyclictest(rtevalModulePrototype):
 
 
     def WorkloadAlive(self):
-        if self.__started:
-            return self.__cyclicprocess.poll() is None
-        else:
-            return False
-
-
-    def _WorkloadCleanup(self):
-        if not self.__started:
-            return
+        self.__lock.acquire()
+        try:
+            if self.__started:
+                return self.__cyclicprocess.poll() is None
+            else:
+                return False
+        finally:
+            self.__lock.release()
+
+
+    def __stop(self):
+        "Stops cyclictest and parses the histogram it writes when exiting"
         while self.__cyclicprocess.poll() is None:
             self._log(Log.DEBUG, "Sending SIGINT")
             os.kill(self.__cyclicprocess.pid, signal.SIGINT)
@@ -349,8 +367,9 @@ class Cyclictest(rtevalModulePrototype):
                 continue
 
             for i,core in enumerate(self.__cpus):
-                self.__cyclicdata[core].bucket(index, int(vals[i+1]))
-                self.__cyclicdata['system'].bucket(index, int(vals[i+1]))
+                for rundata in (self.__cyclicdata, self.__snapdata):
+                    rundata[core].bucket(index, int(vals[i+1]))
+                    rundata['system'].bucket(index, int(vals[i+1]))
 
         # generate statistics for each RunData object
         for n in self.__cyclicdata.keys():
@@ -358,13 +377,60 @@ class Cyclictest(rtevalModulePrototype):
             self.__cyclicdata[n].reduce()
             #print self.__cyclicdata[n]
 
-        self._setFinished()
         self.__started = False
         os.close(self.__nullfp)
         del self.__nullfp
 
 
+    def _WorkloadCleanup(self):
+        self.__lock.acquire()
+        try:
+            if not self.__started:
+                return
+            self.__stop()
+            self._setFinished()
+        finally:
+            self.__lock.release()
+
+
+    def SnapshotInterrupts(self):
+        "cyclictest only writes its histogram when exiting, see MakeSnapshot()"
+        return True
+
+
+    def MakeSnapshot(self):
+        """Returns a report with the statistics of the whole run so far, and the
+        histogram of the samples since the previous snapshot.  cyclictest only
+        writes its histogram when exiting, so it is stopped and started again.
+        Nothing is measured until the new cyclictest runs, and the new process
+        adds its own start up latencies to the samples.  Thus rteval only makes
+        snapshots of a cyclictest run when explicitly asked for (--snapshot-restart),
+        and the gaps are recorded in the report"""
+        self.__lock.acquire()
+        try:
+            if self.__started and self.__cyclicprocess.poll() is None:
+                gapstart = time.time()
+                self.__stop()
+                self.__cyclicoutput.seek(0)
+                self.__cyclicoutput.truncate()
+                self._WorkloadTask()
+                gap = time.time() - gapstart
+                self.__snapgaps += 1
+                self.__snapgaptime += gap
+                self._log(Log.WARN, "cyclictest was not measuring for %.3f seconds, "
+                          "while making a snapshot" % gap)
+            rep_n = self.__report(self.__snapdata)
+            self.__snapdata = self.__newrundata()
+            return rep_n
+        finally:
+            self.__lock.release()
+
+
     def MakeReport(self):
+        return self.__report(None)
+
+
+    def __report(self, histdata):
         rep_n = libxml2.newNode('cyclictest')
         rep_n.newProp('command_line', ' '.join(self.__cmd))
 
@@ -383,11 +449,17 @@ class Cyclictest(rtevalModulePrototype):
         if abrt:
             rep_n.addChild(abrt_n)
 
-        rep_n.addChild(self.__cyclicdata["system"].MakeReport())
+        # Report the time cyclictest was stopped for snapshots
+        if self.__snapgaps:
+            gap_n = rep_n.newChild(None, 'snapshot_gaps', None)
+            gap_n.newProp('count', str(self.__snapgaps))
+            gap_n.newProp('seconds', '%.3f' % self.__snapgaptime)
+
+        rep_n.addChild(self.__cyclicdata["system"].MakeReport(histdata and histdata["system"] or None))
         for thr in self.__cpus:
             if str(thr) not in self.__cyclicdata:
                 continue
-            rep_n.addChild(self.__cyclicdata[str(thr)].MakeReport())
+            rep_n.addChild(self.__cyclicdata[str(thr)].MakeReport(histdata and histdata[str(thr)]))
 
         return rep_n
 
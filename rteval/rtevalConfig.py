@@ -93,6 +93,8 @@ default_config = {
         'xmlrpc'     : None,
         'xslt_report': default_config_search(['rteval_text.xsl'], os.path.isfile),
         'report_interval': '600',
+        'snapshot_interval': '0',
+        'snapshot_restart': False,
         'logging'    : False,
         }
     }
@@ -88,6 +88,44 @@ class rtevalReport(object):
         self.__xmlreport.Write("-", xslt_tpl)
 
 
+    def _snapshot_report(self, measure_start, runid, seq, final, measurements):
+        """Creates a snapshot report of a run in progress, with the measurements
+        since the previous snapshot.  Returns a libxml2.xmlDoc object, which the
+        caller must free"""
+
+        duration = datetime.now() - measure_start
+        seconds = duration.seconds
+        hours = seconds / 3600
+        if hours: seconds -= (hours * 3600)
+        minutes = seconds / 60
+        if minutes: seconds -= (minutes * 60)
+
+        snapreport = xmlout.XMLOut('rteval', self.__version)
+        snapreport.NewReport()
+
+        snapreport.openblock('run_info', {'days': duration.days,
+                             'hours': hours,
+                             'minutes': minutes,
+                             'seconds': seconds})
+        snapreport.taggedvalue('date', self.__start.strftime('%Y-%m-%d'))
+        snapreport.taggedvalue('time', self.__start.strftime('%H:%M:%S'))
+        if self.__annotate:
+            snapreport.taggedvalue('annotate', self.__annotate)
+        snapreport.openblock('snapshot', {'runid': runid,
+                                          'seq': seq,
+                                          'final': final and 1 or 0})
+        snapreport.closeblock()
+        snapreport.closeblock()
+
+        snapreport.AppendXMLnodes(self._sysinfo.MakeReport())
+        snapreport.AppendXMLnodes(self._loadmods.MakeReport())
+        snapreport.AppendXMLnodes(measurements)
+        snapreport.close()
+
+        # The document is freed together with the XMLOut object
+        return snapreport.GetXMLdocument().copyDoc(1)
+
+
     def GetXMLreport(self):
         "Retrieves the complete rteval XML report as a libxml2.xmlDoc object"
         return self.__xmlreport.GetXMLdocument()
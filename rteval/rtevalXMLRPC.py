@@ -24,7 +24,7 @@
 #   are deemed to be part of the source code.
 #
 
-import socket, time
+import socket, time, httplib
 import rtevalclient, xmlrpclib
 from Log import Log
 
@@ -35,6 +35,7 @@ class rtevalXMLRPC(object):
         self.__logger = logger
         self.__mailer = mailer
         self.__client = rtevalclient.rtevalclient(self.__url)
+        self.__snapshots = []
 
 
     def Ping(self):
@@ -85,14 +86,22 @@ class rtevalXMLRPC(object):
         attempt = 0
         exitcode = 2   # Presume failure
         warning_sent = False
+        upload = self.__client.PrepareReport(xmlreport) # Kept, so retries resume the upload
         while attempt < 6:
             try:
                 print "Submitting report to %s" % self.__url
-                rterid = self.__client.SendReport(xmlreport)
+                if upload is not None:
+                    try:
+                        rterid = self.__client.UploadReport(upload)
+                    except rtevalclient.UploadNotSupported:
+                        # Older server, only the XML-RPC API is available
+                        upload = None
+                if upload is None:
+                    rterid = self.__client.SendReport(xmlreport)
                 print "Report registered with submission id %i" % rterid
                 attempt = 10
                 exitcode = 0 # Success
-            except socket.error:
+            except (socket.error, httplib.HTTPException):
                 attempt += 1
                 if attempt > 5:
                     break # To avoid sleeping before we abort
@@ -123,3 +132,54 @@ class rtevalXMLRPC(object):
 
         return exitcode
 
+
+    def QueueSnapshot(self, xmlreport):
+        """Queues a snapshot report for submission.  The libxml2.xmlDoc object is
+        freed when the snapshot is registered"""
+        self.__snapshots.append([xmlreport, self.__client.PrepareReport(xmlreport)])
+
+
+    def SendSnapshots(self):
+        """Does one attempt to send the queued snapshots, in order.  Snapshots
+        which are not sent stay queued, and a resumed upload is registered only once.
+        Returns the number of snapshots still queued"""
+
+        while len(self.__snapshots) > 0:
+            (xmlreport, upload) = self.__snapshots[0]
+            try:
+                if upload is not None:
+                    try:
+                        rterid = self.__client.UploadReport(upload)
+                    except rtevalclient.UploadNotSupported:
+                        upload = self.__snapshots[0][1] = None
+                if upload is None:
+                    rterid = self.__client.SendReport(xmlreport)
+            except (socket.error, httplib.HTTPException), err:
+                self.__logger.log(Log.WARN, "Failed sending snapshot to %s: %s"
+                                  % (self.__host, str(err)))
+                break
+
+            self.__logger.log(Log.INFO, "Snapshot registered with submission id %i" % rterid)
+            self.__snapshots.pop(0)
+            xmlreport.freeDoc()
+
+        return len(self.__snapshots)
+
+
+    def FlushSnapshots(self):
+        "Sends all the queued snapshots.  Returns 0 on success or 2 on submission failure."
+
+        attempt = 0
+        while self.SendSnapshots() > 0:
+            attempt += 1
+            if attempt > 5:
+                if (self.__mailer is not None):
+                    self.__mailer.SendMessage("[RTEVAL:FAILURE] Failed to submit snapshots to XML-RPC server",
+                                              "Server %s did not respond at all after %i attempts."
+                                              % (self.__host, attempt - 1))
+                return 2
+
+            print "Failed sending snapshots.  Doing another attempt(%i) " % attempt
+            time.sleep(attempt)
+
+        return 0
@@ -31,6 +31,17 @@ import StringIO
 import bz2
 import base64
 import platform
+import re
+import uuid
+import urllib
+import urlparse
+import httplib
+
+
+class UploadNotSupported(Exception):
+    "The server does not provide the API2 upload interface"
+    pass
+
 
 class rtevalclient:
     """
@@ -38,6 +49,7 @@ class rtevalclient:
     """
     def __init__(self, url="http://rtserver.farm.hsv.redhat.com/rteval/API1/", hostn = None):
         self.srv = xmlrpclib.ServerProxy(url)
+        self.api2url = re.sub(r'/API1/?$', '/API2/', url)
         if hostn is None:
             self.hostname = platform.node()
         else:
@@ -64,6 +76,97 @@ class rtevalclient:
         print "rtevalclient::SendReport() - Sent %i bytes (XML document length: %i bytes, compression ratio: %.02f%%)" % (len(data), doclen, (1-(float(len(data)) / float(doclen)))*100 )
         return ret
 
+    def SendReports(self, reports):
+        """Sends several reports in one call, given as a list of (hostname, xmldoc) pairs.
+        Returns a list of submission IDs, in the same order as the reports"""
+        batch = []
+        for (hostname, xmldoc) in reports:
+            if xmldoc.type != 'document_xml':
+                raise Exception, "Input is not XML document"
+
+            fbuf = StringIO.StringIO()
+            xmlbuf = libxml2.createOutputBuffer(fbuf, 'UTF-8')
+            xmldoc.saveFileTo(xmlbuf, 'UTF-8')
+
+            compr = bz2.BZ2Compressor(9)
+            cmpr = compr.compress(fbuf.getvalue())
+            batch.append([hostname, base64.b64encode(cmpr + compr.flush())])
+
+        ret = self.srv.SendReports(batch)
+        print "rtevalclient::SendReports() - Sent %i reports" % len(batch)
+        return ret
+
+    def PrepareReport(self, xmldoc):
+        "Compresses a report for UploadReport().  The result is reused when resuming an upload"
+        if xmldoc.type != 'document_xml':
+            raise Exception, "Input is not XML document"
+
+        fbuf = StringIO.StringIO()
+        xmlbuf = libxml2.createOutputBuffer(fbuf, 'UTF-8')
+        doclen = xmldoc.saveFileTo(xmlbuf, 'UTF-8')
+
+        compr = bz2.BZ2Compressor(9)
+        cmpr = compr.compress(fbuf.getvalue())
+        return {'uploadid': uuid.uuid4().hex,
+                'data': cmpr + compr.flush(),
+                'doclen': doclen}
+
+    def __upload_request(self, method, uploadid, crange = None, body = None):
+        url = urlparse.urlparse(self.api2url)
+        if url.scheme == 'https':
+            conn = httplib.HTTPSConnection(url.netloc)
+        else:
+            conn = httplib.HTTPConnection(url.netloc)
+        try:
+            headers = {'Content-Type': 'application/octet-stream'}
+            if crange is not None:
+                headers['Content-Range'] = crange
+            conn.request(method, "%supload/%s?clientid=%s" % (url.path, uploadid, urllib.quote(self.hostname)),
+                         body, headers)
+            resp = conn.getresponse()
+            text = resp.read().strip()
+        finally:
+            conn.close()
+
+        if resp.status in (404, 405, 501):
+            raise UploadNotSupported("API2 uploads not supported: %i %s" % (resp.status, resp.reason))
+        if resp.status not in (200, 201, 409) or len(text.split()) != 2:
+            raise Exception, "Upload failed: %i %s %s" % (resp.status, resp.reason, text)
+        (key, value) = text.split()
+        return (key, int(value))
+
+    def UploadReport(self, upload, chunksize = 1048576):
+        """Sends a report prepared by PrepareReport() through the API2 interface, without
+        base64 encoding.  An interrupted upload continues where the server stopped receiving.
+        Returns the submission id"""
+        data = upload['data']
+        total = len(data)
+        # Each chunk once, and some requests for restarted or concurrent uploads
+        requests = (total // chunksize) + 10
+        (key, value) = self.__upload_request('GET', upload['uploadid'])
+        while key == 'offset':
+            requests -= 1
+            if requests < 0:
+                raise Exception, "Upload did not complete, the server is at offset %i of %i" % (value, total)
+            offset = value
+            if offset < total:
+                end = min(offset + chunksize, total)
+                (key, value) = self.__upload_request('PUT', upload['uploadid'],
+                                                     "bytes %i-%i/%i" % (offset, end - 1, total),
+                                                     data[offset:end])
+            else:
+                # Everything is received, but the report was not registered
+                (key, value) = self.__upload_request('PUT', upload['uploadid'], "bytes */%i" % total, '')
+                if key == 'offset':
+                    (key, value) = self.__upload_request('GET', upload['uploadid'])
+                    if key == 'offset' and value >= total:
+                        raise Exception, "Upload is complete, but the server did not register the report"
+            if key == 'offset' and value <= offset and offset < total:
+                raise Exception, "Upload did not progress at offset %i" % offset
+
+        print "rtevalclient::UploadReport() - Sent %i bytes (XML document length: %i bytes, compression ratio: %.02f%%)" % (total, upload['doclen'], (1-(float(total) / float(upload['doclen'])))*100 )
+        return value
+
     def SendDataAsFile(self, fname, data, decompr = False):
         compr = bz2.BZ2Compressor(9)
         cmprdata = compr.compress(data)
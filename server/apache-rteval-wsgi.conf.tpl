@@ -28,6 +28,7 @@
 WSGISocketPrefix /var/run/wsgi
 WSGIDaemonProcess rtevalxmlrpc processes=3 threads=15 python-path={_INSTALLDIR_}
 WSGIScriptAlias /rteval/API1 {_INSTALLDIR_}/rteval_xmlrpc.wsgi
+WSGIScriptAlias /rteval/API2 {_INSTALLDIR_}/rteval_xmlrpc.wsgi
 
 <Directory "{_INSTALLDIR_}">
     Options Indexes FollowSymLinks
@@ -29,27 +29,37 @@
 import psycopg2
 import types
 
+def BuildDSN(host=None, port=None, user=None, password=None, database=None):
+    "Builds a psycopg2 connection string.  SSL is required for network connections"
+    dsnd = {}
+    if host is not None:
+        dsnd['host'] = host
+        dsnd['sslmode'] = 'require'
+    if port is not None:
+        dsnd['port'] = str(port)
+        dsnd['sslmode'] = 'require'
+    if user is not None:
+        dsnd['user'] = user
+    if password is not None:
+        dsnd['password'] = password
+    if database is not None:
+        dsnd['dbname'] = database
+
+    return " ".join(["%s='%s'" %(k,v) for (k,v) in dsnd.items()])
+
+
 class Database(object):
     def __init__(self, host=None, port=None, user=None, password=None, database=None,
-                 noaction=False, debug=False):
+                 noaction=False, debug=False, conn=None):
         self.noaction = noaction
         self.debug = debug
 
-        dsnd = {}
-        if host is not None:
-            dsnd['host'] = host
-            dsnd['sslmode'] = 'require'
-        if port is not None:
-            dsnd['port'] = str(port)
-            dsnd['sslmode'] = 'require'
-        if user is not None:
-            dsnd['user'] = user
-        if password is not None:
-            dsnd['password'] = password
-        if database is not None:
-            dsnd['dbname'] = database
-
-        dsn = " ".join(["%s='%s'" %(k,v) for (k,v) in dsnd.items()])
+        if conn is not None:
+            # Use an already established connection, such as one from a connection pool
+            self.conn = conn
+            return
+
+        dsn = BuildDSN(host=host, port=port, user=user, password=password, database=database)
         self.conn = not self.noaction and psycopg2.connect(dsn) or None
 
 
@@ -73,8 +83,9 @@ class Database(object):
         if type(sqlvars['records']) is not types.ListType:
             raise AttributeError,"The 'records' element is not a list of fields"
 
+        # Nothing to insert, the result is one value per record like below
         if len(sqlvars['records']) == 0:
-            return True
+            return []
 
         try:
             sqlvars['returning']
@@ -82,49 +93,41 @@ class Database(object):
             sqlvars['returning'] = None
 
         #
-        # Build SQL template
-        #
-        sqlstub = "INSERT INTO %s (%s) VALUES (%s)" % (
-            sqlvars['table'],
-            ",".join(sqlvars['fields']),
-            ",".join(["%%(%s)s" % f for f in sqlvars['fields']])
-            )
-
-        # Get a database cursor
-        curs = not self.noaction and self.conn.cursor() or None
-
-        #
-        # Loop through all records and insert them into the database
+        # Build one INSERT statement for all records, which is sent to the
+        # database in one round trip.  Statement level triggers are only fired once.
         #
-        results = []
-        for rec in sqlvars['records']:
+        values = {}
+        rows = []
+        for (r, rec) in enumerate(sqlvars['records']):
             if type(rec) is not types.ListType:
                 raise AttributeError, "The field values inside the 'records' list must be in a list"
 
-            # Create a dictionary, which will be used for the SQL operation
-            values = {}
+            # Each value gets its own parameter name: <field>_<record index>
             for i in range(0, len(sqlvars['fields'])):
-                values[sqlvars['fields'][i]] = rec[i]
+                values["%s_%i" % (sqlvars['fields'][i], r)] = rec[i]
+            rows.append("(%s)" % ",".join(["%%(%s_%i)s" % (f, r) for f in sqlvars['fields']]))
 
-            if self.debug:
-                print "SQL QUERY: ==> %s" % (sqlstub % values)
-
-            # Do the INSERT query
-            if not self.noaction:
-                curs.execute(sqlstub, values)
-
-            # If a return value for the INSERT is defined, catch that one
-            if not self.noaction and sqlvars['returning']:
-                # The psycopg2 do not handle INSERT INTO ... RETURNING column queries, so we can only use
-                # this on tables with oid and do the look up that way
-                vls = {"table": sqlvars['table'], 'colname': sqlvars['returning'], 'oid': str(curs.lastrowid)}
-                curs.execute("SELECT %(colname)s FROM %(table)s WHERE oid='%(oid)s'" % vls)
-                results.append(curs.fetchone()[0])
-            else:
-                results.append(True)
+        sql = "INSERT INTO %s (%s) VALUES %s%s" % (
+            sqlvars['table'],
+            ",".join(sqlvars['fields']),
+            ",".join(rows),
+            sqlvars['returning'] and " RETURNING %s" % sqlvars['returning'] or ""
+            )
 
-        if not self.noaction:
-            curs.close()
+        if self.debug:
+            print "SQL QUERY: ==> %s" % sql
+
+        if self.noaction:
+            return [True for rec in sqlvars['records']]
+
+        # Do the INSERT query
+        curs = self.conn.cursor()
+        curs.execute(sql, values)
+        if sqlvars['returning']:
+            results = [row[0] for row in curs.fetchall()]
+        else:
+            results = [True for rec in sqlvars['records']]
+        curs.close()
         return results
 
 
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   affinity.c
+ * @date   Mon Oct 19 01:26:48 2026
+ *
+ * @brief  Places the threads on CPUs and NUMA nodes
+ *
+ * The main thread pins itself to the housekeeping_cpus early, so all the helper
+ * threads started later (log writer, archiver, watchdog, ingest listener, ...)
+ * inherit it.  Each worker thread then moves itself to its own placement before
+ * it allocates anything, which is either a single CPU from worker_cpus or all
+ * CPUs of a NUMA node from worker_numa_nodes.  The placement is picked round
+ * robin by the worker slot, so a worker slot always runs on the same place.  With
+ * only housekeeping_cpus set, the worker threads move to all the other online CPUs.
+ *
+ * Linux allocates memory on the node of the thread touching it first.  As the
+ * worker threads create their memory arenas and XML dictionaries after being
+ * placed, their memory is local to their node.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <affinity.h>
+
+/**
+ * Placement of the threads
+ */
+struct _AffinityMap {
+	LogContext *log;           /**< Log context */
+	int housekeeping;          /**< Set if the housekeeping threads are pinned */
+	cpu_set_t hkcpus;          /**< CPUs of the housekeeping threads (config: housekeeping_cpus) */
+	unsigned int nplaces;      /**< Number of worker placements, 0 if the workers are not pinned */
+	cpu_set_t *places;         /**< CPUs of each worker placement */
+	int *labels;               /**< CPU or NUMA node number of each placement, used in the log.
+				    *   -1 for the CPUs outside housekeeping_cpus */
+	const char *kind;          /**< "CPU" or "NUMA node", used in the log */
+};
+
+
+/**
+ * Parses a list of CPU or node numbers, such as "0-3,8,10-11"
+ *
+ * @param log   Log context
+ * @param name  Name of the configuration setting, used in the log
+ * @param str   The list to parse
+ * @param set   Returns the numbers found
+ *
+ * @return Returns the number of entries found, or -1 on errors
+ */
+static int affinity_parse_list(LogContext *log, const char *name, const char *str, cpu_set_t *set)
+{
+	const char *p = str;
+	char *end = NULL;
+	long first, last, i;
+
+	CPU_ZERO(set);
+	while( *p ) {
+		while( (*p == ' ') || (*p == ',') ) {
+			p++;
+		}
+		if( !*p || (*p == '\n') ) {
+			break;
+		}
+		first = strtol(p, &end, 10);
+		if( end == p ) {
+			goto error;
+		}
+		last = first;
+		if( *end == '-' ) {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if( end == p ) {
+				goto error;
+			}
+		}
+		if( (first < 0) || (last < first) || (last >= CPU_SETSIZE) ) {
+			goto error;
+		}
+		for( i = first; i <= last; i++ ) {
+			CPU_SET(i, set);
+		}
+		p = end;
+	}
+	return CPU_COUNT(set);
+
+ error:
+	writelog(log, LOG_EMERG, "Invalid %s value '%s'", name, str);
+	return -1;
+}
+
+
+/**
+ * Reads a CPU list from sysfs
+ *
+ * @param log    Log context
+ * @param fname  File containing the CPU list
+ * @param set    Returns the CPUs found
+ *
+ * @return Returns the number of CPUs found, or -1 on errors
+ */
+static int affinity_read_cpulist(LogContext *log, const char *fname, cpu_set_t *set)
+{
+	FILE *fp = NULL;
+	char buf[4096];
+	int ret = -1;
+
+	fp = fopen(fname, "r");
+	if( !fp ) {
+		return -1;
+	}
+	memset(&buf, 0, sizeof(buf));
+	if( fgets(buf, sizeof(buf) - 1, fp) ) {
+		ret = affinity_parse_list(log, fname, buf, set);
+	}
+	fclose(fp);
+	return ret;
+}
+
+
+/**
+ * Reads the CPUs of a NUMA node from sysfs
+ *
+ * @param log   Log context
+ * @param node  NUMA node number
+ * @param set   Returns the CPUs of the node
+ *
+ * @return Returns the number of CPUs found, or -1 on errors
+ */
+static int affinity_node_cpus(LogContext *log, int node, cpu_set_t *set)
+{
+	char fname[256];
+	int ret;
+
+	snprintf(fname, 254, "%s/node%i/cpulist", AFFINITY_SYSFS_NODE, node);
+	if( (ret = affinity_read_cpulist(log, fname, set)) < 0 ) {
+		writelog(log, LOG_EMERG, "NUMA node %i is not available", node);
+	}
+	return ret;
+}
+
+
+/**
+ * Prepares a worker placement for each CPU or NUMA node in the list
+ *
+ * @param map    AffinityMap
+ * @param list   CPU or NUMA node numbers
+ * @param nodes  Set if the list contains NUMA nodes
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int affinity_prepare_places(AffinityMap *map, cpu_set_t *list, int nodes)
+{
+	cpu_set_t local;
+	int i;
+
+	map->places = malloc_nullsafe(map->log, CPU_COUNT(list) * sizeof(cpu_set_t));
+	map->labels = malloc_nullsafe(map->log, CPU_COUNT(list) * sizeof(int));
+	map->kind = (nodes ? "NUMA node" : "CPU");
+	for( i = 0; i < CPU_SETSIZE; i++ ) {
+		if( !CPU_ISSET(i, list) ) {
+			continue;
+		}
+		if( nodes ) {
+			if( affinity_node_cpus(map->log, i, &local) < 1 ) {
+				return -1;
+			}
+			// Leave the housekeeping CPUs to the housekeeping threads, if possible
+			if( map->housekeeping ) {
+				cpu_set_t rest;
+				unsigned int j;
+
+				CPU_ZERO(&rest);
+				for( j = 0; j < CPU_SETSIZE; j++ ) {
+					if( CPU_ISSET(j, &local) && !CPU_ISSET(j, &map->hkcpus) ) {
+						CPU_SET(j, &rest);
+					}
+				}
+				if( CPU_COUNT(&rest) > 0 ) {
+					memcpy(&local, &rest, sizeof(cpu_set_t));
+				}
+			}
+		} else {
+			CPU_ZERO(&local);
+			CPU_SET(i, &local);
+		}
+		memcpy(&map->places[map->nplaces], &local, sizeof(cpu_set_t));
+		map->labels[map->nplaces] = i;
+		map->nplaces++;
+	}
+	return 1;
+}
+
+
+/**
+ * Prepares one worker placement with all online CPUs except the housekeeping CPUs.  Used
+ * when housekeeping_cpus is set without worker_cpus or worker_numa_nodes, so the worker
+ * threads do not inherit the housekeeping CPUs.
+ *
+ * @param map  AffinityMap
+ *
+ * @return Returns 1 on success, 0 if no CPUs are left for the workers, otherwise -1
+ */
+static int affinity_prepare_rest(AffinityMap *map)
+{
+	cpu_set_t online;
+	unsigned int i;
+
+	if( affinity_read_cpulist(map->log, AFFINITY_SYSFS_ONLINE, &online) < 1 ) {
+		writelog(map->log, LOG_WARNING, "Could not read the online CPUs from %s",
+			 AFFINITY_SYSFS_ONLINE);
+		return -1;
+	}
+	for( i = 0; i < CPU_SETSIZE; i++ ) {
+		if( CPU_ISSET(i, &map->hkcpus) ) {
+			CPU_CLR(i, &online);
+		}
+	}
+	if( CPU_COUNT(&online) == 0 ) {
+		return 0;
+	}
+
+	map->places = malloc_nullsafe(map->log, sizeof(cpu_set_t));
+	map->labels = malloc_nullsafe(map->log, sizeof(int));
+	memcpy(&map->places[0], &online, sizeof(cpu_set_t));
+	map->labels[0] = -1;
+	map->kind = "CPUs outside housekeeping_cpus";
+	map->nplaces = 1;
+	return 1;
+}
+
+
+/**
+ * Prepares the thread placement from the configuration
+ *
+ * @param log  Log context
+ * @param cfg  Configuration
+ *
+ * @return Returns an AffinityMap on success, otherwise NULL
+ */
+AffinityMap *affinity_init(LogContext *log, eurephiaVALUES *cfg)
+{
+	AffinityMap *map = NULL;
+	const char *hkcpus = NULL, *cpus = NULL, *nodes = NULL;
+	cpu_set_t list;
+
+	map = malloc_nullsafe(log, sizeof(AffinityMap));
+	map->log = log;
+
+	hkcpus = eGet_value(cfg, "housekeeping_cpus");
+	if( hkcpus && *hkcpus ) {
+		if( affinity_parse_list(log, "housekeeping_cpus", hkcpus, &map->hkcpus) < 1 ) {
+			goto error;
+		}
+		map->housekeeping = 1;
+	}
+
+	cpus = eGet_value(cfg, "worker_cpus");
+	nodes = eGet_value(cfg, "worker_numa_nodes");
+	if( cpus && *cpus ) {
+		if( nodes && *nodes ) {
+			writelog(log, LOG_WARNING, "Both worker_cpus and worker_numa_nodes are set, "
+				 "worker_numa_nodes is ignored");
+		}
+		if( (affinity_parse_list(log, "worker_cpus", cpus, &list) < 1)
+		    || (affinity_prepare_places(map, &list, 0) < 0) ) {
+			goto error;
+		}
+	} else if( nodes && *nodes ) {
+		if( (affinity_parse_list(log, "worker_numa_nodes", nodes, &list) < 1)
+		    || (affinity_prepare_places(map, &list, 1) < 0) ) {
+			goto error;
+		}
+	}
+
+	if( map->nplaces > 0 ) {
+		writelog(log, LOG_INFO, "Worker threads are spread over %i %ss",
+			 map->nplaces, map->kind);
+	} else if( map->housekeeping ) {
+		// The workers must not inherit the housekeeping CPUs from the main thread
+		if( affinity_prepare_rest(map) > 0 ) {
+			writelog(log, LOG_INFO, "Worker threads run on the %i %s",
+				 CPU_COUNT(&map->places[0]), map->kind);
+		} else {
+			writelog(log, LOG_WARNING, "No CPUs are left outside housekeeping_cpus, "
+				 "the worker threads share them with the housekeeping threads");
+		}
+	}
+	return map;
+
+ error:
+	affinity_free(map);
+	return NULL;
+}
+
+
+/**
+ * Pins the calling thread to the housekeeping CPUs.  Threads started by the calling
+ * thread afterwards inherit this.
+ *
+ * @param map  AffinityMap
+ *
+ * @return Returns 1 on success or if housekeeping_cpus is not set, otherwise -1
+ */
+int affinity_pin_housekeeping(AffinityMap *map)
+{
+	int rc;
+
+	if( !map || !map->housekeeping ) {
+		return 1;
+	}
+	if( (rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &map->hkcpus)) != 0 ) {
+		writelog(map->log, LOG_WARNING, "Could not move to the housekeeping CPUs: %s",
+			 strerror(rc));
+		return -1;
+	}
+	return 1;
+}
+
+
+/**
+ * Moves the calling worker thread to its placement.  Must be called before the worker
+ * allocates its memory, so the memory is local to its NUMA node.
+ *
+ * @param map  AffinityMap
+ * @param id   Worker slot of the thread
+ *
+ * @return Returns 1 on success or if the workers are not pinned, otherwise -1
+ */
+int affinity_pin_worker(AffinityMap *map, unsigned int id)
+{
+	unsigned int place;
+	int rc;
+
+	if( !map || (map->nplaces == 0) ) {
+		return 1;
+	}
+	place = id % map->nplaces;
+	if( (rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &map->places[place])) != 0 ) {
+		writelog(map->log, LOG_WARNING, "[Thread %i] Could not move to the worker CPUs: %s",
+			 id, strerror(rc));
+		return -1;
+	}
+	if( map->labels[place] < 0 ) {
+		writelog(map->log, LOG_DEBUG, "[Thread %i] Running on the %s", id, map->kind);
+	} else {
+		writelog(map->log, LOG_DEBUG, "[Thread %i] Running on %s %i",
+			 id, map->kind, map->labels[place]);
+	}
+	return 1;
+}
+
+
+/**
+ * Releases the thread placement
+ *
+ * @param map  AffinityMap
+ */
+void affinity_free(AffinityMap *map)
+{
+	if( !map ) {
+		return;
+	}
+	free_nullsafe(map->places);
+	free_nullsafe(map->labels);
+	free_nullsafe(map);
+}
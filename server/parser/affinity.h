@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   affinity.h
+ * @date   Mon Oct 19 01:26:48 2026
+ *
+ * @brief  Places the threads on CPUs and NUMA nodes
+ *
+ */
+
+#ifndef _RTEVAL_AFFINITY_H
+#define _RTEVAL_AFFINITY_H
+
+#include <eurephia_values.h>
+#include <log.h>
+
+#define AFFINITY_SYSFS_NODE "/sys/devices/system/node"  /**< Where the NUMA node CPU lists are found */
+#define AFFINITY_SYSFS_ONLINE "/sys/devices/system/cpu/online"  /**< List of the online CPUs */
+
+typedef struct _AffinityMap AffinityMap;
+
+AffinityMap *affinity_init(LogContext *log, eurephiaVALUES *cfg);
+int affinity_pin_housekeeping(AffinityMap *map);
+int affinity_pin_worker(AffinityMap *map, unsigned int id);
+void affinity_free(AffinityMap *map);
+
+#endif
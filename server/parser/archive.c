@@ -0,0 +1,1097 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   archive.c
+ * @date   Sun Oct 18 17:05:12 2026
+ *
+ * @brief  Moves processed reports into the report directory, outside the worker threads
+ *
+ * The worker threads only decide where a report will be archived, and write a small
+ * handoff record into the ARCHIVE_PENDING_DIR directory before the database
+ * transaction is committed.  When the transaction is committed, the report is handed
+ * over to the archiver thread, which moves (or compresses) the report into the report
+ * directory and removes the handoff record.  Failed jobs are retried by the archiver
+ * thread, up to ARCHIVE_MAX_ATTEMPTS times.  The archiver queue is bounded, so the
+ * worker threads slow down if the archiver thread falls behind.  If the daemon stops before this is done, the remaining handoff records are
+ * processed by archive_replay() on the next start.
+ *
+ * All file operations are done relative to a directory descriptor of the report
+ * directory, and directories known to exist are cached.  Reports are spread out in
+ * up to ARCHIVE_MAX_FANOUT sub directories, based on a hash of the client ID, to
+ * avoid single directories holding a huge amount of files.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <bzlib.h>
+
+#include <eurephia_nullsafe.h>
+#include <log.h>
+#include <pgsql.h>
+#include <probes.h>
+#include <archive.h>
+
+#define DIRCACHE_BUCKETS 1024   /**< Number of hash buckets in the directory cache */
+#define DIRCACHE_MAX     65536  /**< The directory cache is flushed when growing beyond this */
+#define ARCHIVE_BUFSIZE  65536  /**< Buffer size used when compressing reports */
+#define ARCHIVE_RETRY_DELAY 10  /**< Seconds before a failed job is retried the first time */
+#define ARCHIVE_RETRY_MAX  600  /**< Maximum number of seconds between retries of a failed job */
+#define ARCHIVE_MAX_ATTEMPTS 20 /**< Failed attempts before a job is parked, see archive_park() */
+#define ARCHIVE_QUEUE_MAX  256  /**< Jobs in the archiver queue before archive_submit() waits */
+
+/**
+ * A directory known to exist in the report directory
+ */
+typedef struct _DirCacheEntry {
+	struct _DirCacheEntry *next;  /**< Next entry in the same hash bucket */
+	char name[1];                 /**< Directory name, relative to the report directory */
+} DirCacheEntry;
+
+/**
+ * The report archive.  The directory cache is only used by the archiver thread.
+ */
+struct _ReportArchive {
+	LogContext *log;           /**< Log context */
+	char *reportdir;           /**< Report directory, as given in the configuration */
+	int rootfd;                /**< Directory descriptor of the report directory */
+	int pendfd;                /**< Directory descriptor of the handoff record directory */
+	unsigned int fanout;       /**< Number of hashed sub directories, 0 disables it */
+	int compress;              /**< Compress uncompressed reports with bzip2 */
+	DirCacheEntry *dircache[DIRCACHE_BUCKETS]; /**< Directories known to exist */
+	unsigned int dircache_cnt; /**< Number of entries in the directory cache */
+	ArchiveJob *head;          /**< First job in the archiver queue */
+	ArchiveJob *tail;          /**< Last job in the archiver queue */
+	unsigned int queued;       /**< Number of jobs from head to tail */
+	ArchiveJob *retry;         /**< Failed jobs, waiting to be retried */
+	pthread_mutex_t mtx;       /**< Protects the queue and the shutdown flag */
+	pthread_cond_t cond;       /**< Signals new jobs and shut down */
+	pthread_cond_t cond_space; /**< Signals room in the archiver queue */
+	int shutdown;              /**< Set when the archiver thread should stop */
+	int running;               /**< Set when the archiver thread is started */
+	pthread_t thread;          /**< The archiver thread */
+};
+
+
+/**
+ * FNV-1a hash of a string
+ *
+ * @param str  Input string
+ * @param len  Number of characters to hash
+ *
+ * @return Returns the hash value
+ */
+static unsigned int archive_hash(const char *str, size_t len)
+{
+	unsigned int h = 2166136261U;
+	size_t i;
+
+	for( i = 0; i < len; i++ ) {
+		h ^= (unsigned char) str[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+
+/**
+ * Frees an archive job
+ *
+ * @param job  ArchiveJob to free
+ */
+static void archive_freejob(ArchiveJob *job)
+{
+	if( !job ) {
+		return;
+	}
+	free_nullsafe(job->srcfname);
+	free_nullsafe(job->destfname);
+	free(job);
+}
+
+
+/**
+ * Writes a complete buffer to a file descriptor
+ *
+ * @param fd   File descriptor
+ * @param buf  Data to write
+ * @param len  Number of bytes to write
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while( len > 0 ) {
+		ssize_t w = write(fd, buf, len);
+
+		if( w < 0 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+			return -1;
+		}
+		buf += w;
+		len -= w;
+	}
+	return 1;
+}
+
+
+/**
+ * Looks up a directory in the directory cache
+ *
+ * @param arch  ReportArchive
+ * @param name  Directory name, relative to the report directory
+ * @param len   Length of the directory name
+ *
+ * @return Returns 1 if the directory was found in the cache, otherwise 0
+ */
+static int dircache_check(ReportArchive *arch, const char *name, size_t len)
+{
+	DirCacheEntry *e = NULL;
+	unsigned int h = archive_hash(name, len) % DIRCACHE_BUCKETS;
+
+	for( e = arch->dircache[h]; e; e = e->next ) {
+		if( (strncmp(e->name, name, len) == 0) && (e->name[len] == '\0') ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Empties the directory cache
+ *
+ * @param arch  ReportArchive
+ */
+static void dircache_flush(ReportArchive *arch)
+{
+	DirCacheEntry *e = NULL;
+	unsigned int i;
+
+	for( i = 0; i < DIRCACHE_BUCKETS; i++ ) {
+		while( arch->dircache[i] ) {
+			e = arch->dircache[i];
+			arch->dircache[i] = e->next;
+			free(e);
+		}
+	}
+	arch->dircache_cnt = 0;
+}
+
+
+/**
+ * Removes the directories of an archived report from the directory cache, when they
+ * turned out to be gone, such as when the report directory was rotated.
+ *
+ * @param arch     ReportArchive
+ * @param relname  Report file name, relative to the report directory
+ */
+static void dircache_drop(ReportArchive *arch, const char *relname)
+{
+	DirCacheEntry **pp = NULL, *e = NULL;
+	const char *ptr = relname;
+
+	while( (ptr = strchr(ptr, '/')) != NULL ) {
+		size_t len = ptr - relname;
+
+		ptr++;
+		pp = &arch->dircache[archive_hash(relname, len) % DIRCACHE_BUCKETS];
+		while( (e = *pp) != NULL ) {
+			if( (strncmp(e->name, relname, len) == 0) && (e->name[len] == '\0') ) {
+				*pp = e->next;
+				free(e);
+				arch->dircache_cnt--;
+			} else {
+				pp = &e->next;
+			}
+		}
+	}
+}
+
+
+/**
+ * Adds a directory to the directory cache
+ *
+ * @param arch  ReportArchive
+ * @param name  Directory name, relative to the report directory
+ * @param len   Length of the directory name
+ */
+static void dircache_add(ReportArchive *arch, const char *name, size_t len)
+{
+	DirCacheEntry *e = NULL;
+	unsigned int h;
+
+	if( arch->dircache_cnt >= DIRCACHE_MAX ) {
+		dircache_flush(arch);
+	}
+
+	h = archive_hash(name, len) % DIRCACHE_BUCKETS;
+
+	e = malloc_nullsafe(arch->log, sizeof(DirCacheEntry) + len);
+	memcpy(e->name, name, len);
+	e->name[len] = '\0';
+	e->next = arch->dircache[h];
+	arch->dircache[h] = e;
+	arch->dircache_cnt++;
+}
+
+
+/**
+ * Makes sure the directory of an archived report exists, similar to 'mkdir -p'
+ *
+ * @param arch     ReportArchive
+ * @param relname  Report file name, relative to the report directory
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int archive_mkdir(ReportArchive *arch, const char *relname)
+{
+	const char *end = strrchr(relname, '/');
+	const char *ptr = NULL;
+	char *path = NULL;
+	int ret = -1;
+
+	if( !end || dircache_check(arch, relname, end - relname) ) {
+		return 1;
+	}
+
+	// Create each missing path element, relative to the report directory
+	path = strdup(relname);
+	if( !path ) {
+		writelog(arch->log, LOG_ALERT, "Could not allocate memory for a directory name");
+		return -1;
+	}
+	ptr = relname;
+	while( (ptr = strchr(ptr, '/')) != NULL ) {
+		size_t len = ptr - relname;
+
+		ptr++;
+		if( (len == 0) || dircache_check(arch, relname, len) ) {
+			continue;
+		}
+		path[len] = '\0';
+		if( (mkdirat(arch->rootfd, path, 0755) < 0) && (errno != EEXIST) ) {
+			writelog(arch->log, LOG_ALERT,
+				 "Could not create directory: %s/%s (%s)",
+				 arch->reportdir, path, strerror(errno));
+			goto exit;
+		}
+		path[len] = '/';
+		dircache_add(arch, relname, len);
+	}
+	ret = 1;
+ exit:
+	free_nullsafe(path);
+	return ret;
+}
+
+
+/**
+ * Flushes the directory of an archived report to disk, making the directory entry
+ * of the report durable
+ *
+ * @param arch     ReportArchive
+ * @param relname  Report file name, relative to the report directory
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int archive_syncdir(ReportArchive *arch, const char *relname)
+{
+	const char *end = strrchr(relname, '/');
+	char *path = NULL;
+	int fd, err = 0;
+
+	if( end ) {
+		path = strdup(relname);
+		if( !path ) {
+			writelog(arch->log, LOG_ALERT, "Could not allocate memory for a directory name");
+			return -1;
+		}
+		path[end - relname] = '\0';
+		fd = openat(arch->rootfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	} else {
+		fd = dup(arch->rootfd);
+	}
+	if( (fd < 0) || (fsync(fd) < 0) ) {
+		err = errno;
+		writelog(arch->log, LOG_ALERT, "Could not flush directory %s/%s (%s)",
+			 arch->reportdir, (path ? path : ""), strerror(err));
+	}
+	if( fd >= 0 ) {
+		close(fd);
+	}
+	free_nullsafe(path);
+	errno = err;
+	return (err ? -1 : 1);
+}
+
+
+/**
+ * Compresses a report into the report directory with bzip2.  The compressed report
+ * is written to a temporary file first, which is renamed when completed.  The source
+ * file is removed when the renamed report is flushed to disk.
+ *
+ * @param arch  ReportArchive
+ * @param job   ArchiveJob of the report
+ *
+ * @return Returns 1 on success, otherwise -1.  If the source file is gone, errno is ENOENT.
+ */
+static int archive_bzip2(ReportArchive *arch, ArchiveJob *job)
+{
+	char inbuf[ARCHIVE_BUFSIZE], outbuf[ARCHIVE_BUFSIZE];
+	char *tmpname = NULL;
+	bz_stream bz;
+	int infd = -1, outfd = -1, bzinit = 0, ret = -1, bzrc, err = 0;
+	ssize_t len;
+
+	infd = open(job->srcfname, O_RDONLY | O_CLOEXEC);
+	if( infd < 0 ) {
+		return -1;
+	}
+
+	tmpname = malloc_nullsafe(arch->log, strlen(job->relname) + 6);
+	sprintf(tmpname, "%s.tmp", job->relname);
+	outfd = openat(arch->rootfd, tmpname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if( outfd < 0 ) {
+		err = errno;
+		writelog(arch->log, LOG_ALERT, "Could not create %s/%s (%s)",
+			 arch->reportdir, tmpname, strerror(err));
+		goto exit;
+	}
+
+	memset(&bz, 0, sizeof(bz_stream));
+	if( BZ2_bzCompressInit(&bz, 9, 0, 0) != BZ_OK ) {
+		writelog(arch->log, LOG_ALERT, "Could not initialise the bzip2 compressor");
+		goto exit;
+	}
+	bzinit = 1;
+
+	// Compress the report, one buffer at the time, until the end of the file is reached
+	for( ;; ) {
+		len = read(infd, inbuf, sizeof(inbuf));
+		if( len < 0 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+			err = errno;
+			writelog(arch->log, LOG_ALERT, "Could not read %s (%s)",
+				 job->srcfname, strerror(err));
+			goto exit;
+		}
+		bz.next_in = inbuf;
+		bz.avail_in = len;
+		do {
+			bz.next_out = outbuf;
+			bz.avail_out = sizeof(outbuf);
+			bzrc = BZ2_bzCompress(&bz, (len > 0 ? BZ_RUN : BZ_FINISH));
+			if( (bzrc != BZ_RUN_OK) && (bzrc != BZ_FINISH_OK) && (bzrc != BZ_STREAM_END) ) {
+				writelog(arch->log, LOG_ALERT,
+					 "Failed to compress %s (bzip2 error %i)",
+					 job->srcfname, bzrc);
+				goto exit;
+			}
+			if( write_all(outfd, outbuf, sizeof(outbuf) - bz.avail_out) < 0 ) {
+				err = errno;
+				writelog(arch->log, LOG_ALERT, "Could not write %s/%s (%s)",
+					 arch->reportdir, tmpname, strerror(err));
+				goto exit;
+			}
+		} while( (len > 0) ? (bz.avail_in > 0) : (bzrc != BZ_STREAM_END) );
+		if( len == 0 ) {
+			break;
+		}
+	}
+
+	if( (fsync(outfd) < 0) || (close(outfd) < 0) ) {
+		err = errno;
+		outfd = -1;
+		writelog(arch->log, LOG_ALERT, "Could not write %s/%s (%s)",
+			 arch->reportdir, tmpname, strerror(err));
+		goto exit;
+	}
+	outfd = -1;
+
+	if( renameat(arch->rootfd, tmpname, arch->rootfd, job->relname) < 0 ) {
+		err = errno;
+		writelog(arch->log, LOG_ALERT, "Could not rename %s/%s to %s (%s)",
+			 arch->reportdir, tmpname, job->destfname, strerror(err));
+		goto exit;
+	}
+	// The source may only go away when the compressed report is durable
+	if( archive_syncdir(arch, job->relname) < 0 ) {
+		err = errno;
+		goto exit;
+	}
+	if( (unlink(job->srcfname) < 0) && (errno != ENOENT) ) {
+		writelog(arch->log, LOG_WARNING, "Could not remove %s (%s)",
+			 job->srcfname, strerror(errno));
+	}
+	ret = 1;
+
+ exit:
+	if( bzinit ) {
+		BZ2_bzCompressEnd(&bz);
+	}
+	if( outfd >= 0 ) {
+		close(outfd);
+	}
+	if( ret < 0 ) {
+		unlinkat(arch->rootfd, tmpname, 0);
+	}
+	close(infd);
+	free_nullsafe(tmpname);
+	errno = err;
+	return ret;
+}
+
+
+/**
+ * Archives a report and removes its handoff record.  If archiving fails, the handoff
+ * record is kept, and the job is retried by the archiver thread later on.
+ *
+ * @param arch  ReportArchive
+ * @param job   ArchiveJob of the report
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int archive_process(ReportArchive *arch, ArchiveJob *job)
+{
+	char recname[32];
+	int rc = -1, tries;
+
+	PROBE3(report__rename, job->submid, job->srcfname, job->destfname);
+	for( tries = 0; tries < 2; tries++ ) {
+		if( archive_mkdir(arch, job->relname) < 0 ) {
+			return -1;
+		}
+
+		errno = 0;
+		if( job->compress ) {
+			rc = archive_bzip2(arch, job);
+		} else {
+			rc = renameat(AT_FDCWD, job->srcfname, arch->rootfd, job->relname);
+		}
+
+		// If the source is still there, the cached directory was removed behind our back
+		if( (rc < 0) && (errno == ENOENT) && (access(job->srcfname, F_OK) == 0) ) {
+			writelog(arch->log, LOG_WARNING, "(submid: %i) The directory of %s is gone, "
+				 "creating it again", job->submid, job->destfname);
+			dircache_drop(arch, job->relname);
+			errno = ENOENT;
+			continue;
+		}
+		break;
+	}
+
+	if( (rc < 0) && (errno == ENOENT)
+	    && (faccessat(arch->rootfd, job->relname, F_OK, 0) == 0) ) {
+		// Already archived, the handoff record was not removed
+		rc = 0;
+	}
+	if( rc < 0 ) {
+		writelog(arch->log, LOG_ALERT,
+			 "(submid: %i) Failed to move report file from %s to %s (%s)",
+			 job->submid, job->srcfname, job->destfname, strerror(errno));
+		return -1;
+	}
+
+	// archive_bzip2() flushes the directory itself, before removing the source file
+	if( ((rc == 0) || !job->compress) && (archive_syncdir(arch, job->relname) < 0) ) {
+		return -1;
+	}
+
+	snprintf(recname, sizeof(recname), "%u.rec", job->submid);
+	if( unlinkat(arch->pendfd, recname, 0) < 0 ) {
+		writelog(arch->log, LOG_WARNING,
+			 "Could not remove the archive handoff record %s/%s/%s (%s)",
+			 arch->reportdir, ARCHIVE_PENDING_DIR, recname, strerror(errno));
+	}
+	writelog(arch->log, LOG_DEBUG, "(submid: %i) Report archived as %s",
+		 job->submid, job->destfname);
+	return 1;
+}
+
+
+/**
+ * Gives up a job which failed ARCHIVE_MAX_ATTEMPTS times.  The handoff record is
+ * renamed to <submid>.failed, so it is neither retried nor replayed on the next start,
+ * and the report is left where it is for the administrator.
+ *
+ * @param arch  ReportArchive
+ * @param job   ArchiveJob, which is freed
+ */
+static void archive_park(ReportArchive *arch, ArchiveJob *job)
+{
+	char recname[32], failname[32];
+
+	snprintf(recname, sizeof(recname), "%u.rec", job->submid);
+	snprintf(failname, sizeof(failname), "%u.failed", job->submid);
+	if( renameat(arch->pendfd, recname, arch->pendfd, failname) < 0 ) {
+		writelog(arch->log, LOG_WARNING, "Could not rename %s/%s/%s (%s)",
+			 arch->reportdir, ARCHIVE_PENDING_DIR, recname, strerror(errno));
+	}
+	writelog(arch->log, LOG_CRIT,
+		 "(submid: %i) Giving up archiving %s to %s after %u attempts, see %s/%s/%s",
+		 job->submid, job->srcfname, job->destfname, job->attempts,
+		 arch->reportdir, ARCHIVE_PENDING_DIR, failname);
+	archive_freejob(job);
+}
+
+
+/**
+ * Moves the failed jobs which are due for a new attempt back to the archiver queue.
+ * Must be called with the archiver mutex held.
+ *
+ * @param arch  ReportArchive
+ * @param now   Current time
+ *
+ * @return Returns the time of the next pending retry, or 0 if no failed jobs are left
+ */
+static time_t archive_requeue(ReportArchive *arch, time_t now)
+{
+	ArchiveJob **prev = &arch->retry, *job = NULL;
+	time_t next = 0;
+
+	while( (job = *prev) != NULL ) {
+		if( job->retry_at > now ) {
+			if( (next == 0) || (job->retry_at < next) ) {
+				next = job->retry_at;
+			}
+			prev = &job->next;
+			continue;
+		}
+		*prev = job->next;
+		job->next = NULL;
+		if( arch->tail ) {
+			arch->tail->next = job;
+		} else {
+			arch->head = job;
+		}
+		arch->tail = job;
+		arch->queued++;
+	}
+	return next;
+}
+
+
+/**
+ * The archiver thread.  Processes the archiver queue until archive_shutdown() is called
+ * and the queue is empty.  Failed jobs are retried with an increasing delay, and jobs
+ * still failing on shut down are retried on the next start.
+ *
+ * @param data  ReportArchive
+ *
+ * @return Returns NULL
+ */
+static void *archive_thread(void *data)
+{
+	ReportArchive *arch = (ReportArchive *) data;
+	ArchiveJob *job = NULL;
+	struct timespec ts;
+	time_t next;
+	unsigned int delay;
+
+	pthread_mutex_lock(&arch->mtx);
+	for( ;; ) {
+		next = archive_requeue(arch, time(NULL));
+		if( !arch->head ) {
+			if( arch->shutdown ) {
+				break;
+			}
+			if( next > 0 ) {
+				ts.tv_sec = next;
+				ts.tv_nsec = 0;
+				pthread_cond_timedwait(&arch->cond, &arch->mtx, &ts);
+			} else {
+				pthread_cond_wait(&arch->cond, &arch->mtx);
+			}
+			continue;
+		}
+		job = arch->head;
+		arch->head = job->next;
+		if( !arch->head ) {
+			arch->tail = NULL;
+		}
+		arch->queued--;
+		pthread_cond_broadcast(&arch->cond_space);
+		pthread_mutex_unlock(&arch->mtx);
+
+		if( archive_process(arch, job) < 0 ) {
+			job->attempts++;
+			if( job->attempts >= ARCHIVE_MAX_ATTEMPTS ) {
+				archive_park(arch, job);
+				pthread_mutex_lock(&arch->mtx);
+				continue;
+			}
+			delay = ARCHIVE_RETRY_DELAY << (job->attempts < 6 ? job->attempts - 1 : 5);
+			if( delay > ARCHIVE_RETRY_MAX ) {
+				delay = ARCHIVE_RETRY_MAX;
+			}
+			job->retry_at = time(NULL) + delay;
+			writelog(arch->log, LOG_WARNING,
+				 "(submid: %i) Archiving the report is retried in %u seconds",
+				 job->submid, delay);
+			pthread_mutex_lock(&arch->mtx);
+			job->next = arch->retry;
+			arch->retry = job;
+		} else {
+			archive_freejob(job);
+			pthread_mutex_lock(&arch->mtx);
+		}
+	}
+	pthread_mutex_unlock(&arch->mtx);
+	return NULL;
+}
+
+
+/**
+ * Prepares the report archive.  The report directory is created if missing.
+ *
+ * @param log        Log context
+ * @param reportdir  The report directory (config: reportdir)
+ * @param fanout     Number of hashed sub directories to use, 0 disables it (config: archive_fanout)
+ * @param compress   If set, uncompressed reports are compressed with bzip2 (config: archive_compress)
+ *
+ * @return Returns a pointer to a ReportArchive on success, otherwise NULL
+ */
+ReportArchive *archive_init(LogContext *log, const char *reportdir, unsigned int fanout, int compress)
+{
+	ReportArchive *arch = NULL;
+
+	if( !reportdir ) {
+		writelog(log, LOG_EMERG, "No report directory is configured");
+		return NULL;
+	}
+	if( fanout > ARCHIVE_MAX_FANOUT ) {
+		writelog(log, LOG_WARNING, "archive_fanout is limited to %i", ARCHIVE_MAX_FANOUT);
+		fanout = ARCHIVE_MAX_FANOUT;
+	}
+
+	arch = malloc_nullsafe(log, sizeof(ReportArchive));
+	arch->log = log;
+	arch->reportdir = strdup(reportdir);
+	arch->fanout = fanout;
+	arch->compress = compress;
+	arch->rootfd = -1;
+	arch->pendfd = -1;
+	pthread_mutex_init(&arch->mtx, NULL);
+	pthread_cond_init(&arch->cond, NULL);
+	pthread_cond_init(&arch->cond_space, NULL);
+
+	if( (mkdir(reportdir, 0755) < 0) && (errno != EEXIST) ) {
+		writelog(log, LOG_EMERG, "Could not create directory: %s (%s)",
+			 reportdir, strerror(errno));
+		goto error;
+	}
+	arch->rootfd = open(reportdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if( arch->rootfd < 0 ) {
+		writelog(log, LOG_EMERG, "Could not open directory: %s (%s)",
+			 reportdir, strerror(errno));
+		goto error;
+	}
+
+	if( (mkdirat(arch->rootfd, ARCHIVE_PENDING_DIR, 0700) < 0) && (errno != EEXIST) ) {
+		writelog(log, LOG_EMERG, "Could not create directory: %s/%s (%s)",
+			 reportdir, ARCHIVE_PENDING_DIR, strerror(errno));
+		goto error;
+	}
+	arch->pendfd = openat(arch->rootfd, ARCHIVE_PENDING_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if( arch->pendfd < 0 ) {
+		writelog(log, LOG_EMERG, "Could not open directory: %s/%s (%s)",
+			 reportdir, ARCHIVE_PENDING_DIR, strerror(errno));
+		goto error;
+	}
+	return arch;
+
+ error:
+	archive_shutdown(arch);
+	return NULL;
+}
+
+
+/**
+ * Starts the archiver thread
+ *
+ * @param arch  ReportArchive
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+int archive_start(ReportArchive *arch)
+{
+	int rc;
+
+	if( (rc = pthread_create(&arch->thread, NULL, archive_thread, arch)) != 0 ) {
+		writelog(arch->log, LOG_EMERG, "Could not start the archiver thread: %s",
+			 strerror(rc));
+		return -1;
+	}
+	arch->running = 1;
+	return 1;
+}
+
+
+/**
+ * Builds an archive job from the contents of a handoff record
+ *
+ * @param arch    ReportArchive
+ * @param buf     Contents of the record, will be modified
+ *
+ * @return Returns an ArchiveJob on success, NULL if the record is incomplete
+ */
+static ArchiveJob *archive_parse_record(ReportArchive *arch, char *buf)
+{
+	char *fields[4], *ptr = buf;
+	ArchiveJob *job = NULL;
+	size_t dirlen = strlen(arch->reportdir);
+	int i;
+
+	// submid, source file, destination relative to the report directory, mode
+	for( i = 0; i < 4; i++ ) {
+		char *eol = strchr(ptr, '\n');
+
+		if( !eol ) {
+			return NULL;
+		}
+		*eol = '\0';
+		fields[i] = ptr;
+		ptr = eol + 1;
+	}
+
+	job = malloc_nullsafe(arch->log, sizeof(ArchiveJob));
+	job->submid = atoi_nullsafe(fields[0]);
+	job->srcfname = strdup(fields[1]);
+	job->destfname = malloc_nullsafe(arch->log, dirlen + strlen(fields[2]) + 2);
+	sprintf(job->destfname, "%s/%s", arch->reportdir, fields[2]);
+	job->relname = job->destfname + dirlen + 1;
+	job->compress = (strcmp(fields[3], "bzip2") == 0);
+	return job;
+}
+
+
+/**
+ * Processes handoff records left behind by a previous run.  Reports registered in the
+ * database are queued for archiving.  Records of reports which were never committed
+ * to the database are removed.  Must be called after archive_start().
+ *
+ * @param arch    ReportArchive
+ * @param shards  Shard databases where the reports may be registered
+ * @param dbc     Database connection to the main database
+ *
+ * @return Returns the number of reports queued for archiving on success, otherwise -1
+ */
+int archive_replay(ReportArchive *arch, ShardMap *shards, dbconn *dbc)
+{
+	DIR *dir = NULL;
+	struct dirent *de = NULL;
+	int fd, queued = 0, ret = -1;
+
+	fd = dup(arch->pendfd);
+	if( (fd < 0) || ((dir = fdopendir(fd)) == NULL) ) {
+		writelog(arch->log, LOG_EMERG, "Could not read directory %s/%s (%s)",
+			 arch->reportdir, ARCHIVE_PENDING_DIR, strerror(errno));
+		if( fd >= 0 ) {
+			close(fd);
+		}
+		return -1;
+	}
+	rewinddir(dir);
+
+	while( (de = readdir(dir)) != NULL ) {
+		char buf[8192];
+		ArchiveJob *job = NULL;
+		unsigned int submid = 0;
+		int recfd, exists, end = 0;
+		ssize_t len;
+
+		// Only <submid>.rec, parked <submid>.failed records are left alone
+		if( (sscanf(de->d_name, "%u.rec%n", &submid, &end) != 1) || (end == 0)
+		    || (de->d_name[end] != '\0') || (submid < 1) ) {
+			continue;
+		}
+
+		memset(&buf, 0, sizeof(buf));
+		recfd = openat(arch->pendfd, de->d_name, O_RDONLY | O_CLOEXEC);
+		if( recfd < 0 ) {
+			continue;
+		}
+		len = read(recfd, buf, sizeof(buf) - 1);
+		close(recfd);
+
+		job = (len > 0 ? archive_parse_record(arch, buf) : NULL);
+		exists = ((job && (job->submid == submid)) ? shard_report_registered(shards, dbc, submid) : 0);
+		if( exists < 0 ) {
+			archive_freejob(job);
+			goto exit;
+		} else if( exists == 0 ) {
+			// The transaction was never committed, the report remains in the queue
+			writelog(arch->log, LOG_INFO,
+				 "Removing stale archive handoff record for submid %u", submid);
+			unlinkat(arch->pendfd, de->d_name, 0);
+			archive_freejob(job);
+			continue;
+		}
+		archive_submit(arch, job);
+		queued++;
+	}
+	if( queued > 0 ) {
+		writelog(arch->log, LOG_INFO, "Archiving %i report%s left from the previous run",
+			 queued, (queued == 1 ? "" : "s"));
+	}
+	ret = queued;
+ exit:
+	closedir(dir);
+	return ret;
+}
+
+
+/**
+ * Makes a client ID usable as a single directory name inside the report directory.
+ * Path separators and control characters are replaced, and so is a leading dot, which
+ * also covers "." and "..", and keeps clients out of ARCHIVE_PENDING_DIR.
+ *
+ * @param clientid  Client ID, as registered in the submission queue
+ *
+ * @return Returns a new string which must be freed with free(), or NULL on errors
+ */
+static char *archive_clientdir(const char *clientid)
+{
+	char *dir = NULL, *p = NULL;
+
+	dir = strdup(clientid);
+	if( !dir ) {
+		return NULL;
+	}
+	for( p = dir; *p; p++ ) {
+		if( (*p == '/') || (*p == '\\') ) {
+			*p = ':';
+		} else if( iscntrl((unsigned char) *p) ) {
+			*p = '_';
+		}
+	}
+	if( (dir[0] == '.') || (dir[0] == '\0') ) {
+		p = malloc(strlen(dir) + 2);
+		if( p ) {
+			p[0] = '_';
+			strcpy(p + 1, (dir[0] == '.' ? dir + 1 : dir));
+		}
+		free(dir);
+		dir = p;
+	}
+	return dir;
+}
+
+
+/**
+ * Decides where a report will be archived, and writes a durable handoff record for it.
+ * Must be called before the database transaction registering the report is committed.
+ *
+ * @param arch      ReportArchive
+ * @param submid    Submission ID
+ * @param clientid  Client ID of the submitter
+ * @param rterid    rteval run ID assigned to the report
+ * @param snapseq   Sequence number of a snapshot report, 0 for complete reports
+ * @param srcfname  Report file in the submission queue
+ * @param suffix    File name suffix of compressed reports, such as ".bz2".  May be NULL.
+ *
+ * @return Returns an ArchiveJob on success, otherwise NULL.  The destfname member contains
+ *         the file name to register in the database.
+ */
+ArchiveJob *archive_prepare(ReportArchive *arch, unsigned int submid, const char *clientid,
+			    int rterid, unsigned int snapseq, const char *srcfname,
+			    const char *suffix)
+{
+	ArchiveJob *job = NULL;
+	char recname[32], *rec = NULL, *ptr = NULL, *clientdir = NULL;
+	size_t dirlen, len;
+	int fd = -1;
+
+	if( !clientid || !srcfname || (rterid < 0) ) {
+		return NULL;
+	}
+
+	// The client ID is chosen by the submitter, and must not lead outside of the directory
+	clientdir = archive_clientdir(clientid);
+	if( !clientdir ) {
+		writelog(arch->log, LOG_ALERT, "Could not allocate memory for a directory name");
+		return NULL;
+	}
+
+	job = malloc_nullsafe(arch->log, sizeof(ArchiveJob));
+	job->submid = submid;
+	job->srcfname = strdup(srcfname);
+	job->compress = (arch->compress && (strlen_nullsafe(suffix) == 0));
+
+	dirlen = strlen(arch->reportdir);
+	len = dirlen + strlen(clientdir) + strlen_nullsafe(suffix) + 56;
+	job->destfname = malloc_nullsafe(arch->log, len);
+	ptr = job->destfname + snprintf(job->destfname, len, "%s/", arch->reportdir);
+	if( arch->fanout > 0 ) {
+		ptr += sprintf(ptr, "%02x/", archive_hash(clientid, strlen(clientid)) % arch->fanout);
+	}
+	ptr += snprintf(ptr, len - (ptr - job->destfname), "%s/report-%i", clientdir, rterid);
+	if( snapseq > 0 ) {
+		// All snapshots of a run share the rterid
+		ptr += snprintf(ptr, len - (ptr - job->destfname), "-%u", snapseq);
+	}
+	snprintf(ptr, len - (ptr - job->destfname), ".xml%s",
+		 (job->compress ? ".bz2" : (suffix ? suffix : "")));
+	job->relname = job->destfname + dirlen + 1;
+
+	// Write the handoff record, and make sure it hits the disk
+	len = strlen(job->srcfname) + strlen(job->relname) + 32;
+	rec = malloc_nullsafe(arch->log, len);
+	len = snprintf(rec, len, "%i\n%s\n%s\n%s\n", submid, job->srcfname, job->relname,
+		       (job->compress ? "bzip2" : "move"));
+
+	snprintf(recname, sizeof(recname), "%u.rec", submid);
+	fd = openat(arch->pendfd, recname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if( (fd < 0) || (write_all(fd, rec, len) < 0) || (fsync(fd) < 0) ) {
+		writelog(arch->log, LOG_ALERT,
+			 "(submid: %i) Could not write archive handoff record %s/%s/%s (%s)",
+			 submid, arch->reportdir, ARCHIVE_PENDING_DIR, recname, strerror(errno));
+		if( fd >= 0 ) {
+			close(fd);
+			unlinkat(arch->pendfd, recname, 0);
+		}
+		archive_freejob(job);
+		job = NULL;
+		goto exit;
+	}
+	close(fd);
+	fsync(arch->pendfd);
+ exit:
+	free_nullsafe(clientdir);
+	free_nullsafe(rec);
+	return job;
+}
+
+
+/**
+ * Removes the handoff record of a report which will not be archived, as the database
+ * transaction was rolled back.  The ArchiveJob is freed.
+ *
+ * @param arch  ReportArchive
+ * @param job   ArchiveJob, as returned by archive_prepare()
+ */
+void archive_cancel(ReportArchive *arch, ArchiveJob *job)
+{
+	char recname[32];
+
+	if( !job ) {
+		return;
+	}
+	snprintf(recname, sizeof(recname), "%u.rec", job->submid);
+	unlinkat(arch->pendfd, recname, 0);
+	archive_freejob(job);
+}
+
+
+/**
+ * Queues a report for the archiver thread.  Must be called after the database
+ * transaction is committed.  The archiver thread takes over the ArchiveJob.  If
+ * ARCHIVE_QUEUE_MAX jobs are already queued, the calling worker thread waits until
+ * the archiver thread catches up.
+ *
+ * @param arch  ReportArchive
+ * @param job   ArchiveJob, as returned by archive_prepare()
+ */
+void archive_submit(ReportArchive *arch, ArchiveJob *job)
+{
+	if( !job ) {
+		return;
+	}
+	job->next = NULL;
+	pthread_mutex_lock(&arch->mtx);
+	while( arch->running && !arch->shutdown && (arch->queued >= ARCHIVE_QUEUE_MAX) ) {
+		pthread_cond_wait(&arch->cond_space, &arch->mtx);
+	}
+	arch->queued++;
+	if( arch->tail ) {
+		arch->tail->next = job;
+	} else {
+		arch->head = job;
+	}
+	arch->tail = job;
+	pthread_cond_signal(&arch->cond);
+	pthread_mutex_unlock(&arch->mtx);
+}
+
+
+/**
+ * Stops the archiver thread when the queue is processed, and frees the ReportArchive.
+ *
+ * @param arch  ReportArchive
+ */
+void archive_shutdown(ReportArchive *arch)
+{
+	DirCacheEntry *e = NULL;
+	int i;
+
+	if( !arch ) {
+		return;
+	}
+
+	if( arch->running ) {
+		pthread_mutex_lock(&arch->mtx);
+		arch->shutdown = 1;
+		pthread_cond_signal(&arch->cond);
+		pthread_cond_broadcast(&arch->cond_space);
+		pthread_mutex_unlock(&arch->mtx);
+		pthread_join(arch->thread, NULL);
+	}
+
+	// Jobs not processed keep their handoff records, and are done on the next start
+	while( arch->head ) {
+		ArchiveJob *job = arch->head;
+
+		arch->head = job->next;
+		archive_freejob(job);
+	}
+	while( arch->retry ) {
+		ArchiveJob *job = arch->retry;
+
+		arch->retry = job->next;
+		archive_freejob(job);
+	}
+	for( i = 0; i < DIRCACHE_BUCKETS; i++ ) {
+		while( arch->dircache[i] ) {
+			e = arch->dircache[i];
+			arch->dircache[i] = e->next;
+			free(e);
+		}
+	}
+	if( arch->pendfd >= 0 ) {
+		close(arch->pendfd);
+	}
+	if( arch->rootfd >= 0 ) {
+		close(arch->rootfd);
+	}
+	pthread_cond_destroy(&arch->cond);
+	pthread_cond_destroy(&arch->cond_space);
+	pthread_mutex_destroy(&arch->mtx);
+	free_nullsafe(arch->reportdir);
+	free(arch);
+}
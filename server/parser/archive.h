@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   archive.h
+ * @date   Sun Oct 18 17:05:12 2026
+ *
+ * @brief  Moves processed reports into the report directory, outside the worker threads
+ *
+ */
+
+#ifndef _RTEVAL_ARCHIVE_H
+#define _RTEVAL_ARCHIVE_H
+
+#include <time.h>
+
+#include <log.h>
+#include <pgsql.h>
+#include <shard.h>
+
+#define ARCHIVE_PENDING_DIR ".pending"  /**< Directory in the report directory holding the handoff records */
+#define ARCHIVE_MAX_FANOUT  256         /**< Maximum number of hashed sub directories */
+
+typedef struct _ReportArchive ReportArchive;
+
+/**
+ * A report waiting to be archived
+ */
+typedef struct _ArchiveJob {
+	struct _ArchiveJob *next;  /**< Next job in the archiver queue */
+	unsigned int submid;       /**< Submission ID of the report */
+	int compress;              /**< If set, the report is bzip2 compressed while archived */
+	char *srcfname;            /**< Report file in the submission queue */
+	char *destfname;           /**< Full path of the archived report, as registered in the database */
+	const char *relname;       /**< destfname, relative to the report directory */
+	unsigned int attempts;     /**< Number of failed attempts to archive the report */
+	time_t retry_at;           /**< When a failed job is retried */
+} ArchiveJob;
+
+ReportArchive *archive_init(LogContext *log, const char *reportdir, unsigned int fanout, int compress);
+int archive_start(ReportArchive *arch);
+int archive_replay(ReportArchive *arch, ShardMap *shards, dbconn *dbc);
+ArchiveJob *archive_prepare(ReportArchive *arch, unsigned int submid, const char *clientid,
+			    int rterid, unsigned int snapseq, const char *srcfname,
+			    const char *suffix);
+void archive_cancel(ReportArchive *arch, ArchiveJob *job);
+void archive_submit(ReportArchive *arch, ArchiveJob *job);
+void archive_shutdown(ReportArchive *arch);
+
+#endif
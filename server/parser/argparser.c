@@ -41,8 +41,13 @@ void usage() {
 	       "  -d | --daemon                    Run as a daemon\n"
 	       "  -l | --log        <log dest>     Where to put log data\n"
 	       "  -L | --log-level  <verbosity>    What to log\n"
+	       "  -A | --log-async                 Write file/console logs from a separate thread\n"
 	       "  -f | --config     <config file>  Which configuration file to use\n"
-	       "  -t | --threads    <num. threads> How many worker threads to start (def: 4)\n"
+	       "  -t | --threads    <num. threads> Maximum number of worker threads (def: 4)\n"
+	       "  -R | --reingest   <directory>    Load measurement data again from archived reports\n"
+	       "  -T | --reingest-tables <tables>  Tables to load with --reingest (def: measurement_tables)\n"
+	       "  -O | --transform-only <directory> <reports...>\n"
+	       "                                   Write COPY load files for the reports, no database\n"
 	       "  -h | --help                      This help screen\n"
 	       "\n"
 	       "** Configuration file\n"
@@ -77,6 +82,25 @@ void usage() {
 	       "    info                - General run information\n"
 	       "    debug               - Detailed run information, incl. thread operations\n"
 	       "\n"
+	       "With --log-async, log lines written to a file or the console are queued in\n"
+	       "per thread buffers and written in batches by a separate log writer thread.\n"
+	       "This avoids worker threads waiting for each other on log file I/O.\n"
+	       "Syslog logging is not affected by this option.\n"
+	       "\n"
+	       "** Re-ingesting archived reports\n"
+	       "With --reingest, the program does not process the submission queue.  Instead\n"
+	       "it loads the measurement tables again from all archived reports found in the\n"
+	       "given directory, for rteval runs registered in the database, and exits.\n"
+	       "The completed rteval runs are recorded in a state file in that directory, so\n"
+	       "an interrupted re-ingest continues where it stopped when started again.\n"
+	       "\n"
+	       "** Transform-only mode\n"
+	       "With --transform-only, the measurement tables of the reports given after the\n"
+	       "arguments are written to one COPY load file per table in the given directory,\n"
+	       "together with a manifest, without connecting to the database.  Reports can be\n"
+	       "given as files, as directories with archived reports or as '-', which reads\n"
+	       "a list of files and directories from stdin.\n"
+	       "\n"
 	       );
 }
 
@@ -95,8 +119,12 @@ eurephiaVALUES *parse_arguments(int argc, char **argv) {
 	static struct option long_opts[] = {
 		{"log", 1, 0, 'l'},
 		{"log-level", 1, 0, 'L'},
+		{"log-async", 0, 0, 'A'},
 		{"config", 1, 0, 'f'},
 		{"threads", 1, 0, 't'},
+		{"reingest", 1, 0, 'R'},
+		{"reingest-tables", 1, 0, 'T'},
+		{"transform-only", 1, 0, 'O'},
 		{"daemon", 0, 0, 'd'},
 		{"help", 0, 0, 'h'},
 		{0, 0, 0, 0}
@@ -109,7 +137,7 @@ eurephiaVALUES *parse_arguments(int argc, char **argv) {
 
 	while( 1 ) {
 		optidx = 0;
-		c = getopt_long(argc, argv, "l:L:f:t:dh", long_opts, &optidx);
+		c = getopt_long(argc, argv, "l:L:Af:t:R:T:O:dh", long_opts, &optidx);
 		if( c == -1 ) {
 			break;
 		}
@@ -121,12 +149,24 @@ eurephiaVALUES *parse_arguments(int argc, char **argv) {
 		case 'L':
 			eUpdate_value(args, "loglevel", optarg, 1);
 			break;
+		case 'A':
+			eUpdate_value(args, "log_async", "1", 1);
+			break;
 		case 'f':
 			eUpdate_value(args, "configfile", optarg, 0);
 			break;
 		case 't':
 			eUpdate_value(args, "threads", optarg, 0);
 			break;
+		case 'R':
+			eUpdate_value(args, "reingest", optarg, 1);
+			break;
+		case 'T':
+			eUpdate_value(args, "reingest_tables", optarg, 1);
+			break;
+		case 'O':
+			eUpdate_value(args, "transform_only", optarg, 1);
+			break;
 		case 'd':
 			eUpdate_value(args, "daemon", "1", 0);
 			break;
@@ -136,6 +176,11 @@ eurephiaVALUES *parse_arguments(int argc, char **argv) {
 		}
 	}
 
+	// Re-ingesting and transforming reports are batch jobs, never run as a daemon
+	if( eGet_value(args, "reingest") || eGet_value(args, "transform_only") ) {
+		eUpdate_value(args, "daemon", "0", 0);
+	}
+
 	// If logging is not configured, and it is not run as a daemon
 	// -> log to stderr:
 	if( (eGet_value(args, "log") == NULL)
@@ -117,9 +117,34 @@ static inline eurephiaVALUES *default_cfg_values(LogContext *log, eurephiaVALUES
 	eAdd_value(cfg, "database", "rteval");
 	eAdd_value(cfg, "db_username", "rtevparser");
 	eAdd_value(cfg, "db_password", "rtevaldb_parser");
+	eAdd_value(cfg, "db_check_idle", "30");
+	eAdd_value(cfg, "shard_key", "sysid");
 	eAdd_value(cfg, "reportdir", "/var/lib/rteval/reports");
+	eAdd_value(cfg, "archive_fanout", "256");
+	eAdd_value(cfg, "archive_compress", "0");
+	eAdd_value(cfg, "min_threads", "1");
+	eAdd_value(cfg, "thread_idle_timeout", "120");
+	eAdd_value(cfg, "thread_grow_wait", "2");
+	eAdd_value(cfg, "dispatch_ahead", "2");
+	eAdd_value(cfg, "sched_short_size", "131072");
+	eAdd_value(cfg, "sched_short_burst", "4");
+	eAdd_value(cfg, "sched_client_window", "4");
+	eAdd_value(cfg, "sched_max_candidates", "256");
+	eAdd_value(cfg, "ingest_max_connections", "8");
+	eAdd_value(cfg, "ingest_allow_remote", "0");
+	eAdd_value(cfg, "retry_max_attempts", "5");
+	eAdd_value(cfg, "retry_delay", "60");
+	eAdd_value(cfg, "retry_max_delay", "3600");
+	eAdd_value(cfg, "job_timeout", "300");
+	eAdd_value(cfg, "xslt_max_depth", "3000");
+	eAdd_value(cfg, "xslt_max_vars", "15000");
+	eAdd_value(cfg, "xslt_max_steps", "0");
 	eAdd_value(cfg, "max_report_size", "2097152"); // 2MB
 	eAdd_value(cfg, "measurement_tables", "cyclic_statistics, cyclic_histogram, hwlatdetect_summary, hwlatdetect_samples");
+	eAdd_value(cfg, "worker_arena", "0");
+	eAdd_value(cfg, "worker_arena_chunk", "1048576");    // 1MB
+	eAdd_value(cfg, "worker_arena_retain", "33554432");  // 32MB
+	eAdd_value(cfg, "worker_arena_limit", "0");
 
 	// Copy over the arguments to the config, update existing settings
 	for( ptr = prgargs; ptr; ptr = ptr->next ) {
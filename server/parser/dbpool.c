@@ -0,0 +1,426 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   dbpool.c
+ * @date   Sun Oct 18 23:48:10 2026
+ *
+ * @brief  Database connections shared by the worker threads
+ *
+ * The worker threads only need a database connection while they update the
+ * submission queue and register a report, not while the report is parsed.
+ * Instead of one connection per worker thread, up to db_connections connections
+ * are kept in a pool, and the workers check out a connection for each of these
+ * steps.  This allows running more worker threads than database connections.
+ *
+ * Connections are opened when first needed.  A connection idle for more than
+ * db_check_idle seconds is checked before it is handed out again.  Connections
+ * which are returned in a broken state are reopened by a background thread,
+ * every DBPOOL_RECONNECT_INTERVAL seconds until it succeeds.  Meanwhile, the
+ * workers wait for the other connections.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <dbpool.h>
+
+/**
+ * States of a pooled connection
+ */
+typedef enum { dpEMPTY, dpIDLE, dpBUSY, dpBROKEN } DbPoolState;
+
+/**
+ * One pooled connection
+ */
+typedef struct {
+	DbPoolState state;         /**< State of this connection */
+	dbconn *dbc;               /**< The database connection, NULL if not open */
+	time_t last_used;          /**< When the connection was returned to the pool */
+} DbPoolSlot;
+
+/**
+ * The connection pool
+ */
+struct _DbPool {
+	LogContext *log;           /**< Log context */
+	eurephiaVALUES *cfg;       /**< Configuration, used when connecting */
+	unsigned int size;         /**< Number of connections in the pool */
+	unsigned int first_id;     /**< Connection ID of the first pooled connection */
+	unsigned int check_idle;   /**< Seconds idle before a connection is checked again */
+	DbPoolSlot *slots;         /**< All pooled connections */
+	unsigned long checkouts;   /**< Number of connections handed out */
+	unsigned long waits;       /**< Number of check outs which had to wait */
+	unsigned long reconnects;  /**< Number of broken connections reopened */
+	pthread_mutex_t mtx;       /**< Protects the slot states and the counters */
+	pthread_cond_t cond;       /**< Signalled when a connection becomes available */
+	pthread_cond_t cond_broken; /**< Wakes up the reconnect thread */
+	int stop;                  /**< Set by dbpool_free() */
+	int reconnector_running;   /**< Set when the reconnect thread is started */
+	pthread_t reconnector;     /**< The reconnect thread */
+};
+
+
+/**
+ * Opens a pooled connection
+ *
+ * @param pool  DbPool
+ * @param idx   Index of the connection in the pool
+ *
+ * @return Returns a database connection on success, otherwise NULL
+ */
+static dbconn *dbpool_open(DbPool *pool, unsigned int idx)
+{
+	// The measurement tables are set for each report, see parse_report()
+	return db_connect(pool->cfg, pool->first_id + idx, pool->log);
+}
+
+
+/**
+ * Closes a pooled connection
+ *
+ * @param dbc  Database connection, may be NULL
+ */
+static void dbpool_close(dbconn *dbc)
+{
+	db_disconnect(dbc);
+}
+
+
+/**
+ * Finds a connection in the given state.  Must be called with the pool mutex held.
+ *
+ * @param pool   DbPool
+ * @param state  The state to look for
+ *
+ * @return Returns the index of the connection, or -1 if none is found
+ */
+static int dbpool_find(DbPool *pool, DbPoolState state)
+{
+	unsigned int i;
+
+	for( i = 0; i < pool->size; i++ ) {
+		if( pool->slots[i].state == state ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+/**
+ * The reconnect thread.  Reopens the broken connections.
+ *
+ * @param data  DbPool
+ *
+ * @return Returns NULL
+ */
+static void *dbpool_reconnector(void *data)
+{
+	DbPool *pool = (DbPool *) data;
+	struct timeval now;
+	struct timespec wakeup;
+	unsigned int i;
+
+	pthread_mutex_lock(&pool->mtx);
+	while( !pool->stop ) {
+		for( i = 0; !pool->stop && (i < pool->size); i++ ) {
+			DbPoolSlot *slot = &pool->slots[i];
+
+			if( slot->state != dpBROKEN ) {
+				continue;
+			}
+			slot->state = dpBUSY;
+			pthread_mutex_unlock(&pool->mtx);
+
+			dbpool_close(slot->dbc);
+			slot->dbc = dbpool_open(pool, i);
+
+			pthread_mutex_lock(&pool->mtx);
+			if( slot->dbc ) {
+				writelog(pool->log, LOG_INFO, "[Connection %i] Reconnected to the database",
+					 slot->dbc->id);
+				slot->state = dpIDLE;
+				slot->last_used = time(NULL);
+				pool->reconnects++;
+				pthread_cond_broadcast(&pool->cond);
+			} else {
+				slot->state = dpBROKEN;
+			}
+		}
+
+		gettimeofday(&now, NULL);
+		wakeup.tv_sec = now.tv_sec + DBPOOL_RECONNECT_INTERVAL;
+		wakeup.tv_nsec = now.tv_usec * 1000;
+		pthread_cond_timedwait(&pool->cond_broken, &pool->mtx, &wakeup);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return NULL;
+}
+
+
+/**
+ * Prepares the connection pool and starts the reconnect thread.  No connections are
+ * opened yet.
+ *
+ * @param log       Log context
+ * @param cfg       Configuration
+ * @param dbc       Database connection of the main thread, used to check for free connections.
+ *                  May be NULL, then the check is skipped.
+ * @param first_id  Connection ID of the first pooled connection, used in the log
+ *
+ * @return Returns a DbPool on success, otherwise NULL
+ */
+DbPool *dbpool_init(LogContext *log, eurephiaVALUES *cfg, dbconn *dbc, unsigned int first_id)
+{
+	DbPool *pool = NULL;
+	int rc, freeconns;
+
+	pool = malloc_nullsafe(log, sizeof(DbPool));
+	pool->log = log;
+	pool->cfg = cfg;
+	pool->first_id = first_id;
+	pool->size = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "db_connections")),
+				     defaultIntValue(atoi_nullsafe(eGet_value(cfg, "threads")), 4));
+	pool->check_idle = atoi_nullsafe(eGet_value(cfg, "db_check_idle"));
+	pthread_mutex_init(&pool->mtx, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pthread_cond_init(&pool->cond_broken, NULL);
+
+	freeconns = (dbc ? db_available_connections(dbc) : -1);
+	if( (freeconns >= 0) && (pool->size > freeconns) ) {
+		writelog(log, LOG_WARNING,
+			 "Only %i free database connections, limiting the connection pool to %i",
+			 freeconns, (freeconns > 0 ? freeconns : 1));
+		pool->size = (freeconns > 0 ? freeconns : 1);
+	}
+	pool->slots = malloc_nullsafe(log, pool->size * sizeof(DbPoolSlot));
+
+	if( (rc = pthread_create(&pool->reconnector, NULL, dbpool_reconnector, pool)) != 0 ) {
+		writelog(log, LOG_EMERG, "Could not start the database reconnect thread: %s",
+			 strerror(rc));
+		dbpool_free(pool);
+		return NULL;
+	}
+	pool->reconnector_running = 1;
+	writelog(log, LOG_INFO, "Using up to %i database connections for the worker threads",
+		 pool->size);
+	return pool;
+}
+
+
+/**
+ * Opens one more connection, if the pool has not opened all of them yet.  Used to
+ * connect in advance when the worker threads start.
+ *
+ * @param pool  DbPool
+ *
+ * @return Returns 1 if a connection was opened or no more connections are needed,
+ *         otherwise -1
+ */
+int dbpool_warmup(DbPool *pool)
+{
+	DbPoolSlot *slot = NULL;
+	int idx;
+
+	pthread_mutex_lock(&pool->mtx);
+	if( (idx = dbpool_find(pool, dpEMPTY)) < 0 ) {
+		pthread_mutex_unlock(&pool->mtx);
+		return 1;
+	}
+	slot = &pool->slots[idx];
+	slot->state = dpBUSY;
+	pthread_mutex_unlock(&pool->mtx);
+
+	slot->dbc = dbpool_open(pool, idx);
+
+	pthread_mutex_lock(&pool->mtx);
+	slot->state = (slot->dbc ? dpIDLE : dpEMPTY);
+	slot->last_used = time(NULL);
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mtx);
+	return (slot->dbc ? 1 : -1);
+}
+
+
+/**
+ * Checks out a database connection, waiting until one is available.  The connection
+ * must be given back with dbpool_put() as soon as possible, and it must not be kept
+ * while doing other things than database work.
+ *
+ * @param pool      DbPool
+ * @param shutdown  Pointer to the global shutdown flag
+ *
+ * @return Returns a database connection, or NULL if the shutdown flag is set while waiting
+ */
+dbconn *dbpool_get(DbPool *pool, const int *shutdown)
+{
+	struct timeval now;
+	struct timespec wakeup;
+	int idx, waited = 0;
+
+	pthread_mutex_lock(&pool->mtx);
+	while( !pool->stop && (*shutdown == 0) ) {
+		DbPoolSlot *slot = NULL;
+		int fresh;
+
+		if( (idx = dbpool_find(pool, dpIDLE)) < 0 ) {
+			idx = dbpool_find(pool, dpEMPTY);
+		}
+		if( idx < 0 ) {
+			waited = 1;
+			gettimeofday(&now, NULL);
+			wakeup.tv_sec = now.tv_sec + DBPOOL_WAIT_INTERVAL;
+			wakeup.tv_nsec = now.tv_usec * 1000;
+			pthread_cond_timedwait(&pool->cond, &pool->mtx, &wakeup);
+			continue;
+		}
+
+		slot = &pool->slots[idx];
+		fresh = (slot->state == dpEMPTY);
+		slot->state = dpBUSY;
+		pool->checkouts++;
+		pool->waits += waited;
+		waited = 0;
+		pthread_mutex_unlock(&pool->mtx);
+
+		// Connect or check the connection without blocking the others
+		if( fresh ) {
+			slot->dbc = dbpool_open(pool, idx);
+		} else if( pool->check_idle && ((time(NULL) - slot->last_used) >= pool->check_idle)
+			   && (db_ping(slot->dbc) != 1) ) {
+			dbpool_close(slot->dbc);
+			slot->dbc = NULL;
+		}
+		if( slot->dbc ) {
+			return slot->dbc;
+		}
+
+		// Leave it to the reconnect thread, and try another connection
+		pthread_mutex_lock(&pool->mtx);
+		slot->state = dpBROKEN;
+		pthread_cond_signal(&pool->cond_broken);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return NULL;
+}
+
+
+/**
+ * Gives back a database connection checked out by dbpool_get().  Unfinished transactions
+ * are rolled back, and broken connections are reopened by the reconnect thread.
+ *
+ * @param pool  DbPool
+ * @param dbc   Database connection, may be NULL
+ */
+void dbpool_put(DbPool *pool, dbconn *dbc)
+{
+	DbPoolSlot *slot = NULL;
+	int usable;
+
+	if( !dbc ) {
+		return;
+	}
+	assert( (dbc->id >= pool->first_id) && (dbc->id < (pool->first_id + pool->size)) );
+	slot = &pool->slots[dbc->id - pool->first_id];
+	dbc->stats = NULL;
+	usable = db_check_idle(dbc);
+
+	pthread_mutex_lock(&pool->mtx);
+	if( usable ) {
+		slot->state = dpIDLE;
+		slot->last_used = time(NULL);
+		pthread_cond_signal(&pool->cond);
+	} else {
+		writelog(pool->log, LOG_WARNING, "[Connection %i] Connection broken, reconnecting",
+			 dbc->id);
+		slot->state = dpBROKEN;
+		pthread_cond_signal(&pool->cond_broken);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+
+/**
+ * Writes the connection pool counters to the log
+ *
+ * @param pool  DbPool
+ */
+void dbpool_log_stats(DbPool *pool)
+{
+	unsigned int i, count[4] = { 0, 0, 0, 0 };
+	unsigned long checkouts, waits, reconnects;
+
+	if( !pool ) {
+		return;
+	}
+	pthread_mutex_lock(&pool->mtx);
+	for( i = 0; i < pool->size; i++ ) {
+		count[pool->slots[i].state]++;
+	}
+	checkouts = pool->checkouts;
+	waits = pool->waits;
+	reconnects = pool->reconnects;
+	pthread_mutex_unlock(&pool->mtx);
+
+	writelog(pool->log, LOG_INFO,
+		 "Database pool: %i idle, %i in use, %i broken, %i not opened; "
+		 "%lu check outs, %lu waited, %lu reconnects",
+		 count[dpIDLE], count[dpBUSY], count[dpBROKEN], count[dpEMPTY],
+		 checkouts, waits, reconnects);
+}
+
+
+/**
+ * Stops the reconnect thread and closes all pooled connections.  The worker threads
+ * must be stopped first.
+ *
+ * @param pool  DbPool
+ */
+void dbpool_free(DbPool *pool)
+{
+	unsigned int i;
+
+	if( !pool ) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_cond_signal(&pool->cond_broken);
+	pthread_mutex_unlock(&pool->mtx);
+	if( pool->reconnector_running ) {
+		pthread_join(pool->reconnector, NULL);
+	}
+
+	for( i = 0; pool->slots && (i < pool->size); i++ ) {
+		dbpool_close(pool->slots[i].dbc);
+	}
+	pthread_cond_destroy(&pool->cond_broken);
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->mtx);
+	free_nullsafe(pool->slots);
+	free_nullsafe(pool);
+}
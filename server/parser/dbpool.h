@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   dbpool.h
+ * @date   Sun Oct 18 23:48:10 2026
+ *
+ * @brief  Database connections shared by the worker threads
+ *
+ */
+
+#ifndef _RTEVAL_DBPOOL_H
+#define _RTEVAL_DBPOOL_H
+
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+
+#define DBPOOL_RECONNECT_INTERVAL 5   /**< Seconds between each attempt to reconnect broken connections */
+#define DBPOOL_WAIT_INTERVAL      1   /**< Seconds between each check of the shutdown flag while waiting */
+
+typedef struct _DbPool DbPool;
+
+DbPool *dbpool_init(LogContext *log, eurephiaVALUES *cfg, dbconn *dbc, unsigned int first_id);
+int dbpool_warmup(DbPool *pool);
+dbconn *dbpool_get(DbPool *pool, const int *shutdown);
+void dbpool_put(DbPool *pool, dbconn *dbc);
+void dbpool_log_stats(DbPool *pool);
+void dbpool_free(DbPool *pool);
+
+#endif
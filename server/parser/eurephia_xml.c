@@ -40,6 +40,7 @@
 #include <libxml/xmlstring.h>
 
 #include <eurephia_nullsafe.h>
+#include <memarena.h>
 
 
 /**
@@ -52,18 +53,12 @@
  */
 char *xmlGetAttrValue(xmlAttr *attr, const char *key) {
         xmlAttr *aptr;
-        xmlChar *x_key = NULL;
-
-        x_key = xmlCharStrdup(key);
-        assert( x_key != NULL );
 
         for( aptr = attr; aptr != NULL; aptr = aptr->next ) {
-                if( xmlStrcmp(aptr->name, x_key) == 0 ) {
-                        free_nullsafe(x_key);
+                if( xmlStrcmp(aptr->name, (const xmlChar *) key) == 0 ) {
                         return (char *)(aptr->children != NULL ? aptr->children->content : NULL);
                 }
         }
-        free_nullsafe(x_key);
         return NULL;
 }
 
@@ -78,22 +73,16 @@ char *xmlGetAttrValue(xmlAttr *attr, const char *key) {
  */
 xmlNode *xmlFindNode(xmlNode *node, const char *key) {
         xmlNode *nptr = NULL;
-        xmlChar *x_key = NULL;
 
         if( (node == NULL) || (node->children == NULL) ) {
                 return NULL;
         }
 
-        x_key = xmlCharStrdup(key);
-        assert( x_key != NULL );
-
         for( nptr = node->children; nptr != NULL; nptr = nptr->next ) {
-                if( xmlStrcmp(nptr->name, x_key) == 0 ) {
-                        free_nullsafe(x_key);
+                if( xmlStrcmp(nptr->name, (const xmlChar *) key) == 0 ) {
                         return nptr;
                 }
         }
-        free_nullsafe(x_key);
         return NULL;
 }
 
@@ -130,7 +119,7 @@ inline char *xmlGetNodeContent(xmlNode *node, const char *key) {
  * @param node Input XML node to be serialised
  *
  * @return Returns a pointer to a new buffer containing the serialised data.  This buffer must be freed
- *         after usage
+ *         with free_arena() after usage
  */
 char *xmlNodeToString(LogContext *log, xmlNode *node) {
 	xmlBuffer *buf = NULL;
@@ -154,7 +143,7 @@ char *xmlNodeToString(LogContext *log, xmlNode *node) {
 	}
 	xmlSaveClose(serctx);
 
-	ret = strdup_nullsafe((char *) xmlBufferContent(buf));
+	ret = strdup_arena((char *) xmlBufferContent(buf));
 	xmlBufferFree(buf);
 	return ret;
 }
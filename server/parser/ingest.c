@@ -0,0 +1,802 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   ingest.c
+ * @date   Sun Oct 18 18:12:40 2026
+ *
+ * @brief  Receives reports directly over a UNIX or TCP socket
+ *
+ * This is an alternative to the XML-RPC service for submitting reports.  The
+ * reports are received as they are, normally compressed, and saved into the
+ * submission queue directory without being parsed.  The submission is then
+ * registered in the submissionqueue table and sent directly to the worker threads,
+ * without waiting for the submission queue checker.
+ *
+ * The protocol is line based.  For each report, the client sends a request line
+ * followed by the report itself:
+ *
+ *     SUBMIT <clientid> <report size in bytes>\n
+ *     <report data>
+ *
+ * The server replies with "OK <submid>\n" or "ERR <reason>\n".  Several reports
+ * may be sent over the same connection.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <statuses.h>
+#include <parsethread.h>
+#include <reportfile.h>
+#include <ingest.h>
+
+/**
+ * The ingestion listener
+ */
+struct _IngestListener {
+	LogContext *log;           /**< Log context */
+	dbconn *dbc;               /**< Database connection, shared by all connections */
+	pthread_mutex_t mtx_db;    /**< Protects the database connection */
+	time_t db_used;            /**< When the database connection was last checked */
+	mqd_t msgq;                /**< POSIX MQ descriptor of the worker threads */
+	JobScheduler *sched;       /**< Job scheduler, deciding the lane of each report */
+	WorkerPool *workers;       /**< Worker pool, providing the job slots */
+	char *queuedir;            /**< Submission queue directory */
+	char *unixpath;            /**< Path of the UNIX socket, NULL when listening on TCP */
+	int listenfd;              /**< Listening socket */
+	SettingsStore *settings;   /**< Published settings, providing the maximum report size */
+	unsigned int max_conns;    /**< Maximum number of simultaneous connections */
+	unsigned int active;       /**< Number of active connections */
+	pthread_mutex_t mtx_conn;  /**< Protects the active counter */
+	pthread_cond_t cond_conn;  /**< Signalled when a connection is closed */
+	int *shutdown;             /**< Global shutdown flag */
+	int stop;                  /**< Set by ingest_stop() */
+	pthread_t thread;          /**< The listener thread */
+};
+
+/**
+ * A client connection, with a small read buffer
+ */
+typedef struct {
+	IngestListener *ing;       /**< The listener which accepted the connection */
+	int fd;                    /**< Client socket */
+	size_t pos;                /**< Start of the unread data in buf */
+	size_t len;                /**< End of the unread data in buf */
+	char buf[65536];           /**< Read buffer */
+} IngestConn;
+
+
+/**
+ * Reads more data from the client into the read buffer
+ *
+ * @param c  IngestConn
+ *
+ * @return Returns the number of bytes read, 0 on end of file and -1 on errors
+ */
+static ssize_t conn_fill(IngestConn *c)
+{
+	ssize_t r;
+
+	if( c->pos > 0 ) {
+		memmove(c->buf, c->buf + c->pos, c->len - c->pos);
+		c->len -= c->pos;
+		c->pos = 0;
+	}
+	do {
+		r = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+	} while( (r < 0) && (errno == EINTR) );
+	if( r > 0 ) {
+		c->len += r;
+	}
+	return r;
+}
+
+
+/**
+ * Reads a request line from the client
+ *
+ * @param c     IngestConn
+ * @param line  Buffer for the line, the newline is removed
+ * @param size  Size of the line buffer
+ *
+ * @return Returns 1 when a line was read, 0 if the client closed the connection
+ *         and -1 on errors or too long lines.
+ */
+static int conn_readline(IngestConn *c, char *line, size_t size)
+{
+	char *eol = NULL;
+	size_t len;
+
+	while( (eol = memchr(c->buf + c->pos, '\n', c->len - c->pos)) == NULL ) {
+		ssize_t r;
+
+		if( (c->len - c->pos) >= size ) {
+			return -1;
+		}
+		r = conn_fill(c);
+		if( r <= 0 ) {
+			return ((r == 0) && (c->len == c->pos) ? 0 : -1);
+		}
+	}
+
+	len = eol - (c->buf + c->pos);
+	if( len >= size ) {
+		return -1;
+	}
+	memcpy(line, c->buf + c->pos, len);
+	line[len] = '\0';
+	if( (len > 0) && (line[len-1] == '\r') ) {
+		line[len-1] = '\0';
+	}
+	c->pos += len + 1;
+	return 1;
+}
+
+
+/**
+ * Sends a reply line to the client
+ *
+ * @param c      IngestConn
+ * @param reply  Reply to send, including the newline
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int conn_reply(IngestConn *c, const char *reply)
+{
+	size_t len = strlen(reply);
+
+	while( len > 0 ) {
+		ssize_t w = send(c->fd, reply, len, MSG_NOSIGNAL);
+
+		if( w < 0 ) {
+			if( errno == EINTR ) {
+				continue;
+			}
+			return -1;
+		}
+		reply += w;
+		len -= w;
+	}
+	return 1;
+}
+
+
+/**
+ * Receives a report from the client, and saves it into a new file in the
+ * submission queue directory
+ *
+ * @param c         IngestConn
+ * @param clientid  Client ID of the submitter
+ * @param size      Size of the report
+ * @param fname     Buffer for the file name of the saved report
+ * @param fnsize    Size of the file name buffer
+ *
+ * @return Returns 1 on success, 0 if the report format is not recognised and
+ *         -1 on errors.
+ */
+static int ingest_spool(IngestConn *c, const char *clientid, size_t size, char *fname, size_t fnsize)
+{
+	IngestListener *ing = c->ing;
+	reportCompression comp;
+	const char *suffix = NULL;
+	char safeid[INGEST_CLIENTID_MAX + 1];
+	size_t need = (size < 4 ? size : 4);
+	int fd = -1, i;
+
+	// Look at the first bytes to find the format of the report
+	while( (c->len - c->pos) < need ) {
+		if( conn_fill(c) <= 0 ) {
+			return -1;
+		}
+	}
+	comp = reportfile_detect(c->buf + c->pos, need);
+	if( comp == rfcNONE ) {
+		unsigned char first = c->buf[c->pos];
+
+		if( (first != '<') && (first != 0xef) && (first != ' ')
+		    && (first != '\n') && (first != '\r') && (first != '\t') ) {
+			return 0;
+		}
+	}
+
+	// Same naming as the XML-RPC service uses, with a unique suffix
+	for( i = 0; clientid[i] && (i < INGEST_CLIENTID_MAX); i++ ) {
+		switch( clientid[i] ) {
+		case '/':
+		case '\\':
+			safeid[i] = ':';
+			break;
+		case '.':
+			safeid[i] = '_';
+			break;
+		default:
+			safeid[i] = clientid[i];
+			break;
+		}
+	}
+	safeid[i] = '\0';
+	suffix = reportfile_suffix(comp);
+	snprintf(fname, fnsize, "%s/%s-XXXXXX.xml%s", ing->queuedir, safeid, suffix);
+	fd = mkstemps(fname, strlen(suffix) + 4);
+	if( fd < 0 ) {
+		writelog(ing->log, LOG_ERR, "[Ingest] Could not create %s: %s",
+			 fname, strerror(errno));
+		return -1;
+	}
+
+	// Copy the report into the file, reusing the read buffer
+	while( size > 0 ) {
+		size_t avail = c->len - c->pos;
+
+		if( avail == 0 ) {
+			if( conn_fill(c) <= 0 ) {
+				writelog(ing->log, LOG_WARNING,
+					 "[Ingest] Connection lost while receiving a report from %s",
+					 clientid);
+				goto error;
+			}
+			continue;
+		}
+		if( avail > size ) {
+			avail = size;
+		}
+		while( avail > 0 ) {
+			ssize_t w = write(fd, c->buf + c->pos, avail);
+
+			if( w < 0 ) {
+				if( errno == EINTR ) {
+					continue;
+				}
+				writelog(ing->log, LOG_ERR, "[Ingest] Could not write %s: %s",
+					 fname, strerror(errno));
+				goto error;
+			}
+			c->pos += w;
+			avail -= w;
+			size -= w;
+		}
+	}
+
+	if( (fchmod(fd, 0644) < 0) || (fsync(fd) < 0) ) {
+		writelog(ing->log, LOG_ERR, "[Ingest] Could not write %s: %s",
+			 fname, strerror(errno));
+		goto error;
+	}
+	close(fd);
+	return 1;
+
+ error:
+	close(fd);
+	unlink(fname);
+	return -1;
+}
+
+
+/**
+ * Checks the shared database connection before it is used, and resets it if the
+ * connection was lost or has been idle for a while, such as after a database restart.
+ * Must be called with mtx_db held.
+ *
+ * @param ing  IngestListener
+ *
+ * @return Returns 1 if the connection can be used, otherwise 0
+ */
+static int ingest_db_check(IngestListener *ing)
+{
+	time_t now = time(NULL);
+
+	if( (db_connection_lost(ing->dbc) || ((now - ing->db_used) >= INGEST_DB_CHECK_IDLE))
+	    && (db_ping(ing->dbc) != 1) ) {
+		return 0;
+	}
+	ing->db_used = now;
+	return 1;
+}
+
+
+/**
+ * Registers a saved report in the submission queue, and sends it directly to the
+ * worker threads.  If the worker threads cannot take another job, the submission is
+ * left for the submission queue checker.  The database connection is only held while
+ * the submission is registered, so a full message queue does not hold back the other
+ * connections.
+ *
+ * @param ing       IngestListener
+ * @param clientid  Client ID of the submitter
+ * @param fname     File name of the saved report
+ * @param size      Size of the saved report, in bytes
+ *
+ * @return Returns the submission ID on success, otherwise -1.  Once the submission is
+ *         registered, the submission ID is returned even if it could not be sent to the
+ *         worker threads, as it is picked up from the submission queue later.
+ */
+static int ingest_register(IngestListener *ing, const char *clientid, const char *fname,
+			   unsigned long size)
+{
+	parseJob_t job;
+	struct timespec timeout;
+	int submid = -1, direct = 0;
+
+	// No job slot is given during shut down
+	direct = workerpool_claim_slot(ing->workers);
+	pthread_mutex_lock(&ing->mtx_db);
+	if( ingest_db_check(ing) ) {
+		submid = db_register_submission(ing->dbc, clientid, fname,
+						(direct ? STAT_ASSIGNED : STAT_NEW), size);
+	}
+	pthread_mutex_unlock(&ing->mtx_db);
+	if( (submid < 0) || !direct ) {
+		goto exit;
+	}
+
+	memset(&job, 0, sizeof(parseJob_t));
+	job.status = jbAVAIL;
+	job.submid = submid;
+	snprintf(job.clientid, 255, "%.254s", clientid);
+	snprintf(job.filename, 4095, "%.4094s", fname);
+	job.size = size;
+	sched_classify(ing->sched, &job, size);
+	job.queued = workerpool_clock();
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout.tv_sec += 1;
+	if( mq_timedsend(ing->msgq, (char *) &job, sizeof(parseJob_t),
+			 sched_mq_priority(&job), &timeout) < 0 ) {
+		writelog(ing->log, (errno == ETIMEDOUT ? LOG_INFO : LOG_ERR),
+			 "[Ingest] Could not send submid %i to the worker threads (%s), "
+			 "leaving it in the submission queue", submid, strerror(errno));
+
+		// The submission is registered, so the client must not send it again.  If it
+		// cannot be requeued, it is recovered as an assigned submission on the next start.
+		pthread_mutex_lock(&ing->mtx_db);
+		if( !ingest_db_check(ing) || (db_requeue_submission(ing->dbc, submid) < 0) ) {
+			writelog(ing->log, LOG_ERR, "[Ingest] Could not requeue submid %i, it is "
+				 "parsed when rteval-parserd is restarted", submid);
+		}
+		pthread_mutex_unlock(&ing->mtx_db);
+		goto exit;
+	}
+	direct = 0; // The slot is released when a worker picks up the job
+ exit:
+	if( direct ) {
+		workerpool_release_slot(ing->workers);
+	}
+	return submid;
+}
+
+
+/**
+ * Checks that a client ID can be used as a directory name in the report directory.
+ * The client ID is not authenticated, so anything which could point the archiver
+ * outside of its own directory is refused.
+ *
+ * @param clientid  Client ID from the SUBMIT line
+ *
+ * @return Returns 1 if the client ID is acceptable, otherwise 0
+ */
+static int ingest_clientid_valid(const char *clientid)
+{
+	const unsigned char *p = NULL;
+
+	if( (strcmp(clientid, ".") == 0) || strstr(clientid, "..") || strchr(clientid, '/') ) {
+		return 0;
+	}
+	for( p = (const unsigned char *) clientid; *p; p++ ) {
+		if( iscntrl(*p) ) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+/**
+ * Handles one client connection, until the client disconnects or an error occurs
+ *
+ * @param data  IngestConn
+ *
+ * @return Returns NULL
+ */
+static void *ingest_connection(void *data)
+{
+	IngestConn *c = (IngestConn *) data;
+	IngestListener *ing = c->ing;
+	struct timeval tmo;
+	char line[INGEST_HEADER_MAX], reply[64], fname[4096];
+
+	tmo.tv_sec = INGEST_TIMEOUT;
+	tmo.tv_usec = 0;
+	setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo));
+	setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, &tmo, sizeof(tmo));
+
+	while( (*(ing->shutdown) == 0) && !ing->stop ) {
+		char *cmd = NULL, *clientid = NULL, *sizestr = NULL, *saveptr = NULL, *end = NULL;
+		unsigned long size = 0;
+		int rc, submid;
+
+		rc = conn_readline(c, line, sizeof(line));
+		if( rc == 0 ) {
+			break;
+		} else if( rc < 0 ) {
+			conn_reply(c, "ERR protocol\n");
+			break;
+		}
+
+		cmd = strtok_r(line, " ", &saveptr);
+		clientid = strtok_r(NULL, " ", &saveptr);
+		sizestr = strtok_r(NULL, " ", &saveptr);
+		if( !cmd || (strcmp(cmd, "SUBMIT") != 0) || !clientid || !sizestr
+		    || strtok_r(NULL, " ", &saveptr)
+		    || (strlen(clientid) > INGEST_CLIENTID_MAX) ) {
+			conn_reply(c, "ERR protocol\n");
+			break;
+		}
+		size = strtoul(sizestr, &end, 10);
+		if( (*end != '\0') || (size == 0) ) {
+			conn_reply(c, "ERR protocol\n");
+			break;
+		}
+		if( !ingest_clientid_valid(clientid) ) {
+			writelog(ing->log, LOG_WARNING,
+				 "[Ingest] Rejected a report with an invalid client ID");
+			conn_reply(c, "ERR clientid\n");
+			break;
+		}
+		if( size > settings_max_report_size(ing->settings) ) {
+			writelog(ing->log, LOG_ERR,
+				 "[Ingest] Report from %s is too big (%lu bytes), rejected",
+				 clientid, size);
+			conn_reply(c, "ERR too big\n");
+			break;
+		}
+
+		rc = ingest_spool(c, clientid, size, fname, sizeof(fname));
+		if( rc == 0 ) {
+			conn_reply(c, "ERR format\n");
+			break;
+		} else if( rc < 0 ) {
+			conn_reply(c, "ERR spool\n");
+			break;
+		}
+
+		submid = ingest_register(ing, clientid, fname, size);
+		if( submid < 0 ) {
+			unlink(fname);
+			conn_reply(c, "ERR database\n");
+			break;
+		}
+		writelog(ing->log, LOG_INFO, "[Ingest] Received report from %s, submid: %i - %s",
+			 clientid, submid, fname);
+
+		snprintf(reply, sizeof(reply), "OK %i\n", submid);
+		if( conn_reply(c, reply) < 0 ) {
+			break;
+		}
+	}
+
+	close(c->fd);
+	free(c);
+
+	pthread_mutex_lock(&ing->mtx_conn);
+	ing->active--;
+	pthread_cond_signal(&ing->cond_conn);
+	pthread_mutex_unlock(&ing->mtx_conn);
+	return NULL;
+}
+
+
+/**
+ * The listener thread.  Accepts connections and starts a thread for each of them.
+ * When shutting down, it waits for all connections to complete.
+ *
+ * @param data  IngestListener
+ *
+ * @return Returns NULL
+ */
+static void *ingest_listener(void *data)
+{
+	IngestListener *ing = (IngestListener *) data;
+	pthread_attr_t attr;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	while( (*(ing->shutdown) == 0) && !ing->stop ) {
+		struct pollfd pfd;
+		IngestConn *c = NULL;
+		pthread_t thr;
+		int fd, rc;
+
+		pfd.fd = ing->listenfd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if( poll(&pfd, 1, 1000) <= 0 ) {
+			continue;
+		}
+
+		fd = accept(ing->listenfd, NULL, NULL);
+		if( fd < 0 ) {
+			continue;
+		}
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+		pthread_mutex_lock(&ing->mtx_conn);
+		if( ing->active >= ing->max_conns ) {
+			pthread_mutex_unlock(&ing->mtx_conn);
+			send(fd, "ERR busy\n", 9, MSG_NOSIGNAL | MSG_DONTWAIT);
+			close(fd);
+			continue;
+		}
+		ing->active++;
+		pthread_mutex_unlock(&ing->mtx_conn);
+
+		c = malloc_nullsafe(ing->log, sizeof(IngestConn));
+		c->ing = ing;
+		c->fd = fd;
+		if( (rc = pthread_create(&thr, &attr, ingest_connection, c)) != 0 ) {
+			writelog(ing->log, LOG_ERR, "[Ingest] Could not start connection thread: %s",
+				 strerror(rc));
+			close(fd);
+			free(c);
+			pthread_mutex_lock(&ing->mtx_conn);
+			ing->active--;
+			pthread_mutex_unlock(&ing->mtx_conn);
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	// No new connections, and wait for the active ones to complete
+	close(ing->listenfd);
+	ing->listenfd = -1;
+	if( ing->unixpath ) {
+		unlink(ing->unixpath);
+	}
+	pthread_mutex_lock(&ing->mtx_conn);
+	while( ing->active > 0 ) {
+		pthread_cond_wait(&ing->cond_conn, &ing->mtx_conn);
+	}
+	pthread_mutex_unlock(&ing->mtx_conn);
+	return NULL;
+}
+
+
+/**
+ * Checks if a socket address is a loopback address
+ *
+ * @param addr  Socket address
+ *
+ * @return Returns 1 for loopback addresses, otherwise 0
+ */
+static int ingest_is_loopback(const struct sockaddr *addr)
+{
+	if( addr->sa_family == AF_INET ) {
+		return ((ntohl(((const struct sockaddr_in *) addr)->sin_addr.s_addr) >> 24) == 127);
+	} else if( addr->sa_family == AF_INET6 ) {
+		return IN6_IS_ADDR_LOOPBACK(&((const struct sockaddr_in6 *) addr)->sin6_addr);
+	}
+	return 0;
+}
+
+
+/**
+ * Opens the listening socket.  As the protocol has no authentication, TCP sockets
+ * are only opened on loopback addresses unless remote is set.
+ *
+ * @param ing     IngestListener
+ * @param where   Where to listen, "unix:<path>" or "tcp:[<address>:]<port>"
+ * @param remote  Set if other than loopback addresses are allowed (config: ingest_allow_remote)
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int ingest_listen(IngestListener *ing, const char *where, int remote)
+{
+	int on = 1;
+
+	if( strncmp(where, "unix:", 5) == 0 ) {
+		struct sockaddr_un addr;
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if( strlen(where + 5) >= sizeof(addr.sun_path) ) {
+			writelog(ing->log, LOG_EMERG, "[Ingest] Socket path is too long: %s", where + 5);
+			return -1;
+		}
+		strcpy(addr.sun_path, where + 5);
+
+		ing->listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if( ing->listenfd < 0 ) {
+			goto error;
+		}
+		unlink(addr.sun_path);
+		if( bind(ing->listenfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ) {
+			goto error;
+		}
+		ing->unixpath = strdup(addr.sun_path);
+		chmod(addr.sun_path, 0660);
+	} else if( strncmp(where, "tcp:", 4) == 0 ) {
+		struct addrinfo hints, *ai = NULL;
+		char *host = strdup(where + 4), *port = NULL;
+		int rc;
+
+		// tcp:<port>, tcp:<host>:<port> or tcp:[<IPv6 address>]:<port>
+		port = strrchr(host, ':');
+		if( port ) {
+			*port++ = '\0';
+			if( (host[0] == '[') && (host[strlen(host)-1] == ']') ) {
+				host[strlen(host)-1] = '\0';
+				memmove(host, host + 1, strlen(host));
+			}
+		} else {
+			port = host;
+		}
+
+		// Without an address, only the loopback address is used
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		rc = getaddrinfo((port == host ? NULL : host), port, &hints, &ai);
+		if( rc != 0 ) {
+			writelog(ing->log, LOG_EMERG, "[Ingest] Invalid listen address %s: %s",
+				 where, gai_strerror(rc));
+			free(host);
+			return -1;
+		}
+		free(host);
+		if( !remote && !ingest_is_loopback(ai->ai_addr) ) {
+			writelog(ing->log, LOG_EMERG,
+				 "[Ingest] %s is not a loopback address.  The ingest protocol has no "
+				 "authentication, set ingest_allow_remote to 1 to listen on it anyway",
+				 where);
+			freeaddrinfo(ai);
+			return -1;
+		}
+
+		ing->listenfd = socket(ai->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if( ing->listenfd < 0 ) {
+			freeaddrinfo(ai);
+			goto error;
+		}
+		setsockopt(ing->listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		rc = bind(ing->listenfd, ai->ai_addr, ai->ai_addrlen);
+		freeaddrinfo(ai);
+		if( rc < 0 ) {
+			goto error;
+		}
+	} else {
+		writelog(ing->log, LOG_EMERG,
+			 "[Ingest] Invalid ingest_listen value '%s', expected unix:<path> "
+			 "or tcp:[<address>:]<port>", where);
+		return -1;
+	}
+
+	if( listen(ing->listenfd, 64) < 0 ) {
+		goto error;
+	}
+	writelog(ing->log, LOG_INFO, "[Ingest] Listening for reports on %s", where);
+	return 1;
+
+ error:
+	writelog(ing->log, LOG_EMERG, "[Ingest] Could not listen on %s: %s", where, strerror(errno));
+	return -1;
+}
+
+
+/**
+ * Starts the report ingestion listener, if configured (config: ingest_listen)
+ *
+ * @param log              Log context
+ * @param cfg              Configuration
+ * @param dbc              Database connection used by the listener only
+ * @param msgq             POSIX MQ descriptor of the worker threads
+ * @param sched            Job scheduler
+ * @param workers          Worker pool
+ * @param settings         Published settings, providing the maximum report size
+ * @param shutdown         Pointer to the global shutdown flag
+ *
+ * @return Returns a pointer to an IngestListener on success, otherwise NULL
+ */
+IngestListener *ingest_start(LogContext *log, eurephiaVALUES *cfg, dbconn *dbc, mqd_t msgq,
+			     JobScheduler *sched, WorkerPool *workers,
+			     SettingsStore *settings, int *shutdown)
+{
+	IngestListener *ing = NULL;
+	const char *datadir = eGet_value(cfg, "datadir");
+	int rc;
+
+	ing = malloc_nullsafe(log, sizeof(IngestListener));
+	ing->log = log;
+	ing->dbc = dbc;
+	ing->msgq = msgq;
+	ing->sched = sched;
+	ing->workers = workers;
+	ing->settings = settings;
+	ing->max_conns = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "ingest_max_connections")), 8);
+	ing->shutdown = shutdown;
+	ing->listenfd = -1;
+	pthread_mutex_init(&ing->mtx_db, NULL);
+	pthread_mutex_init(&ing->mtx_conn, NULL);
+	pthread_cond_init(&ing->cond_conn, NULL);
+
+	// The same queue directory as used by the XML-RPC service
+	ing->queuedir = malloc_nullsafe(log, strlen_nullsafe(datadir) + 8);
+	sprintf(ing->queuedir, "%s/queue", (datadir ? datadir : ""));
+	if( (mkdir(ing->queuedir, 0700) < 0) && (errno != EEXIST) ) {
+		writelog(log, LOG_EMERG, "[Ingest] Could not create directory: %s (%s)",
+			 ing->queuedir, strerror(errno));
+		goto error;
+	}
+
+	if( ingest_listen(ing, eGet_value(cfg, "ingest_listen"),
+			  atoi_nullsafe(eGet_value(cfg, "ingest_allow_remote"))) < 0 ) {
+		goto error;
+	}
+
+	if( (rc = pthread_create(&ing->thread, NULL, ingest_listener, ing)) != 0 ) {
+		writelog(log, LOG_EMERG, "[Ingest] Could not start the listener thread: %s",
+			 strerror(rc));
+		goto error;
+	}
+	return ing;
+
+ error:
+	if( ing->listenfd >= 0 ) {
+		close(ing->listenfd);
+	}
+	free_nullsafe(ing->unixpath);
+	free_nullsafe(ing->queuedir);
+	free(ing);
+	return NULL;
+}
+
+
+/**
+ * Stops the report ingestion listener.  Waits for all active connections to complete.
+ *
+ * @param ing  IngestListener
+ */
+void ingest_stop(IngestListener *ing)
+{
+	if( !ing ) {
+		return;
+	}
+	ing->stop = 1;
+	pthread_join(ing->thread, NULL);
+
+	pthread_cond_destroy(&ing->cond_conn);
+	pthread_mutex_destroy(&ing->mtx_conn);
+	pthread_mutex_destroy(&ing->mtx_db);
+	free_nullsafe(ing->unixpath);
+	free_nullsafe(ing->queuedir);
+	free(ing);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   ingest.h
+ * @date   Sun Oct 18 18:12:40 2026
+ *
+ * @brief  Receives reports directly over a UNIX or TCP socket
+ *
+ */
+
+#ifndef _RTEVAL_INGEST_H
+#define _RTEVAL_INGEST_H
+
+#include <mqueue.h>
+
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <scheduler.h>
+#include <workerpool.h>
+#include <settings.h>
+
+#define INGEST_HEADER_MAX   512  /**< Maximum length of a request line */
+#define INGEST_TIMEOUT      30   /**< Seconds a client may be idle before being disconnected */
+#define INGEST_CLIENTID_MAX 128  /**< Maximum length of a client ID, see the submissionqueue table */
+#define INGEST_DB_CHECK_IDLE 30  /**< Seconds the database connection may be idle before it is checked */
+
+typedef struct _IngestListener IngestListener;
+
+IngestListener *ingest_start(LogContext *log, eurephiaVALUES *cfg, dbconn *dbc, mqd_t msgq,
+			     JobScheduler *sched, WorkerPool *workers,
+			     SettingsStore *settings, int *shutdown);
+void ingest_stop(IngestListener *ing);
+
+#endif
@@ -26,7 +26,9 @@
 #include <errno.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <time.h>
 #include <pthread.h>
+#include <sched.h>
 #include <syslog.h>
 
 #include <eurephia_nullsafe.h>
@@ -56,39 +58,109 @@ static struct {
 };
 
 
+#define LOGRING_SLOTS   256     /**< Number of log lines each per thread ring buffer can hold */
+#define LOGRING_MSGLEN  1024    /**< Maximum length of a log line queued in a ring buffer */
+#define LOGWRITER_BATCH 65536   /**< Size of the buffer the log writer collects lines into */
+#define LOGRING_TAKING  (~0ULL) /**< LogRing reserved value while the time stamp is taken */
+
+/**
+ * Monotonic time stamp in nanoseconds, as used by the reserved member of LogRing
+ */
+#define LOG_TS_NSEC(ts) ((unsigned long long) (ts)->tv_sec * 1000000000ULL + (ts)->tv_nsec)
+
+/**
+ * A single formatted log line, waiting in a ring buffer
+ */
+typedef struct {
+	struct timespec ts;        /**<  Monotonic time stamp, used to keep the lines in order */
+	unsigned int len;          /**<  Length of msg */
+	char msg[LOGRING_MSGLEN];  /**<  The formatted log line, including the line break */
+} LogRingSlot;
+
+/**
+ * Single producer/single consumer ring buffer.  Each thread writing to the log
+ * gets its own ring buffer, only the owner thread updates head and only the log
+ * writer thread updates tail.  Thus no locking is needed.
+ */
+typedef struct _LogRing {
+	unsigned int head;         /**<  Next slot to write to.  Only updated by the owner thread */
+	unsigned int tail;         /**<  Next slot to read from.  Only updated by the writer thread */
+	int orphaned;              /**<  Set when the owner thread has exited, the ring can be reused */
+	unsigned int dropped;      /**<  Log lines lost because the ring was full, reset by the writer */
+	unsigned long long reserved; /**< Time stamp of the line being queued, see log_async_queue() */
+	LogRingSlot slot[LOGRING_SLOTS]; /**< The queued log lines */
+	struct _LogRing *next;     /**<  Next ring buffer.  The list only grows while logging */
+} LogRing;
+
+/**
+ * State of the asynchronous log writer
+ */
+struct _LogAsync {
+	LogContext *lctx;          /**<  The log context the writer belongs to */
+	pthread_t writer;          /**<  The log writer thread */
+	pthread_mutex_t mtx_rings; /**<  Only taken when a new thread registers its ring buffer */
+	pthread_key_t ringkey;     /**<  Thread specific pointer to the threads own ring buffer */
+	LogRing *rings;            /**<  All registered ring buffers */
+	pthread_mutex_t mtx_drain; /**<  Serialises draining the ring buffers, protects batch */
+	pthread_mutex_t mtx_wake;  /**<  Used with cond_wake to wait for new log lines */
+	pthread_cond_t cond_wake;  /**<  Signalled when a log line is queued while the writer sleeps */
+	int sleeping;              /**<  Set while the writer thread waits on cond_wake */
+	int shutdown;              /**<  Set when the writer thread should drain and exit */
+	struct timespec last;      /**<  Time stamp of the last line written, protected by mtx_drain */
+	char batch[LOGWRITER_BATCH]; /**< Buffer where log lines are collected before writing */
+};
+
+
+/**
+ * Changes the log level of a log context.  Can be done while other threads are logging.
+ *
+ * @param lctx    Log context
+ * @param loglvl  The new log level.  Can be one of the values defined in syslog_prio_map.
+ *
+ * @return Returns 1 if the log level was changed, otherwise 0 (unknown or no log level)
+ */
+int log_set_level(LogContext *lctx, const char *loglvl) {
+	int i;
+
+	if( !lctx || !loglvl ) {
+		return 0;
+	}
+	for( i = 0; syslog_prio_map[i].priority_str; i++ ) {
+		if( strcasecmp(loglvl, syslog_prio_map[i].priority_str) == 0 ) {
+			__atomic_store_n(&lctx->verbosity, syslog_prio_map[i].prio_level,
+					 __ATOMIC_RELAXED);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
 /**
  * Initialises a log context.  It parses the log destination and log level and
  * prepares a context which can be used by writelog()
  *
  * @param logdest  String containing either syslog:[facility], stderr: or stdout:, or a file name.
  * @param loglvl   Defines the log level.  Can be one of the values defined in syslog_prio_map.
+ * @param async    If set, file and console logging will be done asynchronously once
+ *                 log_start_async() has been called.
  *
  * @return Returns a pointer to a log context on success, otherwise NULL.
  */
-LogContext *init_log(const char *logdest, const char *loglvl) {
+LogContext *init_log(const char *logdest, const char *loglvl, int async) {
 	LogContext *logctx = NULL;
-	int i;
 
 	logctx = (LogContext *) calloc(1, sizeof(LogContext)+2);
 	assert( logctx != NULL);
 
 	logctx->logfp = NULL;
+	logctx->async_req = async;
+	logctx->async = NULL;
+	clock_gettime(CLOCK_MONOTONIC, &logctx->started);
 
-	// Get the int value of the log level string
-	logctx->verbosity = -1;
-	if( loglvl ) {
-		for( i = 0; syslog_prio_map[i].priority_str; i++ ) {
-			if( strcasecmp(loglvl, syslog_prio_map[i].priority_str) == 0 ) {
-				logctx->verbosity = syslog_prio_map[i].prio_level;
-				break;
-			}
-		}
-	}
-
-	// If log level is not set, set LOG_INFo as default
-	if( logctx->verbosity == -1 ) {
-		logctx->verbosity = LOG_INFO;
-	}
+	// If log level is not set, set LOG_INFO as default
+	logctx->verbosity = LOG_INFO;
+	log_set_level(logctx, loglvl);
 
 	if( logdest == NULL ) {
 		logctx->logtype = ltSYSLOG;
@@ -145,6 +217,520 @@ LogContext *init_log(const char *logdest, const char *loglvl) {
 }
 
 
+/**
+ * Formats a complete log line, with time stamp and log level prefix, into a buffer.
+ *
+ * @param lctx    Log context
+ * @param ts      Monotonic time stamp of the log event
+ * @param loglvl  Log level
+ * @param buf     Destination buffer
+ * @param size    Size of the destination buffer
+ * @param fmt     Format string
+ * @param ap      Arguments to the format string
+ *
+ * @return Returns the length of the complete log line.  If this is equal or bigger than size,
+ *         the line was truncated.
+ */
+static int log_format_line(LogContext *lctx, struct timespec *ts, unsigned int loglvl,
+			   char *buf, size_t size, const char *fmt, va_list ap)
+{
+	const char *prefix = "";
+	long sec, nsec;
+	int len, msglen;
+
+	switch( loglvl ) {
+	case LOG_EMERG:
+		prefix = "**  EMERG  ERROR  ** ";
+		break;
+	case LOG_ALERT:
+		prefix = "**  ALERT  ERROR  ** ";
+		break;
+	case LOG_CRIT:
+		prefix = "** CRITICAL ERROR ** ";
+		break;
+	case LOG_ERR:
+		prefix = "** ERROR ** ";
+		break;
+	case LOG_WARNING:
+		prefix = "*WARNING* ";
+		break;
+	case LOG_NOTICE:
+		prefix = "[NOTICE] ";
+		break;
+	case LOG_INFO:
+		prefix = "[INFO]   ";
+		break;
+	case LOG_DEBUG:
+		prefix = "[DEBUG]  ";
+		break;
+	}
+
+	sec = ts->tv_sec - lctx->started.tv_sec;
+	nsec = ts->tv_nsec - lctx->started.tv_nsec;
+	if( nsec < 0 ) {
+		sec--;
+		nsec += 1000000000L;
+	}
+
+	len = snprintf(buf, size, "[%8ld.%06ld] %s", sec, nsec / 1000, prefix);
+	msglen = vsnprintf(buf + len, size - len - 1, fmt, ap);
+	len += msglen;
+	if( len < (size - 1) ) {
+		buf[len] = '\n';
+		buf[len+1] = '\0';
+	}
+	return len + 1;
+}
+
+
+/**
+ * Writes a log line directly to the log file or console.  Used when logging synchronously
+ * and for log lines too long for a ring buffer slot.
+ *
+ * @param lctx    Log context
+ * @param loglvl  Log level
+ * @param fmt     Format string
+ * @param ap      Arguments to the format string
+ */
+static void log_write_sync(LogContext *lctx, unsigned int loglvl, const char *fmt, va_list ap)
+{
+	char buf[2048], *line = buf;
+	struct timespec ts;
+	va_list ap_cp;
+	int len;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	va_copy(ap_cp, ap);
+	len = log_format_line(lctx, &ts, loglvl, buf, sizeof(buf), fmt, ap_cp);
+	va_end(ap_cp);
+	if( len >= sizeof(buf) ) {
+		// Too long for the stack buffer, format it again in a big enough buffer
+		line = malloc(len + 1);
+		if( !line ) {
+			// Write the truncated line, which lacks the line break
+			line = buf;
+			len = strlen(buf);
+		} else {
+			va_copy(ap_cp, ap);
+			len = log_format_line(lctx, &ts, loglvl, line, len + 1, fmt, ap_cp);
+			va_end(ap_cp);
+		}
+	}
+
+	pthread_mutex_lock(lctx->mtx_log);
+	fwrite(line, 1, len, lctx->logfp);
+	if( lctx->logtype == ltFILE ) {
+		fflush(lctx->logfp);
+	}
+	pthread_mutex_unlock(lctx->mtx_log);
+
+	if( line != buf ) {
+		free(line);
+	}
+}
+
+
+/**
+ * pthread key destructor, marks the ring buffer of an exiting thread as reusable
+ *
+ * @param ring  The LogRing of the exiting thread
+ */
+static void log_async_orphan(void *ring)
+{
+	__atomic_store_n(&((LogRing *) ring)->orphaned, 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Assigns a ring buffer to the calling thread.  Rings from exited threads are
+ * reused when they are drained, otherwise a new ring buffer is allocated.
+ *
+ * @param la  Asynchronous log writer state
+ *
+ * @return Returns a pointer to the threads ring buffer, or NULL on memory allocation failures
+ */
+static LogRing *log_async_register(LogAsync *la)
+{
+	LogRing *ring = NULL;
+
+	pthread_mutex_lock(&la->mtx_rings);
+	for( ring = la->rings; ring; ring = ring->next ) {
+		if( __atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE)
+		    && (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == ring->head) ) {
+			ring->orphaned = 0;
+			break;
+		}
+	}
+	if( !ring ) {
+		ring = (LogRing *) calloc(1, sizeof(LogRing));
+		if( !ring ) {
+			pthread_mutex_unlock(&la->mtx_rings);
+			return NULL;
+		}
+		ring->next = la->rings;
+		__atomic_store_n(&la->rings, ring, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&la->mtx_rings);
+
+	pthread_setspecific(la->ringkey, ring);
+	return ring;
+}
+
+
+/**
+ * Queues a log line in the calling threads ring buffer.
+ *
+ * @param lctx    Log context
+ * @param loglvl  Log level
+ * @param fmt     Format string
+ * @param ap      Arguments to the format string
+ *
+ * @return Returns 1 if the line was queued or dropped because the ring buffer is full.  If
+ *         the line is too long, 0 is returned and the caller must write the line synchronously,
+ *         after the queued lines have been flushed with log_async_flush().
+ */
+static int log_async_queue(LogContext *lctx, unsigned int loglvl, const char *fmt, va_list ap)
+{
+	LogAsync *la = lctx->async;
+	LogRing *ring = NULL;
+	LogRingSlot *slot = NULL;
+	unsigned int head;
+	va_list ap_cp;
+	int len;
+
+	ring = (LogRing *) pthread_getspecific(la->ringkey);
+	if( !ring && !(ring = log_async_register(la)) ) {
+		return 0;
+	}
+
+	head = ring->head;
+	if( (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) >= LOGRING_SLOTS ) {
+		// Never block the logging thread, the writer reports the lost lines
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return 1;
+	}
+
+	// Announce the line before its time stamp is taken.  Until it is published, the
+	// writer does not write lines from other threads with a later time stamp.
+	slot = &ring->slot[head % LOGRING_SLOTS];
+	__atomic_store_n(&ring->reserved, LOGRING_TAKING, __ATOMIC_SEQ_CST);
+	clock_gettime(CLOCK_MONOTONIC, &slot->ts);
+	__atomic_store_n(&ring->reserved, LOG_TS_NSEC(&slot->ts), __ATOMIC_SEQ_CST);
+	va_copy(ap_cp, ap);
+	len = log_format_line(lctx, &slot->ts, loglvl, slot->msg, LOGRING_MSGLEN, fmt, ap_cp);
+	va_end(ap_cp);
+	if( len >= LOGRING_MSGLEN ) {
+		__atomic_store_n(&ring->reserved, 0, __ATOMIC_RELEASE);
+		return 0;
+	}
+	slot->len = len;
+
+	// Publish the log line to the writer thread, and wake it up if it is waiting.
+	// Sequentially consistent, as the writer sets sleeping before it checks head.
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&ring->reserved, 0, __ATOMIC_RELEASE);
+	if( __atomic_load_n(&la->sleeping, __ATOMIC_SEQ_CST) ) {
+		pthread_mutex_lock(&la->mtx_wake);
+		pthread_cond_signal(&la->cond_wake);
+		pthread_mutex_unlock(&la->mtx_wake);
+	}
+	return 1;
+}
+
+
+/**
+ * Adds a log line generated by the log writer itself to the batch buffer.  It gets the
+ * time stamp of the last line written, as lines with earlier time stamps may still be queued.
+ * Must be called with mtx_drain held.
+ *
+ * @param la      Asynchronous log writer state
+ * @param used    Number of bytes already used in the batch buffer
+ * @param loglvl  Log level
+ * @param fmt     Format string
+ *
+ * @return Returns the new number of bytes used in the batch buffer
+ */
+static size_t log_async_note(LogAsync *la, size_t used, unsigned int loglvl, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	if( (LOGWRITER_BATCH - used) < LOGRING_MSGLEN ) {
+		pthread_mutex_lock(la->lctx->mtx_log);
+		fwrite(la->batch, 1, used, la->lctx->logfp);
+		pthread_mutex_unlock(la->lctx->mtx_log);
+		used = 0;
+	}
+	va_start(ap, fmt);
+	len = log_format_line(la->lctx, &la->last, loglvl, la->batch + used, LOGRING_MSGLEN, fmt, ap);
+	va_end(ap);
+	return used + (len < LOGRING_MSGLEN ? len : strlen(la->batch + used));
+}
+
+
+/**
+ * Writes all queued log lines from all ring buffers to the log, in time stamp order.
+ * Lines are collected and written in batches, with a single flush per batch.  The
+ * number of lines dropped since the last call is logged afterwards.  Must be called
+ * with mtx_drain held.
+ *
+ * Another thread may be queueing a line with an earlier time stamp than lines already
+ * queued.  Writing then stops before the first line later than that line, and the rest
+ * is written by a later call, once the line is published.
+ *
+ * @param la     Asynchronous log writer state
+ * @param final  If set, all queued lines are written regardless, used when stopping
+ *
+ * @return Returns the number of log lines written
+ */
+static unsigned int log_async_drain(LogAsync *la, int final)
+{
+	LogRing *rings = NULL, *r = NULL, *next = NULL;
+	LogRingSlot *slot = NULL, *nextslot = NULL;
+	unsigned int lines = 0, dropped = 0;
+	unsigned long long res;
+	size_t used = 0;
+	int wait = 0;
+
+	rings = __atomic_load_n(&la->rings, __ATOMIC_ACQUIRE);
+	while( 1 ) {
+		// Find the oldest queued log line among all ring buffers
+		next = NULL;
+		nextslot = NULL;
+		for( r = rings; r; r = r->next ) {
+			if( r->tail == __atomic_load_n(&r->head, __ATOMIC_SEQ_CST) ) {
+				continue;
+			}
+			slot = &r->slot[r->tail % LOGRING_SLOTS];
+			if( !nextslot || (slot->ts.tv_sec < nextslot->ts.tv_sec)
+			    || ((slot->ts.tv_sec == nextslot->ts.tv_sec)
+				&& (slot->ts.tv_nsec < nextslot->ts.tv_nsec)) ) {
+				next = r;
+				nextslot = slot;
+			}
+		}
+		if( !next ) {
+			break;
+		}
+
+		// Lines reserved after the heads were read above are later than the line found
+		for( r = rings; !final && !wait && r; r = r->next ) {
+			res = __atomic_load_n(&r->reserved, __ATOMIC_SEQ_CST);
+			wait = ((res == LOGRING_TAKING) || (res && (LOG_TS_NSEC(&nextslot->ts) > res)));
+		}
+		if( wait ) {
+			break;
+		}
+
+		if( (used + nextslot->len) > LOGWRITER_BATCH ) {
+			pthread_mutex_lock(la->lctx->mtx_log);
+			fwrite(la->batch, 1, used, la->lctx->logfp);
+			pthread_mutex_unlock(la->lctx->mtx_log);
+			used = 0;
+		}
+		memcpy(la->batch + used, nextslot->msg, nextslot->len);
+		used += nextslot->len;
+		la->last = nextslot->ts;
+		lines++;
+
+		// Release the slot back to the owner thread
+		__atomic_store_n(&next->tail, next->tail + 1, __ATOMIC_RELEASE);
+	}
+
+	for( r = rings; r; r = r->next ) {
+		dropped += __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED);
+	}
+	if( dropped > 0 ) {
+		used = log_async_note(la, used, LOG_WARNING,
+				      "%u log lines were dropped, as the log ring buffers were full",
+				      dropped);
+		lines++;
+	}
+
+	if( lines > 0 ) {
+		pthread_mutex_lock(la->lctx->mtx_log);
+		fwrite(la->batch, 1, used, la->lctx->logfp);
+		fflush(la->lctx->logfp);
+		pthread_mutex_unlock(la->lctx->mtx_log);
+	}
+	return lines;
+}
+
+
+/**
+ * Writes out all queued log lines from the calling thread.  Used before a log line is
+ * written directly, to keep the log in order.
+ *
+ * @param la  Asynchronous log writer state
+ */
+static void log_async_flush(LogAsync *la)
+{
+	LogRing *ring = (LogRing *) pthread_getspecific(la->ringkey);
+
+	pthread_mutex_lock(&la->mtx_drain);
+	log_async_drain(la, 0);
+	// Lines being queued by other threads may hold back the lines of this thread
+	while( ring && (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != ring->head) ) {
+		sched_yield();
+		log_async_drain(la, 0);
+	}
+	pthread_mutex_unlock(&la->mtx_drain);
+}
+
+
+/**
+ * Checks if any ring buffer has queued log lines or dropped lines to report
+ *
+ * @param la  Asynchronous log writer state
+ *
+ * @return Returns 1 if there is something to write, otherwise 0
+ */
+static int log_async_pending(LogAsync *la)
+{
+	LogRing *r = NULL;
+
+	for( r = __atomic_load_n(&la->rings, __ATOMIC_ACQUIRE); r; r = r->next ) {
+		if( (r->tail != __atomic_load_n(&r->head, __ATOMIC_SEQ_CST))
+		    || __atomic_load_n(&r->dropped, __ATOMIC_RELAXED) ) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * The log writer thread.  Drains the ring buffers until a shutdown is requested, and
+ * sleeps until a new log line is queued when there is nothing to write.
+ *
+ * @param data  Pointer to the LogAsync state
+ *
+ * @return Returns always NULL
+ */
+static void *log_async_writer(void *data)
+{
+	LogAsync *la = (LogAsync *) data;
+	unsigned int written;
+	int done = 0;
+
+	while( !done ) {
+		done = __atomic_load_n(&la->shutdown, __ATOMIC_ACQUIRE);
+		pthread_mutex_lock(&la->mtx_drain);
+		written = log_async_drain(la, done);
+		pthread_mutex_unlock(&la->mtx_drain);
+		if( done ) {
+			break;
+		}
+		if( (written == 0) && log_async_pending(la) ) {
+			// Held back by a line being queued, let that thread finish it
+			sched_yield();
+			continue;
+		}
+
+		// Announce the sleep before checking the rings again, so that a log line
+		// queued in between will signal the condition
+		pthread_mutex_lock(&la->mtx_wake);
+		__atomic_store_n(&la->sleeping, 1, __ATOMIC_SEQ_CST);
+		if( !log_async_pending(la) && !__atomic_load_n(&la->shutdown, __ATOMIC_ACQUIRE) ) {
+			pthread_cond_wait(&la->cond_wake, &la->mtx_wake);
+		}
+		__atomic_store_n(&la->sleeping, 0, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&la->mtx_wake);
+	}
+	return NULL;
+}
+
+
+/**
+ * Starts the asynchronous log writer, if asynchronous logging was requested to init_log().
+ * Only file and console logging can be done asynchronously.  This must be called after the
+ * process has been daemonised, as the writer thread will not survive a fork().
+ *
+ * @param lctx  Log context
+ *
+ * @return Returns 1 if the writer thread was started, 0 if logging is done synchronously
+ *         and -1 on errors.
+ */
+int log_start_async(LogContext *lctx)
+{
+	LogAsync *la = NULL;
+	int rc;
+
+	if( !lctx || !lctx->async_req || (lctx->logtype == ltSYSLOG) || lctx->async ) {
+		return 0;
+	}
+
+	la = (LogAsync *) calloc(1, sizeof(LogAsync));
+	if( !la ) {
+		writelog(lctx, LOG_ERR, "Could not allocate memory for the asynchronous log writer");
+		return -1;
+	}
+	la->lctx = lctx;
+	la->last = lctx->started;
+	pthread_mutex_init(&la->mtx_rings, NULL);
+	pthread_mutex_init(&la->mtx_drain, NULL);
+	pthread_mutex_init(&la->mtx_wake, NULL);
+	pthread_cond_init(&la->cond_wake, NULL);
+	if( (rc = pthread_key_create(&la->ringkey, log_async_orphan)) != 0 ) {
+		writelog(lctx, LOG_ERR, "Could not prepare the asynchronous log writer: %s",
+			 strerror(rc));
+		goto error;
+	}
+
+	if( (rc = pthread_create(&la->writer, NULL, log_async_writer, la)) != 0 ) {
+		writelog(lctx, LOG_ERR, "Could not start the asynchronous log writer: %s",
+			 strerror(rc));
+		pthread_key_delete(la->ringkey);
+		goto error;
+	}
+	__atomic_store_n(&lctx->async, la, __ATOMIC_RELEASE);
+	writelog(lctx, LOG_DEBUG, "Asynchronous logging started");
+	return 1;
+
+ error:
+	pthread_cond_destroy(&la->cond_wake);
+	pthread_mutex_destroy(&la->mtx_wake);
+	pthread_mutex_destroy(&la->mtx_drain);
+	pthread_mutex_destroy(&la->mtx_rings);
+	free_nullsafe(la);
+	return -1;
+}
+
+
+/**
+ * Stops the asynchronous log writer, writing out all queued log lines.
+ *
+ * @param lctx  Log context
+ */
+static void log_stop_async(LogContext *lctx)
+{
+	LogAsync *la = lctx->async;
+	LogRing *ring = NULL, *next = NULL;
+
+	if( !la ) {
+		return;
+	}
+
+	pthread_mutex_lock(&la->mtx_wake);
+	__atomic_store_n(&la->shutdown, 1, __ATOMIC_RELEASE);
+	pthread_cond_signal(&la->cond_wake);
+	pthread_mutex_unlock(&la->mtx_wake);
+	pthread_join(la->writer, NULL);
+	lctx->async = NULL;
+
+	for( ring = la->rings; ring; ring = next ) {
+		next = ring->next;
+		free(ring);
+	}
+	pthread_key_delete(la->ringkey);
+	pthread_cond_destroy(&la->cond_wake);
+	pthread_mutex_destroy(&la->mtx_wake);
+	pthread_mutex_destroy(&la->mtx_drain);
+	pthread_mutex_destroy(&la->mtx_rings);
+	free(la);
+}
+
+
 /**
  * Tears down a log context.  Closes log files and releases memory used by the log context.
  *
@@ -155,6 +741,7 @@ void close_log(LogContext *lctx) {
 		return;
 	}
 
+	log_stop_async(lctx);
 	switch( lctx->logtype ) {
 	case ltFILE:
 		fclose(lctx->logfp);
@@ -172,64 +759,36 @@ void close_log(LogContext *lctx) {
 
 
 /**
- * Write data to the log.
+ * Write data to the log.  Should be called via the writelog() macro, which
+ * checks the log level before any arguments are evaluated.
  *
  * @param lctx    Log context, where the data will be logged
  * @param loglvl  Log level.  See the priorities for syslog(3) for valid values.
  * @param fmt     Data to be logged (stdarg)
  */
-void writelog(LogContext *lctx, unsigned int loglvl, const char *fmt, ... ) {
-	if( !lctx || !fmt ) {
+void writelog_func(LogContext *lctx, unsigned int loglvl, const char *fmt, ... ) {
+	va_list ap;
+
+	if( !fmt || !log_enabled(lctx, loglvl) ) {
 		return;
 	}
 
-	if( lctx->verbosity >= loglvl ) {
-		va_list ap;
-
-		va_start(ap, fmt);
-		switch( lctx->logtype ) {
-		case ltSYSLOG:
-			vsyslog(loglvl, fmt, ap);
-			break;
-
-		case ltCONSOLE:
-		case ltFILE:
-			pthread_mutex_lock(lctx->mtx_log);
-			switch( loglvl ) {
-			case LOG_EMERG:
-				fprintf(lctx->logfp, "**  EMERG  ERROR  ** ");
-				break;
-			case LOG_ALERT:
-				fprintf(lctx->logfp, "**  ALERT  ERROR  ** ");
-				break;
-			case LOG_CRIT:
-				fprintf(lctx->logfp, "** CRITICAL ERROR ** ");
-				break;
-			case LOG_ERR:
-				fprintf(lctx->logfp, "** ERROR ** ");
-				break;
-			case LOG_WARNING:
-				fprintf(lctx->logfp, "*WARNING* ");
-				break;
-			case LOG_NOTICE:
-				fprintf(lctx->logfp, "[NOTICE] ");
-				break;
-			case LOG_INFO:
-				fprintf(lctx->logfp, "[INFO]   ");
-				break;
-			case LOG_DEBUG:
-				fprintf(lctx->logfp, "[DEBUG]  ");
-				break;
-			}
-			vfprintf(lctx->logfp, fmt, ap);
-			fprintf(lctx->logfp, "\n");
-			pthread_mutex_unlock(lctx->mtx_log);
+	va_start(ap, fmt);
+	switch( lctx->logtype ) {
+	case ltSYSLOG:
+		vsyslog(loglvl, fmt, ap);
+		break;
 
-			if( lctx->logtype == ltFILE ) {
-				fflush(lctx->logfp);
-			}
-			break;
+	case ltCONSOLE:
+	case ltFILE:
+		if( !lctx->async ) {
+			log_write_sync(lctx, loglvl, fmt, ap);
+		} else if( !log_async_queue(lctx, loglvl, fmt, ap) ) {
+			// Write out the lines queued before this one first
+			log_async_flush(lctx->async);
+			log_write_sync(lctx, loglvl, fmt, ap);
 		}
-		va_end(ap);
+		break;
 	}
+	va_end(ap);
 }
@@ -23,6 +23,8 @@
 #ifndef _RTEVAL_LOG_H
 #define _RTEVAL_LOG_H
 
+#include <stdio.h>
+#include <time.h>
 #include <pthread.h>
 #include <syslog.h>
 
@@ -31,6 +33,9 @@
  */
 typedef enum { ltSYSLOG, ltFILE, ltCONSOLE } LogType;
 
+/** Opaque state for the asynchronous log writer, see log.c */
+typedef struct _LogAsync LogAsync;
+
 /**
  * The log context structure.  Keeps needed information for
  * a flawless logging experience :-P
@@ -40,11 +45,42 @@ typedef struct {
 	FILE *logfp;               /**<  Only used if logging to stderr, stdout or a file */
 	unsigned int verbosity;    /**<  Defines which log level the user wants to log */
 	pthread_mutex_t *mtx_log;  /**<  Mutex to threads to write to a file based log in parallel */
+	struct timespec started;   /**<  Monotonic time stamp of when the log context was created */
+	int async_req;             /**<  Asynchronous logging requested, see log_start_async() */
+	LogAsync *async;           /**<  Asynchronous log writer, NULL when logging synchronously */
 } LogContext;
 
 
-LogContext *init_log(const char *fname, const char *loglvl);
+LogContext *init_log(const char *fname, const char *loglvl, int async);
+int log_start_async(LogContext *lctx);
+int log_set_level(LogContext *lctx, const char *loglvl);
 void close_log(LogContext *lctx);
-void writelog(LogContext *lctx, unsigned int loglvl, const char *fmt, ... );
+
+/**
+ * Checks if a message on the given log level will be logged, by comparing it to the
+ * configured log level.  The log level may be changed while other threads are logging.
+ *
+ * @param lctx    Log context
+ * @param loglvl  Log level to check
+ */
+#define log_enabled(lctx, loglvl)					\
+	((lctx) && ((int) (loglvl) <= (int) __atomic_load_n(&(lctx)->verbosity, __ATOMIC_RELAXED)))
+
+/**
+ * Write data to the log.  The log level is checked before the arguments are
+ * evaluated, thus no formatting work is done for messages which are not logged.
+ *
+ * @param lctx    Log context, where the data will be logged
+ * @param loglvl  Log level.  See the priorities for syslog(3) for valid values.
+ * @param fmt     Data to be logged (stdarg)
+ */
+#define writelog(lctx, loglvl, fmt...)					\
+	do {								\
+		LogContext *__lctx = (lctx);				\
+		if( log_enabled(__lctx, (loglvl)) ) {			\
+			writelog_func(__lctx, (loglvl), fmt);		\
+		}							\
+	} while(0)
+void writelog_func(LogContext *lctx, unsigned int loglvl, const char *fmt, ... );
 
 #endif
@@ -0,0 +1,745 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   memarena.c
+ * @date   Sun Oct 18 13:41:05 2026
+ *
+ * @brief  Per worker thread memory arenas, used by both the parser and libxml2
+ *
+ * A worker thread processing a report does a huge amount of small allocations,
+ * both directly and through libxml2/libxslt.  When memarena_setup() is called
+ * before libxml2 is initialised, all libxml2 allocations goes through the hooks
+ * in this file.  If the calling thread has activated an arena, memory is taken
+ * from large mmap()ed chunks owned by that thread, otherwise the ordinary
+ * heap is used.  Freeing arena memory is (mostly) a no-op, all of it is released
+ * at once by memarena_reset() when the job is completed.  A limited amount of
+ * chunks is kept for the next job, the rest is given back to the kernel.
+ *
+ * The libxml2 hooks are process wide, and libxml2/libxslt create some global
+ * state lazily.  libxml2 therefore only gets arena memory between memarena_begin()
+ * and memarena_end(), which is used around parsing a report and applying the XSLT
+ * template.  Everything else libxml2 allocates comes from the heap, while the
+ * *_arena() functions always use the active arena.  Each chunk counts its live
+ * allocations, and memarena_reset() keeps chunks which are still referenced
+ * mapped until the last allocation in them is freed.
+ *
+ * An arena may have a limit.  Allocations beyond the limit fail, and the arena
+ * is marked as exceeded until the next reset, so the job can be aborted.
+ *
+ * Every allocation is prefixed with a small header recording which arena owns
+ * it, so memory allocated from the heap and from any arena can be freed through
+ * the same functions.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <libxml/xmlmemory.h>
+#include <libxml/xmlerror.h>
+
+#include <eurephia_nullsafe.h>
+#include <memarena.h>
+
+#define MEMARENA_ALIGN 16                                                  /**< Alignment of all allocations */
+#define MEMARENA_ROUND(sz) (((sz) + (MEMARENA_ALIGN - 1)) & ~((size_t) MEMARENA_ALIGN - 1))
+
+/**
+ * A memory chunk mapped from the kernel.  The usable memory follows directly after this header.
+ */
+typedef struct _MemChunk {
+	struct _MemChunk *prev;    /**< Previous chunk in the list */
+	struct _MemChunk *next;    /**< Next chunk in the list */
+	size_t size;               /**< Usable size of this chunk */
+	size_t used;               /**< Bytes handed out from this chunk */
+	int dedicated;             /**< Set if this chunk holds a single large allocation */
+	int pinned;                /**< Set if this chunk outlived a reset, see memarena_reset() */
+	unsigned long live;        /**< Allocations in this chunk not freed yet, updated atomically */
+	MemArena *arena;           /**< Arena owning this chunk */
+} MemChunk;
+
+/**
+ * Header in front of each allocation
+ */
+typedef struct {
+	MemChunk *chunk;           /**< Chunk holding this allocation, NULL if allocated from the heap */
+	size_t size;               /**< Requested size */
+} MemHeader;
+
+#define CHUNK_HDR MEMARENA_ROUND(sizeof(MemChunk))
+#define MEM_HDR   MEMARENA_ROUND(sizeof(MemHeader))
+#define CHUNK_DATA(c) ((char *) (c) + CHUNK_HDR)
+#define MEM_HEADER(ptr) ((MemHeader *) ((char *) (ptr) - MEM_HDR))
+#define MEM_SPACE(sz) (MEM_HDR + MEMARENA_ROUND((sz) > 0 ? (sz) : 1))
+
+/**
+ * A memory arena.  Only used by the thread which activated it.
+ */
+struct _MemArena {
+	MemChunk *chunks;          /**< Chunks in use, the chunk allocations are done from is first */
+	MemChunk *spare;           /**< Empty chunks kept for reuse */
+	MemChunk *pinned;          /**< Chunks still referenced after a reset */
+	size_t chunksize;          /**< Usable size of each ordinary chunk */
+	size_t retain;             /**< Maximum bytes of spare chunks to keep on reset */
+	size_t spare_size;         /**< Bytes currently kept in spare chunks */
+	size_t inuse;              /**< Bytes handed out since the last reset */
+	size_t peak;               /**< Highest inuse value since the last reset */
+	size_t mapped;             /**< Bytes currently mapped from the kernel */
+	size_t limit;              /**< Maximum bytes handed out between resets, 0 for no limit */
+	int exceeded;              /**< Set when an allocation failed due to the limit */
+};
+
+static int hooks_installed = 0;                 /**< Set when libxml2 uses the hooks in this file */
+static LogContext *hooks_log = NULL;            /**< Log context used by the hooks */
+static unsigned long foreign_frees = 0;         /**< Arena memory freed by other threads than the owner */
+static __thread MemArena *current_arena = NULL; /**< The arena activated by this thread */
+static __thread unsigned int arena_depth = 0;   /**< Nesting level of memarena_begin() calls */
+
+
+/**
+ * Maps a new memory chunk from the kernel
+ *
+ * @param arena     Arena the chunk will belong to
+ * @param size      Usable size of the chunk
+ * @param dedicated Set to 1 if this chunk will hold a single allocation
+ *
+ * @return Returns a pointer to the new chunk on success, otherwise NULL
+ */
+static MemChunk *chunk_map(MemArena *arena, size_t size, int dedicated)
+{
+	MemChunk *c = NULL;
+
+	c = mmap(NULL, CHUNK_HDR + size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if( c == MAP_FAILED ) {
+		return NULL;
+	}
+	c->prev = c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	c->dedicated = dedicated;
+	c->pinned = 0;
+	c->live = 0;
+	c->arena = arena;
+	arena->mapped += CHUNK_HDR + size;
+	return c;
+}
+
+
+/**
+ * Returns a chunk to the kernel
+ *
+ * @param arena  Arena the chunk belongs to
+ * @param c      Chunk to unmap
+ */
+static void chunk_unmap(MemArena *arena, MemChunk *c)
+{
+	arena->mapped -= CHUNK_HDR + c->size;
+	munmap(c, CHUNK_HDR + c->size);
+}
+
+
+/**
+ * Removes a chunk from the list of chunks in use
+ *
+ * @param arena  Arena the chunk belongs to
+ * @param c      Chunk to unlink
+ */
+static void chunk_unlink(MemArena *arena, MemChunk *c)
+{
+	if( c->prev ) {
+		c->prev->next = c->next;
+	} else {
+		arena->chunks = c->next;
+	}
+	if( c->next ) {
+		c->next->prev = c->prev;
+	}
+	c->prev = c->next = NULL;
+}
+
+
+/**
+ * Allocates memory from an arena.  Allocations larger than a quarter of the chunk size
+ * gets a dedicated chunk, which is unmapped as soon as the allocation is freed.
+ *
+ * @param arena  Arena to allocate from
+ * @param size   Number of bytes requested
+ *
+ * @return Returns a pointer to the allocated memory, or NULL on errors
+ */
+static void *arena_alloc(MemArena *arena, size_t size)
+{
+	size_t need = MEM_SPACE(size);
+	MemChunk *c = arena->chunks;
+	MemHeader *h = NULL;
+
+	if( arena->limit && ((arena->inuse + need) > arena->limit) ) {
+		arena->exceeded = 1;
+		return NULL;
+	}
+
+	if( need > (arena->chunksize / 4) ) {
+		c = chunk_map(arena, need, 1);
+		if( !c ) {
+			return NULL;
+		}
+		// Keep the current chunk first in the list
+		if( arena->chunks && !arena->chunks->dedicated ) {
+			c->prev = arena->chunks;
+			c->next = arena->chunks->next;
+			if( c->next ) {
+				c->next->prev = c;
+			}
+			arena->chunks->next = c;
+		} else {
+			c->next = arena->chunks;
+			if( c->next ) {
+				c->next->prev = c;
+			}
+			arena->chunks = c;
+		}
+	} else if( !c || c->dedicated || ((c->size - c->used) < need) ) {
+		if( arena->spare ) {
+			c = arena->spare;
+			arena->spare = c->next;
+			arena->spare_size -= c->size;
+			c->used = 0;
+		} else {
+			c = chunk_map(arena, arena->chunksize, 0);
+			if( !c ) {
+				return NULL;
+			}
+		}
+		c->prev = NULL;
+		c->next = arena->chunks;
+		if( c->next ) {
+			c->next->prev = c;
+		}
+		arena->chunks = c;
+	}
+
+	h = (MemHeader *) (CHUNK_DATA(c) + c->used);
+	h->chunk = c;
+	h->size = size;
+	c->used += need;
+	__atomic_add_fetch(&c->live, 1, __ATOMIC_RELAXED);
+
+	arena->inuse += need;
+	if( arena->inuse > arena->peak ) {
+		arena->peak = arena->inuse;
+	}
+	return (char *) h + MEM_HDR;
+}
+
+
+/**
+ * Checks if the given allocation is the last one done from the current chunk
+ *
+ * @param arena  Arena owning the allocation
+ * @param h      Header of the allocation
+ *
+ * @return Returns the chunk if this was the latest allocation, otherwise NULL
+ */
+static inline MemChunk *arena_last_alloc(MemArena *arena, MemHeader *h)
+{
+	MemChunk *c = arena->chunks;
+
+	if( c && !c->dedicated && ((char *) h + MEM_SPACE(h->size) == CHUNK_DATA(c) + c->used) ) {
+		return c;
+	}
+	return NULL;
+}
+
+
+/**
+ * Allocates memory with an allocation header from the heap
+ *
+ * @param size  Number of bytes to allocate
+ *
+ * @return Returns a pointer to the allocated memory, or NULL on errors
+ */
+static void *heap_alloc(size_t size)
+{
+	MemHeader *h = NULL;
+
+	h = malloc(MEM_HDR + size);
+	if( !h ) {
+		return NULL;
+	}
+	h->chunk = NULL;
+	h->size = size;
+	return (char *) h + MEM_HDR;
+}
+
+
+/**
+ * malloc() replacement, used by libxml2 and malloc_arena().  The arena is only used
+ * between memarena_begin() and memarena_end().
+ *
+ * @param size  Number of bytes to allocate
+ *
+ * @return Returns a pointer to the allocated memory, or NULL on errors
+ */
+static void *hook_malloc(size_t size)
+{
+	if( current_arena && arena_depth ) {
+		return arena_alloc(current_arena, size);
+	}
+	return heap_alloc(size);
+}
+
+
+/**
+ * free() replacement, used by libxml2 and memarena_release().  Arena memory is only
+ * given back if it is the most recent allocation or if it has a dedicated chunk, the rest
+ * is released by memarena_reset().
+ *
+ * @param ptr  Pointer to the memory to free
+ */
+static void hook_free(void *ptr)
+{
+	MemHeader *h = NULL;
+	MemArena *arena = NULL;
+	MemChunk *c = NULL;
+
+	if( !ptr ) {
+		return;
+	}
+
+	h = MEM_HEADER(ptr);
+	c = h->chunk;
+	if( !c ) {
+		free(h);
+		return;
+	}
+	arena = c->arena;
+	__atomic_sub_fetch(&c->live, 1, __ATOMIC_RELEASE);
+
+	// Arenas are not thread safe, only the owning thread may modify it.  Memory of another
+	// arena is left alone, but this means something outlived the job which allocated it.
+	if( arena != current_arena ) {
+		unsigned long cnt = __atomic_add_fetch(&foreign_frees, 1, __ATOMIC_RELAXED);
+
+		// Log the first occurences, then less and less often
+		if( (cnt & (cnt - 1)) == 0 ) {
+			writelog(hooks_log, LOG_WARNING,
+				 "Memory arena: %lu byte(s) at %p freed by another thread than "
+				 "the arena owner (%lu such frees so far)", (unsigned long) h->size, ptr, cnt);
+		}
+		return;
+	}
+
+	if( c->pinned ) {
+		// Unmapped by memarena_reset() when all allocations in it are freed
+		return;
+	}
+	if( c->dedicated ) {
+		arena->inuse -= MEM_SPACE(h->size);
+		chunk_unlink(arena, c);
+		chunk_unmap(arena, c);
+	} else if( (c = arena_last_alloc(arena, h)) ) {
+		c->used -= MEM_SPACE(h->size);
+		arena->inuse -= MEM_SPACE(h->size);
+	}
+}
+
+
+/**
+ * realloc() replacement, used by libxml2 and realloc_arena().  If the memory region is the most
+ * recent arena allocation and there is room in the chunk, the region is extended in place.
+ *
+ * @param ptr   Pointer to the memory to resize
+ * @param size  New size of the memory region
+ *
+ * @return Returns a pointer to the resized memory region, or NULL on errors
+ */
+static void *hook_realloc(void *ptr, size_t size)
+{
+	MemHeader *h = NULL;
+	MemArena *arena = NULL;
+	MemChunk *c = NULL;
+	void *newptr = NULL;
+
+	if( !ptr ) {
+		return hook_malloc(size);
+	}
+
+	h = MEM_HEADER(ptr);
+	if( !h->chunk ) {
+		h = realloc(h, MEM_HDR + size);
+		if( !h ) {
+			return NULL;
+		}
+		h->size = size;
+		return (char *) h + MEM_HDR;
+	}
+
+	arena = h->chunk->arena;
+	if( (arena == current_arena) && (c = arena_last_alloc(arena, h)) ) {
+		size_t oldspace = MEM_SPACE(h->size), newspace = MEM_SPACE(size);
+
+		if( (newspace <= (arena->chunksize / 4))
+		    && ((c->used - oldspace + newspace) <= c->size) ) {
+			c->used = c->used - oldspace + newspace;
+			arena->inuse = arena->inuse - oldspace + newspace;
+			if( arena->inuse > arena->peak ) {
+				arena->peak = arena->inuse;
+			}
+			h->size = size;
+			return ptr;
+		}
+	} else if( size <= h->size ) {
+		return ptr;
+	}
+
+	newptr = hook_malloc(size);
+	if( !newptr ) {
+		return NULL;
+	}
+	memcpy(newptr, ptr, (size < h->size ? size : h->size));
+	hook_free(ptr);
+	return newptr;
+}
+
+
+/**
+ * strdup() replacement, used by libxml2 and strdup_arena()
+ *
+ * @param str  String to duplicate
+ *
+ * @return Returns a pointer to the new string, or NULL on errors
+ */
+static char *hook_strdup(const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *ret = NULL;
+
+	ret = hook_malloc(len);
+	if( ret ) {
+		memcpy(ret, str, len);
+	}
+	return ret;
+}
+
+
+/**
+ * Makes libxml2 use the arena aware memory functions.  This must be called before any other
+ * libxml2 or libxslt function, including xmlInitParser() and xsltInit().
+ *
+ * @param log  Log context, used to report misuse of arena memory
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+int memarena_setup(LogContext *log)
+{
+	if( xmlMemSetup(hook_free, hook_malloc, hook_realloc, hook_strdup) != 0 ) {
+		return -1;
+	}
+	hooks_log = log;
+	hooks_installed = 1;
+	return 1;
+}
+
+
+/**
+ * Creates a new memory arena.  No memory is mapped before the first allocation, so the
+ * memory will be local to the thread using it.
+ *
+ * @param chunksize  Size of each memory chunk
+ * @param retain     Maximum amount of memory to keep mapped after a reset
+ *
+ * @return Returns a pointer to the new arena on success, otherwise NULL
+ */
+MemArena *memarena_new(size_t chunksize, size_t retain)
+{
+	MemArena *arena = NULL;
+
+	arena = calloc(1, sizeof(MemArena));
+	if( !arena ) {
+		return NULL;
+	}
+	arena->chunksize = MEMARENA_ROUND(chunksize > 0 ? chunksize : MEMARENA_DEFAULT_CHUNK);
+	arena->retain = retain;
+	return arena;
+}
+
+
+/**
+ * Makes the calling thread allocate memory from the given arena.
+ *
+ * @param arena  Arena to use, NULL makes the thread use the heap
+ */
+void memarena_activate(MemArena *arena)
+{
+	current_arena = arena;
+}
+
+
+/**
+ * Lets libxml2 allocate from the active arena of the calling thread, until memarena_end()
+ * is called.  Calls may be nested.  Only use this around code producing data which is
+ * released before the arena is reset, such as parsing a report or applying the XSLT template.
+ */
+void memarena_begin(void)
+{
+	arena_depth++;
+}
+
+
+/**
+ * Ends a memarena_begin() section, libxml2 allocates from the heap again
+ */
+void memarena_end(void)
+{
+	if( arena_depth > 0 ) {
+		arena_depth--;
+	}
+}
+
+
+/**
+ * Releases all memory allocated from an arena.  Chunks up to the retain limit are kept
+ * for reuse, the rest is unmapped.  Chunks with allocations which are not freed yet are
+ * left mapped and are not reused, as something may still refer to them.  They are unmapped
+ * by a later reset, once all allocations in them have been freed.
+ *
+ * @param arena  Arena to reset
+ */
+void memarena_reset(MemArena *arena)
+{
+	MemChunk *c = NULL, *next = NULL, **pc = NULL;
+	unsigned long live = 0, pinned = 0;
+
+	if( !arena ) {
+		return;
+	}
+
+	// libxml2 keeps the last error per thread, which may point into the arena
+	if( arena == current_arena ) {
+		xmlResetLastError();
+	}
+
+	// Release the chunks left from earlier resets which are no longer referenced
+	pc = &arena->pinned;
+	while( (c = *pc) ) {
+		if( __atomic_load_n(&c->live, __ATOMIC_ACQUIRE) == 0 ) {
+			*pc = c->next;
+			chunk_unmap(arena, c);
+		} else {
+			pc = &c->next;
+		}
+	}
+
+	for( c = arena->chunks; c; c = next ) {
+		unsigned long cnt = __atomic_load_n(&c->live, __ATOMIC_ACQUIRE);
+
+		next = c->next;
+		if( cnt > 0 ) {
+			c->pinned = 1;
+			c->prev = NULL;
+			c->next = arena->pinned;
+			arena->pinned = c;
+			live += cnt;
+			pinned++;
+		} else if( !c->dedicated && ((arena->spare_size + c->size) <= arena->retain) ) {
+			c->used = 0;
+			c->prev = NULL;
+			c->next = arena->spare;
+			arena->spare = c;
+			arena->spare_size += c->size;
+		} else {
+			chunk_unmap(arena, c);
+		}
+	}
+	arena->chunks = NULL;
+	arena->inuse = 0;
+	arena->peak = 0;
+	arena->exceeded = 0;
+
+	if( pinned > 0 ) {
+		writelog(hooks_log, LOG_WARNING,
+			 "Memory arena: %lu allocation(s) outlived the report, keeping %lu chunk(s) "
+			 "mapped until they are freed", live, pinned);
+	}
+}
+
+
+/**
+ * Releases all memory used by an arena, including the arena itself
+ *
+ * @param arena  Arena to destroy
+ */
+void memarena_destroy(MemArena *arena)
+{
+	MemChunk *c = NULL, *next = NULL;
+
+	if( !arena ) {
+		return;
+	}
+
+	memarena_reset(arena);
+	for( c = arena->spare; c; c = next ) {
+		next = c->next;
+		chunk_unmap(arena, c);
+	}
+	arena->spare = NULL;
+
+	// The chunks still referenced point at the arena, so neither can be released
+	if( arena->pinned ) {
+		writelog(hooks_log, LOG_WARNING,
+			 "Memory arena: %lu byte(s) still referenced, not released", (unsigned long) arena->mapped);
+		return;
+	}
+	free(arena);
+}
+
+
+/**
+ * Limits the memory handed out by an arena between two resets
+ *
+ * @param arena  Arena to limit
+ * @param limit  Maximum number of bytes, 0 for no limit
+ */
+void memarena_set_limit(MemArena *arena, size_t limit)
+{
+	arena->limit = limit;
+}
+
+
+/**
+ * Checks if an allocation failed due to the arena limit since the last reset
+ *
+ * @param arena  Arena to check, may be NULL
+ *
+ * @return Returns 1 if the limit was exceeded, otherwise 0
+ */
+int memarena_exceeded(MemArena *arena)
+{
+	return (arena && arena->exceeded);
+}
+
+
+/**
+ * Retrieves the memory usage of an arena
+ *
+ * @param arena   Arena to inspect
+ * @param inuse   Return pointer for bytes allocated since the last reset
+ * @param peak    Return pointer for the highest allocation level since the last reset
+ * @param mapped  Return pointer for bytes mapped from the kernel
+ */
+void memarena_usage(MemArena *arena, size_t *inuse, size_t *peak, size_t *mapped)
+{
+	*inuse = arena->inuse;
+	*peak = arena->peak;
+	*mapped = arena->mapped;
+}
+
+
+/**
+ * Arena aware replacement of malloc_nullsafe().  Allocates from the current arena of the
+ * calling thread, if arenas are enabled, also outside memarena_begin() sections.  The memory region is zero'd.
+ *
+ * @param log   Log context
+ * @param sz    Size of the memory region being allocated
+ *
+ * @return Returns a void pointer to the memory region on success, otherwise NULL
+ */
+void *malloc_arena(LogContext *log, size_t sz)
+{
+	void *buf = NULL;
+
+	if( !hooks_installed ) {
+		return malloc_nullsafe(log, sz);
+	}
+
+	arena_depth++;
+	buf = hook_malloc(sz);
+	arena_depth--;
+	if( !buf && current_arena && current_arena->exceeded ) {
+		// The job is aborted due to the arena limit, but the parser's own
+		// allocations must not fail.
+		buf = heap_alloc(sz);
+	}
+	if( !buf ) {
+		writelog(log, LOG_EMERG, "Could not allocate memory region for %ld bytes", sz);
+		exit(9);
+	}
+	memset(buf, 0, sz);
+	return buf;
+}
+
+
+/**
+ * Arena aware replacement of realloc()
+ *
+ * @param ptr  Memory region allocated with any of the *_arena() functions
+ * @param sz   New size of the memory region
+ *
+ * @return Returns a pointer to the resized memory region, or NULL on errors
+ */
+void *realloc_arena(void *ptr, size_t sz)
+{
+	void *ret = NULL;
+
+	if( !hooks_installed ) {
+		return realloc(ptr, sz);
+	}
+	arena_depth++;
+	ret = hook_realloc(ptr, sz);
+	arena_depth--;
+	return ret;
+}
+
+
+/**
+ * Arena aware replacement of strdup_nullsafe()
+ *
+ * @param str  String to duplicate, may be NULL
+ *
+ * @return Returns a pointer to the duplicated string.  If the input is NULL, NULL is returned.
+ */
+char *strdup_arena(const char *str)
+{
+	char *ret = NULL;
+
+	if( !str ) {
+		return NULL;
+	}
+	if( !hooks_installed ) {
+		return strdup(str);
+	}
+	arena_depth++;
+	ret = hook_strdup(str);
+	arena_depth--;
+	return ret;
+}
+
+
+/**
+ * Frees memory allocated by any of the *_arena() functions.  Use the free_arena() macro instead
+ * of calling this function directly.
+ *
+ * @param ptr  Pointer to the memory region to free
+ */
+void memarena_release(void *ptr)
+{
+	if( hooks_installed ) {
+		hook_free(ptr);
+	} else {
+		free(ptr);
+	}
+}
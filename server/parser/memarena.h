@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   memarena.h
+ * @date   Sun Oct 18 13:41:05 2026
+ *
+ * @brief  Per worker thread memory arenas, used by both the parser and libxml2
+ *
+ */
+
+#ifndef _RTEVAL_MEMARENA_H
+#define _RTEVAL_MEMARENA_H
+
+#include <sys/types.h>
+#include <log.h>
+
+#define MEMARENA_DEFAULT_CHUNK  1048576   /**< Default arena chunk size (1MB) */
+#define MEMARENA_DEFAULT_RETAIN 33554432  /**< Default amount of memory kept between jobs (32MB) */
+
+typedef struct _MemArena MemArena;
+
+int memarena_setup(LogContext *log);
+MemArena *memarena_new(size_t chunksize, size_t retain);
+void memarena_activate(MemArena *arena);
+void memarena_begin(void);
+void memarena_end(void);
+void memarena_reset(MemArena *arena);
+void memarena_destroy(MemArena *arena);
+void memarena_set_limit(MemArena *arena, size_t limit);
+int memarena_exceeded(MemArena *arena);
+void memarena_usage(MemArena *arena, size_t *inuse, size_t *peak, size_t *mapped);
+
+void *malloc_arena(LogContext *log, size_t sz);
+void *realloc_arena(void *ptr, size_t sz);
+char *strdup_arena(const char *str);
+void memarena_release(void *ptr);
+
+/**
+ * Null safe free() for memory allocated by malloc_arena(), realloc_arena(), strdup_arena()
+ * or any of the libxml2 allocation functions.
+ *
+ * @param ptr Pointer to the memory region being freed.
+ *
+ */
+#define free_arena(ptr) if( ptr ) { memarena_release(ptr); ptr = NULL; }
+
+#endif
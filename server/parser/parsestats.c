@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   parsestats.c
+ * @date   Sun Oct 18 10:14:22 2026
+ *
+ * @brief  Collects timing and volume information while processing a submission
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <parsestats.h>
+
+/**
+ * Resets a parseStats_t structure
+ *
+ * @param stats  Pointer to the statistics to reset
+ */
+void parsestats_init(parseStats_t *stats)
+{
+	memset(stats, 0, sizeof(parseStats_t));
+}
+
+
+/**
+ * Records the current time from the monotonic clock, to be used by parsestats_elapsed()
+ *
+ * @param start  Pointer to where to store the start time
+ */
+void parsestats_timer_start(struct timespec *start)
+{
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+
+/**
+ * Calculates how much time has passed since parsestats_timer_start() was called
+ *
+ * @param start  Pointer to the start time
+ *
+ * @return Returns the elapsed time in seconds
+ */
+double parsestats_elapsed(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) (now.tv_sec - start->tv_sec)
+		+ ((double) (now.tv_nsec - start->tv_nsec) / 1000000000.0);
+}
+
+
+/**
+ * Adds inserted records to the per table counters.  If the table is not seen before,
+ * a new counter is added.  Tables beyond PARSESTATS_MAX_TABLES are silently ignored.
+ *
+ * @param stats  Pointer to the statistics of the current submission. May be NULL.
+ * @param table  Table name the records was inserted into
+ * @param rows   Number of inserted records
+ */
+void parsestats_add_rows(parseStats_t *stats, const char *table, unsigned int rows)
+{
+	unsigned int i;
+
+	if( !stats || !table ) {
+		return;
+	}
+
+	for( i = 0; i < stats->numtables; i++ ) {
+		if( strcmp(stats->tables[i].table, table) == 0 ) {
+			stats->tables[i].rows += rows;
+			return;
+		}
+	}
+
+	if( stats->numtables < PARSESTATS_MAX_TABLES ) {
+		snprintf(stats->tables[i].table, sizeof(stats->tables[i].table), "%s", table);
+		stats->tables[i].rows = rows;
+		stats->numtables++;
+	}
+}
+
+
+/**
+ * Sums up all records inserted for a submission
+ *
+ * @param stats  Pointer to the statistics of the current submission
+ *
+ * @return Returns the total number of records inserted
+ */
+unsigned int parsestats_total_rows(parseStats_t *stats)
+{
+	unsigned int i, ret = 0;
+
+	for( i = 0; i < stats->numtables; i++ ) {
+		ret += stats->tables[i].rows;
+	}
+	return ret;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   parsestats.h
+ * @date   Sun Oct 18 10:14:22 2026
+ *
+ * @brief  Collects timing and volume information while processing a submission
+ *
+ */
+
+#ifndef _RTEVAL_PARSESTATS_H
+#define _RTEVAL_PARSESTATS_H
+
+#include <sys/types.h>
+#include <time.h>
+
+#define PARSESTATS_MAX_TABLES 32   /**< Maximum number of tables tracked per submission */
+
+/**
+ * Number of records inserted into a single table
+ */
+typedef struct {
+	char table[64];            /**< Table name */
+	unsigned int rows;         /**< Number of records inserted */
+} parseStatsTable_t;
+
+/**
+ * Statistics for a single submission.  All times are in seconds.
+ */
+typedef struct {
+	off_t report_size;         /**< Size of the report file, in bytes */
+	unsigned int lane;         /**< Scheduler lane the submission was dispatched in */
+	double queue_wait;         /**< Time waiting for a worker thread */
+	unsigned int attempt;      /**< Failed attempts before this one */
+	double parse_time;         /**< Time spent parsing the XML report */
+	double transform_time;     /**< Time spent in XSLT transformations */
+	double insert_time;        /**< Time spent inserting records into the database */
+	double commit_time;        /**< Time spent on the final COMMIT */
+	unsigned int numtables;    /**< Number of used elements in tables */
+	parseStatsTable_t tables[PARSESTATS_MAX_TABLES]; /**< Records inserted per table */
+} parseStats_t;
+
+void parsestats_init(parseStats_t *stats);
+void parsestats_timer_start(struct timespec *start);
+double parsestats_elapsed(struct timespec *start);
+void parsestats_add_rows(parseStats_t *stats, const char *table, unsigned int rows);
+unsigned int parsestats_total_rows(parseStats_t *stats);
+
+#endif
@@ -27,8 +27,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <time.h>
 #include <pthread.h>
-#include <libgen.h>
 #include <errno.h>
 #include <assert.h>
 
@@ -38,194 +38,127 @@
 #include <log.h>
 #include <threadinfo.h>
 #include <statuses.h>
-
-
-/**
- * Does the same job as 'mkdir -p', but it expects a complete filename as input, and it will
- * extract the directory path from that filename
- *
- * @param fname  Full filename containing the directory the report will reside.
- *
- * @return Returns 1 on success, otherwise -1
- */
-static int make_report_dir(LogContext *log, const char *fname) {
-	char *fname_cp = NULL, *dname = NULL, *chkdir = NULL;
-	char *tok = NULL, *saveptr = NULL;
-	int ret = 0;
-	struct stat info;
-
-	if( !fname ) {
-		return 0;
-	}
-
-	fname_cp = strdup(fname);
-	assert( fname_cp != NULL );
-	dname = dirname(fname_cp);
-	chkdir = malloc_nullsafe(log, strlen(dname)+8);
-
-	if( dname[0] == '/' ) {
-		chkdir[0] = '/';
-	}
-
-	// Traverse the directory path, and make sure the directory exists
-	tok = strtok_r(dname, "/", &saveptr);
-	while( tok ) {
-		strcat(chkdir, tok);
-		strcat(chkdir, "/");
-
-		errno = 0;
-		// Check if directory exists
-		if( (stat(chkdir, &info) < 0) ) {
-			switch( errno ) {
-			case ENOENT: // If the directory do not exist, create it
-				if( mkdir(chkdir, 0755) < 0 ) {
-					// If creating dir failed, report error
-					writelog(log, LOG_ALERT,
-						 "Could not create directory: %s (%s)",
-						 chkdir, strerror(errno));
-					ret = -1;
-					goto exit;
-				}
-				break;
-			default: // If other failure, report that and exit
-				writelog(log, LOG_ALERT,
-					 "Could not access directory: %s (%s)",
-					 chkdir, strerror(errno));
-				ret = -1;
-				goto exit;
-			}
-		}
-		// Goto next path element
-		tok = strtok_r(NULL, "/", &saveptr);
-	}
-	ret = 1;
- exit:
-	free_nullsafe(fname_cp);
-	free_nullsafe(chkdir);
-
-	return ret;
-}
-
-
-/**
- * Builds up a proper full path of where to save the report.
- *
- * @param destdir   Destination directory for all reports
- * @param fname     Report filename, containing hostname of the reporter
- * @param rterid    rteval run ID
- *
- * @return Returns a pointer to a string with the new full path filename on success, otherwise NULL.
- */
-static char *get_destination_path(LogContext *log, const char *destdir,
-				  parseJob_t *job, const int rterid)
-{
-        char *newfname = NULL;
-        int retlen = 0;
-
-        if( !job || rterid < 0 ) {
-                return NULL;
-        }
-
-        retlen = strlen_nullsafe(job->clientid) + strlen(destdir) + 24;
-        newfname = malloc_nullsafe(log, retlen+2);
-
-        snprintf(newfname, retlen, "%s/%s/report-%i.xml", destdir, job->clientid, rterid);
-
-        return newfname;
-}
-
-
-/**
- * Checks if the file size of the given file is below the given max size value.
- *
- * @param thrdata  Pointer to a threadData_t structure with log context and max_report_size setting
- * @param fname    Filename of the file to check
- *
- * @return Returns 1 if file is within the limit, otherwise 0.  On errors -1 is returned.
- */
-inline int check_filesize(threadData_t *thrdata, const char *fname) {
-	struct stat info;
-
-	if( !fname ) {
-		return 0;
-	}
-
-	errno = 0;
-	if( (stat(fname, &info) < 0) ) {
-		writelog(thrdata->dbc->log, LOG_ERR, "Failed to check report file '%s': %s",
-			 fname, strerror(errno));
-		return -1;
-	}
-
-	return (info.st_size <= thrdata->max_report_size);
-}
+#include <parsestats.h>
+#include <probes.h>
+#include <memarena.h>
+#include <reportfile.h>
+#include <archive.h>
+#include <workerpool.h>
+#include <scheduler.h>
+#include <dbpool.h>
+#include <retry.h>
+#include <watchdog.h>
+#include <settings.h>
+#include <shard.h>
 
 
 /**
  * The core parse function.  Parses an XML file and stores it in the database according to
  * the xmlparser.xsl template.
  *
- * @param thrdata  Pointer to a threadData_t structure with database connection, log context, settings, etc
+ * @param thrdata  Pointer to a threadData_t structure with database connections, log context, settings, etc
  * @param job      Pointer to a parseJob_t structure containing the job information
+ * @param stats    Timing and record counts of the report are collected here
  *
  * @return Return values:
  * @code
  *          STAT_SUCCESS  : Successfully registered report
- *          STAT_FTOOBIG  : XML report file is too big
+ *          STAT_FTOOBIG  : XML report file is too big, or too big when decompressed
  *          STAT_XMLFAIL  : Could not parse the XML report file
  *          STAT_SYSREG   : Failed to register the system into the systems or systems_hostname tables
+ *                          or could not find the shard database of the report
  *          STAT_RTERIDREG: Failed to get a new rterid value
- *          STAT_GENDB    : Failed to start an SQL transaction (BEGIN)
+ *          STAT_GENDB    : Failed to start an SQL transaction (BEGIN), or no database connection
  *          STAT_RTEVRUNS : Failed to register the rteval run into rtevalruns or rtevalruns_details
  *          STAT_MEASURE  : Failed to register the measurement data into tables their corresponding tables
- *          STAT_REPMOVE  : Failed to move the report file
+ *          STAT_REPMOVE  : Failed to prepare archiving of the report file
+ *          STAT_DUPLICATE: The snapshot report is already registered
  * @endcode
  */
-inline int parse_report(threadData_t *thrdata, parseJob_t *job)
+inline int parse_report(threadData_t *thrdata, parseJob_t *job, parseStats_t *stats)
 {
 	int syskey = -1, rterid = -1;
-	int rc = -1;
-	xmlDoc *repxml = NULL;
-	char *destfname;
-
-	// Check file size - and reject too big files
-	if( check_filesize(thrdata, job->filename) == 0 ) {
-		writelog(thrdata->dbc->log, LOG_ERR,
+	int rc = -1, snapshot = 0, newrun = 1, latest = 1;
+	reportSnapshot snap;
+	DbPool *dbpool = NULL;
+	xmlDoc *repxml = NULL, *sysinfo = NULL;
+	ArchiveJob *archjob = NULL;
+	struct timespec tstart;
+	reportFile rf;
+	int rfres = 0;
+
+	// Open the report - and reject too big files
+	rfres = reportfile_open(thrdata->log, &rf, job->filename, thrdata->settings->max_report_size);
+	if( stats ) {
+		stats->report_size = rf.size;
+	}
+	if( rfres == 0 ) {
+		writelog(thrdata->log, LOG_ERR,
 			 "[Thread %i] (submid: %i) Report file '%s' is too big, rejected",
 			 thrdata->id, job->submid, job->filename);
 		return STAT_FTOOBIG;
 	}
+	PROBE3(parse__start, job->submid, job->filename, rf.size);
 
-
-	repxml = xmlParseFile(job->filename);
+	parsestats_timer_start(&tstart);
+	repxml = reportfile_parse(thrdata->log, &rf, thrdata->xmldict);
+	reportfile_close(&rf);
+	if( stats ) {
+		stats->parse_time = parsestats_elapsed(&tstart);
+	}
+	PROBE2(xmlparse__done, job->submid, (repxml != NULL));
+	if( !repxml && rf.toobig ) {
+		writelog(thrdata->log, LOG_ERR,
+			 "[Thread %i] (submid: %i) Decompressed report '%s' is too big, rejected",
+			 thrdata->id, job->submid, job->filename);
+		return STAT_FTOOBIG;
+	}
 	if( !repxml ) {
-		writelog(thrdata->dbc->log, LOG_ERR,
+		writelog(thrdata->log, LOG_ERR,
 			 "[Thread %i] (submid: %i) Could not parse XML file: %s",
 			 thrdata->id, job->submid, job->filename);
 	        return STAT_XMLFAIL;
 	}
 
-	pthread_mutex_lock(thrdata->mtx_sysreg);
-	syskey = db_register_system(thrdata->dbc, thrdata->xslt, repxml);
-	if( syskey < 0 ) {
-		writelog(thrdata->dbc->log, LOG_ERR,
-			 "[Thread %i] Failed to register system (submid: %i, XML file: %s)",
+	// Snapshots of a long rteval run are added to the same rteval run
+	snapshot = reportGetSnapshot(thrdata->log, repxml, &snap);
+	if( snapshot < 0 ) {
+		writelog(thrdata->log, LOG_ERR,
+			 "[Thread %i] (submid: %i) Invalid snapshot information in %s",
 			 thrdata->id, job->submid, job->filename);
+		rc = STAT_XMLFAIL;
+		goto exit;
+	}
+
+	// Find the database where this report is stored, with shards it depends on the report.
+	// The system information transformed to find the shard is reused for db_register_system().
+	dbpool = shard_route(thrdata->shards, job, thrdata->settings->xslt, repxml, stats, &sysinfo);
+	if( !dbpool ) {
 		rc = STAT_SYSREG;
-		pthread_mutex_unlock(thrdata->mtx_sysreg);
 		goto exit;
+	}
 
+	// The database connection is only needed from here on
+	thrdata->dbc = dbpool_get(dbpool, thrdata->shutdown);
+	if( !thrdata->dbc ) {
+		rc = STAT_GENDB;
+		goto exit;
 	}
+	thrdata->dbc->stats = stats;
+	thrdata->dbc->measurement_tbls = thrdata->settings->measurement_tbls;
 
-	rterid = db_get_new_rterid(thrdata->dbc);
-	if( rterid < 0 ) {
-		writelog(thrdata->dbc->log, LOG_ERR,
-			 "[Thread %i] Failed to register rteval run (submid: %i, XML file: %s)",
+	pthread_mutex_lock(thrdata->mtx_sysreg);
+	syskey = db_register_system(thrdata->dbc, thrdata->settings->xslt, repxml, sysinfo);
+	if( syskey < 0 ) {
+		writelog(thrdata->log, LOG_ERR,
+			 "[Thread %i] Failed to register system (submid: %i, XML file: %s)",
 			 thrdata->id, job->submid, job->filename);
-		rc = STAT_RTERIDREG;
+		rc = STAT_SYSREG;
 		pthread_mutex_unlock(thrdata->mtx_sysreg);
 		goto exit;
+
 	}
+
 	pthread_mutex_unlock(thrdata->mtx_sysreg);
 
 	if( db_begin(thrdata->dbc) < 1 ) {
@@ -233,113 +166,180 @@ inline int parse_report(threadData_t *thrdata, parseJob_t *job)
 		goto exit;
 	}
 
-	// Create a new filename of where to save the report
-	destfname = get_destination_path(thrdata->dbc->log, thrdata->destdir, job, rterid);
-	if( !destfname ) {
-		writelog(thrdata->dbc->log, LOG_ERR,
-			 "[Thread %i] Failed to generate local report filename for (submid: %i) %s",
-			 thrdata->id, job->submid, job->filename);
-		db_rollback(thrdata->dbc);
-		rc = STAT_UNKNFAIL;
-		goto exit;
+	if( snapshot ) {
+		int res = db_snapshot_lookup(thrdata->dbc, &snap, &rterid, &latest);
+
+		if( res < 0 ) {
+			db_rollback(thrdata->dbc);
+			rc = STAT_GENDB;
+			goto exit;
+		} else if( res == 0 ) {
+			writelog(thrdata->log, LOG_WARNING,
+				 "[Thread %i] (submid: %i) Snapshot %u of rteval run %s is already "
+				 "registered, ignoring %s",
+				 thrdata->id, job->submid, snap.seq, snap.runid, job->filename);
+			db_rollback(thrdata->dbc);
+			rc = STAT_DUPLICATE;
+			goto exit;
+		}
+		newrun = (rterid < 1);
 	}
 
-	if( db_register_rtevalrun(thrdata->dbc, thrdata->xslt, repxml, job->submid,
-				  syskey, rterid, destfname) < 0 ) {
-		writelog(thrdata->dbc->log, LOG_ERR,
-			 "[Thread %i] Failed to register rteval run (submid: %i, XML file: %s)",
-			 thrdata->id, job->submid, job->filename);
-		db_rollback(thrdata->dbc);
-		rc = STAT_RTEVRUNS;
-		goto exit;
+	if( newrun ) {
+		rterid = shard_new_rterid(thrdata->shards, thrdata->dbc, thrdata->shutdown);
+		if( rterid < 0 ) {
+			writelog(thrdata->log, LOG_ERR,
+				 "[Thread %i] Failed to register rteval run (submid: %i, XML file: %s)",
+				 thrdata->id, job->submid, job->filename);
+			db_rollback(thrdata->dbc);
+			rc = STAT_RTERIDREG;
+			goto exit;
+		}
 	}
 
-	if( db_register_measurements(thrdata->dbc, thrdata->xslt, repxml, rterid) != 1 ) {
-		writelog(thrdata->dbc->log, LOG_ERR,
-			 "[Thread %i] Failed to register measurement data (submid: %i, XML file: %s)",
+	// Decide where to archive the report, the archiver thread moves it after COMMIT
+	archjob = archive_prepare(thrdata->archive, job->submid, job->clientid, rterid, snap.seq,
+				  job->filename, reportfile_suffix(rf.compression));
+	if( !archjob ) {
+		writelog(thrdata->log, LOG_ERR,
+			 "[Thread %i] Failed to prepare archiving of (submid: %i) %s",
 			 thrdata->id, job->submid, job->filename);
 		db_rollback(thrdata->dbc);
-		rc = STAT_MEASURE;
+		rc = STAT_REPMOVE;
 		goto exit;
 	}
 
-	// When all database registrations are done, move the file to it's right place
-	if( make_report_dir(thrdata->dbc->log, destfname) < 1 ) { // Make sure report directory exists
+	if( newrun ) {
+		if( db_register_rtevalrun(thrdata->dbc, thrdata->settings->xslt, repxml, job->submid,
+					  syskey, rterid, archjob->destfname) < 0 ) {
+			writelog(thrdata->log, LOG_ERR,
+				 "[Thread %i] Failed to register rteval run (submid: %i, XML file: %s)",
+				 thrdata->id, job->submid, job->filename);
+			db_rollback(thrdata->dbc);
+			rc = STAT_RTEVRUNS;
+			goto exit;
+		}
+
+		if( db_register_measurements(thrdata->dbc, thrdata->settings->xslt, repxml, rterid) != 1 ) {
+			writelog(thrdata->log, LOG_ERR,
+				 "[Thread %i] Failed to register measurement data (submid: %i, XML file: %s)",
+				 thrdata->id, job->submid, job->filename);
+			db_rollback(thrdata->dbc);
+			rc = STAT_MEASURE;
+			goto exit;
+		}
+	} else {
+		// A later snapshot of an already registered rteval run
+		if( (latest && (db_update_rtevalrun(thrdata->dbc, thrdata->settings->xslt, repxml, job->submid,
+						     syskey, rterid, archjob->destfname) < 0))
+		    || (db_merge_measurements(thrdata->dbc, thrdata->settings->xslt, repxml,
+					      rterid, latest) < 0) ) {
+			writelog(thrdata->log, LOG_ERR,
+				 "[Thread %i] Failed to add snapshot %u to rteval run %i "
+				 "(submid: %i, XML file: %s)",
+				 thrdata->id, snap.seq, rterid, job->submid, job->filename);
+			db_rollback(thrdata->dbc);
+			rc = STAT_MEASURE;
+			goto exit;
+		}
+	}
+
+	if( snapshot && (db_register_snapshot(thrdata->dbc, &snap, rterid, job->submid) < 0) ) {
 		db_rollback(thrdata->dbc);
-		rc = STAT_REPMOVE;
+		rc = STAT_RTEVRUNS;
 		goto exit;
 	}
 
-	if( rename(job->filename, destfname) < 0 ) { // Move the file
-		writelog(thrdata->dbc->log, LOG_ERR,
-			 "[Thread %i] (submid: %i) Failed to move report file from %s to %s (%s)",
-			 thrdata->id, job->submid, job->filename, destfname, strerror(errno));
-		db_rollback(thrdata->dbc);
-		rc = STAT_REPMOVE;
+	parsestats_timer_start(&tstart);
+	if( db_commit(thrdata->dbc) < 1 ) {
+		rc = STAT_GENDB;
 		goto exit;
 	}
-	free_nullsafe(destfname);
+	if( stats ) {
+		stats->commit_time = parsestats_elapsed(&tstart);
+	}
+
+	// The report is registered, hand it over to the archiver thread
+	archive_submit(thrdata->archive, archjob);
+	archjob = NULL;
 
 	rc = STAT_SUCCESS;
-	db_commit(thrdata->dbc);
-	writelog(thrdata->dbc->log, LOG_INFO,
+	writelog(thrdata->log, LOG_INFO,
 		 "[Thread %i] Report parsed and stored (submid: %i, rterid: %i)",
 		 thrdata->id, job->submid, rterid);
  exit:
+	// A failure caused by a lost database connection is not the fault of the report
+	if( (rc != STAT_SUCCESS) && thrdata->dbc && db_connection_lost(thrdata->dbc) ) {
+		rc = STAT_GENDB;
+	}
+	if( thrdata->dbc ) {
+		thrdata->dbc->measurement_tbls = NULL;
+		dbpool_put(dbpool, thrdata->dbc);
+	}
+	thrdata->dbc = NULL;
+	archive_cancel(thrdata->archive, archjob);
+	if( sysinfo ) {
+		xmlFreeDoc(sysinfo);
+	}
 	xmlFreeDoc(repxml);
 	return rc;
 }
 
 
 /**
- * The parser thread.  This thread lives until a shutdown notification is received.  It pulls
- * messages on a POSIX MQ based message queue containing submission ID and full path to an XML
- * report to be parsed.
+ * The parser thread.  This thread lives until a shutdown notification is received, or until
+ * the worker pool lets it retire after being idle.  It pulls messages on a POSIX MQ based
+ * message queue containing submission ID and full path to an XML report to be parsed.
  *
- * @param thrargs Contains database connection, XSLT stylesheet, POSXI MQ descriptor, etc
+ * @param thrargs Contains database connection pool, XSLT stylesheet, POSXI MQ descriptor, etc
  *
  * @return Returns 0 on successful operation, otherwise 1 on errors.
  */
 void *parsethread(void *thrargs) {
 	threadData_t *args = (threadData_t *) thrargs;
 	parseJob_t jobinfo;
+	parseStats_t stats;
 	long exitcode = 0;
 
-	writelog(args->dbc->log, LOG_DEBUG, "[Thread %i] Starting", args->id);
-	pthread_mutex_lock(args->mtx_thrcnt);
-	(*(args->threadcount)) += 1;
-	pthread_mutex_unlock(args->mtx_thrcnt);
+	writelog(args->log, LOG_DEBUG, "[Thread %i] Starting", args->id);
+
+	// All libxml2 and parser allocations in this thread are taken from the arena, if enabled
+	memarena_activate(args->arena);
+
+	// Let the watchdog abort reports exceeding the processing limits
+	args->guard = watchdog_register(args->watchdog, args->id);
+
+	// Element and attribute names are shared between all reports parsed by this thread.
+	// When using an arena, everything is released after each report, including the dictionary.
+	if( !args->arena ) {
+		args->xmldict = xmlDictCreate();
+	}
 
 	// Polling loop
 	while( *(args->shutdown) == 0 ) {
 		int len = 0;
 		unsigned int prio = 0;
-
-		// Check if the database connection is alive before pulling any messages
-		if( db_ping(args->dbc) != 1 ) {
-			writelog(args->dbc->log, LOG_EMERG,
-				 "[Thread %i] Lost database conneciting: Shutting down thread.",
-				 args->id);
-
-			if( *(args->threadcount) <= 1 ) {
-				writelog(args->dbc->log, LOG_EMERG,
-					 "No more worker threads available.  "
-					 "Signaling for complete shutdown!");
-				kill(getpid(), SIGUSR1);
-			}
-			exitcode = 1;
-			goto exit;
-		}
+		struct timespec timeout;
 
 		// Retrieve a parse job from the message queue
 		memset(&jobinfo, 0, sizeof(parseJob_t));
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_sec += args->idle_timeout;
 		errno = 0;
-		len = mq_receive(args->msgq, (char *)&jobinfo, sizeof(parseJob_t), &prio);
-		if( (len < 0) && errno != EAGAIN ) {
-			writelog(args->dbc->log, LOG_CRIT,
+		len = mq_timedreceive(args->msgq, (char *)&jobinfo, sizeof(parseJob_t), &prio, &timeout);
+		if( (len < 0) && (errno == ETIMEDOUT) ) {
+			// Idle for a while, leave if the pool has more threads than needed
+			if( workerpool_retire(args->pool, args->id) ) {
+				writelog(args->log, LOG_INFO, "[Thread %i] Idle, retiring", args->id);
+				goto exit;
+			}
+			continue;
+		} else if( (len < 0) && (errno != EAGAIN) && (errno != EINTR) ) {
+			writelog(args->log, LOG_CRIT,
 				 "Could not receive the message from queue: %s",
 				 strerror(errno));
-			pthread_exit((void *) 1);
+			exitcode = 1;
+			goto exit;
 		}
 
 		// Ignore whatever message if the shutdown flag is set.
@@ -349,29 +349,96 @@ void *parsethread(void *thrargs) {
 
 		// If we have a message, then process the parse job
 		if( (errno != EAGAIN) && (len > 0) ) {
-			int res = 0;
+			int res = 0, inprog = 0;
+			double wait = (jobinfo.queued ? workerpool_clock() - jobinfo.queued : 0.0);
 
-			writelog(args->dbc->log, LOG_INFO,
+			PROBE2(job__dequeue, args->id, jobinfo.submid);
+			writelog(args->log, LOG_INFO,
 				 "[Thread %i] Job recieved, submid: %i - %s",
 				 args->id, jobinfo.submid, jobinfo.filename);
-
-			// Mark the job as "in progress", if successful update, continue parsing it
-			if( db_update_submissionqueue(args->dbc, jobinfo.submid, STAT_INPROG) ) {
-				res = parse_report(args, &jobinfo);
-				// Set the status for the submission
-				db_update_submissionqueue(args->dbc, jobinfo.submid, res);
+			workerpool_job_started(args->pool, jobinfo.queued);
+			sched_job_started(args->sched, &jobinfo, wait);
+
+			// Mark the job as "in progress", if successful update, continue parsing it.
+			// A database connection is only checked out while it is needed.
+			args->dbc = dbpool_get(args->dbpool, args->shutdown);
+			inprog = (args->dbc && db_update_submissionqueue(args->dbc, jobinfo.submid, STAT_INPROG));
+			dbpool_put(args->dbpool, args->dbc);
+			args->dbc = NULL;
+			if( inprog ) {
+				parsestats_init(&stats);
+				stats.lane = jobinfo.lane;
+				stats.queue_wait = wait;
+				stats.attempt = jobinfo.attempts;
+
+				// The report is processed with the settings published when it is started
+				args->settings = settings_acquire(args->settings_store);
+				watchdog_job_start(args->guard, jobinfo.submid);
+				res = parse_report(args, &jobinfo, &stats);
+
+				// Failures caused by the processing limits get their own status
+				if( (watchdog_job_done(args->guard) || memarena_exceeded(args->arena))
+				    && (res != STAT_SUCCESS) ) {
+					writelog(args->log, LOG_ERR,
+						 "[Thread %i] (submid: %i) Report exceeded the processing limits",
+						 args->id, jobinfo.submid);
+					res = STAT_ABORTED;
+				}
+				PROBE2(parse__done, jobinfo.submid, res);
+				settings_release(args->settings_store, args->settings);
+				args->settings = NULL;
 			} else {
-				writelog(args->dbc->log, LOG_CRIT,
+				writelog(args->log, LOG_CRIT,
 					 "Failed to mark submid %i as STAT_INPROG",
 					 jobinfo.submid);
+				res = STAT_GENDB;
+			}
+
+			// Set the status for the submission, unless it is queued again for a retry
+			args->dbc = dbpool_get(args->dbpool, args->shutdown);
+			if( args->dbc ) {
+				if( retry_submission(args->retry, args->dbc, &jobinfo, res) < 1 ) {
+					db_update_submissionqueue(args->dbc, jobinfo.submid, res);
+				}
+				if( inprog ) {
+					db_register_submission_stats(args->dbc, jobinfo.submid, res, &stats);
+				}
+			}
+			dbpool_put(args->dbpool, args->dbc);
+			args->dbc = NULL;
+
+			// Avoid an ever growing dictionary
+			if( args->xmldict && (xmlDictSize(args->xmldict) > REPORTFILE_DICT_MAX) ) {
+				xmlDictFree(args->xmldict);
+				args->xmldict = xmlDictCreate();
+			}
+
+			// Release everything allocated while processing this report
+			if( args->arena ) {
+				size_t inuse, peak, mapped;
+
+				memarena_usage(args->arena, &inuse, &peak, &mapped);
+				writelog(args->log, LOG_DEBUG,
+					 "[Thread %i] (submid: %i) Arena peak usage %ld KB, %ld KB mapped",
+					 args->id, jobinfo.submid, peak / 1024, mapped / 1024);
+				memarena_reset(args->arena);
+			}
+			if( workerpool_job_done(args->pool, args->id) ) {
+				writelog(args->log, LOG_INFO, "[Thread %i] Worker pool reduced, retiring", args->id);
+				goto exit;
 			}
 		}
 	}
-	writelog(args->dbc->log, LOG_DEBUG, "[Thread %i] Shut down", args->id);
+	writelog(args->log, LOG_DEBUG, "[Thread %i] Shut down", args->id);
  exit:
-	pthread_mutex_lock(args->mtx_thrcnt);
-	(*(args->threadcount)) -= 1;
-	pthread_mutex_unlock(args->mtx_thrcnt);
+	watchdog_unregister(args->watchdog, args->guard);
+	args->guard = NULL;
+	if( args->xmldict ) {
+		xmlDictFree(args->xmldict);
+		args->xmldict = NULL;
+	}
+	memarena_activate(NULL);
+	workerpool_exited(args->pool, args->id);
 
 	pthread_exit((void *) exitcode);
 }
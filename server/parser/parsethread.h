@@ -23,6 +23,9 @@
 #ifndef _PARSETHREAD_H
 #define _PARSETHREAD_H
 
+#include <time.h>
+#include <sys/types.h>
+
 /**
  * jbNONE means no job available,
  * jbAVAIL indicates that parseJob_t contains a job
@@ -37,6 +40,10 @@ typedef struct {
         unsigned int submid;               /**< Work info: Numeric ID of the job being parsed */
         char clientid[256];                /**< Work info: Should contain senders hostname */
         char filename[4096];               /**< Work info: Full filename of the report to be parsed */
+        unsigned int lane;                 /**< Scheduler lane, see scheduler.h */
+        unsigned int attempts;             /**< Failed attempts of parsing this report so far */
+        off_t size;                        /**< Size of the report file, -1 if not registered */
+        double queued;                     /**< Time the job was queued, from workerpool_clock() */
 } parseJob_t;
 
 
@@ -27,6 +27,7 @@
 #include <pthread.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
 
 #include <libpq-fe.h>
 
@@ -43,6 +44,8 @@
 #include <pgsql.h>
 #include <log.h>
 #include <statuses.h>
+#include <probes.h>
+#include <memarena.h>
 
 /** forward declaration, to be able to setup dbhelper_func pointers */
 static char * pgsql_BuildArray(LogContext *log, xmlNode *sql_n);
@@ -52,6 +55,32 @@ static dbhelper_func pgsql_helpers = {
         .dbh_FormatArray = &(pgsql_BuildArray)
 };
 
+/**
+ * Wrapper around parseToSQLdata() which accounts the time spent in the XSLT processing
+ * in the statistics of the current submission, if statistics are being collected.
+ *
+ * @param dbc       Database handler, the statistics are found in dbc->stats
+ * @param xslt      XSLT template defining the data transformation
+ * @param indata_d  Input XML data to transform to a sqldata XML document
+ * @param params    Parameters to be sent to the XSLT parser
+ *
+ * @return Returns the result of parseToSQLdata()
+ */
+static xmlDoc *pgsql_parseToSQLdata(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *indata_d,
+				    parseParams *params)
+{
+	xmlDoc *ret = NULL;
+	struct timespec tstart;
+
+	parsestats_timer_start(&tstart);
+	ret = parseToSQLdata(dbc->log, xslt, indata_d, params);
+	if( dbc->stats ) {
+		dbc->stats->transform_time += parsestats_elapsed(&tstart);
+	}
+	return ret;
+}
+
+
 /**
  * Connect to a database, based on the given configuration
  *
@@ -68,6 +97,7 @@ dbconn *db_connect(eurephiaVALUES *cfg, unsigned int id, LogContext *log) {
 	ret = (dbconn *) malloc_nullsafe(log, sizeof(dbconn)+2);
 	ret->id = id;
 	ret->log = log;
+	ret->stats = NULL;
 
 	writelog(log, LOG_DEBUG, "[Connection %i] Connecting to database: server=%s:%s, "
 		 "database=%s, user=%s", ret->id,
@@ -119,6 +149,16 @@ dbconn *db_connect(eurephiaVALUES *cfg, unsigned int id, LogContext *log) {
 }
 
 
+/**
+ * Prepares the xmlparser for producing sqldata for PostgreSQL, without connecting to
+ * the database.  db_connect() does this as well, this is only needed when the data is
+ * not loaded directly, like when writing COPY load files.
+ */
+void db_init_offline(void) {
+	init_xmlparser(&pgsql_helpers);
+}
+
+
 /**
  * Pings the database connection to check if it is alive
  *
@@ -150,6 +190,34 @@ int db_ping(dbconn *dbc) {
 }
 
 
+/**
+ * Finds how many more connections the database server accepts for ordinary users
+ *
+ * @param dbc  Database connection
+ *
+ * @return Returns the number of free connections, or -1 if it could not be found
+ */
+int db_available_connections(dbconn *dbc) {
+	PGresult *res = NULL;
+	int ret = -1;
+
+	res = PQexec(dbc->db,
+		     "SELECT current_setting('max_connections')::INTEGER"
+		     "       - current_setting('superuser_reserved_connections')::INTEGER"
+		     "       - (SELECT count(*) FROM pg_stat_activity)");
+	if( PQresultStatus(res) != PGRES_TUPLES_OK ) {
+		writelog(dbc->log, LOG_WARNING,
+			 "[Connection %i] Could not check for free database connections: %s",
+			 dbc->id, PQresultErrorMessage(res));
+	} else {
+		ret = atoi_nullsafe(PQgetvalue(res, 0, 0));
+		ret = (ret < 0 ? 0 : ret);
+	}
+	PQclear(res);
+	return ret;
+}
+
+
 /**
  * Disconnect from the database
  *
@@ -230,11 +298,14 @@ eurephiaVALUES *pgsql_INSERT(dbconn *dbc, xmlDoc *sqldoc) {
 	char **field_ar = NULL, *fields = NULL, **value_ar = NULL, *values = NULL, *table = NULL, 
 		tmp[20], *sql = NULL, *key = NULL, oid[34];
 
-	unsigned int fieldcnt = 0, *field_idx, i = 0, schemaver = 0;
+	unsigned int fieldcnt = 0, *field_idx, i = 0, schemaver = 0, rows = 0;
+	size_t bytes = 0;
 	PGresult *dbres = NULL;
 	eurephiaVALUES *res = NULL;
+	struct timespec tstart;
 
 	assert( (dbc != NULL) && (sqldoc != NULL) );
+	parsestats_timer_start(&tstart);
 
 	root_n = xmlDocGetRootElement(sqldoc);
 	if( !root_n || (xmlStrcmp(root_n->name, (xmlChar *) "sqldata") != 0) ) {
@@ -349,6 +420,7 @@ eurephiaVALUES *pgsql_INSERT(dbconn *dbc, xmlDoc *sqldoc) {
 	PQclear(dbres);
 
 	// Loop through all records and generate SQL statements
+	PROBE3(insert__start, dbc->id, table, fieldcnt);
 	res = eCreate_value_space(dbc->log, 1);
 	memset(&oid, 0, 34);
 	foreach_xmlnode(recs_n->children, ptr_n) {
@@ -357,7 +429,7 @@ eurephiaVALUES *pgsql_INSERT(dbconn *dbc, xmlDoc *sqldoc) {
 		}
 
 		// Loop through all value nodes in each record node and get the values for each field
-		value_ar = calloc(fieldcnt, sizeof(char *));
+		value_ar = malloc_arena(dbc->log, fieldcnt * sizeof(char *));
 		i = 0;
 		foreach_xmlnode(ptr_n->children, val_n) {
 			char *fid_s = NULL;
@@ -392,9 +464,9 @@ eurephiaVALUES *pgsql_INSERT(dbconn *dbc, xmlDoc *sqldoc) {
 
 			// Free up the memory we've used for this record
 			for( i = 0; i < fieldcnt; i++ ) {
-				free_nullsafe(value_ar[i]);
+				free_arena(value_ar[i]);
 			}
-			free_nullsafe(value_ar);
+			free_arena(value_ar);
 			goto exit;
 		}
 		if( key ) {
@@ -405,15 +477,24 @@ eurephiaVALUES *pgsql_INSERT(dbconn *dbc, xmlDoc *sqldoc) {
 			eAdd_value(res, "oid", oid);
 		}
 		PQclear(dbres);
+		rows++;
 
 		// Free up the memory we've used for this record
 		for( i = 0; i < fieldcnt; i++ ) {
-			free_nullsafe(value_ar[i]);
+			bytes += strlen_nullsafe(value_ar[i]);
+			free_arena(value_ar[i]);
 		}
-		free_nullsafe(value_ar);
+		free_arena(value_ar);
 	}
+	PROBE4(insert__done, dbc->id, table, rows, bytes);
 
  exit:
+	if( dbc->stats ) {
+		dbc->stats->insert_time += parsestats_elapsed(&tstart);
+		if( res ) {
+			parsestats_add_rows(dbc->stats, table, rows);
+		}
+	}
 	free_nullsafe(sql);
 	free_nullsafe(fields);
 	free_nullsafe(values);
@@ -422,15 +503,272 @@ eurephiaVALUES *pgsql_INSERT(dbconn *dbc, xmlDoc *sqldoc) {
 	return res;
 }
 
+
+/**
+ * Appends a value to a COPY data buffer, escaped according to the COPY text format
+ *
+ * @param buf    Pointer to the buffer, which is enlarged as needed
+ * @param size   Pointer to the allocated size of the buffer
+ * @param len    Pointer to the length of the data in the buffer
+ * @param value  The value to append, NULL values are written as \N
+ * @param delim  Character to write after the value, a tab or a newline
+ */
+static void pgsql_copy_append(char **buf, size_t *size, size_t *len, const char *value, char delim) {
+	const char *p = NULL;
+	size_t need = (value ? (strlen(value) * 2) : 2) + 2;
+
+	if( (*len + need) > *size ) {
+		*size = (*len + need) * 2;
+		*buf = realloc(*buf, *size);
+	}
+	if( !value ) {
+		(*buf)[(*len)++] = '\\';
+		(*buf)[(*len)++] = 'N';
+	}
+	for( p = value; p && *p; p++ ) {
+		switch( *p ) {
+		case '\\':
+			(*buf)[(*len)++] = '\\';
+			(*buf)[(*len)++] = '\\';
+			break;
+		case '\t':
+			(*buf)[(*len)++] = '\\';
+			(*buf)[(*len)++] = 't';
+			break;
+		case '\n':
+			(*buf)[(*len)++] = '\\';
+			(*buf)[(*len)++] = 'n';
+			break;
+		case '\r':
+			(*buf)[(*len)++] = '\\';
+			(*buf)[(*len)++] = 'r';
+			break;
+		default:
+			(*buf)[(*len)++] = *p;
+		}
+	}
+	(*buf)[(*len)++] = delim;
+}
+
+
+/**
+ * Encodes the records of a sqldata XML document in the COPY text format, without
+ * any database connection.  The 'key' attribute is not supported.  The sqldata document
+ * format is described in pgsql_INSERT().
+ *
+ * @param log     Log context
+ * @param sqldoc  sqldata XML document containing the records
+ * @param cd      copyData where the result is stored, the table name points into sqldoc.
+ *                It must be released with db_free_copydata() when the function succeeds.
+ *
+ * @return Returns the number of records encoded on success, otherwise -1
+ */
+int db_encode_copydata(LogContext *log, xmlDoc *sqldoc, copyData *cd) {
+	xmlNode *root_n = NULL, *fields_n = NULL, *recs_n = NULL, *ptr_n = NULL, *val_n = NULL;
+	char **field_ar = NULL, **value_ar = NULL;
+	unsigned int *field_idx = NULL, i = 0;
+	size_t collen = 1;
+
+	assert( (sqldoc != NULL) && (cd != NULL) );
+	memset(cd, 0, sizeof(copyData));
+
+	root_n = xmlDocGetRootElement(sqldoc);
+	if( !root_n || (xmlStrcmp(root_n->name, (xmlChar *) "sqldata") != 0) ) {
+		writelog(log, LOG_ERR, "Input XML document is not a valid sqldata document");
+		return -1;
+	}
+
+	cd->table = xmlGetAttrValue(root_n->properties, "table");
+	if( !cd->table ) {
+		writelog(log, LOG_ERR, "Input XML document is missing table reference");
+		return -1;
+	}
+	cd->schemaver = sqldataGetRequiredSchemaVer(log, root_n);
+
+	fields_n = xmlFindNode(root_n, "fields");
+	recs_n = xmlFindNode(root_n, "records");
+	if( !fields_n || !recs_n ) {
+		writelog(log, LOG_ERR, "Input XML document is missing either <fields/> or <records/>");
+		return -1;
+	}
+
+	// Generate lists of all fields and a index mapping table, the same way as pgsql_INSERT()
+	foreach_xmlnode(fields_n->children, ptr_n) {
+		if( ptr_n->type == XML_ELEMENT_NODE ) {
+			cd->fields++;
+		}
+	}
+	field_idx = calloc(cd->fields+1, sizeof(unsigned int));
+	field_ar = calloc(cd->fields+1, sizeof(char *));
+	foreach_xmlnode(fields_n->children, ptr_n) {
+		if( ptr_n->type != XML_ELEMENT_NODE ) {
+			continue;
+		}
+		field_idx[i] = atoi_nullsafe(xmlGetAttrValue(ptr_n->properties, "fid"));
+		field_ar[i] = xmlExtractContent(ptr_n);
+		collen += strlen_nullsafe(field_ar[i]) + 1;
+		i++;
+	}
+
+	cd->columns = malloc_nullsafe(log, collen);
+	for( i = 0; i < cd->fields; i++ ) {
+		strcat(cd->columns, field_ar[i]);
+		strcat(cd->columns, (i < (cd->fields-1) ? "," : ""));
+	}
+
+	cd->size = PGSQL_COPY_BUFFER;
+	cd->data = malloc_nullsafe(log, cd->size);
+	foreach_xmlnode(recs_n->children, ptr_n) {
+		if( ptr_n->type != XML_ELEMENT_NODE ) {
+			continue;
+		}
+
+		value_ar = malloc_arena(log, (cd->fields+1) * sizeof(char *));
+		memset(value_ar, 0, (cd->fields+1) * sizeof(char *));
+		i = 0;
+		foreach_xmlnode(ptr_n->children, val_n) {
+			char *fid_s = NULL;
+
+			if( i >= cd->fields ) {
+				break;
+			}
+			if( val_n->type != XML_ELEMENT_NODE ) {
+				continue;
+			}
+			fid_s = xmlGetAttrValue(val_n->properties, "fid");
+			if( (fid_s == NULL) || (atoi_nullsafe(fid_s) < 0) ) {
+				continue;
+			}
+			value_ar[field_idx[i]] = sqldataExtractContent(log, val_n);
+			i++;
+		}
+
+		for( i = 0; i < cd->fields; i++ ) {
+			pgsql_copy_append(&cd->data, &cd->size, &cd->len, value_ar[i],
+					  (i < (cd->fields-1) ? '\t' : '\n'));
+			cd->bytes += strlen_nullsafe(value_ar[i]);
+			free_arena(value_ar[i]);
+		}
+		free_arena(value_ar);
+		cd->rows++;
+	}
+
+	free_nullsafe(field_ar);
+	free_nullsafe(field_idx);
+	return cd->rows;
+}
+
+
+/**
+ * Releases the memory used by a copyData filled in by db_encode_copydata()
+ *
+ * @param cd  copyData to release
+ */
+void db_free_copydata(copyData *cd) {
+	free_nullsafe(cd->columns);
+	free_nullsafe(cd->data);
+	cd->len = 0;
+	cd->size = 0;
+}
+
+
+/**
+ * Loads the records of a sqldata XML document with COPY ... FROM STDIN.  This is much
+ * faster than pgsql_INSERT() for many records, but the 'key' attribute is not supported.
+ * The records are encoded by db_encode_copydata() and sent to the server in chunks of
+ * PGSQL_COPY_BUFFER bytes.
+ *
+ * @param dbc     Database handler to a PostgreSQL
+ * @param sqldoc  sqldata XML document containing the data to be loaded
+ *
+ * @return Returns the number of records loaded on success, otherwise -1
+ */
+static int pgsql_COPY(dbconn *dbc, xmlDoc *sqldoc) {
+	copyData cd;
+	char *sql = NULL;
+	size_t sent = 0;
+	PGresult *dbres = NULL;
+	int ret = -1;
+	struct timespec tstart;
+
+	assert( (dbc != NULL) && (sqldoc != NULL) );
+	parsestats_timer_start(&tstart);
+
+	if( db_encode_copydata(dbc->log, sqldoc, &cd) < 0 ) {
+		writelog(dbc->log, LOG_ERR, "[Connection %i] Could not prepare the COPY data", dbc->id);
+		db_free_copydata(&cd);
+		return -1;
+	}
+
+	if( (cd.schemaver < 100) || (cd.schemaver > dbc->sqlschemaver) ) {
+		writelog(dbc->log, LOG_ERR,
+			 "[Connection %i] Cannot process data for the '%s' table.  "
+			 "The needed SQL schema version is %i, while the database is using version %i",
+			 dbc->id, cd.table, cd.schemaver, dbc->sqlschemaver);
+		db_free_copydata(&cd);
+		return -1;
+	}
+
+	sql = malloc_nullsafe(dbc->log, strlen(cd.table) + strlen(cd.columns) + 30);
+	sprintf(sql, "COPY %s (%s) FROM STDIN", cd.table, cd.columns);
+
+	dbres = PQexec(dbc->db, sql);
+	if( PQresultStatus(dbres) != PGRES_COPY_IN ) {
+		writelog(dbc->log, LOG_ALERT, "[Connection %i] Failed to start COPY into %s: %s",
+			 dbc->id, cd.table, PQresultErrorMessage(dbres));
+		PQclear(dbres);
+		goto exit;
+	}
+	PQclear(dbres);
+
+	// Send the data in large chunks
+	PROBE3(insert__start, dbc->id, cd.table, cd.fields);
+	while( sent < cd.len ) {
+		size_t chunk = ((cd.len - sent) > PGSQL_COPY_BUFFER ? PGSQL_COPY_BUFFER : (cd.len - sent));
+
+		if( PQputCopyData(dbc->db, cd.data + sent, chunk) != 1 ) {
+			break;
+		}
+		sent += chunk;
+	}
+
+	if( (sent == cd.len) && (PQputCopyEnd(dbc->db, NULL) == 1) ) {
+		ret = cd.rows;
+	} else {
+		PQputCopyEnd(dbc->db, "aborted");
+	}
+	while( (dbres = PQgetResult(dbc->db)) != NULL ) {
+		if( PQresultStatus(dbres) != PGRES_COMMAND_OK ) {
+			writelog(dbc->log, LOG_ALERT, "[Connection %i] Failed to COPY into %s: %s",
+				 dbc->id, cd.table, PQresultErrorMessage(dbres));
+			ret = -1;
+		}
+		PQclear(dbres);
+	}
+	PROBE4(insert__done, dbc->id, cd.table, cd.rows, cd.bytes);
+
+ exit:
+	if( dbc->stats ) {
+		dbc->stats->insert_time += parsestats_elapsed(&tstart);
+		if( ret >= 0 ) {
+			parsestats_add_rows(dbc->stats, cd.table, cd.rows);
+		}
+	}
+	free_nullsafe(sql);
+	db_free_copydata(&cd);
+	return ret;
+}
+
+
 /**
  * @copydoc sqldataValueArray()
  */
 static char * pgsql_BuildArray(LogContext *log, xmlNode *sql_n) {
 	char *ret = NULL, *ptr = NULL;
 	xmlNode *node = NULL;
-	size_t retlen = 0;
+	size_t retlen = 2;
 
-	ret = malloc_nullsafe(log, 2);
+	ret = malloc_arena(log, retlen);
 	if( ret == NULL ) {
 		writelog(log, LOG_ERR,
 			 "Failed to allocate memory for a new PostgreSQL array");
@@ -448,13 +786,13 @@ static char * pgsql_BuildArray(LogContext *log, xmlNode *sql_n) {
 		ptr = sqldataValueHash(log, node);
 		if( ptr ) {
 			retlen += strlen(ptr) + 4;
-			ret = realloc(ret, retlen);
+			ret = realloc_arena(ret, retlen);
 			if( ret == NULL ) {
 				writelog(log, LOG_ERR,
 					 "Failed to allocate memory to expand "
 					 "array to include '%s'", ptr);
-				free_nullsafe(ret);
-				free_nullsafe(ptr);
+				free_arena(ret);
+				free_arena(ptr);
 				return NULL;
 			}
 			/* Newer PostgreSQL servers expects numbers to be without quotes */
@@ -468,7 +806,7 @@ static char * pgsql_BuildArray(LogContext *log, xmlNode *sql_n) {
 				strncat(ret, ptr, strlen(ptr));
 				strncat(ret, ",", 1);
 			}
-			free_nullsafe(ptr);
+			free_arena(ptr);
 		}
 	}
 	/* Replace the last comma with a close-array marker */
@@ -511,15 +849,18 @@ int db_begin(dbconn *dbc) {
 int db_commit(dbconn *dbc) {
 	PGresult *dbres = NULL;
 
+	PROBE1(commit__start, dbc->id);
 	dbres = PQexec(dbc->db, "COMMIT");
 	if( PQresultStatus(dbres) != PGRES_COMMAND_OK ) {
 		writelog(dbc->log, LOG_ALERT,
 			 "[Connection %i] Failed to do commit a database transaction (COMMIT): %s",
 			 dbc->id, PQresultErrorMessage(dbres));
 		PQclear(dbres);
+		PROBE2(commit__done, dbc->id, -1);
 		return -1;
 	}
 	PQclear(dbres);
+	PROBE2(commit__done, dbc->id, 1);
 	return 1;
 }
 
@@ -548,166 +889,169 @@ int db_rollback(dbconn *dbc) {
 
 
 /**
- * This function blocks until a notification is received from the database
+ * Checks that a connection can be used again by someone else.  An unfinished transaction
+ * is rolled back.
+ *
+ * @param dbc  Database connection
+ *
+ * @return Returns 1 if the connection is usable, otherwise 0
+ */
+int db_check_idle(dbconn *dbc) {
+	switch( PQtransactionStatus(dbc->db) ) {
+	case PQTRANS_IDLE:
+		return 1;
+
+	case PQTRANS_INTRANS:
+	case PQTRANS_INERROR:
+		writelog(dbc->log, LOG_WARNING,
+			 "[Connection %i] Rolling back an unfinished transaction", dbc->id);
+		return (db_rollback(dbc) == 1);
+
+	default:
+		// A query is still running, or the connection is broken
+		return 0;
+	}
+}
+
+
+/**
+ * Checks if the connection to the database server is lost
+ *
+ * @param dbc  Database connection
+ *
+ * @return Returns 1 if the connection is lost, otherwise 0
+ */
+int db_connection_lost(dbconn *dbc) {
+	return (PQstatus(dbc->db) != CONNECTION_OK);
+}
+
+
+/**
+ * Starts listening for notifications from the database.  The returned socket becomes
+ * readable when a notification arrives, which is then to be collected with
+ * db_get_notifications().  The socket changes if the connection is reset.
  *
  * @param dbc        Database connection
- * @param shutdown   Pointer to the shutdown flag.  Used to avoid reporting false errors.
  * @param listenfor  Name to be used when calling LISTEN
  *
- * @return Returns 1 on successful waiting, otherwise -1
+ * @return Returns the socket of the database connection on success, otherwise -1
  */
-int db_wait_notification(dbconn *dbc, const int *shutdown, const char *listenfor) {
-	int sock, ret = 0;
+int db_listen(dbconn *dbc, const char *listenfor) {
 	PGresult *dbres = NULL;
-	PGnotify *notify = NULL;
-	fd_set input_mask;
 	char *sql = NULL;
+	int sock = -1;
 
 	sql = malloc_nullsafe(dbc->log, strlen_nullsafe(listenfor) + 12);
 	assert( sql != NULL );
 
-	// Initiate listening
 	sprintf(sql, "LISTEN %s", listenfor);
 	dbres = PQexec(dbc->db, sql);
 	if( PQresultStatus(dbres) != PGRES_COMMAND_OK ) {
 		writelog(dbc->log, LOG_ALERT, "[Connection %i] SQL %s",
 			 dbc->id, PQresultErrorMessage(dbres));
-		free_nullsafe(sql);
-		PQclear(dbres);
-		return -1;
+		goto exit;
 	}
-	PQclear(dbres);
 
-	// Start listening and waiting
-	while( ret == 0 ) {
-		sock = PQsocket(dbc->db);
-		if (sock < 0) {
-			// shouldn't happen
-			ret = -1;
-			break;
-		}
-
-		// Wait for something to happen on the database socket
-		FD_ZERO(&input_mask);
-		FD_SET(sock, &input_mask);
-		if (select(sock + 1, &input_mask, NULL, NULL, NULL) < 0) {
-			// If the shutdown flag is set, select() will fail due to a signal.  Only
-			// report errors if we're not shutting down, or else exit normally with
-			// successful waiting.
-			if( *shutdown == 0 ) {
-				writelog(dbc->log, LOG_CRIT, "[Connection %i] select() failed: %s",
-					 dbc->id, strerror(errno));
-				ret = -1;
-				goto exit;
-			} else {
-				ret = 1;
-			}
-			break;
-		}
+	sock = PQsocket(dbc->db);
+	if( sock < 0 ) {
+		writelog(dbc->log, LOG_ALERT, "[Connection %i] No database socket available",
+			 dbc->id);
+	}
+ exit:
+	PQclear(dbres);
+	free_nullsafe(sql);
+	return sock;
+}
 
-		// Process the event
-		PQconsumeInput(dbc->db);
 
-		// Check if connection still is valid
-		if( PQstatus(dbc->db) != CONNECTION_OK ) {
-			PQreset(dbc->db);
-			if( PQstatus(dbc->db) != CONNECTION_OK ) {
-				writelog(dbc->log, LOG_EMERG,
-					 "[Connection %i] Database connection died: %s",
-					 dbc->id, PQerrorMessage(dbc->db));
-				ret = -1;
-				goto exit;
-			}
-			writelog(dbc->log, LOG_CRIT,
-				 "[Connection %i] Database connection restored", dbc->id);
-		}
+/**
+ * Collects the notifications received from the database, without blocking.  Must be called
+ * after each database query as well, as notifications may arrive together with the query
+ * results.
+ *
+ * @param dbc        Database connection
+ *
+ * @return Returns the number of notifications received, 0 if none.  If the connection is
+ *         lost, -1 is returned.
+ */
+int db_get_notifications(dbconn *dbc) {
+	PGnotify *notify = NULL;
+	int count = 0;
 
-		while ((notify = PQnotifies(dbc->db)) != NULL) {
-			// If a notification was received, inform and exit with success.
-			writelog(dbc->log, LOG_DEBUG,
-				 "[Connection %i] Received notfication from pid %d",
-				 dbc->id, notify->be_pid);
-			PQfreemem(notify);
-			ret = 1;
-			break;
-		}
+	if( (PQconsumeInput(dbc->db) == 0) || (PQstatus(dbc->db) != CONNECTION_OK) ) {
+		writelog(dbc->log, LOG_CRIT, "[Connection %i] Failed to read notifications: %s",
+			 dbc->id, PQerrorMessage(dbc->db));
+		return -1;
 	}
 
-	// Stop listening when we exit
-	sprintf(sql, "UNLISTEN %s", listenfor);
-	dbres = PQexec(dbc->db, sql);
-	if( PQresultStatus(dbres) != PGRES_COMMAND_OK ) {
-		writelog(dbc->log, LOG_ALERT, "[Connection %i] SQL %s",
-			 dbc->id, PQresultErrorMessage(dbres));
-		free_nullsafe(sql);
-		ret = -1;
+	while( (notify = PQnotifies(dbc->db)) != NULL ) {
+		writelog(dbc->log, LOG_DEBUG,
+			 "[Connection %i] Received notfication from pid %d",
+			 dbc->id, notify->be_pid);
+		PQfreemem(notify);
+		count++;
 	}
-	free_nullsafe(sql);
-	PQclear(dbres);
-
- exit:
-	return ret;
+	return count;
 }
 
 
 /**
- * Retrive the first available submitted report
+ * Retrieves the oldest waiting submissions of each client, to be scheduled by the caller
  *
- * @param dbc   Database connection
- * @param mtx   pthread_mutex to avoid parallel access to the submission queue table, to avoid
- *              the same job being retrieved multiple times.
+ * @param dbc      Database connection
+ * @param window   Maximum number of submissions per client
+ * @param max      Maximum number of submissions in total
+ * @param count    Returns the number of submissions found
  *
- * @return Returns a pointer to a parseJob_t struct, with the parse job info on success, otherwise NULL
+ * @return Returns an array of parseJob_t structs, ordered by submission ID, on success.
+ *         On errors NULL is returned.  The array must be freed by the caller.
  */
-parseJob_t *db_get_submissionqueue_job(dbconn *dbc, pthread_mutex_t *mtx) {
-	parseJob_t *job = NULL;
+parseJob_t *db_get_submissionqueue_candidates(dbconn *dbc, unsigned int window,
+					      unsigned int max, unsigned int *count) {
+	parseJob_t *jobs = NULL;
 	PGresult *res = NULL;
 	char sql[4098];
+	int i, retries;
 
-	job = (parseJob_t *) malloc_nullsafe(dbc->log, sizeof(parseJob_t));
-
-	// Get the first available submission
+	// Submissions waiting for a retry are held back until they are due
+	retries = (dbc->sqlschemaver >= 106);
 	memset(&sql, 0, 4098);
 	snprintf(sql, 4096,
-		 "SELECT submid, filename, clientid"
-		 "  FROM submissionqueue"
-		 " WHERE status = %i"
+		 "SELECT submid, filename, clientid, %s, %s"
+		 "  FROM (SELECT submid, filename, clientid, %s, %s,"
+		 "               row_number() OVER (PARTITION BY clientid ORDER BY submid) AS clientpos"
+		 "          FROM submissionqueue"
+		 "         WHERE status = %i%s) AS waiting"
+		 " WHERE clientpos <= %u"
 		 " ORDER BY submid"
-		 " LIMIT 1",
-		 STAT_NEW);
+		 " LIMIT %u",
+		 (retries ? "attempts" : "0 AS attempts"), (retries ? "report_size" : "NULL AS report_size"),
+		 (retries ? "attempts" : "0 AS attempts"), (retries ? "report_size" : "NULL AS report_size"),
+		 STAT_NEW, (retries ? " AND (retry_after IS NULL OR retry_after <= NOW())" : ""),
+		 window, max);
 
-	pthread_mutex_lock(mtx);
 	res = PQexec(dbc->db, sql);
 	if( PQresultStatus(res) != PGRES_TUPLES_OK ) {
-		pthread_mutex_unlock(mtx);
 		writelog(dbc->log, LOG_ALERT,
 			 "[Connection %i] Failed to query submission queue (SELECT): %s",
 			 dbc->id, PQresultErrorMessage(res));
 		PQclear(res);
-		free_nullsafe(job);
 		return NULL;
 	}
 
-	if( PQntuples(res) == 1 ) {
-		job->status = jbAVAIL;
-		job->submid = atoi_nullsafe(PQgetvalue(res, 0, 0));
-		snprintf(job->filename, 4095, "%.4094s", PQgetvalue(res, 0, 1));
-		snprintf(job->clientid,  255, "%.254s", PQgetvalue(res, 0, 2));
-
-		// Update the submission queue status
-		if( db_update_submissionqueue(dbc, job->submid, STAT_ASSIGNED) < 1 ) {
-			pthread_mutex_unlock(mtx);
-			writelog(dbc->log, LOG_ALERT, "[Connection %i] Failed to update "
-				 "submission queue statis to STAT_ASSIGNED", dbc->id);
-			free_nullsafe(job);
-			return NULL;
-		}
-	} else {
-		job->status = jbNONE;
+	// Always allocate one element, an empty array is not an error
+	*count = PQntuples(res);
+	jobs = (parseJob_t *) malloc_nullsafe(dbc->log, (*count + 1) * sizeof(parseJob_t));
+	for( i = 0; i < *count; i++ ) {
+		jobs[i].status = jbAVAIL;
+		jobs[i].submid = atoi_nullsafe(PQgetvalue(res, i, 0));
+		snprintf(jobs[i].filename, 4095, "%.4094s", PQgetvalue(res, i, 1));
+		snprintf(jobs[i].clientid,  255, "%.254s", PQgetvalue(res, i, 2));
+		jobs[i].attempts = atoi_nullsafe(PQgetvalue(res, i, 3));
+		jobs[i].size = (PQgetisnull(res, i, 4) ? -1 : atoll(PQgetvalue(res, i, 4)));
 	}
-	pthread_mutex_unlock(mtx);
 	PQclear(res);
-	return job;
+	return jobs;
 }
 
 
@@ -748,6 +1092,8 @@ int db_update_submissionqueue(dbconn *dbc, unsigned int submid, int status) {
 	case STAT_GENDB:
 	case STAT_RTEVRUNS:
 	case STAT_MEASURE:
+	case STAT_DUPLICATE:
+	case STAT_ABORTED:
 		snprintf(sql, 4096,
 			 "UPDATE submissionqueue SET status = %i, parseend = NOW() WHERE submid = %i",
 			 status, submid);
@@ -780,33 +1126,292 @@ int db_update_submissionqueue(dbconn *dbc, unsigned int submid, int status) {
 
 
 /**
- * Registers information into the 'systems' and 'systems_hostname' tables, based on the
- * summary/report XML file from rteval.
+ * Registers a new submission in the submission queue
  *
- * @param dbc        Database handler where to perform the SQL queries
- * @param xslt       A pointer to a parsed 'xmlparser.xsl' XSLT template
- * @param summaryxml The XML report from rteval
+ * @param dbc       Database handler where to perform the SQL query
+ * @param clientid  Client ID of the submitter
+ * @param filename  Full path of the report file in the submission queue
+ * @param status    Initial status of the submission
+ * @param size      Size of the report file, in bytes
  *
- * @return Returns a value > 0 on success, which is a unique reference to the system of the report.
- *         If the function detects that this system is already registered, the 'syskey' reference will
- *         be reused.  On errors, -1 will be returned.
+ * @return Returns the submission ID on success, otherwise -1
  */
-int db_register_system(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml) {
+int db_register_submission(dbconn *dbc, const char *clientid, const char *filename, int status,
+			   off_t size) {
 	PGresult *dbres = NULL;
-	eurephiaVALUES *dbdata = NULL;
-	xmlDoc *sysinfo_d = NULL, *hostinfo_d = NULL;
-	parseParams prms;
-	char sqlq[4098];
-	char *sysid = NULL;  // SHA1 value of the system id
-	char *ipaddr = NULL, *hostname = NULL;
-	int syskey = -1;
-
-	memset(&prms, 0, sizeof(parseParams));
-	prms.table = "systems";
-	sysinfo_d = parseToSQLdata(dbc->log, xslt, summaryxml, &prms);
-	if( !sysinfo_d ) {
-		writelog(dbc->log, LOG_ERR, "[Connection %i] Could not parse the input XML data", dbc->id);
-		syskey= -1;
+	const char *params[4];
+	char status_s[34], size_s[34];
+	int submid = -1;
+
+	snprintf(status_s, 33, "%i", status);
+	snprintf(size_s, 33, "%lld", (long long) size);
+	params[0] = clientid;
+	params[1] = filename;
+	params[2] = status_s;
+	params[3] = size_s;
+	dbres = PQexecParams(dbc->db,
+			     "INSERT INTO submissionqueue (clientid, filename, status, report_size)"
+			     " VALUES ($1, $2, $3, $4) RETURNING submid",
+			     4, NULL, params, NULL, NULL, 0);
+	if( (PQresultStatus(dbres) != PGRES_TUPLES_OK) || (PQntuples(dbres) != 1) ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to register submission from %s: %s",
+			 dbc->id, clientid, PQresultErrorMessage(dbres));
+	} else {
+		submid = atoi_nullsafe(PQgetvalue(dbres, 0, 0));
+	}
+	PQclear(dbres);
+	return submid;
+}
+
+
+/**
+ * Puts an assigned submission back into the submission queue, and notifies the
+ * submission queue checker about it
+ *
+ * @param dbc     Database handler where to perform the SQL query
+ * @param submid  Submission ID
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+int db_requeue_submission(dbconn *dbc, unsigned int submid) {
+	PGresult *dbres = NULL;
+	char sql[256];
+	int ret = 1;
+
+	snprintf(sql, 254,
+		 "UPDATE submissionqueue SET status = %i WHERE submid = %i; NOTIFY rteval_submq",
+		 STAT_NEW, submid);
+	dbres = PQexec(dbc->db, sql);
+	if( PQresultStatus(dbres) != PGRES_COMMAND_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to requeue submid %i: %s",
+			 dbc->id, submid, PQresultErrorMessage(dbres));
+		ret = -1;
+	}
+	PQclear(dbres);
+	return ret;
+}
+
+
+/**
+ * Puts a failed submission back into the submission queue, to be parsed again when the
+ * retry delay has passed.  The submission queue checker is notified, so it can plan
+ * when to look for it again.  Only available from SQL schema version 1.6.
+ *
+ * @param dbc     Database handler where to perform the SQL query
+ * @param submid  Submission ID
+ * @param delay   Seconds until the submission may be parsed again
+ *
+ * @return Returns 1 on success, 0 if the database schema does not support it, otherwise -1
+ */
+int db_retry_submission(dbconn *dbc, unsigned int submid, unsigned int delay) {
+	PGresult *dbres = NULL;
+	char sql[512];
+	int ret = 1;
+
+	if( dbc->sqlschemaver < 106 ) {
+		return 0;
+	}
+
+	snprintf(sql, 510,
+		 "UPDATE submissionqueue"
+		 "   SET status = %i, attempts = attempts + 1, parseend = NOW(),"
+		 "       retry_after = NOW() + interval '%u seconds'"
+		 " WHERE submid = %u; NOTIFY rteval_submq",
+		 STAT_NEW, delay, submid);
+	dbres = PQexec(dbc->db, sql);
+	if( PQresultStatus(dbres) != PGRES_COMMAND_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to schedule a retry of submid %i: %s",
+			 dbc->id, submid, PQresultErrorMessage(dbres));
+		ret = -1;
+	}
+	PQclear(dbres);
+	return ret;
+}
+
+
+/**
+ * Finds out when the next submission waiting for a retry is due
+ *
+ * @param dbc  Database handler where to perform the SQL query
+ *
+ * @return Returns the number of seconds until the next retry is due, 0 if no submissions
+ *         are waiting for a retry.  On errors -1 is returned.
+ */
+int db_get_next_retry(dbconn *dbc) {
+	PGresult *dbres = NULL;
+	char sql[512];
+	int ret = -1;
+
+	if( dbc->sqlschemaver < 106 ) {
+		return 0;
+	}
+
+	snprintf(sql, 510,
+		 "SELECT CEIL(EXTRACT(EPOCH FROM MIN(retry_after) - NOW()))"
+		 "  FROM submissionqueue"
+		 " WHERE status = %i AND retry_after > NOW()", STAT_NEW);
+	dbres = PQexec(dbc->db, sql);
+	if( (PQresultStatus(dbres) != PGRES_TUPLES_OK) || (PQntuples(dbres) != 1) ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to look up the next retry: %s",
+			 dbc->id, PQresultErrorMessage(dbres));
+	} else if( PQgetisnull(dbres, 0, 0) ) {
+		ret = 0;
+	} else {
+		ret = atoi_nullsafe(PQgetvalue(dbres, 0, 0));
+		ret = (ret < 1 ? 1 : ret);
+	}
+	PQclear(dbres);
+	return ret;
+}
+
+
+/**
+ * Retrieves the submissions left assigned or in progress when rteval-parserd stopped
+ *
+ * @param dbc  Database handler where to perform the SQL query
+ *
+ * @return Returns a 0 terminated array of submission IDs, which must be freed with free().
+ *         On errors NULL is returned.
+ */
+unsigned int *db_get_interrupted_submissions(dbconn *dbc) {
+	PGresult *dbres = NULL;
+	char sql[256];
+	unsigned int *ret = NULL;
+	int i;
+
+	snprintf(sql, 254,
+		 "SELECT submid FROM submissionqueue WHERE status IN (%i, %i) ORDER BY submid",
+		 STAT_ASSIGNED, STAT_INPROG);
+	dbres = PQexec(dbc->db, sql);
+	if( PQresultStatus(dbres) != PGRES_TUPLES_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to look up interrupted submissions: %s",
+			 dbc->id, PQresultErrorMessage(dbres));
+		PQclear(dbres);
+		return NULL;
+	}
+
+	ret = malloc_nullsafe(dbc->log, (PQntuples(dbres) + 1) * sizeof(unsigned int));
+	for( i = 0; i < PQntuples(dbres); i++ ) {
+		ret[i] = atoi_nullsafe(PQgetvalue(dbres, i, 0));
+	}
+	PQclear(dbres);
+	return ret;
+}
+
+
+/**
+ * Recovers submissions left assigned or in progress when rteval-parserd stopped
+ * unexpectedly.  Submissions where the report is registered are marked as successful.
+ * The others are put back into the submission queue, unless they have already been
+ * attempted max_attempts times, which are marked as failed.  An interrupted attempt counts
+ * as an attempt, so a report crashing the parser is not tried forever.
+ *
+ * @param dbc           Database handler where to perform the SQL query
+ * @param max_attempts  Maximum number of attempts of a submission
+ * @param requeued      Returns the number of submissions put back into the queue
+ * @param completed     Returns the number of submissions found to be registered
+ * @param failed        Returns the number of submissions given up
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+int db_recover_submissions(dbconn *dbc, unsigned int max_attempts, unsigned int *requeued,
+			   unsigned int *completed, unsigned int *failed) {
+	PGresult *dbres = NULL;
+	char sql[2048];
+	int i, status;
+
+	*requeued = *completed = *failed = 0;
+	if( dbc->sqlschemaver >= 106 ) {
+		snprintf(sql, 2046,
+			 "UPDATE submissionqueue AS sq"
+			 "   SET status = CASE WHEN registered THEN %i"
+			 "                     WHEN attempts + 1 >= %u THEN %i"
+			 "                     ELSE %i END,"
+			 "       parseend = CASE WHEN registered OR attempts + 1 >= %u THEN NOW()"
+			 "                       ELSE NULL END,"
+			 "       attempts = attempts + 1, retry_after = NULL"
+			 "  FROM (SELECT submid, (EXISTS (SELECT 1 FROM rtevalruns r WHERE r.submid = q.submid)"
+			 "                        OR EXISTS (SELECT 1 FROM rtevalrun_snapshots s"
+			 "                                    WHERE s.submid = q.submid)) AS registered"
+			 "          FROM submissionqueue q WHERE status IN (%i, %i)) AS found"
+			 " WHERE sq.submid = found.submid"
+			 " RETURNING sq.status",
+			 STAT_SUCCESS, max_attempts, STAT_UNKNFAIL, STAT_NEW, max_attempts,
+			 STAT_ASSIGNED, STAT_INPROG);
+	} else {
+		snprintf(sql, 2046,
+			 "UPDATE submissionqueue AS sq"
+			 "   SET status = CASE WHEN EXISTS (SELECT 1 FROM rtevalruns r"
+			 "                                   WHERE r.submid = sq.submid) THEN %i"
+			 "                     ELSE %i END"
+			 " WHERE status IN (%i, %i)"
+			 " RETURNING sq.status",
+			 STAT_SUCCESS, STAT_NEW, STAT_ASSIGNED, STAT_INPROG);
+	}
+	dbres = PQexec(dbc->db, sql);
+	if( PQresultStatus(dbres) != PGRES_TUPLES_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to recover interrupted submissions: %s",
+			 dbc->id, PQresultErrorMessage(dbres));
+		PQclear(dbres);
+		return -1;
+	}
+
+	for( i = 0; i < PQntuples(dbres); i++ ) {
+		status = atoi_nullsafe(PQgetvalue(dbres, i, 0));
+		if( status == STAT_NEW ) {
+			(*requeued)++;
+		} else if( status == STAT_SUCCESS ) {
+			(*completed)++;
+		} else {
+			(*failed)++;
+		}
+	}
+	PQclear(dbres);
+	return 1;
+}
+
+
+/**
+ * Registers information into the 'systems' and 'systems_hostname' tables, based on the
+ * summary/report XML file from rteval.
+ *
+ * @param dbc        Database handler where to perform the SQL queries
+ * @param xslt       A pointer to a parsed 'xmlparser.xsl' XSLT template
+ * @param summaryxml The XML report from rteval
+ * @param sysinfo    The 'systems' table data of the report, if already transformed by
+ *                   shard_route().  If NULL, the report is transformed here.
+ *
+ * @return Returns a value > 0 on success, which is a unique reference to the system of the report.
+ *         If the function detects that this system is already registered, the 'syskey' reference will
+ *         be reused.  On errors, -1 will be returned.
+ */
+int db_register_system(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml, xmlDoc *sysinfo) {
+	PGresult *dbres = NULL;
+	eurephiaVALUES *dbdata = NULL;
+	xmlDoc *sysinfo_d = NULL, *hostinfo_d = NULL;
+	parseParams prms;
+	char sqlq[4098];
+	char *sysid = NULL;  // SHA1 value of the system id
+	char *ipaddr = NULL, *hostname = NULL;
+	int syskey = -1;
+	struct timespec tstart;
+
+	if( sysinfo ) {
+		sysinfo_d = sysinfo;
+	} else {
+		memset(&prms, 0, sizeof(parseParams));
+		prms.table = "systems";
+		sysinfo_d = pgsql_parseToSQLdata(dbc, xslt, summaryxml, &prms);
+	}
+	if( !sysinfo_d ) {
+		writelog(dbc->log, LOG_ERR, "[Connection %i] Could not parse the input XML data", dbc->id);
+		syskey= -1;
 		goto exit;
 	}
 	sysid = sqldataGetValue(dbc->log, sysinfo_d, "sysid", 0);
@@ -819,7 +1424,7 @@ int db_register_system(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml) {
 
 	memset(&sqlq, 0, 4098);
 	snprintf(sqlq, 4096, "SELECT syskey FROM systems WHERE sysid = '%.256s'", sysid);
-	free_nullsafe(sysid);
+	free_arena(sysid);
 	dbres = PQexec(dbc->db, sqlq);
 	if( PQresultStatus(dbres) != PGRES_TUPLES_OK ) {
 		writelog(dbc->log, LOG_ALERT, "[Connection %i] SQL %s",
@@ -847,7 +1452,11 @@ int db_register_system(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml) {
 			goto exit;
 		}
 		syskey = atoi_nullsafe(dbdata->val);
+		parsestats_timer_start(&tstart);
 		hostinfo_d = sqldataGetHostInfo(dbc->log, xslt, summaryxml, syskey, &hostname, &ipaddr);
+		if( dbc->stats ) {
+			dbc->stats->transform_time += parsestats_elapsed(&tstart);
+		}
 		if( !hostinfo_d ) {
 			syskey = -1;
 			goto exit;
@@ -860,7 +1469,11 @@ int db_register_system(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml) {
 
 	} else if( PQntuples(dbres) == 1 ) { // System found - check if the host IP is known or not
 		syskey = atoi_nullsafe(PQgetvalue(dbres, 0, 0));
+		parsestats_timer_start(&tstart);
 		hostinfo_d = sqldataGetHostInfo(dbc->log, xslt, summaryxml, syskey, &hostname, &ipaddr);
+		if( dbc->stats ) {
+			dbc->stats->transform_time += parsestats_elapsed(&tstart);
+		}
 		if( !hostinfo_d ) {
 			syskey = -1;
 			goto exit;
@@ -906,9 +1519,9 @@ int db_register_system(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml) {
 	}
 
  exit:
-	free_nullsafe(hostname);
-	free_nullsafe(ipaddr);
-	if( sysinfo_d ) {
+	free_arena(hostname);
+	free_arena(ipaddr);
+	if( sysinfo_d && (sysinfo_d != sysinfo) ) {
 		xmlFreeDoc(sysinfo_d);
 	}
 	if( hostinfo_d ) {
@@ -949,6 +1562,41 @@ int db_get_new_rterid(dbconn *dbc) {
 }
 
 
+/**
+ * Checks if a report is registered in the database, either as a complete report or as a
+ * snapshot of an rteval run
+ *
+ * @param dbc     Database handler where to perform the SQL query
+ * @param submid  Submission ID of the report
+ *
+ * @return Returns 1 if the report is registered, 0 if not found.  On errors -1 is returned.
+ */
+int db_report_registered(dbconn *dbc, unsigned int submid) {
+	PGresult *dbres = NULL;
+	char sql[256];
+	int ret = -1;
+
+	if( dbc->sqlschemaver >= 106 ) {
+		snprintf(sql, 254,
+			 "SELECT 1 FROM rtevalruns WHERE submid = %u"
+			 " UNION ALL SELECT 1 FROM rtevalrun_snapshots WHERE submid = %u",
+			 submid, submid);
+	} else {
+		snprintf(sql, 254, "SELECT 1 FROM rtevalruns WHERE submid = %u", submid);
+	}
+	dbres = PQexec(dbc->db, sql);
+	if( PQresultStatus(dbres) != PGRES_TUPLES_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to look up submid %u: %s",
+			 dbc->id, submid, PQresultErrorMessage(dbres));
+	} else {
+		ret = (PQntuples(dbres) > 0 ? 1 : 0);
+	}
+	PQclear(dbres);
+	return ret;
+}
+
+
 /**
  * Registers information into the 'rtevalruns' and 'rtevalruns_details' tables
  *
@@ -977,7 +1625,7 @@ int db_register_rtevalrun(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml,
 	prms.rterid = rterid;
 	prms.submid = submid;
 	prms.report_filename = report_fname;
-	rtevalrun_d = parseToSQLdata(dbc->log, xslt, summaryxml, &prms);
+	rtevalrun_d = pgsql_parseToSQLdata(dbc, xslt, summaryxml, &prms);
 	if( !rtevalrun_d ) {
 		writelog(dbc->log, LOG_ERR,
 			 "[Connection %i] Could not parse the input XML data", dbc->id);
@@ -1005,7 +1653,7 @@ int db_register_rtevalrun(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml,
 	memset(&prms, 0, sizeof(parseParams));
 	prms.table = "rtevalruns_details";
 	prms.rterid = rterid;
-	rtevalrundets_d = parseToSQLdata(dbc->log, xslt, summaryxml, &prms);
+	rtevalrundets_d = pgsql_parseToSQLdata(dbc, xslt, summaryxml, &prms);
 	if( !rtevalrundets_d ) {
 		writelog(dbc->log, LOG_ERR,
 			 "[Connection %i] Could not parse the input XML data (rtevalruns_details)",
@@ -1067,7 +1715,7 @@ int db_register_measurements(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryx
         for_array_str(tbl, i, dbc->measurement_tbls) {
                 writelog(dbc->log, LOG_DEBUG, "Processing measurement table '%s'", tbl);
 		prms.table = tbl;
-		meas_d = parseToSQLdata(dbc->log, xslt, summaryxml, &prms);
+		meas_d = pgsql_parseToSQLdata(dbc, xslt, summaryxml, &prms);
 		if( meas_d && meas_d->children ) {
 			// Insert SQL data which was found and generated
 			dbdata = pgsql_INSERT(dbc, meas_d);
@@ -1098,3 +1746,518 @@ int db_register_measurements(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryx
  exit:
 	return result;
 }
+
+
+/**
+ * Looks up an rteval run which is submitted as snapshots.  All snapshots of the same run
+ * are serialised by a transaction level lock on the run ID, thus this must be called
+ * inside the transaction registering the snapshot.  Requires SQL schema version 1.6.
+ *
+ * @param dbc     Database handler where to perform the SQL queries
+ * @param snap    Snapshot information of the report
+ * @param rterid  Return pointer for the rteval run ID, 0 if no snapshot of this run is
+ *                registered yet
+ * @param latest  Return pointer, set to 1 if no later snapshot of this run is registered
+ *
+ * @return Returns 1 if the snapshot is not registered, 0 if it is already registered.
+ *         On errors -1 is returned.
+ */
+int db_snapshot_lookup(dbconn *dbc, reportSnapshot *snap, int *rterid, int *latest) {
+	PGresult *dbres = NULL;
+	const char *params[2];
+	char seq_s[34];
+	int ret = -1;
+
+	if( dbc->sqlschemaver < 106 ) {
+		writelog(dbc->log, LOG_ERR,
+			 "[Connection %i] Snapshot reports requires SQL schema version 1.6",
+			 dbc->id);
+		return -1;
+	}
+
+	params[0] = snap->runid;
+	dbres = PQexecParams(dbc->db, "SELECT pg_advisory_xact_lock(hashtext($1))",
+			     1, NULL, params, NULL, NULL, 0);
+	if( PQresultStatus(dbres) != PGRES_TUPLES_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to lock rteval run %s: %s",
+			 dbc->id, snap->runid, PQresultErrorMessage(dbres));
+		goto exit;
+	}
+	PQclear(dbres);
+
+	snprintf(seq_s, 33, "%u", snap->seq);
+	params[1] = seq_s;
+	dbres = PQexecParams(dbc->db,
+			     "SELECT min(rterid), max(seq), bool_or(seq = $2::INTEGER)"
+			     "  FROM rtevalrun_snapshots WHERE runid = $1",
+			     2, NULL, params, NULL, NULL, 0);
+	if( (PQresultStatus(dbres) != PGRES_TUPLES_OK) || (PQntuples(dbres) != 1) ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to look up rteval run %s: %s",
+			 dbc->id, snap->runid, PQresultErrorMessage(dbres));
+		goto exit;
+	}
+	*rterid = atoi_nullsafe(PQgetvalue(dbres, 0, 0));
+	*latest = (snap->seq > (unsigned int) atoi_nullsafe(PQgetvalue(dbres, 0, 1)));
+	ret = (strcmp(PQgetvalue(dbres, 0, 2), "t") == 0 ? 0 : 1);
+ exit:
+	PQclear(dbres);
+	return ret;
+}
+
+
+/**
+ * Records that a snapshot of an rteval run is registered
+ *
+ * @param dbc     Database handler where to perform the SQL query
+ * @param snap    Snapshot information of the report
+ * @param rterid  rteval run ID the snapshot belongs to
+ * @param submid  Submission ID of the snapshot
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+int db_register_snapshot(dbconn *dbc, reportSnapshot *snap, int rterid, unsigned int submid) {
+	PGresult *dbres = NULL;
+	const char *params[5];
+	char seq_s[34], rterid_s[34], submid_s[34];
+	int ret = 1;
+
+	snprintf(seq_s, 33, "%u", snap->seq);
+	snprintf(rterid_s, 33, "%i", rterid);
+	snprintf(submid_s, 33, "%u", submid);
+	params[0] = snap->runid;
+	params[1] = seq_s;
+	params[2] = rterid_s;
+	params[3] = submid_s;
+	params[4] = (snap->final ? "t" : "f");
+	dbres = PQexecParams(dbc->db,
+			     "INSERT INTO rtevalrun_snapshots (runid, seq, rterid, submid, final)"
+			     " VALUES ($1, $2, $3, $4, $5)",
+			     5, NULL, params, NULL, NULL, 0);
+	if( PQresultStatus(dbres) != PGRES_COMMAND_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to register snapshot %u of rteval run %s: %s",
+			 dbc->id, snap->seq, snap->runid, PQresultErrorMessage(dbres));
+		ret = -1;
+	}
+	PQclear(dbres);
+	return ret;
+}
+
+
+/**
+ * Updates the run duration and load average of an rteval run from a later snapshot
+ *
+ * @param dbc           Database handler where to perform the SQL queries
+ * @param xslt          A pointer to a parsed 'xmlparser.xsl' XSLT template
+ * @param summaryxml    The XML snapshot report from rteval
+ * @param submid        Submission ID of the snapshot
+ * @param syskey        System key, as returned by db_register_system()
+ * @param rterid        rteval run ID to update
+ * @param report_fname  File name of the archived snapshot
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+int db_update_rtevalrun(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml,
+			unsigned int submid, int syskey, int rterid, const char *report_fname)
+{
+	xmlDoc *rtevalrun_d = NULL;
+	parseParams prms;
+	PGresult *dbres = NULL;
+	const char *params[3];
+	char *duration = NULL, *loadavg = NULL, rterid_s[34];
+	int ret = -1;
+
+	memset(&prms, 0, sizeof(parseParams));
+	prms.table = "rtevalruns";
+	prms.syskey = syskey;
+	prms.rterid = rterid;
+	prms.submid = submid;
+	prms.report_filename = report_fname;
+	rtevalrun_d = pgsql_parseToSQLdata(dbc, xslt, summaryxml, &prms);
+	if( !rtevalrun_d ) {
+		writelog(dbc->log, LOG_ERR,
+			 "[Connection %i] Could not parse the input XML data", dbc->id);
+		return -1;
+	}
+	duration = sqldataGetValue(dbc->log, rtevalrun_d, "run_duration", 0);
+	loadavg = sqldataGetValue(dbc->log, rtevalrun_d, "load_avg", 0);
+
+	// A snapshot without load information keeps the earlier load average
+	snprintf(rterid_s, 33, "%i", rterid);
+	params[0] = duration;
+	params[1] = (strlen_nullsafe(loadavg) > 0 ? loadavg : NULL);
+	params[2] = rterid_s;
+	dbres = PQexecParams(dbc->db,
+			     "UPDATE rtevalruns SET run_duration = $1,"
+			     "       load_avg = COALESCE($2::REAL, load_avg)"
+			     " WHERE rterid = $3",
+			     3, NULL, params, NULL, NULL, 0);
+	if( PQresultStatus(dbres) != PGRES_COMMAND_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to update rteval run %i: %s",
+			 dbc->id, rterid, PQresultErrorMessage(dbres));
+	} else {
+		ret = 1;
+	}
+	PQclear(dbres);
+	free_arena(duration);
+	free_arena(loadavg);
+	xmlFreeDoc(rtevalrun_d);
+	return ret;
+}
+
+
+/**
+ * Executes an SQL statement for a particular rteval run, used when merging snapshots
+ * and when reloading measurement data
+ *
+ * @param dbc     Database handler where to perform the SQL query
+ * @param fmt     SQL statement, where each %i is replaced by the rterid
+ * @param rterid  rteval run ID
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int pgsql_exec_rterid(dbconn *dbc, const char *fmt, int rterid) {
+	PGresult *dbres = NULL;
+	char sql[512];
+	int ret = 1;
+
+	snprintf(sql, 510, fmt, rterid, rterid);
+	dbres = PQexec(dbc->db, sql);
+	if( PQresultStatus(dbres) != PGRES_COMMAND_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to update the measurement data (rterid %i): %s",
+			 dbc->id, rterid, PQresultErrorMessage(dbres));
+		ret = -1;
+	}
+	PQclear(dbres);
+	return ret;
+}
+
+
+/**
+ * Adds the measurement data of a snapshot to an already registered rteval run.  The
+ * histogram buckets of a snapshot only contains the samples since the previous snapshot,
+ * and are added to the registered buckets.  The statistics of a snapshot covers the whole
+ * run so far, and replaces the registered statistics if this is the latest snapshot.
+ * Other measurement data is appended.
+ *
+ * @param dbc        Database handler where to perform the SQL queries
+ * @param xslt       A pointer to a parsed 'xmlparser.xsl' XSLT template
+ * @param summaryxml The XML snapshot report from rteval
+ * @param rterid     rteval run ID the snapshot belongs to
+ * @param latest     If set, no later snapshot of this run is registered
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+int db_merge_measurements(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml,
+			  int rterid, int latest)
+{
+	xmlDoc *meas_d = NULL;
+	parseParams prms;
+	eurephiaVALUES *dbdata = NULL;
+	char *tbl = NULL;
+	int i;
+
+	memset(&prms, 0, sizeof(parseParams));
+	prms.rterid = rterid;
+
+	i = 0;
+	for_array_str(tbl, i, dbc->measurement_tbls) {
+		int stats = (strcmp(tbl, "cyclic_statistics") == 0);
+
+		if( stats && !latest ) {
+			// A later snapshot has already provided more recent statistics
+			continue;
+		}
+		prms.table = tbl;
+		meas_d = pgsql_parseToSQLdata(dbc, xslt, summaryxml, &prms);
+		if( !meas_d || !meas_d->children ) {
+			if( meas_d ) {
+				xmlFreeDoc(meas_d);
+			}
+			continue;
+		}
+
+		if( stats && (pgsql_exec_rterid(dbc, "DELETE FROM cyclic_statistics WHERE rterid = %i",
+						rterid) < 0) ) {
+			xmlFreeDoc(meas_d);
+			return -1;
+		}
+
+		dbdata = pgsql_INSERT(dbc, meas_d);
+		xmlFreeDoc(meas_d);
+		if( !dbdata ) {
+			return -1;
+		}
+		eFree_values(dbdata);
+	}
+
+	return db_merge_histogram(dbc, rterid);
+}
+
+
+/**
+ * Sums up the histogram buckets of an rteval run registered from several snapshots, so
+ * each bucket is only registered once
+ *
+ * @param dbc     Database handler where to perform the SQL query
+ * @param rterid  rteval run ID
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+int db_merge_histogram(dbconn *dbc, int rterid)
+{
+	return pgsql_exec_rterid(dbc,
+				 "WITH old AS (DELETE FROM cyclic_histogram WHERE rterid = %i"
+				 "             RETURNING core, index, value)"
+				 " INSERT INTO cyclic_histogram (rterid, core, index, value)"
+				 " SELECT %i, core, index, sum(value) FROM old GROUP BY core, index",
+				 rterid);
+}
+
+
+/**
+ * Checks if an rteval run is registered
+ *
+ * @param dbc     Database handler where to perform the SQL query
+ * @param rterid  rteval run ID
+ *
+ * @return Returns 1 if the rteval run is registered, 0 if not found.  On errors -1 is returned.
+ */
+int db_rtevalrun_exists(dbconn *dbc, int rterid)
+{
+	PGresult *dbres = NULL;
+	char sql[128];
+	int ret = -1;
+
+	snprintf(sql, 126, "SELECT 1 FROM rtevalruns WHERE rterid = %i", rterid);
+	dbres = PQexec(dbc->db, sql);
+	if( PQresultStatus(dbres) != PGRES_TUPLES_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to look up rterid %i: %s",
+			 dbc->id, rterid, PQresultErrorMessage(dbres));
+	} else {
+		ret = (PQntuples(dbres) > 0 ? 1 : 0);
+	}
+	PQclear(dbres);
+	return ret;
+}
+
+
+/**
+ * Looks up the submission which registered an rteval run
+ *
+ * @param dbc     Database handler where to perform the SQL query
+ * @param rterid  rteval run ID
+ *
+ * @return Returns the submission ID, or 0 if the rteval run is not registered.  On errors
+ *         -1 is returned.
+ */
+int db_rtevalrun_submid(dbconn *dbc, int rterid)
+{
+	PGresult *dbres = NULL;
+	char sql[128];
+	int ret = -1;
+
+	snprintf(sql, 126, "SELECT submid FROM rtevalruns WHERE rterid = %i", rterid);
+	dbres = PQexec(dbc->db, sql);
+	if( PQresultStatus(dbres) != PGRES_TUPLES_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to look up rterid %i: %s",
+			 dbc->id, rterid, PQresultErrorMessage(dbres));
+	} else {
+		ret = (PQntuples(dbres) > 0 ? atoi_nullsafe(PQgetvalue(dbres, 0, 0)) : 0);
+	}
+	PQclear(dbres);
+	return ret;
+}
+
+
+/**
+ * Retrieves the client ID of a submission in the submission queue
+ *
+ * @param dbc       Database handler where to perform the SQL query
+ * @param submid    Submission ID
+ * @param clientid  Buffer for the client ID
+ * @param len       Size of the clientid buffer
+ *
+ * @return Returns 1 on success, 0 if the submission is not found.  On errors -1 is returned.
+ */
+int db_get_submission_clientid(dbconn *dbc, unsigned int submid, char *clientid, size_t len)
+{
+	PGresult *dbres = NULL;
+	char sql[128];
+	int ret = -1;
+
+	snprintf(sql, 126, "SELECT clientid FROM submissionqueue WHERE submid = %u", submid);
+	dbres = PQexec(dbc->db, sql);
+	if( PQresultStatus(dbres) != PGRES_TUPLES_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to look up submid %u: %s",
+			 dbc->id, submid, PQresultErrorMessage(dbres));
+	} else if( PQntuples(dbres) > 0 ) {
+		snprintf(clientid, len, "%s", PQgetvalue(dbres, 0, 0));
+		ret = 1;
+	} else {
+		ret = 0;
+	}
+	PQclear(dbres);
+	return ret;
+}
+
+
+/**
+ * Replaces the measurement data of an already registered rteval run, in the configured
+ * measurement tables.  The records are loaded with COPY.  For rteval runs submitted as
+ * snapshots, this is called once for each snapshot in order, with replace set on the
+ * first one only.  db_merge_histogram() must be called after the last snapshot.
+ *
+ * @param dbc        Database handler where to perform the SQL queries
+ * @param xslt       A pointer to a parsed 'xmlparser.xsl' XSLT template
+ * @param summaryxml The XML report from rteval
+ * @param rterid     rteval run ID the report belongs to
+ * @param replace    If set, the registered measurement data is removed first
+ * @param latest     If set, this is the last report of the rteval run
+ *
+ * @return Returns the number of records loaded on success, otherwise -1
+ */
+int db_reload_measurements(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml,
+			   int rterid, int replace, int latest)
+{
+	xmlDoc *meas_d = NULL;
+	parseParams prms;
+	char *tbl = NULL, sql[256];
+	int i, rows, total = 0;
+
+	memset(&prms, 0, sizeof(parseParams));
+	prms.rterid = rterid;
+
+	i = 0;
+	for_array_str(tbl, i, dbc->measurement_tbls) {
+		if( replace ) {
+			snprintf(sql, 254, "DELETE FROM %s WHERE rterid = %%i", tbl);
+			if( pgsql_exec_rterid(dbc, sql, rterid) < 0 ) {
+				return -1;
+			}
+		}
+
+		// Statistics covers the whole run, only the last snapshot is used
+		if( !latest && (strcmp(tbl, "cyclic_statistics") == 0) ) {
+			continue;
+		}
+		prms.table = tbl;
+		meas_d = pgsql_parseToSQLdata(dbc, xslt, summaryxml, &prms);
+		if( !meas_d || !meas_d->children ) {
+			if( meas_d ) {
+				xmlFreeDoc(meas_d);
+			}
+			continue;
+		}
+		rows = pgsql_COPY(dbc, meas_d);
+		xmlFreeDoc(meas_d);
+		if( rows < 0 ) {
+			return -1;
+		}
+		total += rows;
+	}
+	return total;
+}
+
+
+/**
+ * Registers the statistics collected while processing a submission into the
+ * 'submission_stats' table.  This table is only available from SQL schema version 1.6,
+ * on older schemas this function silently does nothing.
+ *
+ * @param dbc     Database handler where to perform the SQL queries
+ * @param submid  Submission ID the statistics belongs to
+ * @param status  The final status code of the submission
+ * @param stats   Pointer to the collected statistics
+ *
+ * @return Returns 1 on success, 0 if the database schema does not support it, otherwise -1
+ */
+int db_register_submission_stats(dbconn *dbc, unsigned int submid, int status, parseStats_t *stats)
+{
+	PGresult *dbres = NULL;
+	const char *params[13];
+	char submid_s[34], status_s[34], size_s[34], ptime_s[34], ttime_s[34], itime_s[34],
+		ctime_s[34], rows_s[34], lane_s[34], wait_s[34], attempt_s[34],
+		*tables = NULL, *tblrows = NULL;
+	size_t tbl_len = 3, rows_len = 3;
+	unsigned int i;
+	int ret = -1;
+
+	if( dbc->sqlschemaver < 106 ) {
+		return 0;
+	}
+
+	// Build PostgreSQL arrays of the table names and the records inserted into them
+	for( i = 0; i < stats->numtables; i++ ) {
+		tbl_len += strlen(stats->tables[i].table) + 3;
+		rows_len += 12;
+	}
+	tables = malloc_nullsafe(dbc->log, tbl_len);
+	tblrows = malloc_nullsafe(dbc->log, rows_len);
+	strcpy(tables, "{");
+	strcpy(tblrows, "{");
+	for( i = 0; i < stats->numtables; i++ ) {
+		char tmp[14];
+
+		strcat(tables, "\"");
+		strcat(tables, stats->tables[i].table);
+		strcat(tables, (i < (stats->numtables - 1) ? "\"," : "\""));
+
+		snprintf(tmp, 13, (i < (stats->numtables - 1) ? "%u," : "%u"), stats->tables[i].rows);
+		strcat(tblrows, tmp);
+	}
+	strcat(tables, "}");
+	strcat(tblrows, "}");
+
+	snprintf(submid_s, 33, "%u", submid);
+	snprintf(status_s, 33, "%i", status);
+	snprintf(size_s, 33, "%lld", (long long) stats->report_size);
+	snprintf(ptime_s, 33, "%.6f", stats->parse_time);
+	snprintf(ttime_s, 33, "%.6f", stats->transform_time);
+	snprintf(itime_s, 33, "%.6f", stats->insert_time);
+	snprintf(ctime_s, 33, "%.6f", stats->commit_time);
+	snprintf(rows_s, 33, "%u", parsestats_total_rows(stats));
+	params[0] = submid_s;
+	params[1] = status_s;
+	params[2] = size_s;
+	params[3] = ptime_s;
+	params[4] = ttime_s;
+	params[5] = itime_s;
+	params[6] = ctime_s;
+	params[7] = rows_s;
+	params[8] = tables;
+	params[9] = tblrows;
+	snprintf(lane_s, 33, "%u", stats->lane);
+	snprintf(wait_s, 33, "%.6f", stats->queue_wait);
+	params[10] = lane_s;
+	params[11] = wait_s;
+	snprintf(attempt_s, 33, "%u", stats->attempt);
+	params[12] = attempt_s;
+
+	dbres = PQexecParams(dbc->db,
+			     "INSERT INTO submission_stats (submid, status, report_size, parse_time,"
+			     "                              transform_time, insert_time, commit_time,"
+			     "                              total_rows, tables, table_rows,"
+			     "                              lane, queue_wait, attempt)"
+			     " VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13)",
+			     13, NULL, params, NULL, NULL, 0);
+	if( PQresultStatus(dbres) != PGRES_COMMAND_OK ) {
+		writelog(dbc->log, LOG_ALERT,
+			 "[Connection %i] Failed to register submission statistics (submid: %i): %s",
+			 dbc->id, submid, PQresultErrorMessage(dbres));
+		ret = -1;
+	} else {
+		ret = 1;
+	}
+	PQclear(dbres);
+	free_nullsafe(tables);
+	free_nullsafe(tblrows);
+	return ret;
+}
@@ -32,6 +32,9 @@
 #include <eurephia_values.h>
 #include <parsethread.h>
 #include <xmlparser.h>
+#include <parsestats.h>
+
+#define PGSQL_COPY_BUFFER 65536   /**< Bytes of COPY data sent to the server at a time */
 
 /**
  *  A unified database abstraction layer, providing log support
@@ -42,24 +45,70 @@ typedef struct {
 	PGconn *db;                /**< Database connection handler */
 	unsigned int sqlschemaver; /**< SQL schema version, retrieved from rteval_info table */
 	array_str_t *measurement_tbls; /**< Measurement tables to process */
+	parseStats_t *stats;       /**< If set, timing and record counts are collected here */
 } dbconn;
 
+/**
+ *  The records of a sqldata document, encoded in the COPY text format
+ */
+typedef struct {
+	const char *table;         /**< Table name, points into the sqldata document */
+	char *columns;             /**< Comma separated list of the columns */
+	unsigned int fields;       /**< Number of columns */
+	unsigned int schemaver;    /**< SQL schema version needed for the data */
+	char *data;                /**< COPY data, one line per record */
+	size_t len;                /**< Length of the COPY data */
+	size_t size;               /**< Allocated size of data */
+	unsigned int rows;         /**< Number of records */
+	size_t bytes;              /**< Size of the values, before escaping */
+} copyData;
+
 /* Generic database function */
 dbconn *db_connect(eurephiaVALUES *cfg, unsigned int id, LogContext *log);
 int db_ping(dbconn *dbc);
+int db_available_connections(dbconn *dbc);
 void db_disconnect(dbconn *dbc);
 int db_begin(dbconn *dbc);
 int db_commit(dbconn *dbc);
 int db_rollback(dbconn *dbc);
+int db_check_idle(dbconn *dbc);
+int db_connection_lost(dbconn *dbc);
+void db_init_offline(void);
+int db_encode_copydata(LogContext *log, xmlDoc *sqldoc, copyData *cd);
+void db_free_copydata(copyData *cd);
 
 /* rteval specific database functions */
-int db_wait_notification(dbconn *dbc, const int *shutdown, const char *listenfor);
-parseJob_t *db_get_submissionqueue_job(dbconn *dbc, pthread_mutex_t *mtx);
+int db_listen(dbconn *dbc, const char *listenfor);
+int db_get_notifications(dbconn *dbc);
+parseJob_t *db_get_submissionqueue_candidates(dbconn *dbc, unsigned int window,
+					      unsigned int max, unsigned int *count);
 int db_update_submissionqueue(dbconn *dbc, unsigned int submid, int status);
-int db_register_system(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml);
+int db_register_submission(dbconn *dbc, const char *clientid, const char *filename, int status,
+			   off_t size);
+int db_requeue_submission(dbconn *dbc, unsigned int submid);
+int db_retry_submission(dbconn *dbc, unsigned int submid, unsigned int delay);
+int db_get_next_retry(dbconn *dbc);
+unsigned int *db_get_interrupted_submissions(dbconn *dbc);
+int db_recover_submissions(dbconn *dbc, unsigned int max_attempts, unsigned int *requeued,
+			   unsigned int *completed, unsigned int *failed);
+int db_register_system(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml, xmlDoc *sysinfo);
 int db_get_new_rterid(dbconn *dbc);
+int db_report_registered(dbconn *dbc, unsigned int submid);
 int db_register_rtevalrun(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml,
 			  unsigned int submid, int syskey, int rterid, const char *report_fname);
 int db_register_measurements(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml, int rterid);
+int db_snapshot_lookup(dbconn *dbc, reportSnapshot *snap, int *rterid, int *latest);
+int db_register_snapshot(dbconn *dbc, reportSnapshot *snap, int rterid, unsigned int submid);
+int db_update_rtevalrun(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml,
+			unsigned int submid, int syskey, int rterid, const char *report_fname);
+int db_merge_measurements(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml,
+			  int rterid, int latest);
+int db_merge_histogram(dbconn *dbc, int rterid);
+int db_rtevalrun_exists(dbconn *dbc, int rterid);
+int db_rtevalrun_submid(dbconn *dbc, int rterid);
+int db_get_submission_clientid(dbconn *dbc, unsigned int submid, char *clientid, size_t len);
+int db_reload_measurements(dbconn *dbc, xsltStylesheet *xslt, xmlDoc *summaryxml,
+			   int rterid, int replace, int latest);
+int db_register_submission_stats(dbconn *dbc, unsigned int submid, int status, parseStats_t *stats);
 
 #endif
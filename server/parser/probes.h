@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   probes.h
+ * @date   Sun Oct 18 11:02:47 2026
+ *
+ * @brief  Static (SDT/USDT) trace points in rteval-parserd
+ *
+ * When <sys/sdt.h> is available (systemtap-sdt-devel), these macros expands to
+ * SDT probes under the 'rteval_parserd' provider.  The probes are a single NOP
+ * instruction when no tracer is attached, and can be used by perf, bpftrace and
+ * SystemTap.  Without <sys/sdt.h> the macros expands to nothing.  See the
+ * "Static trace points" section in README.parser for the available probes.
+ *
+ */
+
+#ifndef _RTEVAL_PROBES_H
+#define _RTEVAL_PROBES_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#if defined(HAVE_SYS_SDT_H) && !defined(DISABLE_SDT_PROBES)
+#include <sys/sdt.h>
+
+#define PROBE1(name, a1)                 DTRACE_PROBE1(rteval_parserd, name, a1)
+#define PROBE2(name, a1, a2)             DTRACE_PROBE2(rteval_parserd, name, a1, a2)
+#define PROBE3(name, a1, a2, a3)         DTRACE_PROBE3(rteval_parserd, name, a1, a2, a3)
+#define PROBE4(name, a1, a2, a3, a4)     DTRACE_PROBE4(rteval_parserd, name, a1, a2, a3, a4)
+
+#else
+
+#define PROBE1(name, a1)                 do { } while(0)
+#define PROBE2(name, a1, a2)             do { } while(0)
+#define PROBE3(name, a1, a2, a3)         do { } while(0)
+#define PROBE4(name, a1, a2, a3, a4)     do { } while(0)
+
+#endif
+
+#endif
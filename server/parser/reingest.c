@@ -0,0 +1,732 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   reingest.c
+ * @date   Mon Oct 19 03:12:40 2026
+ *
+ * @brief  Loads the measurement data of archived reports again
+ *
+ * When new measurement tables are added to the database schema, the reports
+ * registered earlier have no data in them.  The re-ingest mode walks a report
+ * archive directory, and loads the selected measurement tables again from each
+ * archived report-<rterid>[-<snapshot>].xml file, for rteval runs which are
+ * registered in the database.  Nothing else of the rteval run is touched.
+ *
+ * All files of an rteval run are processed by one worker thread in a single
+ * transaction: the registered records in the selected tables are removed, and
+ * the records of each report are loaded with COPY, which is much faster than
+ * the INSERT queries used for new reports.  Snapshots are loaded in order and
+ * merged the same way as when they were received.
+ *
+ * The rterid of each completed rteval run is appended to a state file after
+ * COMMIT.  When restarted, the rteval runs found in the state file are skipped,
+ * so an interrupted re-ingest continues where it stopped.  As an rteval run is
+ * replaced as a whole, processing it twice gives the same result.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <dbpool.h>
+#include <shard.h>
+#include <settings.h>
+#include <parsestats.h>
+#include <reportfile.h>
+#include <reingest.h>
+
+/**
+ * One archived report file
+ */
+typedef struct {
+	char *fname;               /**< Full path of the report file */
+	char *clientid;            /**< Name of the directory of the report, the client ID as made safe by the archive */
+	int rterid;                /**< rteval run ID, from the file name */
+	unsigned int seq;          /**< Snapshot sequence number, 0 if not a snapshot */
+} ReingestFile;
+
+/**
+ * Result of processing an rteval run
+ */
+typedef enum { riDONE, riMISSING, riFAILED } ReingestResult;
+
+/**
+ * The re-ingest job
+ */
+typedef struct {
+	LogContext *log;           /**< Log context */
+	JobSettings *settings;     /**< Settings, for the XSLT template and the maximum report size */
+	array_str_t *tables;       /**< Measurement tables to load (config: reingest_tables) */
+	int histogram;             /**< Set if cyclic_histogram is one of the tables */
+	ShardMap *shards;          /**< Databases where the rteval runs are registered */
+	ReingestFile *files;       /**< All report files found, sorted by rterid and snapshot */
+	unsigned int nfiles;       /**< Number of report files found */
+	unsigned int allocated;    /**< Allocated size of files */
+	int *completed;            /**< Sorted rterids found in the state file */
+	unsigned int ncompleted;   /**< Number of rterids found in the state file */
+	FILE *statefp;             /**< State file, completed rterids are appended */
+	unsigned int next;         /**< Index of the first file of the next rteval run to process */
+	unsigned int runs;         /**< Number of rteval runs found */
+	unsigned int done;         /**< rteval runs loaded */
+	unsigned int resumed;      /**< rteval runs skipped, completed by an earlier re-ingest */
+	unsigned int missing;      /**< rteval runs skipped, not registered in the database */
+	unsigned int failed;       /**< rteval runs which failed */
+	unsigned long reports;     /**< Report files loaded */
+	unsigned long rows;        /**< Records loaded */
+	unsigned long long bytes;  /**< Bytes read from the report files */
+	struct timespec started;   /**< When the worker threads were started */
+	unsigned int running;      /**< Number of running worker threads */
+	int stop;                  /**< Set when the re-ingest is to be stopped */
+	pthread_mutex_t mtx;       /**< Protects the counters, next and the state file */
+} Reingest;
+
+/**
+ * A worker thread
+ */
+typedef struct {
+	Reingest *ri;              /**< The re-ingest job */
+	unsigned int id;           /**< Worker number, used in the log */
+	pthread_t thread;          /**< The thread */
+} ReingestWorker;
+
+
+/**
+ * Parses an archived report file name, report-<rterid>[-<snapshot>].xml[.<compression>]
+ *
+ * @param name    File name, without the directory
+ * @param rterid  Returns the rteval run ID
+ * @param seq     Returns the snapshot sequence number, 0 if not a snapshot
+ *
+ * @return Returns 1 if this is an archived report, otherwise 0
+ */
+int reingest_parse_name(const char *name, int *rterid, unsigned int *seq)
+{
+	const char *p = NULL;
+	char *end = NULL;
+
+	if( strncmp(name, "report-", 7) != 0 ) {
+		return 0;
+	}
+	p = name + 7;
+	*rterid = strtol(p, &end, 10);
+	if( (end == p) || (*rterid < 1) ) {
+		return 0;
+	}
+	*seq = 0;
+	if( *end == '-' ) {
+		p = end + 1;
+		*seq = strtoul(p, &end, 10);
+		if( (end == p) || (*seq < 1) ) {
+			return 0;
+		}
+	}
+	if( strncmp(end, ".xml", 4) != 0 ) {
+		return 0;
+	}
+	end += 4;
+	return ((*end == '\0') || (strcmp(end, ".gz") == 0) || (strcmp(end, ".bz2") == 0)
+		|| (strcmp(end, ".zst") == 0));
+}
+
+
+/**
+ * Finds all archived report files in a directory and its sub directories
+ *
+ * @param ri        Reingest
+ * @param path      Directory to search
+ * @param clientid  Name of the directory
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int reingest_scan(Reingest *ri, const char *path, const char *clientid)
+{
+	DIR *dir = NULL;
+	struct dirent *de = NULL;
+	struct stat st;
+	char *fname = NULL;
+	int ret = 1;
+
+	if( (dir = opendir(path)) == NULL ) {
+		writelog(ri->log, LOG_EMERG, "Could not read directory %s: %s", path, strerror(errno));
+		return -1;
+	}
+	while( (ret > 0) && ((de = readdir(dir)) != NULL) ) {
+		int rterid;
+		unsigned int seq;
+
+		// Skip ., .., the archive handoff records and the state file
+		if( de->d_name[0] == '.' ) {
+			continue;
+		}
+		fname = malloc_nullsafe(ri->log, strlen(path) + strlen(de->d_name) + 2);
+		sprintf(fname, "%s/%s", path, de->d_name);
+		if( lstat(fname, &st) < 0 ) {
+			free_nullsafe(fname);
+			continue;
+		}
+
+		if( S_ISDIR(st.st_mode) ) {
+			ret = reingest_scan(ri, fname, de->d_name);
+			free_nullsafe(fname);
+		} else if( S_ISREG(st.st_mode) && reingest_parse_name(de->d_name, &rterid, &seq) ) {
+			if( ri->nfiles == ri->allocated ) {
+				ri->allocated = (ri->allocated ? ri->allocated * 2 : 1024);
+				ri->files = realloc(ri->files, ri->allocated * sizeof(ReingestFile));
+			}
+			ri->files[ri->nfiles].fname = fname;
+			ri->files[ri->nfiles].clientid = strdup(clientid);
+			ri->files[ri->nfiles].rterid = rterid;
+			ri->files[ri->nfiles].seq = seq;
+			ri->nfiles++;
+		} else {
+			free_nullsafe(fname);
+		}
+	}
+	closedir(dir);
+	return ret;
+}
+
+
+/**
+ * Sort function for the report files, by rterid and then by snapshot
+ */
+static int reingest_cmp_files(const void *a, const void *b)
+{
+	const ReingestFile *fa = (const ReingestFile *) a, *fb = (const ReingestFile *) b;
+
+	if( fa->rterid != fb->rterid ) {
+		return (fa->rterid < fb->rterid ? -1 : 1);
+	}
+	return (fa->seq < fb->seq ? -1 : (fa->seq > fb->seq ? 1 : 0));
+}
+
+
+/**
+ * Sort and search function for the completed rterids
+ */
+static int reingest_cmp_rterid(const void *a, const void *b)
+{
+	int ra = *(const int *) a, rb = *(const int *) b;
+
+	return (ra < rb ? -1 : (ra > rb ? 1 : 0));
+}
+
+
+/**
+ * Opens the state file.  The rterids completed by an earlier re-ingest of the same tables
+ * are loaded, a state file for other tables is started over.
+ *
+ * @param ri         Reingest
+ * @param fname      File name of the state file
+ * @param tablelist  The selected tables, as configured
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int reingest_open_state(Reingest *ri, const char *fname, const char *tablelist)
+{
+	FILE *fp = NULL;
+	char line[4096], header[4096];
+	unsigned int allocated = 0;
+
+	snprintf(header, sizeof(header) - 2, "# tables: %s\n", tablelist);
+	if( (fp = fopen(fname, "r")) != NULL ) {
+		if( fgets(line, sizeof(line), fp) && (strcmp(line, header) == 0) ) {
+			while( fgets(line, sizeof(line), fp) ) {
+				int rterid = atoi_nullsafe(line);
+
+				if( rterid < 1 ) {
+					continue;
+				}
+				if( ri->ncompleted == allocated ) {
+					allocated = (allocated ? allocated * 2 : 1024);
+					ri->completed = realloc(ri->completed, allocated * sizeof(int));
+				}
+				ri->completed[ri->ncompleted++] = rterid;
+			}
+		} else {
+			writelog(ri->log, LOG_WARNING,
+				 "The state file %s is for other tables, starting over", fname);
+		}
+		fclose(fp);
+	}
+	if( ri->ncompleted > 0 ) {
+		qsort(ri->completed, ri->ncompleted, sizeof(int), reingest_cmp_rterid);
+		writelog(ri->log, LOG_INFO, "Resuming, %i rteval runs are already completed",
+			 ri->ncompleted);
+	}
+
+	ri->statefp = fopen(fname, (ri->ncompleted > 0 ? "a" : "w"));
+	if( !ri->statefp ) {
+		writelog(ri->log, LOG_EMERG, "Could not open the state file %s: %s",
+			 fname, strerror(errno));
+		return -1;
+	}
+	if( ri->ncompleted == 0 ) {
+		fputs(header, ri->statefp);
+		fflush(ri->statefp);
+	}
+	return 1;
+}
+
+
+/**
+ * Checks the selected tables.  The table names are used in SQL statements, so only
+ * lower case letters, digits and underscores are accepted.
+ *
+ * @param ri  Reingest
+ *
+ * @return Returns 1 if all table names are valid, otherwise -1
+ */
+static int reingest_check_tables(Reingest *ri)
+{
+	unsigned int i;
+
+	for( i = 0; i < strSize(ri->tables); i++ ) {
+		const char *tbl = strGet(ri->tables, i), *p = NULL;
+
+		for( p = tbl; p && *p; p++ ) {
+			if( !(((*p >= 'a') && (*p <= 'z')) || ((*p >= '0') && (*p <= '9'))
+			      || (*p == '_')) ) {
+				writelog(ri->log, LOG_EMERG, "Invalid table name '%s'", tbl);
+				return -1;
+			}
+		}
+		if( tbl && (strcmp(tbl, "cyclic_histogram") == 0) ) {
+			ri->histogram = 1;
+		}
+	}
+	return (strSize(ri->tables) > 0 ? 1 : -1);
+}
+
+
+/**
+ * Hands out the next rteval run to a worker thread.  rteval runs completed by an earlier
+ * re-ingest are skipped.
+ *
+ * @param ri     Reingest
+ * @param first  Returns the index of the first file of the rteval run
+ * @param last   Returns the index after the last file of the rteval run
+ *
+ * @return Returns 1 if an rteval run is handed out, 0 when all are handed out or on stop
+ */
+static int reingest_next(Reingest *ri, unsigned int *first, unsigned int *last)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&ri->mtx);
+	while( !ri->stop && (ri->next < ri->nfiles) ) {
+		int rterid = ri->files[ri->next].rterid;
+
+		*first = ri->next;
+		for( *last = *first; (*last < ri->nfiles) && (ri->files[*last].rterid == rterid); (*last)++ );
+		ri->next = *last;
+
+		if( ri->ncompleted && bsearch(&rterid, ri->completed, ri->ncompleted, sizeof(int),
+					      reingest_cmp_rterid) ) {
+			ri->resumed++;
+			continue;
+		}
+		ret = 1;
+		break;
+	}
+	pthread_mutex_unlock(&ri->mtx);
+	return ret;
+}
+
+
+/**
+ * Reads and parses an archived report file
+ *
+ * @param ri     Reingest
+ * @param id     Worker number
+ * @param rfile  The report file
+ * @param bytes  The size of the report file is added here
+ *
+ * @return Returns the parsed XML document, or NULL on errors
+ */
+static xmlDoc *reingest_parse(Reingest *ri, unsigned int id, ReingestFile *rfile, unsigned long long *bytes)
+{
+	reportFile rf;
+	xmlDoc *repxml = NULL;
+	int res;
+
+	res = reportfile_open(ri->log, &rf, rfile->fname, ri->settings->max_report_size);
+	if( res == 0 ) {
+		writelog(ri->log, LOG_ERR, "[Worker %i] Report file '%s' is too big", id, rfile->fname);
+		return NULL;
+	} else if( res < 0 ) {
+		return NULL;
+	}
+	repxml = reportfile_parse(ri->log, &rf, NULL);
+	*bytes += rf.size;
+	reportfile_close(&rf);
+	if( !repxml ) {
+		writelog(ri->log, LOG_ERR, "[Worker %i] Could not parse XML file: %s", id, rfile->fname);
+	}
+	return repxml;
+}
+
+
+/**
+ * Loads the selected measurement tables again for one rteval run, from all its report
+ * files, in a single transaction
+ *
+ * @param ri     Reingest
+ * @param id     Worker number
+ * @param first  Index of the first file of the rteval run
+ * @param last   Index after the last file of the rteval run
+ * @param rows   Returns the number of records loaded
+ * @param bytes  Returns the number of bytes read
+ *
+ * @return Returns riDONE on success, riMISSING if the rteval run is not registered,
+ *         otherwise riFAILED
+ */
+static ReingestResult reingest_process(Reingest *ri, unsigned int id, unsigned int first,
+				       unsigned int last, unsigned long *rows,
+				       unsigned long long *bytes)
+{
+	ReingestResult res = riFAILED;
+	ReingestFile *rfile = NULL;
+	parseJob_t job;
+	xmlDoc *repxml = NULL;
+	DbPool *pool = NULL;
+	dbconn *dbc = NULL;
+	int rterid = ri->files[first].rterid, loaded;
+	unsigned int i;
+
+	*rows = 0;
+	*bytes = 0;
+	for( i = first; i < last; i++ ) {
+		rfile = &ri->files[i];
+		if( (repxml = reingest_parse(ri, id, rfile, bytes)) == NULL ) {
+			goto exit;
+		}
+
+		if( !dbc ) {
+			int found;
+
+			// The first report decides which database the rteval run is found in.  When
+			// routing by clientid, the registered client ID is used, not the directory name.
+			memset(&job, 0, sizeof(parseJob_t));
+			snprintf(job.clientid, sizeof(job.clientid), "%s", rfile->clientid);
+			snprintf(job.filename, sizeof(job.filename), "%s", rfile->fname);
+			if( (found = shard_run_client(ri->shards, &job, rterid, &ri->stop)) == 0 ) {
+				writelog(ri->log, LOG_INFO,
+					 "[Worker %i] rterid %i is not registered, skipping %s",
+					 id, rterid, rfile->fname);
+				res = riMISSING;
+				goto exit;
+			} else if( found < 0 ) {
+				goto exit;
+			}
+			if( (pool = shard_route(ri->shards, &job, ri->settings->xslt, repxml, NULL, NULL)) == NULL ) {
+				goto exit;
+			}
+			if( (dbc = dbpool_get(pool, &ri->stop)) == NULL ) {
+				goto exit;
+			}
+			dbc->measurement_tbls = ri->tables;
+			if( db_begin(dbc) < 1 ) {
+				goto exit;
+			}
+			if( (found = db_rtevalrun_exists(dbc, rterid)) == 0 ) {
+				writelog(ri->log, LOG_INFO,
+					 "[Worker %i] rterid %i is not registered, skipping %s",
+					 id, rterid, rfile->fname);
+				res = riMISSING;
+				goto exit;
+			} else if( found < 0 ) {
+				goto exit;
+			}
+		}
+
+		loaded = db_reload_measurements(dbc, ri->settings->xslt, repxml, rterid,
+						(i == first), (i == (last - 1)));
+		xmlFreeDoc(repxml);
+		repxml = NULL;
+		if( loaded < 0 ) {
+			goto exit;
+		}
+		*rows += loaded;
+	}
+
+	if( ri->histogram && ((last - first) > 1) && (db_merge_histogram(dbc, rterid) < 0) ) {
+		goto exit;
+	}
+	if( db_commit(dbc) < 1 ) {
+		goto exit;
+	}
+	writelog(ri->log, LOG_DEBUG, "[Worker %i] rterid %i: %lu records loaded from %i files",
+		 id, rterid, *rows, last - first);
+	res = riDONE;
+
+ exit:
+	if( res == riFAILED ) {
+		writelog(ri->log, LOG_ERR, "[Worker %i] Failed to re-ingest rterid %i", id, rterid);
+	}
+	if( dbc ) {
+		// An unfinished transaction is rolled back by the pool
+		dbc->measurement_tbls = NULL;
+		dbpool_put(pool, dbc);
+	}
+	if( repxml ) {
+		xmlFreeDoc(repxml);
+	}
+	return res;
+}
+
+
+/**
+ * Worker thread, processing rteval runs until all are handed out
+ *
+ * @param data  ReingestWorker
+ *
+ * @return Returns NULL
+ */
+static void *reingest_worker(void *data)
+{
+	ReingestWorker *w = (ReingestWorker *) data;
+	Reingest *ri = w->ri;
+	unsigned int first, last;
+
+	while( reingest_next(ri, &first, &last) ) {
+		unsigned long rows = 0;
+		unsigned long long bytes = 0;
+		ReingestResult res;
+
+		res = reingest_process(ri, w->id, first, last, &rows, &bytes);
+
+		pthread_mutex_lock(&ri->mtx);
+		ri->bytes += bytes;
+		switch( res ) {
+		case riDONE:
+			ri->done++;
+			ri->reports += last - first;
+			ri->rows += rows;
+			fprintf(ri->statefp, "%i\n", ri->files[first].rterid);
+			fflush(ri->statefp);
+			break;
+		case riMISSING:
+			ri->missing++;
+			break;
+		default:
+			ri->failed++;
+		}
+		pthread_mutex_unlock(&ri->mtx);
+	}
+
+	pthread_mutex_lock(&ri->mtx);
+	ri->running--;
+	pthread_mutex_unlock(&ri->mtx);
+	return NULL;
+}
+
+
+/**
+ * Writes the progress and throughput to the log
+ *
+ * @param ri     Reingest
+ * @param final  Set when the re-ingest is completed
+ */
+static void reingest_log_progress(Reingest *ri, int final)
+{
+	unsigned int handled;
+	double elapsed = parsestats_elapsed(&ri->started);
+
+	elapsed = (elapsed > 0.001 ? elapsed : 0.001);
+	pthread_mutex_lock(&ri->mtx);
+	handled = ri->done + ri->resumed + ri->missing + ri->failed;
+	writelog(ri->log, (final ? LOG_NOTICE : LOG_INFO),
+		 "Re-ingest%s: %i of %i rteval runs (%i loaded, %i already done, %i not registered, "
+		 "%i failed) in %.0f seconds; %.1f reports/s, %.0f records/s, %.1f MB/s",
+		 (final ? " completed" : ""), handled, ri->runs, ri->done, ri->resumed,
+		 ri->missing, ri->failed, elapsed, ri->reports / elapsed, ri->rows / elapsed,
+		 ri->bytes / elapsed / (1024.0 * 1024.0));
+	pthread_mutex_unlock(&ri->mtx);
+}
+
+
+/**
+ * Releases the re-ingest job
+ *
+ * @param ri     Reingest
+ * @param store  SettingsStore the settings were acquired from
+ */
+static void reingest_free(Reingest *ri, SettingsStore *store)
+{
+	unsigned int i;
+
+	for( i = 0; i < ri->nfiles; i++ ) {
+		free_nullsafe(ri->files[i].fname);
+		free_nullsafe(ri->files[i].clientid);
+	}
+	free_nullsafe(ri->files);
+	free_nullsafe(ri->completed);
+	if( ri->tables ) {
+		strFree(ri->tables);
+	}
+	if( ri->statefp ) {
+		fclose(ri->statefp);
+	}
+	settings_release(store, ri->settings);
+	pthread_mutex_destroy(&ri->mtx);
+	free_nullsafe(ri);
+}
+
+
+/**
+ * Loads the selected measurement tables again from all archived reports in a directory,
+ * using several worker threads.  Stops when all reports are processed, or when SIGINT
+ * or SIGTERM is received.
+ *
+ * @param log    Log context
+ * @param cfg    Configuration, the directory is found in 'reingest'
+ * @param store  SettingsStore, providing the XSLT template
+ * @param sigs   Signals blocked by the calling thread
+ *
+ * @return Returns 1 if all rteval runs were loaded or skipped, 0 if some failed or the
+ *         re-ingest was stopped, otherwise -1
+ */
+int reingest_archive(LogContext *log, eurephiaVALUES *cfg, SettingsStore *store, const sigset_t *sigs)
+{
+	Reingest *ri = NULL;
+	ReingestWorker *workers = NULL;
+	dbconn *dbc = NULL;
+	DbPool *pool = NULL;
+	const char *dir = NULL, *tablelist = NULL, *statefile = NULL;
+	char *defstate = NULL;
+	unsigned int i, nworkers, started = 0;
+	struct timespec lastlog;
+	int rc, ret = -1;
+
+	ri = malloc_nullsafe(log, sizeof(Reingest));
+	ri->log = log;
+	ri->settings = settings_acquire(store);
+	pthread_mutex_init(&ri->mtx, NULL);
+
+	dir = eGet_value(cfg, "reingest");
+	tablelist = eGet_value(cfg, "reingest_tables");
+	tablelist = ((tablelist && *tablelist) ? tablelist : eGet_value(cfg, "measurement_tables"));
+	ri->tables = strSplit(tablelist, ", ");
+	if( !ri->tables || (reingest_check_tables(ri) < 0) ) {
+		writelog(log, LOG_EMERG, "No valid tables to re-ingest");
+		goto exit;
+	}
+
+	// Find all archived reports, grouped by rteval run
+	if( reingest_scan(ri, dir, "") < 0 ) {
+		goto exit;
+	}
+	qsort(ri->files, ri->nfiles, sizeof(ReingestFile), reingest_cmp_files);
+	for( i = 0; i < ri->nfiles; i++ ) {
+		if( (i == 0) || (ri->files[i].rterid != ri->files[i-1].rterid) ) {
+			ri->runs++;
+		}
+	}
+	writelog(log, LOG_INFO, "Found %i reports of %i rteval runs in %s, loading %s",
+		 ri->nfiles, ri->runs, dir, tablelist);
+
+	statefile = eGet_value(cfg, "reingest_state");
+	if( !statefile || !*statefile ) {
+		defstate = malloc_nullsafe(log, strlen(dir) + strlen(REINGEST_STATE_FILE) + 2);
+		sprintf(defstate, "%s/%s", dir, REINGEST_STATE_FILE);
+		statefile = defstate;
+	}
+	if( reingest_open_state(ri, statefile, tablelist) < 0 ) {
+		goto exit;
+	}
+
+	// Connect to the databases
+	if( (dbc = db_connect(cfg, 0, log)) == NULL ) {
+		goto exit;
+	}
+	if( ((pool = dbpool_init(log, cfg, dbc, 2)) == NULL)
+	    || ((ri->shards = shard_init(log, cfg, pool)) == NULL) ) {
+		goto exit;
+	}
+
+	// Start the worker threads
+	nworkers = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "threads")), 4);
+	workers = malloc_nullsafe(log, nworkers * sizeof(ReingestWorker));
+	parsestats_timer_start(&ri->started);
+	for( i = 0; i < nworkers; i++ ) {
+		workers[i].ri = ri;
+		workers[i].id = i + 1;
+		pthread_mutex_lock(&ri->mtx);
+		ri->running++;
+		pthread_mutex_unlock(&ri->mtx);
+		if( (rc = pthread_create(&workers[i].thread, NULL, reingest_worker, &workers[i])) != 0 ) {
+			writelog(log, LOG_CRIT, "Could not start worker thread %i: %s", i + 1, strerror(rc));
+			pthread_mutex_lock(&ri->mtx);
+			ri->running--;
+			pthread_mutex_unlock(&ri->mtx);
+			break;
+		}
+		started++;
+	}
+	if( started == 0 ) {
+		goto exit;
+	}
+
+	// Report the progress until all worker threads are done
+	parsestats_timer_start(&lastlog);
+	while( 1 ) {
+		struct timespec wait = { 1, 0 };
+		unsigned int running;
+		int sig = sigtimedwait(sigs, NULL, &wait);
+
+		if( ((sig == SIGINT) || (sig == SIGTERM)) && !ri->stop ) {
+			writelog(log, LOG_WARNING, "Stopping, the re-ingest continues when started again");
+			pthread_mutex_lock(&ri->mtx);
+			ri->stop = 1;
+			pthread_mutex_unlock(&ri->mtx);
+		}
+		pthread_mutex_lock(&ri->mtx);
+		running = ri->running;
+		pthread_mutex_unlock(&ri->mtx);
+		if( running == 0 ) {
+			break;
+		}
+		if( parsestats_elapsed(&lastlog) >= REINGEST_PROGRESS_INTERVAL ) {
+			reingest_log_progress(ri, 0);
+			parsestats_timer_start(&lastlog);
+		}
+	}
+	for( i = 0; i < started; i++ ) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	reingest_log_progress(ri, 1);
+	ret = ((ri->failed == 0) && !ri->stop ? 1 : 0);
+
+ exit:
+	shard_free(ri->shards);
+	dbpool_free(pool);
+	db_disconnect(dbc);
+	free_nullsafe(workers);
+	free_nullsafe(defstate);
+	reingest_free(ri, store);
+	return ret;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   reingest.h
+ * @date   Mon Oct 19 03:12:40 2026
+ *
+ * @brief  Loads the measurement data of archived reports again
+ *
+ */
+
+#ifndef _RTEVAL_REINGEST_H
+#define _RTEVAL_REINGEST_H
+
+#include <signal.h>
+
+#include <eurephia_values.h>
+#include <log.h>
+#include <settings.h>
+
+#define REINGEST_STATE_FILE ".reingest-state"   /**< Default state file name, in the re-ingested directory */
+#define REINGEST_PROGRESS_INTERVAL 10           /**< Seconds between each progress report in the log */
+
+int reingest_parse_name(const char *name, int *rterid, unsigned int *seq);
+int reingest_archive(LogContext *log, eurephiaVALUES *cfg, SettingsStore *store, const sigset_t *sigs);
+
+#endif
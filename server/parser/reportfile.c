@@ -0,0 +1,486 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   reportfile.c
+ * @date   Sun Oct 18 15:20:36 2026
+ *
+ * @brief  Loads XML reports from the submission queue
+ *
+ * The report files are mapped into memory and fed to libxml2 in blocks directly
+ * from the mapping, without going through stdio.  Blank text nodes from the
+ * indented reports are dropped while parsing.
+ *
+ * Reports compressed with gzip, bzip2 or zstd (if built with libzstd) are
+ * detected by their magic bytes, and are decompressed while being parsed.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <libxml/parser.h>
+#include <libxml/parserInternals.h>
+#include <libxml/dict.h>
+#include <libxml/uri.h>
+#include <zlib.h>
+#include <bzlib.h>
+#if defined(HAVE_ZSTD_H) && defined(HAVE_LIBZSTD)
+#define REPORTFILE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <eurephia_nullsafe.h>
+#include <log.h>
+#include <reportfile.h>
+#include <watchdog.h>
+#include <memarena.h>
+
+/** libxml2 parser options used for reports */
+#define REPORTFILE_PARSE_OPTS (XML_PARSE_NOBLANKS | XML_PARSE_COMPACT | XML_PARSE_NONET)
+
+/**
+ * Reader state, used by the libxml2 read callback
+ */
+typedef struct {
+	reportFile *rf;            /**< The report being read */
+	int eof;                   /**< Set when all data has been read */
+	off_t pos;                 /**< Read position, for uncompressed reports */
+	z_stream gz;               /**< zlib state, for gzip */
+	bz_stream bz;              /**< libbz2 state, for bzip2 */
+#ifdef REPORTFILE_ZSTD
+	ZSTD_DStream *zstd;        /**< libzstd state */
+	ZSTD_inBuffer zin;         /**< libzstd input buffer */
+#endif
+} rfReader;
+
+
+/**
+ * Identifies the compression format of a report by looking at the first bytes
+ *
+ * @param data  The first bytes of the report
+ * @param len   Number of bytes available in data
+ *
+ * @return Returns the compression format of the report
+ */
+reportCompression reportfile_detect(const void *data, size_t len)
+{
+	const unsigned char *d = data;
+
+	if( (len >= 2) && (d[0] == 0x1f) && (d[1] == 0x8b) ) {
+		return rfcGZIP;
+	}
+	if( (len >= 3) && (d[0] == 'B') && (d[1] == 'Z') && (d[2] == 'h') ) {
+		return rfcBZIP2;
+	}
+	if( (len >= 4) && (d[0] == 0x28) && (d[1] == 0xb5) && (d[2] == 0x2f) && (d[3] == 0xfd) ) {
+		return rfcZSTD;
+	}
+	return rfcNONE;
+}
+
+
+/**
+ * Prepares the reading and decompression of a report
+ *
+ * @param dc  Pointer to the reader state to initialise
+ * @param rf  Pointer to an opened reportFile
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int reader_init(rfReader *dc, reportFile *rf)
+{
+	memset(dc, 0, sizeof(rfReader));
+	dc->rf = rf;
+
+	switch( rf->compression ) {
+	case rfcNONE:
+		return 1;
+
+	case rfcGZIP:
+		dc->gz.next_in = rf->data;
+		dc->gz.avail_in = rf->size;
+		// 15 + 32: Maximum window size, and detect gzip or zlib headers
+		return (inflateInit2(&dc->gz, 15 + 32) == Z_OK ? 1 : -1);
+
+	case rfcBZIP2:
+		dc->bz.next_in = rf->data;
+		dc->bz.avail_in = rf->size;
+		return (BZ2_bzDecompressInit(&dc->bz, 0, 0) == BZ_OK ? 1 : -1);
+
+#ifdef REPORTFILE_ZSTD
+	case rfcZSTD:
+		dc->zin.src = rf->data;
+		dc->zin.size = rf->size;
+		dc->zin.pos = 0;
+		dc->zstd = ZSTD_createDStream();
+		if( !dc->zstd || ZSTD_isError(ZSTD_initDStream(dc->zstd)) ) {
+			return -1;
+		}
+		return 1;
+#endif
+	default:
+		return -1;
+	}
+}
+
+
+/**
+ * Checks if there is more data to read or decompress
+ *
+ * @param dc  Pointer to the reader state
+ *
+ * @return Returns 1 if there is more input data, otherwise 0
+ */
+static int reader_pending(rfReader *dc)
+{
+	switch( dc->rf->compression ) {
+	case rfcNONE:
+		return (dc->pos < dc->rf->size);
+	case rfcGZIP:
+		return (dc->gz.avail_in > 0);
+	case rfcBZIP2:
+		return (dc->bz.avail_in > 0);
+#ifdef REPORTFILE_ZSTD
+	case rfcZSTD:
+		return (dc->zin.pos < dc->zin.size);
+#endif
+	default:
+		return 0;
+	}
+}
+
+
+/**
+ * libxml2 read callback.  Copies or decompresses the next block of the report.
+ *
+ * @param context  Pointer to the rfReader state
+ * @param buffer   Buffer where to put the report data
+ * @param len      Size of the buffer
+ *
+ * @return Returns the number of bytes read, 0 at the end of the report and -1 on errors.
+ */
+static int reader_read(void *context, char *buffer, int len)
+{
+	rfReader *dc = (rfReader *) context;
+	int ret = 0;
+
+	// Stop reading if the watchdog aborted the job
+	if( watchdog_expired() ) {
+		return -1;
+	}
+
+	while( (ret == 0) && !dc->eof ) {
+		switch( dc->rf->compression ) {
+		case rfcNONE:
+			ret = ((dc->rf->size - dc->pos) < len ? (dc->rf->size - dc->pos) : len);
+			memcpy(buffer, (char *) dc->rf->data + dc->pos, ret);
+			dc->pos += ret;
+			dc->eof = (dc->pos >= dc->rf->size);
+			break;
+
+		case rfcGZIP:
+			dc->gz.next_out = (unsigned char *) buffer;
+			dc->gz.avail_out = len;
+			switch( inflate(&dc->gz, Z_NO_FLUSH) ) {
+			case Z_OK:
+				break;
+			case Z_STREAM_END:
+				// Concatenated gzip members are allowed
+				if( (dc->gz.avail_in == 0) || (inflateReset(&dc->gz) != Z_OK) ) {
+					dc->eof = 1;
+				}
+				break;
+			default:
+				return -1;
+			}
+			ret = len - dc->gz.avail_out;
+			break;
+
+		case rfcBZIP2:
+			dc->bz.next_out = buffer;
+			dc->bz.avail_out = len;
+			switch( BZ2_bzDecompress(&dc->bz) ) {
+			case BZ_OK:
+				break;
+			case BZ_STREAM_END:
+				dc->eof = 1;
+				break;
+			default:
+				return -1;
+			}
+			ret = len - dc->bz.avail_out;
+			break;
+
+#ifdef REPORTFILE_ZSTD
+		case rfcZSTD: {
+			ZSTD_outBuffer zout = { buffer, len, 0 };
+			size_t zret = ZSTD_decompressStream(dc->zstd, &zout, &dc->zin);
+
+			if( ZSTD_isError(zret) ) {
+				return -1;
+			}
+			if( (zret == 0) && (dc->zin.pos == dc->zin.size) ) {
+				dc->eof = 1;
+			}
+			ret = zout.pos;
+			break;
+		}
+#endif
+		default:
+			return -1;
+		}
+
+		// Stop if no more input is available, but the stream is not completed
+		if( (ret == 0) && !dc->eof && !reader_pending(dc) ) {
+			return -1;
+		}
+	}
+
+	dc->rf->xmlsize += ret;
+	if( dc->rf->xmlsize > dc->rf->maxsize ) {
+		dc->rf->toobig = 1;
+		return -1;
+	}
+	return ret;
+}
+
+
+/**
+ * libxml2 close callback.  Releases the reader state.
+ *
+ * @param context  Pointer to the rfReader state
+ *
+ * @return Returns always 0
+ */
+static int reader_close(void *context)
+{
+	rfReader *dc = (rfReader *) context;
+
+	switch( dc->rf->compression ) {
+	case rfcGZIP:
+		inflateEnd(&dc->gz);
+		break;
+	case rfcBZIP2:
+		BZ2_bzDecompressEnd(&dc->bz);
+		break;
+#ifdef REPORTFILE_ZSTD
+	case rfcZSTD:
+		ZSTD_freeDStream(dc->zstd);
+		break;
+#endif
+	default:
+		break;
+	}
+	free(dc);
+	return 0;
+}
+
+
+/**
+ * Opens a report file and maps it into memory, if it is not bigger than the given limit.
+ *
+ * @param log      Log context
+ * @param rf       Pointer to a reportFile struct which will be prepared
+ * @param fname    File name of the report
+ * @param maxsize  Maximum accepted size of the report
+ *
+ * @return Returns 1 on success.  If the file is too big 0 is returned, and -1 on other errors.
+ *         The file size is available in rf->size if the return value is >= 0.  For compressed
+ *         reports, the decompressed size is checked by reportfile_parse().
+ */
+int reportfile_open(LogContext *log, reportFile *rf, const char *fname, off_t maxsize)
+{
+	struct stat info;
+	int fd = -1;
+
+	memset(rf, 0, sizeof(reportFile));
+	rf->fname = fname;
+	rf->maxsize = maxsize;
+	if( !fname ) {
+		return -1;
+	}
+
+	errno = 0;
+	if( (fd = open(fname, O_RDONLY)) < 0 ) {
+		writelog(log, LOG_ERR, "Failed to open report file '%s': %s",
+			 fname, strerror(errno));
+		return -1;
+	}
+
+	if( fstat(fd, &info) < 0 ) {
+		writelog(log, LOG_ERR, "Failed to check report file '%s': %s",
+			 fname, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	rf->size = info.st_size;
+
+	if( rf->size > maxsize ) {
+		close(fd);
+		return 0;
+	}
+
+	if( rf->size == 0 ) {
+		writelog(log, LOG_ERR, "Report file '%s' is empty", fname);
+		close(fd);
+		return -1;
+	}
+
+	rf->data = mmap(NULL, rf->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if( rf->data == MAP_FAILED ) {
+		writelog(log, LOG_ERR, "Failed to map report file '%s' into memory: %s",
+			 fname, strerror(errno));
+		rf->data = NULL;
+		return -1;
+	}
+	madvise(rf->data, rf->size, MADV_SEQUENTIAL);
+
+	rf->compression = reportfile_detect(rf->data, rf->size);
+#ifndef REPORTFILE_ZSTD
+	if( rf->compression == rfcZSTD ) {
+		writelog(log, LOG_ERR, "Report file '%s' is zstd compressed, "
+			 "which is not supported by this build", fname);
+		reportfile_close(rf);
+		return -1;
+	}
+#endif
+	return 1;
+}
+
+
+/**
+ * Parses an opened report file.  The document is parsed directly from the memory mapping.
+ * Compressed reports are decompressed while parsing.  If the decompressed report is bigger
+ * than the limit given to reportfile_open(), the parsing is aborted and rf->toobig is set.
+ * The document is allocated from the worker arena, if the calling thread has one.
+ *
+ * @param log   Log context
+ * @param rf    Pointer to a reportFile, prepared by reportfile_open()
+ * @param dict  Dictionary to use for element and attribute names.  This should be reused for
+ *              all reports parsed by a thread.  If NULL, a new dictionary is used.
+ *
+ * @return Returns a pointer to the parsed XML document on success, otherwise NULL.
+ */
+xmlDoc *reportfile_parse(LogContext *log, reportFile *rf, xmlDict *dict)
+{
+	xmlParserCtxt *ctxt = NULL;
+	xmlParserInputBuffer *buf = NULL;
+	xmlParserInput *input = NULL;
+	xmlDoc *doc = NULL;
+	rfReader *dc = NULL;
+
+	if( !rf->data ) {
+		return NULL;
+	}
+
+	memarena_begin();
+	ctxt = xmlNewParserCtxt();
+	if( !ctxt ) {
+		memarena_end();
+		writelog(log, LOG_ERR, "Failed to allocate an XML parser context");
+		return NULL;
+	}
+
+	if( dict ) {
+		xmlDictFree(ctxt->dict);
+		ctxt->dict = dict;
+		xmlDictReference(dict);
+	}
+	xmlCtxtUseOptions(ctxt, REPORTFILE_PARSE_OPTS);
+
+	// The report is fed to libxml2 in blocks, so the complete report is never copied.
+	// libxml2 2.9 static memory buffers are not used, as they disable removal of blank nodes.
+	dc = malloc_nullsafe(log, sizeof(rfReader));
+	if( reader_init(dc, rf) < 0 ) {
+		writelog(log, LOG_ERR, "Failed to prepare reading of '%s'", rf->fname);
+		reader_close(dc);
+		goto exit;
+	}
+	buf = xmlParserInputBufferCreateIO(reader_read, reader_close, dc, XML_CHAR_ENCODING_NONE);
+	if( !buf ) {
+		reader_close(dc);
+		writelog(log, LOG_ERR, "Failed to prepare parsing of '%s'", rf->fname);
+		goto exit;
+	}
+
+	input = xmlNewIOInputStream(ctxt, buf, XML_CHAR_ENCODING_NONE);
+	if( !input ) {
+		xmlFreeParserInputBuffer(buf);
+		writelog(log, LOG_ERR, "Failed to prepare parsing of '%s'", rf->fname);
+		goto exit;
+	}
+	input->filename = (char *) xmlCanonicPath((const xmlChar *) rf->fname);
+	inputPush(ctxt, input);
+
+	xmlParseDocument(ctxt);
+	if( ctxt->wellFormed && !rf->toobig ) {
+		doc = ctxt->myDoc;
+	} else {
+		xmlFreeDoc(ctxt->myDoc);
+	}
+	ctxt->myDoc = NULL;
+
+ exit:
+	xmlFreeParserCtxt(ctxt);
+	memarena_end();
+	return doc;
+}
+
+
+/**
+ * Releases the memory mapping of a report file
+ *
+ * @param rf  Pointer to the reportFile to close
+ */
+void reportfile_close(reportFile *rf)
+{
+	if( rf->data ) {
+		munmap(rf->data, rf->size);
+		rf->data = NULL;
+	}
+}
+
+
+/**
+ * Returns the file name suffix matching the compression format of a report
+ *
+ * @param comp  Compression format, such as the compression member of an opened reportFile
+ *
+ * @return Returns a suffix, such as ".bz2".  An empty string is returned for uncompressed reports.
+ */
+const char *reportfile_suffix(reportCompression comp)
+{
+	switch( comp ) {
+	case rfcGZIP:
+		return ".gz";
+	case rfcBZIP2:
+		return ".bz2";
+	case rfcZSTD:
+		return ".zst";
+	default:
+		return "";
+	}
+}
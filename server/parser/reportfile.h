@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   reportfile.h
+ * @date   Sun Oct 18 15:20:36 2026
+ *
+ * @brief  Loads XML reports from the submission queue
+ *
+ */
+
+#ifndef _RTEVAL_REPORTFILE_H
+#define _RTEVAL_REPORTFILE_H
+
+#include <sys/types.h>
+#include <libxml/parser.h>
+#include <libxml/dict.h>
+
+#include <log.h>
+
+#define REPORTFILE_DICT_MAX 65536   /**< Recreate per thread dictionaries growing beyond this many entries */
+
+/**
+ * Compression formats for report files
+ */
+typedef enum { rfcNONE, rfcGZIP, rfcBZIP2, rfcZSTD } reportCompression;
+
+/**
+ * An opened report file
+ */
+typedef struct {
+	const char *fname;         /**< File name of the report */
+	void *data;                /**< The file contents, mapped into memory */
+	off_t size;                /**< Size of the report file, in bytes */
+	off_t maxsize;             /**< Maximum accepted size of the (decompressed) report */
+	reportCompression compression; /**< Compression format of the report file */
+	off_t xmlsize;             /**< Decompressed size, available after reportfile_parse() */
+	int toobig;                /**< Set if the decompressed report exceeded maxsize */
+} reportFile;
+
+int reportfile_open(LogContext *log, reportFile *rf, const char *fname, off_t maxsize);
+xmlDoc *reportfile_parse(LogContext *log, reportFile *rf, xmlDict *dict);
+void reportfile_close(reportFile *rf);
+reportCompression reportfile_detect(const void *data, size_t len);
+const char *reportfile_suffix(reportCompression comp);
+
+#endif
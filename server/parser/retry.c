@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   retry.c
+ * @date   Sun Oct 18 23:57:40 2026
+ *
+ * @brief  Retries submissions which failed for a transient reason
+ *
+ * A submission failing because of the database, such as during a database
+ * failover, is put back into the submission queue instead of being marked as
+ * failed.  It is not picked up again before the retry delay has passed.  The
+ * delay starts at retry_delay seconds and doubles for each failed attempt, up
+ * to retry_max_delay.  A random part of up to half the delay is subtracted, so
+ * the reports failed at the same time are not all retried at the same time.
+ * After retry_max_attempts attempts, the failure status is kept.
+ *
+ * Failures caused by the report itself, such as invalid XML, are never retried.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <statuses.h>
+#include <parsethread.h>
+#include <retry.h>
+
+/**
+ * The retry policy and its counters
+ */
+struct _RetryPolicy {
+	LogContext *log;             /**< Log context */
+	unsigned int max_attempts;   /**< Attempts before giving up (config: retry_max_attempts) */
+	unsigned int delay;          /**< Delay after the first failure (config: retry_delay) */
+	unsigned int max_delay;      /**< Upper limit of the delay (config: retry_max_delay) */
+	pthread_mutex_t mtx;         /**< Protects the random seed and the counters */
+	unsigned int seed;           /**< Random seed for the jitter */
+	unsigned long retried;       /**< Submissions put back into the queue */
+	unsigned long exhausted;     /**< Submissions given up after max_attempts */
+	unsigned long recovered;     /**< Interrupted submissions recovered on start up */
+};
+
+
+/**
+ * Prepares the retry policy
+ *
+ * @param log  Log context
+ * @param cfg  Configuration
+ *
+ * @return Returns a RetryPolicy
+ */
+RetryPolicy *retry_init(LogContext *log, eurephiaVALUES *cfg)
+{
+	RetryPolicy *rp = NULL;
+
+	rp = malloc_nullsafe(log, sizeof(RetryPolicy));
+	rp->log = log;
+	rp->max_attempts = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "retry_max_attempts")), 5);
+	rp->delay = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "retry_delay")), 60);
+	rp->max_delay = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "retry_max_delay")), 3600);
+	if( rp->max_delay < rp->delay ) {
+		rp->max_delay = rp->delay;
+	}
+	rp->seed = time(NULL) ^ getpid();
+	pthread_mutex_init(&rp->mtx, NULL);
+
+	writelog(log, LOG_DEBUG, "Retries: up to %i attempts, delay %i-%i seconds",
+		 rp->max_attempts, rp->delay, rp->max_delay);
+	return rp;
+}
+
+
+/**
+ * Checks if a failure status may succeed when the report is parsed again
+ *
+ * @param status  Status code, as returned by parse_report()
+ *
+ * @return Returns 1 if the failure is transient, otherwise 0
+ */
+int retry_transient(int status)
+{
+	switch( status ) {
+	case STAT_GENDB:
+	case STAT_RTERIDREG:
+	case STAT_REPMOVE:
+		return 1;
+
+	default:
+		// The report itself is at fault, or the submission is done
+		return 0;
+	}
+}
+
+
+/**
+ * Calculates the delay before the next attempt, with exponential backoff and jitter
+ *
+ * @param rp        RetryPolicy
+ * @param attempts  Failed attempts so far, including the last one
+ *
+ * @return Returns the delay in seconds
+ */
+unsigned int retry_delay(RetryPolicy *rp, unsigned int attempts)
+{
+	unsigned int delay = rp->delay, jitter;
+
+	while( (--attempts > 0) && (delay < rp->max_delay) ) {
+		delay *= 2;
+	}
+	delay = (delay > rp->max_delay ? rp->max_delay : delay);
+
+	pthread_mutex_lock(&rp->mtx);
+	jitter = rand_r(&rp->seed) % (delay / 2 + 1);
+	pthread_mutex_unlock(&rp->mtx);
+	return delay - jitter;
+}
+
+
+/**
+ * Puts a failed submission back into the submission queue if the failure is transient
+ * and it has not been attempted too many times.  The caller sets the final status of
+ * the submission if it is not retried.
+ *
+ * @param rp      RetryPolicy
+ * @param dbc     Database connection
+ * @param job     The parse job which failed
+ * @param status  Status code of the attempt, as returned by parse_report()
+ *
+ * @return Returns 1 if the submission will be retried, 0 if not and -1 on database errors
+ */
+int retry_submission(RetryPolicy *rp, dbconn *dbc, parseJob_t *job, int status)
+{
+	unsigned int attempts = job->attempts + 1, delay;
+	int ret;
+
+	if( !retry_transient(status) ) {
+		return 0;
+	}
+	if( attempts >= rp->max_attempts ) {
+		writelog(rp->log, LOG_ERR, "(submid: %i) Giving up after %i attempts, status %i",
+			 job->submid, attempts, status);
+		pthread_mutex_lock(&rp->mtx);
+		rp->exhausted++;
+		pthread_mutex_unlock(&rp->mtx);
+		return 0;
+	}
+
+	delay = retry_delay(rp, attempts);
+	ret = db_retry_submission(dbc, job->submid, delay);
+	if( ret == 1 ) {
+		writelog(rp->log, LOG_WARNING,
+			 "(submid: %i) Attempt %i failed with status %i, retrying in %i seconds",
+			 job->submid, attempts, status, delay);
+		pthread_mutex_lock(&rp->mtx);
+		rp->retried++;
+		pthread_mutex_unlock(&rp->mtx);
+	}
+	return ret;
+}
+
+
+/**
+ * Recovers submissions left assigned or in progress by a previous run, see
+ * db_recover_submissions().  Must be called before any submissions are handed out.
+ *
+ * @param rp   RetryPolicy
+ * @param dbc  Database connection
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+int retry_recover(RetryPolicy *rp, dbconn *dbc)
+{
+	unsigned int requeued, completed, failed;
+
+	if( db_recover_submissions(dbc, rp->max_attempts, &requeued, &completed, &failed) < 0 ) {
+		return -1;
+	}
+	if( requeued + completed + failed > 0 ) {
+		writelog(rp->log, LOG_WARNING,
+			 "Recovered %i interrupted submissions: %i queued again, "
+			 "%i already registered, %i given up",
+			 requeued + completed + failed, requeued, completed, failed);
+	}
+	pthread_mutex_lock(&rp->mtx);
+	rp->recovered += requeued + completed + failed;
+	rp->exhausted += failed;
+	pthread_mutex_unlock(&rp->mtx);
+	return 1;
+}
+
+
+/**
+ * Writes the retry counters to the log
+ *
+ * @param rp  RetryPolicy
+ */
+void retry_log_stats(RetryPolicy *rp)
+{
+	unsigned long retried, exhausted, recovered;
+
+	pthread_mutex_lock(&rp->mtx);
+	retried = rp->retried;
+	exhausted = rp->exhausted;
+	recovered = rp->recovered;
+	pthread_mutex_unlock(&rp->mtx);
+
+	writelog(rp->log, LOG_INFO, "Retries: %lu retried, %lu given up, %lu recovered on start up",
+		 retried, exhausted, recovered);
+}
+
+
+/**
+ * Releases the retry policy
+ *
+ * @param rp  RetryPolicy
+ */
+void retry_free(RetryPolicy *rp)
+{
+	if( !rp ) {
+		return;
+	}
+	pthread_mutex_destroy(&rp->mtx);
+	free(rp);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   retry.h
+ * @date   Sun Oct 18 23:57:40 2026
+ *
+ * @brief  Retries submissions which failed for a transient reason
+ *
+ */
+
+#ifndef _RTEVAL_RETRY_H
+#define _RTEVAL_RETRY_H
+
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <parsethread.h>
+
+typedef struct _RetryPolicy RetryPolicy;
+
+RetryPolicy *retry_init(LogContext *log, eurephiaVALUES *cfg);
+int retry_transient(int status);
+unsigned int retry_delay(RetryPolicy *rp, unsigned int attempts);
+int retry_submission(RetryPolicy *rp, dbconn *dbc, parseJob_t *job, int status);
+int retry_recover(RetryPolicy *rp, dbconn *dbc);
+void retry_log_stats(RetryPolicy *rp);
+void retry_free(RetryPolicy *rp);
+
+#endif
@@ -27,9 +27,13 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <time.h>
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <errno.h>
 #include <assert.h>
 
@@ -40,45 +44,146 @@
 #include <threadinfo.h>
 #include <parsethread.h>
 #include <argparser.h>
+#include <memarena.h>
+#include <archive.h>
+#include <affinity.h>
+#include <ingest.h>
+#include <workerpool.h>
+#include <dbpool.h>
+#include <retry.h>
+#include <watchdog.h>
+#include <scheduler.h>
+#include <settings.h>
+#include <shard.h>
+#include <reingest.h>
+#include <transform.h>
 
 #define DEFAULT_MSG_MAX 5             /**< Default size of the message queue */
-#define XMLPARSER_XSL "xmlparser.xsl" /**< rteval report parser XSLT, parses XML into database friendly data*/
+#define DISPATCH_MAX_EVENTS 8         /**< Events handled per epoll_wait() call */
+#define DISPATCH_RETRY_DELAY 5        /**< Seconds to wait before dispatching again after a failure */
 
 static int shutdown = 0;              /**<  Variable indicating if the program should shutdown */
-static LogContext *logctx = NULL;     /**<  Initialsed log context, to be used by sigcatch() */
+static LogContext *logctx = NULL;     /**<  Initialsed log context */
+
+/**
+ * What is needed to apply a new configuration, see reload_config()
+ */
+typedef struct {
+	eurephiaVALUES *prgargs;      /**<  Command line arguments, the configuration is read with these */
+	SettingsStore *settings;      /**<  Settings used when processing reports */
+	WorkerPool *workers;          /**<  Worker pool, resized to the new number of threads */
+	int worker_arena;             /**<  Set if the worker threads use memory arenas */
+} ReloadContext;
 
 
 /**
- * Simple signal catcher.  Used for SIGINT and SIGTERM signals, and will set the global shutdown
- * shutdown flag.  It's expected that all threads behaves properly and exits as soon as their current
- * work is completed
+ * Blocks the signals handled by the submission queue checker.  This must be done before any
+ * thread is started, so that all threads inherit the signal mask.  The signals are then only
+ * received through a signalfd, by the submission queue checker.
  *
- * @param sig Recieved signal (not used)
+ * @param sigs  Returns the set of handled signals
  */
-void sigcatch(int sig) {
-	switch( sig ) {
-	case SIGINT:
-	case SIGTERM:
-		if( shutdown == 0 ) {
-			shutdown = 1;
-			writelog(logctx, LOG_INFO, "[SIGNAL] Shutting down");
-		} else {
-			writelog(logctx, LOG_INFO, "[SIGNAL] Shutdown in progress ... please be patient ...");
-		}
-		break;
+void block_signals(sigset_t *sigs) {
+	sigemptyset(sigs);
+	sigaddset(sigs, SIGINT);
+	sigaddset(sigs, SIGTERM);
+	sigaddset(sigs, SIGHUP);
+	sigaddset(sigs, SIGUSR1);
+	sigaddset(sigs, SIGUSR2);
+	pthread_sigmask(SIG_BLOCK, sigs, NULL);
+}
 
-	case SIGUSR1:
-		writelog(logctx, LOG_EMERG, "[SIGNAL] Shutdown alarm from a worker thread");
-		shutdown = 1;
-		break;
 
-	default:
-		break;
+/**
+ * Reads the configuration file again and applies the settings which can be changed
+ * while running: the log level, the number of worker threads and the settings used
+ * when processing reports, see settings.h.  Reports already being processed complete
+ * with the previous settings.  Nothing is changed if the new configuration or the XSLT
+ * template cannot be parsed.
+ *
+ * @param rctx  ReloadContext
+ */
+void reload_config(ReloadContext *rctx) {
+	eurephiaVALUES *newcfg = NULL;
+	JobSettings *js = NULL;
+	const char *loglvl = NULL;
+
+	writelog(logctx, LOG_INFO, "[SIGNAL] Reloading the configuration");
+	newcfg = read_config(logctx, rctx->prgargs, "xmlrpc_parser");
+	if( !newcfg ) {
+		writelog(logctx, LOG_ERR, "Could not reload the configuration, keeping the current settings");
+		return;
 	}
 
-	// re-enable signals, to avoid brute force exits.
-	// If brute force is needed, SIGKILL is available.
-	signal(sig, sigcatch);
+	// Prepare everything first, so a broken XSLT template does not leave half the changes applied
+	js = settings_load(logctx, newcfg, rctx->worker_arena);
+	if( !js ) {
+		writelog(logctx, LOG_ERR, "Could not reload the configuration, keeping the current settings");
+		eFree_values(newcfg);
+		return;
+	}
+	settings_publish(rctx->settings, js);
+	workerpool_resize(rctx->workers, newcfg);
+
+	loglvl = eGet_value(newcfg, "loglevel");
+	if( loglvl && !log_set_level(logctx, loglvl) ) {
+		writelog(logctx, LOG_WARNING, "Unknown log level '%s', log level not changed", loglvl);
+	}
+	eFree_values(newcfg);
+	writelog(logctx, LOG_INFO, "Configuration reloaded");
+}
+
+
+/**
+ * Handles the signals received on the signalfd.  SIGINT and SIGTERM sets the global shutdown
+ * flag.  It's expected that all threads behaves properly and exits as soon as their current
+ * work is completed.  SIGUSR1 is sent by the worker pool when no worker threads are left,
+ * SIGUSR2 logs the scheduler, worker pool and retry statistics and SIGHUP reloads the
+ * configuration.
+ *
+ * @param sigfd    signalfd descriptor
+ * @param sched    Job scheduler
+ * @param workers  Worker pool
+ * @param retry    Retry policy
+ * @param reload   What is needed to reload the configuration
+ */
+void handle_signals(int sigfd, JobScheduler *sched, WorkerPool *workers, RetryPolicy *retry,
+		    ReloadContext *reload) {
+	struct signalfd_siginfo si;
+
+	while( read(sigfd, &si, sizeof(si)) == sizeof(si) ) {
+		switch( si.ssi_signo ) {
+		case SIGINT:
+		case SIGTERM:
+			if( shutdown == 0 ) {
+				shutdown = 1;
+				writelog(logctx, LOG_INFO, "[SIGNAL] Shutting down");
+			} else {
+				writelog(logctx, LOG_INFO, "[SIGNAL] Shutdown in progress ... please be patient ...");
+			}
+			break;
+
+		case SIGUSR1:
+			writelog(logctx, LOG_EMERG, "[SIGNAL] Shutdown alarm from a worker thread");
+			shutdown = 1;
+			break;
+
+		case SIGUSR2:
+			sched_log_stats(sched);
+			workerpool_log_stats(workers);
+			retry_log_stats(retry);
+			break;
+
+		case SIGHUP:
+			if( shutdown == 0 ) {
+				reload_config(reload);
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
 }
 
 
@@ -122,114 +227,258 @@ unsigned int get_mqueue_msg_max(LogContext *log) {
 }
 
 
+/**
+ * (Re)starts listening for submission queue notifications, and adds the database socket to
+ * the event loop.  The socket changes when the database connection is reset.
+ *
+ * @param epfd  epoll descriptor of the event loop
+ * @param dbc   Database connection
+ * @param dbfd  The database socket currently in the event loop, -1 if none.  Updated on success.
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int watch_database(int epfd, dbconn *dbc, int *dbfd) {
+	struct epoll_event ev;
+	int sock;
+
+	sock = db_listen(dbc, "rteval_submq");
+	if( sock < 0 ) {
+		return -1;
+	}
+	if( *dbfd >= 0 ) {
+		// Fails if the old socket is already closed, which is fine
+		epoll_ctl(epfd, EPOLL_CTL_DEL, *dbfd, NULL);
+	}
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.fd = sock;
+	if( epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev) < 0 ) {
+		writelog(dbc->log, LOG_EMERG, "Could not watch the database socket: %s", strerror(errno));
+		return -1;
+	}
+	*dbfd = sock;
+	return 1;
+}
+
+
+/**
+ * Checks the database connection after a failure, and resets it if needed
+ *
+ * @param epfd  epoll descriptor of the event loop
+ * @param dbc   Database connection
+ * @param dbfd  The database socket currently in the event loop
+ *
+ * @return Returns 1 if the database connection is usable, otherwise -1
+ */
+static int recover_database(int epfd, dbconn *dbc, int *dbfd) {
+	if( (db_ping(dbc) != 1) || (watch_database(epfd, dbc, dbfd) < 0) ) {
+		writelog(dbc->log, LOG_EMERG, "Lost connection to database.  Shutting down!");
+		return -1;
+	}
+	return 1;
+}
+
+
+/**
+ * Picks the next submission and sends it to the worker threads.  A job slot must be claimed
+ * before calling this function.  The slot is released unless the job is sent.
+ *
+ * @param dbc      Database connection, where to query the submission queue
+ * @param msgq     file descriptor for the message queue
+ * @param sched    Job scheduler
+ * @param workers  Worker pool
+ *
+ * @return Returns 1 when a job was sent, 0 if no submissions are waiting, -1 on database
+ *         errors, -2 if the message queue is full and -3 on other message queue errors.
+ */
+static int dispatch_job(dbconn *dbc, mqd_t msgq, JobScheduler *sched, WorkerPool *workers) {
+	parseJob_t *job = NULL;
+	struct timespec now;
+	int ret = 1, err;
+
+	job = sched_next_job(sched, dbc);
+	if( !job ) {
+		ret = -1;
+		goto exit;
+	}
+	if( job->status == jbNONE ) {
+		ret = 0;
+		goto exit;
+	}
+
+	// Send the job to the queue.  Short jobs get a higher priority.  The claimed slot
+	// guarantees room in the queue, so never wait if it is full anyway.
+	writelog(dbc->log, LOG_DEBUG, "** New job queued: submid %i, %s (lane %i)",
+		 job->submid, job->filename, job->lane);
+	job->queued = workerpool_clock();
+	clock_gettime(CLOCK_REALTIME, &now);
+	if( mq_timedsend(msgq, (char *) job, sizeof(parseJob_t), sched_mq_priority(job), &now) < 0 ) {
+		err = errno;
+		writelog(dbc->log, LOG_ERR, "Could not send submid %i to the worker threads: %s",
+			 job->submid, strerror(err));
+		db_requeue_submission(dbc, job->submid);
+		ret = ((err == ETIMEDOUT) || (err == EAGAIN) || (err == EINTR) ? -2 : -3);
+		goto exit;
+	}
+	free_nullsafe(job);
+	return 1;
+
+ exit:
+	workerpool_release_slot(workers);
+	free_nullsafe(job);
+	return ret;
+}
+
+
 /**
  * Main loop, which polls the submissionqueue table and puts jobs found here into a POSIX MQ queue
- * which the worker threads will pick up.
+ * which the worker threads will pick up.  The job scheduler decides the order of the jobs.  A
+ * submission is only picked when the worker pool can take another job.
+ *
+ * The loop waits in epoll for database notifications, signals, free job slots and the
+ * retry timer, so it reacts immediately on any of them.  When the queue is empty, the
+ * retry timer is set to when the next failed submission is due for a retry.
  *
  * @param dbc           Database connection, where to query the submission queue
  * @param msgq          file descriptor for the message queue
- * @param activethreads Pointer to an int value containing active worker threads.  Each thread updates
- *                      this value directly, and this function should only read it.
+ * @param sigfd         signalfd receiving the signals blocked by block_signals()
+ * @param sched         Job scheduler
+ * @param workers       Worker pool, providing the job slots
+ * @param retry         Retry policy, for the statistics
+ * @param reload        What is needed to reload the configuration on SIGHUP
  *
  * @return Returns 0 on successful run, otherwise > 0 on errors.
  */
-int process_submission_queue(dbconn *dbc, mqd_t msgq, int *activethreads) {
-	pthread_mutex_t mtx_submq = PTHREAD_MUTEX_INITIALIZER;
-	parseJob_t *job = NULL;
-	int rc = 0, i, actthr_cp = 0;
-
-	while( shutdown == 0 ) {
-		// Check status if the worker threads
-		// If we don't have any worker threads, shut down immediately
-		writelog(dbc->log, LOG_DEBUG, "Active worker threads: %i", *activethreads);
-		if( *activethreads < 1 ) {
-			writelog(dbc->log, LOG_EMERG,
-				 "All worker threads ceased to exist.  Shutting down!");
+int process_submission_queue(dbconn *dbc, mqd_t msgq, int sigfd, JobScheduler *sched,
+			     WorkerPool *workers, RetryPolicy *retry, ReloadContext *reload) {
+	struct epoll_event ev, events[DISPATCH_MAX_EVENTS];
+	struct itimerspec holdtime, wakeup;
+	int epfd = -1, timerfd = -1, dbfd = -1, fds[3];
+	int rc = 0, pending = 1, holdoff = 0, res, n, i;
+	uint64_t expired;
+
+	memset(&holdtime, 0, sizeof(struct itimerspec));
+	holdtime.it_value.tv_sec = DISPATCH_RETRY_DELAY;
+
+	// Prepare the event loop
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if( (epfd < 0) || (timerfd < 0) ) {
+		writelog(dbc->log, LOG_EMERG, "Could not prepare the event loop: %s", strerror(errno));
+		shutdown = 1;
+		rc = 2;
+		goto exit;
+	}
+	fds[0] = sigfd;
+	fds[1] = workerpool_slot_fd(workers);
+	fds[2] = timerfd;
+	for( i = 0; i < 3; i++ ) {
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = EPOLLIN;
+		ev.data.fd = fds[i];
+		if( epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev) < 0 ) {
+			writelog(dbc->log, LOG_EMERG, "Could not prepare the event loop: %s",
+				 strerror(errno));
 			shutdown = 1;
-			rc = 1;
+			rc = 2;
 			goto exit;
 		}
+	}
+	if( watch_database(epfd, dbc, &dbfd) < 0 ) {
+		shutdown = 1;
+		rc = 1;
+		goto exit;
+	}
 
-		if( db_ping(dbc) != 1 ) {
-			writelog(dbc->log, LOG_EMERG, "Lost connection to database.  Shutting down!");
-			shutdown = 1;
-			rc = 1;
-			goto exit;
+	while( shutdown == 0 ) {
+		// Hand out jobs while submissions are waiting and the workers can take them
+		while( pending && (shutdown == 0) && workerpool_claim_slot(workers) ) {
+			res = dispatch_job(dbc, msgq, sched, workers);
+			if( res == 0 ) {
+				pending = 0;
+
+				// Wake up when the next failed submission may be retried
+				res = db_get_next_retry(dbc);
+				if( res > 0 ) {
+					memset(&wakeup, 0, sizeof(struct itimerspec));
+					wakeup.it_value.tv_sec = res;
+					timerfd_settime(timerfd, 0, &wakeup, NULL);
+				}
+			} else if( res == -3 ) {
+				writelog(dbc->log, LOG_EMERG,
+					 "Could not send parse job to the queue.  Shutting down!");
+				shutdown = 1;
+				rc = 2;
+				goto exit;
+			} else if( res < 0 ) {
+				if( (res == -1) && (recover_database(epfd, dbc, &dbfd) < 0) ) {
+					shutdown = 1;
+					rc = 1;
+					goto exit;
+				}
+				sched_invalidate(sched);
+				writelog(dbc->log, LOG_WARNING,
+					 "Failed to dispatch a submission, retrying in %i seconds",
+					 DISPATCH_RETRY_DELAY);
+				pending = 0;
+				holdoff = 1;
+				timerfd_settime(timerfd, 0, &holdtime, NULL);
+			}
 		}
 
-		// Fetch an available job
-		job = db_get_submissionqueue_job(dbc, &mtx_submq);
-		if( !job ) {
-			writelog(dbc->log, LOG_EMERG,
-				 "Failed to get submission queue job.  Shutting down!");
-			shutdown = 1;
-			rc = 1;
-			goto exit;
-		}
-		if( job->status == jbNONE ) {
-			free_nullsafe(job);
-			if( db_wait_notification(dbc, &shutdown, "rteval_submq") < 1 ) {
-				writelog(dbc->log, LOG_EMERG,
-					 "Failed to wait for DB notification.  Shutting down!");
+		// Collect the notifications, also those which arrived with the query results.
+		// The scheduler queries the submission queue again after a notification.
+		res = db_get_notifications(dbc);
+		if( res < 0 ) {
+			if( recover_database(epfd, dbc, &dbfd) < 0 ) {
 				shutdown = 1;
 				rc = 1;
 				goto exit;
 			}
+			sched_invalidate(sched);
+			pending = !holdoff;
 			continue;
+		} else if( res > 0 ) {
+			sched_invalidate(sched);
+			if( !holdoff && !pending ) {
+				pending = 1;
+				continue;
+			}
 		}
 
-		// Send the job to the queue
-		writelog(dbc->log, LOG_DEBUG, "** New job queued: submid %i, %s", job->submid, job->filename);
-		do {
-			int res;
-
-			errno = 0;
-			res = mq_send(msgq, (char *) job, sizeof(parseJob_t), 1);
-			if( (res < 0) && (errno != EAGAIN) ) {
-				writelog(dbc->log, LOG_EMERG,
-					 "Could not send parse job to the queue.  "
-					 "Shutting down!");
-				shutdown = 1;
-				rc = 2;
-				goto exit;
-			} else if( errno == EAGAIN ) {
-				writelog(dbc->log, LOG_WARNING,
-					"Message queue filled up.  "
-					"Will not add new messages to queue for the next 60 seconds");
-				sleep(60);
+		n = epoll_wait(epfd, events, DISPATCH_MAX_EVENTS, -1);
+		if( (n < 0) && (errno != EINTR) ) {
+			writelog(dbc->log, LOG_EMERG, "Event loop failed: %s.  Shutting down!",
+				 strerror(errno));
+			shutdown = 1;
+			rc = 2;
+			goto exit;
+		}
+		for( i = 0; i < n; i++ ) {
+			if( events[i].data.fd == sigfd ) {
+				handle_signals(sigfd, sched, workers, retry, reload);
+			} else if( events[i].data.fd == fds[1] ) {
+				workerpool_slot_ack(workers);
+			} else if( events[i].data.fd == timerfd ) {
+				if( read(timerfd, &expired, sizeof(expired)) > 0 ) {
+					sched_invalidate(sched);
+					holdoff = 0;
+					pending = 1;
+				}
 			}
-		} while( (errno == EAGAIN) );
-		free_nullsafe(job);
+			// The database socket is handled by db_get_notifications() above
+		}
 	}
 
  exit:
-	// Send empty messages to the threads, to make them have a look at the shutdown flag
-	job = (parseJob_t *) malloc_nullsafe(dbc->log, sizeof(parseJob_t));
-	errno = 0;
-	// Need to make a copy, as *activethreads will change when threads completes shutdown
-	actthr_cp = *activethreads;
-	for( i = 0; i < actthr_cp; i++ ) {
-		do {
-			int res;
-
-			writelog(dbc->log, LOG_DEBUG, "%s shutdown message %i of %i",
-				 (errno == EAGAIN ? "Resending" : "Sending"), i+1, *activethreads);
-			errno = 0;
-			res = mq_send(msgq, (char *) job, sizeof(parseJob_t), 1);
-			if( (res < 0) && (errno != EAGAIN) ) {
-				writelog(dbc->log, LOG_EMERG,
-					 "Could not send shutdown notification to the queue.");
-				free_nullsafe(job);
-				return rc;
-			} else if( errno == EAGAIN ) {
-				writelog(dbc->log, LOG_WARNING,
-					"Message queue filled up.  "
-					"Will not add new messages to queue for the next 10 seconds");
-				sleep(10);
-			}
-		} while( (errno == EAGAIN) );
+	// The worker threads are notified about the shutdown by workerpool_stop()
+	if( timerfd >= 0 ) {
+		close(timerfd);
+	}
+	if( epfd >= 0 ) {
+		close(epfd);
 	}
-	free_nullsafe(job);
 	return rc;
 }
 
@@ -292,26 +541,34 @@ int daemonise(LogContext *log) {
  * @param argc
  * @param argv
  *
- * @return Returns the result of the process_submission_queue() function.
+ * @return Returns the result of the process_submission_queue() function, or with --reingest
+ *         and --transform-only 0 on success, 1 if some rteval runs or reports failed and
+ *         2 on errors.
  */
 int main(int argc, char **argv) {
         eurephiaVALUES *config = NULL, *prgargs = NULL;
-        char xsltfile[2050], *reportdir = NULL;
-	xsltStylesheet *xslt = NULL;
-	dbconn *dbc = NULL;
-        pthread_t **threads = NULL;
-        pthread_attr_t **thread_attrs = NULL;
+        char *reportdir = NULL;
+	SettingsStore *settings = NULL;
+	JobSettings *js = NULL;
+	ReloadContext reload;
+	dbconn *dbc = NULL, *ingest_dbc = NULL;
+	ReportArchive *archive = NULL;
+	IngestListener *ingest = NULL;
+	WorkerPool *workers = NULL;
+	ShardMap *shards = NULL;
+	DbPool *dbpool = NULL;
+	JobScheduler *sched = NULL;
+	RetryPolicy *retry = NULL;
+	JobWatchdog *watchdog = NULL;
+	AffinityMap *affinity = NULL;
 	pthread_mutex_t mtx_sysreg = PTHREAD_MUTEX_INITIALIZER;
-	pthread_mutex_t mtx_thrcnt = PTHREAD_MUTEX_INITIALIZER;
-	threadData_t **thrdata = NULL;
+	threadData_t thrtmpl;
 	struct mq_attr msgq_attr;
 	mqd_t msgq = 0;
-	int i,rc, mq_init = 0, max_threads = 0, started_threads = 0, activethreads = 0;
-	unsigned int max_report_size = 0;
-
-	// Initialise XML and XSLT libraries
-	xsltInit();
-	xmlInitParser();
+	sigset_t sigs;
+	int rc, mq_init = 0, sigfd = -1;
+	int worker_arena = 0;
+	size_t arena_chunk = 0, arena_retain = 0;
 
 	prgargs = parse_arguments(argc, argv);
 	if( prgargs == NULL ) {
@@ -321,7 +578,8 @@ int main(int argc, char **argv) {
 	}
 
 	// Setup a log context
-	logctx = init_log(eGet_value(prgargs, "log"), eGet_value(prgargs, "loglevel"));
+	logctx = init_log(eGet_value(prgargs, "log"), eGet_value(prgargs, "loglevel"),
+			  atoi_nullsafe(eGet_value(prgargs, "log_async")));
 	if( !logctx ) {
 		fprintf(stderr, "** ERROR **  Could not setup a log context\n");
 		eFree_values(prgargs);
@@ -331,7 +589,16 @@ int main(int argc, char **argv) {
 
 	// Fetch configuration
         config = read_config(logctx, prgargs, "xmlrpc_parser");
-	eFree_values(prgargs); // read_config() copies prgargs into config, we don't need prgargs anymore
+	if( !config ) {
+		rc = 2;
+		goto exit;
+	}
+	if( eGet_value(config, "loglevel") ) {
+		log_set_level(logctx, eGet_value(config, "loglevel"));
+	}
+
+	// Signals are received via a signalfd in the main loop, not by signal handlers
+	block_signals(&sigs);
 
 	// Daemonise process if requested
 	if( atoi_nullsafe(eGet_value(config, "daemon")) == 1 ) {
@@ -341,16 +608,57 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	// Move to the housekeeping CPUs before any threads are started, they inherit it
+	affinity = affinity_init(logctx, config);
+	if( !affinity ) {
+		rc = 2;
+		goto exit;
+	}
+	affinity_pin_housekeeping(affinity);
 
-	// Parse XSLT template
-	snprintf(xsltfile, 512, "%s/%s", eGet_value(config, "xsltpath"), XMLPARSER_XSL);
-	writelog(logctx, LOG_DEBUG, "Parsing XSLT file: %s", xsltfile);
-        xslt = xsltParseStylesheetFile((xmlChar *) xsltfile);
-	if( !xslt ) {
-		writelog(logctx, LOG_EMERG, "Could not parse XSLT template: %s", xsltfile);
+	// Start the asynchronous log writer, if requested.  Must be done after daemonising.
+	if( log_start_async(logctx) < 0 ) {
+		writelog(logctx, LOG_WARNING, "Continuing with synchronous logging");
+	}
+
+	// The memory arena hooks must be installed before libxml2 is initialised
+	worker_arena = atoi_nullsafe(eGet_value(config, "worker_arena"));
+	if( worker_arena && (memarena_setup(logctx) < 0) ) {
+		writelog(logctx, LOG_WARNING,
+			 "Could not install memory arena hooks, worker arenas are disabled");
+		worker_arena = 0;
+	}
+	arena_chunk = defaultIntValue(atoi_nullsafe(eGet_value(config, "worker_arena_chunk")),
+				      MEMARENA_DEFAULT_CHUNK);
+	arena_retain = defaultIntValue(atoi_nullsafe(eGet_value(config, "worker_arena_retain")),
+				       MEMARENA_DEFAULT_RETAIN);
+
+	// Initialise XML and XSLT libraries
+	xsltInit();
+	xmlInitParser();
+
+	// Parse XSLT template and prepare the settings used when processing reports.  With
+	// worker arenas, libxslt must complete the stylesheet before the arenas are used.
+	js = settings_load(logctx, config, worker_arena);
+	if( !js ) {
 		rc = 2;
 		goto exit;
 	}
+	settings = settings_init(logctx, js);
+
+	// Re-ingest archived reports instead of processing the submission queue, if requested
+	if( eGet_value(config, "reingest") ) {
+		rc = reingest_archive(logctx, config, settings, &sigs);
+		rc = (rc > 0 ? 0 : (rc == 0 ? 1 : 2));
+		goto exit;
+	}
+
+	// Write COPY load files for the reports given as arguments, without a database
+	if( eGet_value(config, "transform_only") ) {
+		rc = transform_reports(logctx, config, settings, argc - optind, &argv[optind], &sigs);
+		rc = (rc > 0 ? 0 : (rc == 0 ? 1 : 2));
+		goto exit;
+	}
 
 	// Open a POSIX MQ
 	writelog(logctx, LOG_DEBUG, "Preparing POSIX MQ queue: /rteval_parsequeue");
@@ -367,104 +675,101 @@ int main(int argc, char **argv) {
 	}
 	mq_init = 1;
 
-	// Get the number of worker threads
-	max_threads = atoi_nullsafe(eGet_value(config, "threads"));
-	if( max_threads == 0 ) {
-		max_threads = 4;
-	}
-
-	// Get a database connection for the main thread
-        dbc = db_connect(config, max_threads, logctx);
+	// Get a database connection for the main thread.  This connection is also
+	// used for LISTEN, so it is not shared with the worker threads.
+        dbc = db_connect(config, 0, logctx);
         if( !dbc ) {
 		rc = 4;
 		goto exit;
         }
 
-	// Prepare all threads
-	threads = calloc(max_threads + 1, sizeof(pthread_t *));
-	thread_attrs = calloc(max_threads + 1, sizeof(pthread_attr_t *));
-	thrdata = calloc(max_threads + 1, sizeof(threadData_t *));
-	assert( (threads != NULL) && (thread_attrs != NULL) && (thrdata != NULL) );
+	// Prepare the database connections shared by the worker threads, and the shard
+	// databases where the reports are stored, if configured
+	dbpool = dbpool_init(logctx, config, dbc, 2);
+	if( !dbpool ) {
+		rc = 2;
+		goto exit;
+	}
+	shards = shard_init(logctx, config, dbpool);
+	if( !shards ) {
+		rc = 2;
+		goto exit;
+	}
 
+	// Prepare the report archive, and finish archiving reports left from the previous run
 	reportdir = eGet_value(config, "reportdir");
-	writelog(logctx, LOG_INFO, "Starting %i worker threads", max_threads);
-	max_report_size = defaultIntValue(atoi_nullsafe(eGet_value(config, "max_report_size")), 1024*1024);
-	for( i = 0; i < max_threads; i++ ) {
-		// Prepare thread specific data
-		thrdata[i] = malloc_nullsafe(logctx, sizeof(threadData_t));
-		if( !thrdata[i] ) {
-			writelog(logctx, LOG_EMERG,
-				 "Could not allocate memory for thread data");
-			rc = 2;
-			goto exit;
-		}
+	archive = archive_init(logctx, reportdir, atoi_nullsafe(eGet_value(config, "archive_fanout")),
+			       atoi_nullsafe(eGet_value(config, "archive_compress")));
+	if( !archive || (archive_start(archive) < 0) || (archive_replay(archive, shards, dbc) < 0) ) {
+		rc = 2;
+		goto exit;
+	}
 
-		// Get a database connection for the thread
-		thrdata[i]->dbc = db_connect(config, i, logctx);
-		if( !thrdata[i]->dbc ) {
-			writelog(logctx, LOG_EMERG,
-				"Could not connect to the database for thread %i", i);
-			rc = 2;
-			shutdown = 1;
-			goto exit;
-		}
+	// Prepare the job scheduler
+	sched = sched_init(logctx, config);
+	if( !sched ) {
+		rc = 2;
+		goto exit;
+	}
 
-		// Parse the measurement_tables config variable, split it up into an array
-		thrdata[i]->dbc->measurement_tbls = strSplit(eGet_value(config, "measurement_tables"), ", ");
-		if( !thrdata[i]->dbc->measurement_tbls ) {
-			writelog(dbc->log, LOG_CRIT, "Failed to parse measurement_tables configuration");
-			rc = 2;
-			shutdown = 1;
-			goto exit;
-		}
+	// Recover the submissions interrupted when the previous run stopped
+	retry = retry_init(logctx, config);
+	if( (shard_recover(shards, dbc) < 0) || (retry_recover(retry, dbc) < 0) ) {
+		rc = 2;
+		goto exit;
+	}
 
-		thrdata[i]->shutdown = &shutdown;
-		thrdata[i]->threadcount = &activethreads;
-		thrdata[i]->mtx_thrcnt = &mtx_thrcnt;
-		thrdata[i]->id = i;
-		thrdata[i]->msgq = msgq;
-		thrdata[i]->mtx_sysreg = &mtx_sysreg;
-		thrdata[i]->xslt = xslt;
-		thrdata[i]->destdir = reportdir;
-		thrdata[i]->max_report_size = max_report_size;
-
-		thread_attrs[i] = malloc_nullsafe(logctx, sizeof(pthread_attr_t));
-		if( !thread_attrs[i] ) {
-			writelog(logctx, LOG_EMERG,
-				"Could not allocate memory for thread attributes");
-			rc = 2;
-			goto exit;
-		}
-		pthread_attr_init(thread_attrs[i]);
-		pthread_attr_setdetachstate(thread_attrs[i], PTHREAD_CREATE_JOINABLE);
+	// Setup signal catching.  Signals received before this point are kept pending.
+	sigfd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+	if( sigfd < 0 ) {
+		writelog(logctx, LOG_EMERG, "Could not prepare signal handling: %s", strerror(errno));
+		rc = 2;
+		goto exit;
+	}
 
-		threads[i] = malloc_nullsafe(logctx, sizeof(pthread_t));
-		if( !threads[i] ) {
-			writelog(logctx, LOG_EMERG,
-				"Could not allocate memory for pthread_t");
-			rc = 2;
-			goto exit;
-		}
+	// Start the watchdog, aborting reports exceeding the processing limits
+	watchdog = watchdog_start(logctx, config);
+	if( !watchdog ) {
+		rc = 2;
+		goto exit;
 	}
 
-	// Setup signal catching
-	signal(SIGINT,  sigcatch);
-	signal(SIGTERM, sigcatch);
-	signal(SIGHUP,  SIG_IGN);
-	signal(SIGUSR1, sigcatch);
-	signal(SIGUSR2, SIG_IGN);
-
-	// Start the threads
-	for( i = 0; i < max_threads; i++ ) {
-		int thr_rc = pthread_create(threads[i], thread_attrs[i], parsethread, thrdata[i]);
-		if( thr_rc < 0 ) {
-			writelog(logctx, LOG_EMERG,
-				 "** ERROR **  Failed to start thread %i: %s",
-				 i, strerror(thr_rc));
-			rc = 3;
+	// Start the worker threads.  The worker pool starts and stops threads as needed.
+	memset(&thrtmpl, 0, sizeof(threadData_t));
+	thrtmpl.log = logctx;
+	thrtmpl.dbpool = dbpool;
+	thrtmpl.shards = shards;
+	thrtmpl.shutdown = &shutdown;
+	thrtmpl.msgq = msgq;
+	thrtmpl.mtx_sysreg = &mtx_sysreg;
+	thrtmpl.settings_store = settings;
+	thrtmpl.archive = archive;
+	thrtmpl.sched = sched;
+	thrtmpl.retry = retry;
+	thrtmpl.watchdog = watchdog;
+	thrtmpl.affinity = affinity;
+	thrtmpl.idle_timeout = defaultIntValue(atoi_nullsafe(eGet_value(config, "thread_idle_timeout")), 120);
+	workers = workerpool_start(logctx, config, &thrtmpl,
+				   worker_arena, arena_chunk, arena_retain);
+	if( !workers ) {
+		rc = 3;
+		shutdown = 1;
+		goto exit;
+	}
+
+	// Start receiving reports directly, if configured
+	if( eGet_value(config, "ingest_listen") ) {
+		ingest_dbc = db_connect(config, 1, logctx);
+		if( ingest_dbc ) {
+			ingest = ingest_start(logctx, config, ingest_dbc, msgq, sched, workers,
+					      settings, &shutdown);
+		}
+		if( !ingest ) {
+			writelog(logctx, LOG_EMERG, "Could not start the report ingestion listener");
+			shutdown = 1;
+			rc = 2;
 			goto exit;
 		}
-		started_threads++;
 	}
 
 	// Main routine
@@ -472,43 +777,25 @@ int main(int argc, char **argv) {
 	// checks the submission queue and puts unprocessed records on the POSIX MQ
 	// to be parsed by one of the threads
 	//
-	sleep(3); // Allow at least a few parser threads to settle down first before really starting
 	writelog(logctx, LOG_DEBUG, "Starting submission queue checker");
-	rc = process_submission_queue(dbc, msgq, &activethreads);
+	reload.prgargs = prgargs;
+	reload.settings = settings;
+	reload.workers = workers;
+	reload.worker_arena = worker_arena;
+	rc = process_submission_queue(dbc, msgq, sigfd, sched, workers, retry, &reload);
 	writelog(logctx, LOG_DEBUG, "Submission queue checker shut down");
 
  exit:
-	// Clean up all threads
-	for( i = 0; i < max_threads; i++ ) {
-		// Wait for all threads to exit
-		if( (i < started_threads) && threads && threads[i] ) {
-			void *thread_rc;
-			int j_rc;
-
-			if( (j_rc = pthread_join(*threads[i], &thread_rc)) != 0 ) {
-				writelog(logctx, LOG_CRIT,
-					 "Failed to join thread %i: %s",
-					 i, strerror(j_rc));
-			}
-			pthread_attr_destroy(thread_attrs[i]);
-		}
-		if( threads ) {
-			free_nullsafe(threads[i]);
-		}
-		if( thread_attrs ) {
-			free_nullsafe(thread_attrs[i]);
-		}
+	// Stop receiving new reports
+	ingest_stop(ingest);
+	db_disconnect(ingest_dbc);
 
-		// Disconnect threads database connection
-		if( thrdata && thrdata[i] ) {
-			strFree(thrdata[i]->dbc->measurement_tbls);
-			db_disconnect(thrdata[i]->dbc);
-			free_nullsafe(thrdata[i]);
-		}
-	}
-	free_nullsafe(thrdata);
-	free_nullsafe(threads);
-	free_nullsafe(thread_attrs);
+	// Stop all worker threads
+	shutdown = 1;
+	workerpool_stop(workers);
+	shard_free(shards);
+	dbpool_free(dbpool);
+	watchdog_stop(watchdog);
 
 	// Close message queue
 	if( mq_init == 1 ) {
@@ -524,12 +811,22 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	// Wait for the archiver thread to complete all queued reports
+	archive_shutdown(archive);
+
 	// Disconnect from database, main thread connection
 	db_disconnect(dbc);
+	sched_free(sched);
+	retry_free(retry);
+	affinity_free(affinity);
+	if( sigfd >= 0 ) {
+		close(sigfd);
+	}
 
 	// Free up the rest
 	eFree_values(config);
-	xsltFreeStylesheet(xslt);
+	eFree_values(prgargs);
+	settings_free(settings);
 	xmlCleanupParser();
 	xsltCleanupGlobals();
 
@@ -0,0 +1,568 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   scheduler.c
+ * @date   Sun Oct 18 22:31:05 2026
+ *
+ * @brief  Decides which queued submission the worker threads get next
+ *
+ * Submissions are put in one of two lanes, based on the size of the report file.
+ * Reports not bigger than sched_short_size go into the short lane, and are
+ * dispatched before the other reports.  To avoid starving the big reports, one
+ * report from the normal lane is dispatched after sched_short_burst short ones
+ * when both lanes have waiting reports.  The lane also decides the POSIX MQ
+ * priority, so short reports pass the big reports already waiting for a worker.
+ *
+ * Within a lane, the clients share the workers by weighted fair queuing.  Each
+ * client has a finish tag, which grows by the report size divided by the weight of
+ * the client for every dispatched report.  The next report comes from the client
+ * with the lowest finish tag, so a client with many queued reports gets its turn
+ * as often as the others, but not more.  Clients get the weight 1 unless
+ * configured otherwise in sched_client_weights.
+ *
+ * Only the oldest sched_client_window reports of each client are considered, and
+ * at most sched_max_candidates reports in total.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <statuses.h>
+#include <parsethread.h>
+#include <xmlparser.h>
+#include <scheduler.h>
+
+/**
+ * Scheduling state of a client
+ */
+typedef struct _SchedClient {
+	char *clientid;            /**< Client ID, as registered in the submission queue */
+	unsigned int weight;       /**< Share of the workers, relative to other clients */
+	double finish;             /**< Finish tag of the last dispatched report */
+	unsigned long dispatched;  /**< Number of dispatched reports */
+	int pinned;                /**< Set while the client has waiting candidates, see sched_purge_clients() */
+	struct _SchedClient *next; /**< Next client in the same hash bucket */
+} SchedClient;
+
+/**
+ * Counters per lane
+ */
+typedef struct {
+	unsigned long dispatched;  /**< Reports sent to the worker threads */
+	unsigned long long bytes;  /**< Total size of the dispatched reports */
+	unsigned long started;     /**< Reports picked up by a worker thread */
+	double wait_sum;           /**< Total time the reports waited for a worker thread */
+	double wait_max;           /**< Longest time a report waited for a worker thread */
+} SchedLaneStats;
+
+/**
+ * The scheduler
+ */
+struct _JobScheduler {
+	LogContext *log;           /**< Log context */
+	off_t short_size;          /**< Reports up to this size go into the short lane, 0 disables it */
+	unsigned int short_burst;  /**< Short reports dispatched in a row while big reports wait */
+	unsigned int short_run;    /**< Short reports dispatched in a row */
+	unsigned int client_window; /**< Reports per client considered */
+	unsigned int max_candidates; /**< Reports considered in total */
+	eurephiaVALUES *weights;   /**< Configured client weights */
+	double vtime;              /**< Virtual time, the start tag of the last dispatched report */
+	SchedClient *clients[SCHED_CLIENT_BUCKETS]; /**< Per client state */
+	unsigned int nclients;     /**< Number of clients in the clients table */
+	parseJob_t *cands;         /**< Candidates of the last submission queue query */
+	unsigned int ncands;       /**< Number of candidates in cands */
+	unsigned int nwaiting;     /**< Candidates in cands which are not dispatched yet */
+	int stale;                 /**< Set when the candidates must be queried again */
+	pthread_mutex_t mtx;       /**< Protects the lane counters */
+	SchedLaneStats lanes[SCHED_LANES]; /**< Counters per lane */
+};
+
+static const char *lane_names[SCHED_LANES] = { "normal", "short" };
+
+
+/**
+ * Calculates a hash value of a client ID
+ *
+ * @param str  Client ID
+ *
+ * @return Returns the hash bucket of the client
+ */
+static unsigned int sched_hash(const char *str)
+{
+	unsigned int h = 5381;
+
+	while( *str ) {
+		h = (h * 33) ^ (unsigned char) *str++;
+	}
+	return h % SCHED_CLIENT_BUCKETS;
+}
+
+
+/**
+ * Finds the scheduling state of a known client
+ *
+ * @param sched     JobScheduler
+ * @param clientid  Client ID
+ *
+ * @return Returns a pointer to the client state, or NULL if the client is unknown
+ */
+static SchedClient *sched_find_client(JobScheduler *sched, const char *clientid)
+{
+	SchedClient *c = NULL;
+
+	for( c = sched->clients[sched_hash(clientid)]; c; c = c->next ) {
+		if( strcmp(c->clientid, clientid) == 0 ) {
+			return c;
+		}
+	}
+	return NULL;
+}
+
+
+/**
+ * Forgets clients without any advantage from their history, when too many
+ * clients are tracked.  A client with a finish tag behind the virtual time
+ * starts on the virtual time anyway.  Clients with waiting candidates are kept,
+ * as they are about to be picked.  Must not be called while a job is picked.
+ *
+ * @param sched  JobScheduler
+ */
+static void sched_purge_clients(JobScheduler *sched)
+{
+	SchedClient **pp = NULL, *c = NULL;
+	unsigned int i;
+
+	for( i = 0; i < sched->ncands; i++ ) {
+		if( (sched->cands[i].status == jbAVAIL)
+		    && ((c = sched_find_client(sched, sched->cands[i].clientid)) != NULL) ) {
+			c->pinned = 1;
+		}
+	}
+
+	for( i = 0; i < SCHED_CLIENT_BUCKETS; i++ ) {
+		pp = &sched->clients[i];
+		while( *pp ) {
+			c = *pp;
+			if( !c->pinned && (c->finish <= sched->vtime) ) {
+				*pp = c->next;
+				free_nullsafe(c->clientid);
+				free(c);
+				sched->nclients--;
+			} else {
+				c->pinned = 0;
+				pp = &c->next;
+			}
+		}
+	}
+}
+
+
+/**
+ * Finds the scheduling state of a client, a new state is prepared for unknown clients.
+ * Clients are never forgotten here, so the returned pointers stay valid while a job is
+ * picked.
+ *
+ * @param sched     JobScheduler
+ * @param clientid  Client ID
+ *
+ * @return Returns a pointer to the client state
+ */
+static SchedClient *sched_get_client(JobScheduler *sched, const char *clientid)
+{
+	unsigned int h = sched_hash(clientid);
+	SchedClient *c = NULL;
+	char *weight = NULL;
+
+	if( (c = sched_find_client(sched, clientid)) != NULL ) {
+		return c;
+	}
+
+	c = malloc_nullsafe(sched->log, sizeof(SchedClient));
+	c->clientid = strdup(clientid);
+	weight = eGet_value(sched->weights, clientid);
+	c->weight = defaultIntValue(atoi_nullsafe(weight), 1);
+	c->finish = sched->vtime;
+	c->next = sched->clients[h];
+	sched->clients[h] = c;
+	sched->nclients++;
+	return c;
+}
+
+
+/**
+ * Parses the sched_client_weights setting, a list of <clientid>:<weight> pairs
+ *
+ * @param sched   JobScheduler
+ * @param cfgval  The configured value, may be NULL
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int sched_parse_weights(JobScheduler *sched, const char *cfgval)
+{
+	array_str_t *pairs = NULL;
+	unsigned int i;
+	int ret = 1;
+
+	sched->weights = eCreate_value_space(sched->log, 0);
+	if( !cfgval || !*cfgval ) {
+		return 1;
+	}
+
+	pairs = strSplit(cfgval, ", ");
+	if( !pairs ) {
+		return -1;
+	}
+	for( i = 0; i < strSize(pairs); i++ ) {
+		char *pair = strGet(pairs, i), *sep = NULL;
+
+		if( !pair || !*pair ) {
+			continue;
+		}
+		sep = strrchr(pair, ':');
+		if( !sep || (atoi_nullsafe(sep + 1) < 1) ) {
+			writelog(sched->log, LOG_EMERG,
+				 "Invalid sched_client_weights entry '%s', expected <clientid>:<weight>",
+				 pair);
+			ret = -1;
+			break;
+		}
+		*sep = '\0';
+		eAdd_value(sched->weights, pair, sep + 1);
+	}
+	strFree(pairs);
+	return ret;
+}
+
+
+/**
+ * Prepares the scheduler
+ *
+ * @param log  Log context
+ * @param cfg  Configuration
+ *
+ * @return Returns a JobScheduler on success, otherwise NULL
+ */
+JobScheduler *sched_init(LogContext *log, eurephiaVALUES *cfg)
+{
+	JobScheduler *sched = NULL;
+
+	sched = malloc_nullsafe(log, sizeof(JobScheduler));
+	sched->log = log;
+	sched->short_size = atoi_nullsafe(eGet_value(cfg, "sched_short_size"));
+	sched->short_burst = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "sched_short_burst")), 4);
+	sched->client_window = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "sched_client_window")), 4);
+	sched->max_candidates = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "sched_max_candidates")), 256);
+	pthread_mutex_init(&sched->mtx, NULL);
+
+	if( sched_parse_weights(sched, eGet_value(cfg, "sched_client_weights")) < 0 ) {
+		sched_free(sched);
+		return NULL;
+	}
+
+	writelog(log, LOG_DEBUG, "Scheduler: short lane up to %ld bytes, %i short reports in a row",
+		 (long) sched->short_size, sched->short_burst);
+	return sched;
+}
+
+
+/**
+ * Puts a report into a lane based on its size, and counts it as dispatched.  Used for
+ * reports which are sent directly to the worker threads.
+ *
+ * @param sched  JobScheduler
+ * @param job    The parse job, the lane is set here
+ * @param size   Size of the report file
+ *
+ * @return Returns the lane of the report
+ */
+unsigned int sched_classify(JobScheduler *sched, parseJob_t *job, off_t size)
+{
+	job->lane = (((sched->short_size > 0) && (size <= sched->short_size))
+		     ? SCHED_LANE_SHORT : SCHED_LANE_NORMAL);
+
+	pthread_mutex_lock(&sched->mtx);
+	sched->lanes[job->lane].dispatched++;
+	sched->lanes[job->lane].bytes += size;
+	pthread_mutex_unlock(&sched->mtx);
+	return job->lane;
+}
+
+
+/**
+ * Returns the POSIX MQ priority of a parse job.  Higher priority messages are received first.
+ *
+ * @param job  Parse job
+ *
+ * @return Returns the message priority
+ */
+unsigned int sched_mq_priority(parseJob_t *job)
+{
+	return job->lane + 1;
+}
+
+
+/**
+ * Queries the waiting submissions again, and puts each of them into a lane.  The size
+ * is registered with the submission, only submissions registered before the report_size
+ * column was added are looked up in the file system.
+ *
+ * @param sched  JobScheduler
+ * @param dbc    Database connection
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int sched_refresh(JobScheduler *sched, dbconn *dbc)
+{
+	unsigned int i;
+
+	free_nullsafe(sched->cands);
+	sched->ncands = 0;
+	sched->nwaiting = 0;
+	sched->cands = db_get_submissionqueue_candidates(dbc, sched->client_window,
+							 sched->max_candidates, &sched->ncands);
+	if( !sched->cands ) {
+		sched->ncands = 0;
+		return -1;
+	}
+
+	for( i = 0; i < sched->ncands; i++ ) {
+		parseJob_t *cand = &sched->cands[i];
+
+		if( cand->size < 0 ) {
+			struct stat st;
+
+			// Missing files are reported by the worker thread
+			cand->size = (stat(cand->filename, &st) == 0 ? st.st_size : 0);
+		}
+		cand->lane = (((sched->short_size > 0) && (cand->size <= sched->short_size))
+			      ? SCHED_LANE_SHORT : SCHED_LANE_NORMAL);
+	}
+	sched->nwaiting = sched->ncands;
+	sched->stale = 0;
+	return 1;
+}
+
+
+/**
+ * Makes the next sched_next_job() call query the submission queue again.  Must be called
+ * when new submissions may be waiting, and from the thread calling sched_next_job().
+ *
+ * @param sched  JobScheduler
+ */
+void sched_invalidate(JobScheduler *sched)
+{
+	sched->stale = 1;
+}
+
+
+/**
+ * Finds the next submission to be processed, and marks it as assigned.  The waiting
+ * submissions are queried once, and the following jobs are picked from the same
+ * candidates until they are used up or sched_invalidate() is called.  The submission
+ * queue is also queried again when the last candidate of a client which filled its
+ * sched_client_window is dispatched, as more of its reports may be waiting.
+ *
+ * @param sched  JobScheduler
+ * @param dbc    Database connection
+ *
+ * @return Returns a parse job on success, with the status jbNONE if no submissions are
+ *         waiting.  On errors NULL is returned.
+ */
+parseJob_t *sched_next_job(JobScheduler *sched, dbconn *dbc)
+{
+	parseJob_t *cands = NULL, *job = NULL;
+	SchedClient *c = NULL, *bestc = NULL;
+	double start, finish, beststart = 0, bestfinish = 0;
+	unsigned int i, j, lane, cached = 0, left = 0;
+	int have[SCHED_LANES] = { 0, 0 }, best = -1;
+
+	if( (sched->stale || (sched->nwaiting == 0)) && (sched_refresh(sched, dbc) < 0) ) {
+		return NULL;
+	}
+	cands = sched->cands;
+
+	// Forget idle clients before picking, sched_get_client() never frees any of them
+	if( sched->nclients >= SCHED_MAX_CLIENTS ) {
+		sched_purge_clients(sched);
+	}
+
+	job = malloc_nullsafe(dbc->log, sizeof(parseJob_t));
+	if( sched->nwaiting == 0 ) {
+		job->status = jbNONE;
+		return job;
+	}
+
+	// Dispatched candidates are set to jbNONE
+	for( i = 0; i < sched->ncands; i++ ) {
+		if( cands[i].status == jbAVAIL ) {
+			have[cands[i].lane] = 1;
+		}
+	}
+	lane = ((have[SCHED_LANE_SHORT] && (!have[SCHED_LANE_NORMAL]
+					    || (sched->short_run < sched->short_burst)))
+		? SCHED_LANE_SHORT : SCHED_LANE_NORMAL);
+
+	// Weighted fair queuing between the oldest report of each client in this lane
+	for( i = 0; i < sched->ncands; i++ ) {
+		if( (cands[i].status != jbAVAIL) || (cands[i].lane != lane) ) {
+			continue;
+		}
+		for( j = 0; j < i; j++ ) {
+			if( (cands[j].status == jbAVAIL) && (cands[j].lane == lane)
+			    && (strcmp(cands[j].clientid, cands[i].clientid) == 0) ) {
+				break;
+			}
+		}
+		if( j < i ) {
+			continue; // An older report of the same client is in this lane
+		}
+
+		c = sched_get_client(sched, cands[i].clientid);
+		start = (c->finish > sched->vtime ? c->finish : sched->vtime);
+		finish = start + ((double) (cands[i].size / 1024 + 1) / (double) c->weight);
+		if( (best < 0) || (finish < bestfinish) ) {
+			best = i;
+			bestc = c;
+			beststart = start;
+			bestfinish = finish;
+		}
+	}
+
+	if( db_update_submissionqueue(dbc, cands[best].submid, STAT_ASSIGNED) < 1 ) {
+		writelog(dbc->log, LOG_ALERT, "[Connection %i] Failed to update "
+			 "submission queue statis to STAT_ASSIGNED", dbc->id);
+		sched->stale = 1;
+		free_nullsafe(job);
+		return NULL;
+	}
+	memcpy(job, &cands[best], sizeof(parseJob_t));
+	cands[best].status = jbNONE;
+	sched->nwaiting--;
+
+	// More reports of this client may be waiting if it filled its window
+	for( i = 0; i < sched->ncands; i++ ) {
+		if( strcmp(cands[i].clientid, job->clientid) == 0 ) {
+			cached++;
+			left += (cands[i].status == jbAVAIL);
+		}
+	}
+	if( (left == 0) && (cached >= sched->client_window) ) {
+		sched->stale = 1;
+	}
+
+	bestc->finish = bestfinish;
+	bestc->dispatched++;
+	sched->vtime = beststart;
+	sched->short_run = (lane == SCHED_LANE_SHORT ? sched->short_run + 1 : 0);
+
+	pthread_mutex_lock(&sched->mtx);
+	sched->lanes[lane].dispatched++;
+	sched->lanes[lane].bytes += job->size;
+	pthread_mutex_unlock(&sched->mtx);
+	return job;
+}
+
+
+/**
+ * Called by a worker thread when it picks up a report
+ *
+ * @param sched  JobScheduler
+ * @param job    The parse job
+ * @param wait   Seconds the report waited in the POSIX MQ queue
+ */
+void sched_job_started(JobScheduler *sched, parseJob_t *job, double wait)
+{
+	SchedLaneStats *ls = &sched->lanes[job->lane < SCHED_LANES ? job->lane : SCHED_LANE_NORMAL];
+
+	pthread_mutex_lock(&sched->mtx);
+	ls->started++;
+	ls->wait_sum += wait;
+	if( wait > ls->wait_max ) {
+		ls->wait_max = wait;
+	}
+	pthread_mutex_unlock(&sched->mtx);
+}
+
+
+/**
+ * Writes the scheduler counters to the log.  Must be called from the thread
+ * calling sched_next_job().
+ *
+ * @param sched  JobScheduler
+ */
+void sched_log_stats(JobScheduler *sched)
+{
+	SchedLaneStats lanes[SCHED_LANES];
+	SchedClient *c = NULL;
+	unsigned int i;
+
+	pthread_mutex_lock(&sched->mtx);
+	memcpy(lanes, sched->lanes, sizeof(lanes));
+	pthread_mutex_unlock(&sched->mtx);
+
+	for( i = 0; i < SCHED_LANES; i++ ) {
+		writelog(sched->log, LOG_INFO,
+			 "Scheduler %s lane: %lu dispatched (%llu KB), %lu started, "
+			 "wait average %.3fs, max %.3fs", lane_names[i],
+			 lanes[i].dispatched, lanes[i].bytes / 1024, lanes[i].started,
+			 (lanes[i].started ? lanes[i].wait_sum / lanes[i].started : 0.0),
+			 lanes[i].wait_max);
+	}
+	writelog(sched->log, LOG_INFO, "Scheduler: %i clients tracked", sched->nclients);
+	for( i = 0; i < SCHED_CLIENT_BUCKETS; i++ ) {
+		for( c = sched->clients[i]; c; c = c->next ) {
+			writelog(sched->log, LOG_DEBUG,
+				 "Scheduler client %s: weight %i, %lu dispatched, %.0f KB ahead",
+				 c->clientid, c->weight, c->dispatched,
+				 (c->finish > sched->vtime ? c->finish - sched->vtime : 0.0));
+		}
+	}
+}
+
+
+/**
+ * Releases the scheduler
+ *
+ * @param sched  JobScheduler
+ */
+void sched_free(JobScheduler *sched)
+{
+	SchedClient *c = NULL;
+	unsigned int i;
+
+	if( !sched ) {
+		return;
+	}
+	for( i = 0; i < SCHED_CLIENT_BUCKETS; i++ ) {
+		while( sched->clients[i] ) {
+			c = sched->clients[i];
+			sched->clients[i] = c->next;
+			free_nullsafe(c->clientid);
+			free(c);
+		}
+	}
+	free_nullsafe(sched->cands);
+	eFree_values(sched->weights);
+	pthread_mutex_destroy(&sched->mtx);
+	free(sched);
+}
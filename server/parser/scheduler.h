@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   scheduler.h
+ * @date   Sun Oct 18 22:31:05 2026
+ *
+ * @brief  Decides which queued submission the worker threads get next
+ *
+ */
+
+#ifndef _RTEVAL_SCHEDULER_H
+#define _RTEVAL_SCHEDULER_H
+
+#include <sys/types.h>
+
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <parsethread.h>
+
+#define SCHED_LANE_NORMAL     0    /**< Lane for reports bigger than sched_short_size */
+#define SCHED_LANE_SHORT      1    /**< Lane for small reports, dispatched first */
+#define SCHED_LANES           2    /**< Number of lanes */
+#define SCHED_CLIENT_BUCKETS  256  /**< Hash buckets for the per client state */
+#define SCHED_MAX_CLIENTS     4096 /**< Idle clients are forgotten beyond this */
+
+typedef struct _JobScheduler JobScheduler;
+
+JobScheduler *sched_init(LogContext *log, eurephiaVALUES *cfg);
+parseJob_t *sched_next_job(JobScheduler *sched, dbconn *dbc);
+void sched_invalidate(JobScheduler *sched);
+unsigned int sched_classify(JobScheduler *sched, parseJob_t *job, off_t size);
+unsigned int sched_mq_priority(parseJob_t *job);
+void sched_job_started(JobScheduler *sched, parseJob_t *job, double wait);
+void sched_log_stats(JobScheduler *sched);
+void sched_free(JobScheduler *sched);
+
+#endif
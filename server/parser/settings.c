@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   settings.c
+ * @date   Mon Oct 19 01:58:03 2026
+ *
+ * @brief  Settings used while processing a report, replaceable at run time
+ *
+ * The settings which decide how a report is processed, the compiled XSLT
+ * template, the maximum report size and the measurement tables, are kept
+ * together in a JobSettings snapshot.  When the configuration is reloaded, a
+ * complete new snapshot is prepared first and then published in one step.
+ *
+ * Each worker takes a reference to the current snapshot when it starts on a
+ * report, and releases it when the report is completed.  Reports already being
+ * processed thus complete with the settings they were started with, while new
+ * reports use the new settings.  A replaced snapshot is released when the last
+ * worker using it is done.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libxslt/xsltInternals.h>
+#include <libxslt/transform.h>
+
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <xmlparser.h>
+#include <settings.h>
+
+/**
+ * The published settings
+ */
+struct _SettingsStore {
+	LogContext *log;           /**< Log context */
+	JobSettings *current;      /**< Settings used for new reports */
+	unsigned int generation;   /**< Generation of the current settings */
+	pthread_mutex_t mtx;       /**< Protects current and the reference counters */
+};
+
+
+/**
+ * Releases a settings snapshot which is no longer referenced
+ *
+ * @param js  JobSettings
+ */
+static void settings_destroy(JobSettings *js)
+{
+	if( !js ) {
+		return;
+	}
+	if( js->xslt ) {
+		xsltFreeStylesheet(js->xslt);
+	}
+	if( js->measurement_tbls ) {
+		strFree(js->measurement_tbls);
+	}
+	free_nullsafe(js);
+}
+
+
+/**
+ * Prepares a new settings snapshot from the configuration.  Must be called by a thread
+ * without a memory arena, as the snapshot outlives any report.
+ *
+ * @param log     Log context
+ * @param cfg     Configuration
+ * @param warmup  If set, the stylesheet is prepared for use by worker threads with memory arenas
+ *
+ * @return Returns a JobSettings without any references on success, otherwise NULL
+ */
+JobSettings *settings_load(LogContext *log, eurephiaVALUES *cfg, int warmup)
+{
+	JobSettings *js = NULL;
+	char xsltfile[2050];
+
+	js = malloc_nullsafe(log, sizeof(JobSettings));
+	js->max_report_size = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "max_report_size")),
+					      1024*1024);
+
+	// Parse the measurement_tables config variable, split it up into an array
+	js->measurement_tbls = strSplit(eGet_value(cfg, "measurement_tables"), ", ");
+	if( !js->measurement_tbls ) {
+		writelog(log, LOG_EMERG, "Failed to parse measurement_tables configuration");
+		goto error;
+	}
+
+	// Parse XSLT template
+	snprintf(xsltfile, 2048, "%s/%s", eGet_value(cfg, "xsltpath"), XMLPARSER_XSL);
+	writelog(log, LOG_DEBUG, "Parsing XSLT file: %s", xsltfile);
+	js->xslt = xsltParseStylesheetFile((xmlChar *) xsltfile);
+	if( !js->xslt ) {
+		writelog(log, LOG_EMERG, "Could not parse XSLT template: %s", xsltfile);
+		goto error;
+	}
+
+	// Let libxslt complete the stylesheet before the worker arenas are used
+	if( warmup ) {
+		xmlparser_warmup(log, js->xslt, js->measurement_tbls);
+	}
+	return js;
+
+ error:
+	settings_destroy(js);
+	return NULL;
+}
+
+
+/**
+ * Prepares the settings store
+ *
+ * @param log      Log context
+ * @param initial  Settings used until others are published, from settings_load()
+ *
+ * @return Returns a SettingsStore
+ */
+SettingsStore *settings_init(LogContext *log, JobSettings *initial)
+{
+	SettingsStore *store = NULL;
+
+	store = malloc_nullsafe(log, sizeof(SettingsStore));
+	store->log = log;
+	pthread_mutex_init(&store->mtx, NULL);
+	settings_publish(store, initial);
+	return store;
+}
+
+
+/**
+ * Makes new settings the current settings.  Reports already being processed keep using
+ * the previous settings.
+ *
+ * @param store  SettingsStore
+ * @param js     New settings, from settings_load().  The store takes over the reference.
+ */
+void settings_publish(SettingsStore *store, JobSettings *js)
+{
+	JobSettings *old = NULL;
+
+	pthread_mutex_lock(&store->mtx);
+	old = store->current;
+	js->generation = ++store->generation;
+	js->refcount = 1;
+	store->current = js;
+	pthread_mutex_unlock(&store->mtx);
+
+	writelog(store->log, LOG_DEBUG, "Using settings generation %i", js->generation);
+	settings_release(store, old);
+}
+
+
+/**
+ * Takes a reference to the current settings
+ *
+ * @param store  SettingsStore
+ *
+ * @return Returns the current settings.  Must be released with settings_release().
+ */
+JobSettings *settings_acquire(SettingsStore *store)
+{
+	JobSettings *js = NULL;
+
+	pthread_mutex_lock(&store->mtx);
+	js = store->current;
+	js->refcount++;
+	pthread_mutex_unlock(&store->mtx);
+	return js;
+}
+
+
+/**
+ * Releases a reference to a settings snapshot.  Settings no longer published nor
+ * used by any worker are freed.
+ *
+ * @param store  SettingsStore
+ * @param js     JobSettings, may be NULL
+ */
+void settings_release(SettingsStore *store, JobSettings *js)
+{
+	unsigned int left;
+
+	if( !js ) {
+		return;
+	}
+	pthread_mutex_lock(&store->mtx);
+	left = --js->refcount;
+	pthread_mutex_unlock(&store->mtx);
+
+	if( left == 0 ) {
+		writelog(store->log, LOG_DEBUG, "Releasing settings generation %i", js->generation);
+		settings_destroy(js);
+	}
+}
+
+
+/**
+ * Returns the current maximum report size, for checks done before a report is queued
+ *
+ * @param store  SettingsStore
+ *
+ * @return Returns the max_report_size value of the current settings
+ */
+unsigned int settings_max_report_size(SettingsStore *store)
+{
+	unsigned int size;
+
+	pthread_mutex_lock(&store->mtx);
+	size = store->current->max_report_size;
+	pthread_mutex_unlock(&store->mtx);
+	return size;
+}
+
+
+/**
+ * Releases the settings store and the current settings.  All other references must
+ * be released first.
+ *
+ * @param store  SettingsStore
+ */
+void settings_free(SettingsStore *store)
+{
+	if( !store ) {
+		return;
+	}
+	settings_release(store, store->current);
+	pthread_mutex_destroy(&store->mtx);
+	free_nullsafe(store);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   settings.h
+ * @date   Mon Oct 19 01:58:03 2026
+ *
+ * @brief  Settings used while processing a report, replaceable at run time
+ *
+ */
+
+#ifndef _RTEVAL_SETTINGS_H
+#define _RTEVAL_SETTINGS_H
+
+#include <libxslt/xsltInternals.h>
+
+#include <eurephia_values.h>
+#include <log.h>
+#include <xmlparser.h>
+
+#define XMLPARSER_XSL "xmlparser.xsl" /**< rteval report parser XSLT, parses XML into database friendly data*/
+
+/**
+ * The settings a report is processed with.  A worker takes a reference when it starts
+ * on a report and keeps using the same settings until the report is completed, even if
+ * new settings are published in the mean time.
+ */
+typedef struct _JobSettings {
+	unsigned int generation;       /**< Increased each time new settings are published */
+	xsltStylesheet *xslt;          /**< Compiled xmlparser.xsl */
+	unsigned int max_report_size;  /**< Maximum accepted file size of reports (config: max_report_size) */
+	array_str_t *measurement_tbls; /**< Measurement tables to process (config: measurement_tables) */
+	unsigned int refcount;         /**< References held, protected by the SettingsStore mutex */
+} JobSettings;
+
+typedef struct _SettingsStore SettingsStore;
+
+JobSettings *settings_load(LogContext *log, eurephiaVALUES *cfg, int warmup);
+SettingsStore *settings_init(LogContext *log, JobSettings *initial);
+void settings_publish(SettingsStore *store, JobSettings *js);
+JobSettings *settings_acquire(SettingsStore *store);
+void settings_release(SettingsStore *store, JobSettings *js);
+unsigned int settings_max_report_size(SettingsStore *store);
+void settings_free(SettingsStore *store);
+
+#endif
@@ -0,0 +1,573 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   shard.c
+ * @date   Mon Oct 19 02:37:15 2026
+ *
+ * @brief  Spreads the report data over several databases
+ *
+ * When db_shards is set, the systems, rteval runs and measurement data are
+ * stored in the listed shard databases instead of the main database.  The main
+ * database keeps the submission queue, the submission statistics and the rterid
+ * sequence, so the rterid values stay unique over all shards.
+ *
+ * Each report is routed by its shard key, either the system ID (sysid) or the
+ * client ID (clientid).  All reports with the same key are stored on the same
+ * shard, so the snapshots of an rteval run and the records of a system are kept
+ * together.  The shard is picked by rendezvous hashing: each shard scores the
+ * key, and the shard with the highest score wins.  Adding a shard thus only
+ * moves the keys the new shard wins, the others stay where they are.
+ *
+ * Each shard has its own connection pool, with the same settings as the main
+ * connection pool.  Without db_shards, all reports are stored in the main
+ * database as before.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <dbpool.h>
+#include <xmlparser.h>
+#include <memarena.h>
+#include <parsestats.h>
+#include <statuses.h>
+#include <shard.h>
+
+/**
+ * Keys reports can be routed by
+ */
+typedef enum { skSYSID, skCLIENTID } ShardKey;
+
+/**
+ * One shard database
+ */
+typedef struct {
+	char *name;                /**< The db_shards entry of this shard, used in the log */
+	eurephiaVALUES *cfg;       /**< Connection settings of this shard */
+	DbPool *pool;              /**< Connections used by the worker threads */
+	dbconn *admin;             /**< Connection used by the start up checks, NULL when closed */
+	uint32_t seed;             /**< Hash of the name, seeding the routing score */
+	unsigned long routed;      /**< Number of reports routed to this shard */
+} Shard;
+
+/**
+ * All shards
+ */
+struct _ShardMap {
+	LogContext *log;           /**< Log context */
+	DbPool *main;              /**< Connection pool of the main database */
+	ShardKey key;              /**< What the reports are routed by (config: shard_key) */
+	unsigned int count;        /**< Number of shards, 0 if the main database is used */
+	Shard *shards;             /**< The shards */
+	pthread_mutex_t mtx;       /**< Protects the routing counters */
+};
+
+
+/**
+ * FNV-1a hash of a string
+ *
+ * @param seed  Initial hash value
+ * @param str   String to hash
+ *
+ * @return Returns the hash value
+ */
+static uint32_t shard_hash(uint32_t seed, const char *str)
+{
+	uint32_t h = seed;
+
+	for( ; *str; str++ ) {
+		h ^= (unsigned char) *str;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+
+/**
+ * Scores a key for a shard.  The FNV-1a hash is mixed with the MurmurHash3 finaliser,
+ * to spread keys which only differ slightly.
+ *
+ * @param shard  Shard
+ * @param key    Shard key of the report
+ *
+ * @return Returns the score of the key on this shard
+ */
+static uint32_t shard_score(Shard *shard, const char *key)
+{
+	uint32_t h = shard_hash(shard->seed, key);
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return h;
+}
+
+
+/**
+ * Prepares the connection settings of a shard.  All settings are copied from the main
+ * configuration, except the server, port and database name.
+ *
+ * @param log    Log context
+ * @param cfg    Main configuration
+ * @param entry  db_shards entry, <host>[:<port>]/<database>
+ *
+ * @return Returns the shard configuration on success, otherwise NULL
+ */
+static eurephiaVALUES *shard_parse_entry(LogContext *log, eurephiaVALUES *cfg, char *entry)
+{
+	eurephiaVALUES *scfg = NULL, *ptr = NULL;
+	char *host = NULL, *port = NULL, *database = NULL;
+
+	host = strdup(entry);
+	if( !host ) {
+		return NULL;
+	}
+	database = strchr(host, '/');
+	if( !database || (database == host) || !*(database + 1) ) {
+		writelog(log, LOG_EMERG,
+			 "Invalid db_shards entry '%s', expected <host>[:<port>]/<database>", entry);
+		free_nullsafe(host);
+		return NULL;
+	}
+	*database++ = '\0';
+	if( (port = strchr(host, ':')) != NULL ) {
+		*port++ = '\0';
+		if( atoi_nullsafe(port) < 1 ) {
+			writelog(log, LOG_EMERG, "Invalid port in the db_shards entry '%s'", entry);
+			free_nullsafe(host);
+			return NULL;
+		}
+	}
+
+	scfg = eCreate_value_space(log, 20);
+	for( ptr = cfg; ptr; ptr = ptr->next ) {
+		if( !ptr->key || (strcmp(ptr->key, "db_server") == 0)
+		    || (strcmp(ptr->key, "db_port") == 0) || (strcmp(ptr->key, "database") == 0) ) {
+			continue;
+		}
+		eAdd_value(scfg, ptr->key, ptr->val);
+	}
+	eAdd_value(scfg, "db_server", host);
+	if( port || eGet_value(cfg, "db_port") ) {
+		eAdd_value(scfg, "db_port", (port ? port : eGet_value(cfg, "db_port")));
+	}
+	eAdd_value(scfg, "database", database);
+	free_nullsafe(host);
+	return scfg;
+}
+
+
+/**
+ * Opens the start up connection of a shard, if not already open
+ *
+ * @param map  ShardMap
+ * @param idx  Index of the shard
+ *
+ * @return Returns the database connection, or NULL if the shard is not available
+ */
+static dbconn *shard_admin(ShardMap *map, unsigned int idx)
+{
+	Shard *shard = &map->shards[idx];
+
+	if( !shard->admin ) {
+		shard->admin = db_connect(shard->cfg, (idx + 1) * SHARD_CONN_ID_BASE, map->log);
+		if( !shard->admin ) {
+			writelog(map->log, LOG_EMERG, "Could not connect to shard %s", shard->name);
+		}
+	}
+	return shard->admin;
+}
+
+
+/**
+ * Closes the start up connections of all shards
+ *
+ * @param map  ShardMap
+ */
+static void shard_close_admin(ShardMap *map)
+{
+	unsigned int i;
+
+	for( i = 0; i < map->count; i++ ) {
+		db_disconnect(map->shards[i].admin);
+		map->shards[i].admin = NULL;
+	}
+}
+
+
+/**
+ * Prepares the shards from the configuration.  No connections are opened yet.
+ *
+ * @param log   Log context
+ * @param cfg   Configuration
+ * @param main  Connection pool of the main database
+ *
+ * @return Returns a ShardMap on success, otherwise NULL
+ */
+ShardMap *shard_init(LogContext *log, eurephiaVALUES *cfg, DbPool *main)
+{
+	ShardMap *map = NULL;
+	array_str_t *entries = NULL;
+	const char *shards = NULL, *key = NULL;
+	unsigned int i;
+
+	map = malloc_nullsafe(log, sizeof(ShardMap));
+	map->log = log;
+	map->main = main;
+	pthread_mutex_init(&map->mtx, NULL);
+
+	key = eGet_value(cfg, "shard_key");
+	if( !key || !*key || (strcmp(key, "sysid") == 0) ) {
+		map->key = skSYSID;
+	} else if( strcmp(key, "clientid") == 0 ) {
+		map->key = skCLIENTID;
+	} else {
+		writelog(log, LOG_EMERG, "Invalid shard_key value '%s', expected sysid or clientid", key);
+		goto error;
+	}
+
+	shards = eGet_value(cfg, "db_shards");
+	if( !shards || !*shards ) {
+		return map;
+	}
+	entries = strSplit(shards, ", ");
+	if( !entries ) {
+		writelog(log, LOG_EMERG, "Failed to parse db_shards configuration");
+		goto error;
+	}
+	map->shards = malloc_nullsafe(log, strSize(entries) * sizeof(Shard));
+	for( i = 0; i < strSize(entries); i++ ) {
+		char *entry = strGet(entries, i);
+		Shard *shard = &map->shards[map->count];
+
+		if( !entry || !*entry ) {
+			continue;
+		}
+		shard->name = strdup(entry);
+		shard->seed = shard_hash(2166136261U, entry);
+		shard->cfg = shard_parse_entry(log, cfg, entry);
+		map->count++;
+		if( !shard->cfg ) {
+			goto error;
+		}
+		shard->pool = dbpool_init(log, shard->cfg, NULL,
+					  (map->count * SHARD_CONN_ID_BASE) + 1);
+		if( !shard->pool ) {
+			goto error;
+		}
+	}
+	strFree(entries);
+	entries = NULL;
+
+	if( map->count > 0 ) {
+		writelog(log, LOG_INFO, "Storing the reports on %i shards by %s", map->count,
+			 (map->key == skSYSID ? "sysid" : "clientid"));
+	}
+	return map;
+
+ error:
+	if( entries ) {
+		strFree(entries);
+	}
+	shard_free(map);
+	return NULL;
+}
+
+
+/**
+ * Finds the database where a report is to be stored
+ *
+ * @param map      ShardMap
+ * @param job      The report being processed
+ * @param xslt     A pointer to a parsed 'xmlparser.xsl' XSLT template
+ * @param repxml   The XML report
+ * @param stats    If set, the time spent transforming the report is accounted here
+ * @param sysinfo  If set, returns the 'systems' table data of the report when it was needed
+ *                 to find the shard, otherwise NULL.  It is to be passed on to
+ *                 db_register_system() and freed by the caller.
+ *
+ * @return Returns the connection pool of the database, or NULL if the shard key of the
+ *         report could not be found
+ */
+DbPool *shard_route(ShardMap *map, parseJob_t *job, xsltStylesheet *xslt, xmlDoc *repxml,
+		    parseStats_t *stats, xmlDoc **sysinfo)
+{
+	xmlDoc *sysinfo_d = NULL;
+	char *sysid = NULL;
+	const char *key = NULL;
+	unsigned int i, best = 0;
+	uint32_t score, top = 0;
+
+	if( sysinfo ) {
+		*sysinfo = NULL;
+	}
+	if( map->count == 0 ) {
+		return map->main;
+	}
+
+	if( map->key == skSYSID ) {
+		parseParams prms;
+		struct timespec tstart;
+
+		memset(&prms, 0, sizeof(parseParams));
+		prms.table = "systems";
+		parsestats_timer_start(&tstart);
+		sysinfo_d = parseToSQLdata(map->log, xslt, repxml, &prms);
+		if( stats ) {
+			stats->transform_time += parsestats_elapsed(&tstart);
+		}
+		sysid = (sysinfo_d ? sqldataGetValue(map->log, sysinfo_d, "sysid", 0) : NULL);
+		key = sysid;
+	} else {
+		key = job->clientid;
+	}
+	if( !key || !*key ) {
+		writelog(map->log, LOG_ERR, "(submid: %i) Could not find the shard key of the report",
+			 job->submid);
+		goto exit;
+	}
+
+	for( i = 0; i < map->count; i++ ) {
+		score = shard_score(&map->shards[i], key);
+		if( (i == 0) || (score > top) ) {
+			top = score;
+			best = i;
+		}
+	}
+	pthread_mutex_lock(&map->mtx);
+	map->shards[best].routed++;
+	pthread_mutex_unlock(&map->mtx);
+	writelog(map->log, LOG_DEBUG, "(submid: %i) Storing the report on shard %s",
+		 job->submid, map->shards[best].name);
+
+ exit:
+	free_arena(sysid);
+	if( sysinfo && key && *key ) {
+		*sysinfo = sysinfo_d;
+	} else if( sysinfo_d ) {
+		xmlFreeDoc(sysinfo_d);
+	}
+	return ((key && *key) ? map->shards[best].pool : NULL);
+}
+
+
+/**
+ * Retrieves a new rterid value.  With shards, the value comes from the main database,
+ * so it is unique over all shards.
+ *
+ * @param map       ShardMap
+ * @param dbc       Database connection the report is stored with
+ * @param shutdown  Pointer to the global shutdown flag
+ *
+ * @return Returns a value > 0 on success, otherwise -1
+ */
+int shard_new_rterid(ShardMap *map, dbconn *dbc, const int *shutdown)
+{
+	dbconn *maindbc = NULL;
+	int rterid = -1;
+
+	if( map->count == 0 ) {
+		return db_get_new_rterid(dbc);
+	}
+	if( (maindbc = dbpool_get(map->main, shutdown)) != NULL ) {
+		rterid = db_get_new_rterid(maindbc);
+		dbpool_put(map->main, maindbc);
+	}
+	return rterid;
+}
+
+
+/**
+ * Finds the client ID which submitted an rteval run, for routing its archived reports again.
+ * The archive directory names are made from the client IDs, but cannot always be turned
+ * back into them.  Only needed when the reports are routed by clientid, otherwise the job
+ * is left as it is.
+ *
+ * @param map     ShardMap
+ * @param job     The clientid and submid members are set to the submission of the rteval run
+ * @param rterid  rteval run ID
+ * @param stop    Waiting for a database connection is aborted when this is set
+ *
+ * @return Returns 1 on success, 0 if the rteval run is not registered.  On errors -1 is returned.
+ */
+int shard_run_client(ShardMap *map, parseJob_t *job, int rterid, const int *stop)
+{
+	dbconn *dbc = NULL;
+	unsigned int i;
+	int submid = 0, ret = -1;
+
+	if( (map->count == 0) || (map->key != skCLIENTID) ) {
+		return 1;
+	}
+
+	// rterids are unique over all shards, only one of them has the rteval run
+	for( i = 0; (submid == 0) && (i < map->count); i++ ) {
+		if( (dbc = dbpool_get(map->shards[i].pool, stop)) == NULL ) {
+			return -1;
+		}
+		submid = db_rtevalrun_submid(dbc, rterid);
+		dbpool_put(map->shards[i].pool, dbc);
+	}
+	if( submid < 1 ) {
+		return submid;
+	}
+
+	// The submission queue is only kept in the main database
+	if( (dbc = dbpool_get(map->main, stop)) == NULL ) {
+		return -1;
+	}
+	ret = db_get_submission_clientid(dbc, submid, job->clientid, sizeof(job->clientid));
+	dbpool_put(map->main, dbc);
+	if( ret == 0 ) {
+		writelog(map->log, LOG_ERR,
+			 "(submid: %i) The submission of rterid %i is not in the submission queue",
+			 submid, rterid);
+		return -1;
+	}
+	job->submid = submid;
+	return ret;
+}
+
+
+/**
+ * Checks if a report is registered, in the main database or on any of the shards.
+ * Only used while starting up.
+ *
+ * @param map     ShardMap
+ * @param dbc     Database connection to the main database
+ * @param submid  Submission ID of the report
+ *
+ * @return Returns 1 if the report is registered, 0 if not found.  On errors -1 is returned.
+ */
+int shard_report_registered(ShardMap *map, dbconn *dbc, unsigned int submid)
+{
+	unsigned int i;
+	int ret = 0;
+
+	if( map->count == 0 ) {
+		return db_report_registered(dbc, submid);
+	}
+	for( i = 0; (ret == 0) && (i < map->count); i++ ) {
+		dbconn *sdbc = shard_admin(map, i);
+
+		ret = (sdbc ? db_report_registered(sdbc, submid) : -1);
+	}
+	return ret;
+}
+
+
+/**
+ * Marks the interrupted submissions already registered on a shard as successful.  Must
+ * be called before retry_recover(), which only sees the main database.  This is the last
+ * of the start up checks, the connections used by them are closed afterwards.
+ *
+ * @param map  ShardMap
+ * @param dbc  Database connection to the main database
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+int shard_recover(ShardMap *map, dbconn *dbc)
+{
+	unsigned int *submids = NULL, *s = NULL, completed = 0;
+	int ret = 1;
+
+	if( map->count == 0 ) {
+		return 1;
+	}
+	if( (submids = db_get_interrupted_submissions(dbc)) == NULL ) {
+		ret = -1;
+		goto exit;
+	}
+	for( s = submids; *s; s++ ) {
+		int found = shard_report_registered(map, dbc, *s);
+
+		if( found < 0 ) {
+			ret = -1;
+			break;
+		} else if( found == 1 ) {
+			if( db_update_submissionqueue(dbc, *s, STAT_SUCCESS) < 1 ) {
+				ret = -1;
+				break;
+			}
+			completed++;
+		}
+	}
+	if( completed > 0 ) {
+		writelog(map->log, LOG_WARNING,
+			 "Found %i interrupted submissions already registered on the shards",
+			 completed);
+	}
+ exit:
+	free_nullsafe(submids);
+	shard_close_admin(map);
+	return ret;
+}
+
+
+/**
+ * Writes the shard counters and connection pools to the log
+ *
+ * @param map  ShardMap
+ */
+void shard_log_stats(ShardMap *map)
+{
+	unsigned int i;
+	unsigned long routed;
+
+	if( !map ) {
+		return;
+	}
+	for( i = 0; i < map->count; i++ ) {
+		pthread_mutex_lock(&map->mtx);
+		routed = map->shards[i].routed;
+		pthread_mutex_unlock(&map->mtx);
+		writelog(map->log, LOG_INFO, "Shard %s: %lu reports stored", map->shards[i].name, routed);
+		dbpool_log_stats(map->shards[i].pool);
+	}
+}
+
+
+/**
+ * Closes all shard connections and releases the shards.  The worker threads must be
+ * stopped first.
+ *
+ * @param map  ShardMap
+ */
+void shard_free(ShardMap *map)
+{
+	unsigned int i;
+
+	if( !map ) {
+		return;
+	}
+	shard_close_admin(map);
+	for( i = 0; i < map->count; i++ ) {
+		dbpool_free(map->shards[i].pool);
+		eFree_values(map->shards[i].cfg);
+		free_nullsafe(map->shards[i].name);
+	}
+	free_nullsafe(map->shards);
+	pthread_mutex_destroy(&map->mtx);
+	free_nullsafe(map);
+}
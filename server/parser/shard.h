@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   shard.h
+ * @date   Mon Oct 19 02:37:15 2026
+ *
+ * @brief  Spreads the report data over several databases
+ *
+ */
+
+#ifndef _RTEVAL_SHARD_H
+#define _RTEVAL_SHARD_H
+
+#include <libxml/tree.h>
+#include <libxslt/xsltInternals.h>
+
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <dbpool.h>
+#include <parsethread.h>
+#include <parsestats.h>
+
+#define SHARD_CONN_ID_BASE 100   /**< Connection IDs of shard n start on n * SHARD_CONN_ID_BASE */
+
+typedef struct _ShardMap ShardMap;
+
+ShardMap *shard_init(LogContext *log, eurephiaVALUES *cfg, DbPool *main);
+DbPool *shard_route(ShardMap *map, parseJob_t *job, xsltStylesheet *xslt, xmlDoc *repxml,
+		    parseStats_t *stats, xmlDoc **sysinfo);
+int shard_new_rterid(ShardMap *map, dbconn *dbc, const int *shutdown);
+int shard_run_client(ShardMap *map, parseJob_t *job, int rterid, const int *stop);
+int shard_report_registered(ShardMap *map, dbconn *dbc, unsigned int submid);
+int shard_recover(ShardMap *map, dbconn *dbc);
+void shard_log_stats(ShardMap *map);
+void shard_free(ShardMap *map);
+
+#endif
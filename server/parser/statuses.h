@@ -36,5 +36,7 @@
 #define STAT_MEASURE   10        /**< Registering measurement results failed */
 #define STAT_REPMOVE   11        /**< Failed to move the report file */
 #define STAT_FTOOBIG   12        /**< Report is too big (see config parameter: max_report_size) */
+#define STAT_DUPLICATE 13        /**< Snapshot report is already registered, the report is ignored */
+#define STAT_ABORTED   14        /**< Processing aborted, the report exceeded the processing limits */
 
 #endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   test_memarena.c
+ * @date   Wed Oct 21 09:37:15 2026
+ *
+ * @brief  Tests of the worker memory arenas, run by 'make check'
+ *
+ * The arena code is included directly, so the tests can look at the chunks.
+ *
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include <libxml/parser.h>
+#include <libxml/xmlstring.h>
+
+#include "memarena.c"
+
+static const char test_doc[] = "<rteval><run_info days=\"1\"/><annotate>test</annotate></rteval>";
+
+
+/**
+ * libxml2 only allocates from the arena between memarena_begin() and memarena_end(),
+ * while the *_arena() functions always use it.
+ */
+static void test_scope(MemArena *arena)
+{
+	char *heap = NULL, *scoped = NULL, *own = NULL;
+
+	memarena_activate(arena);
+	heap = (char *) xmlStrdup((const xmlChar *) "heap");
+	own = strdup_arena("own");
+
+	memarena_begin();
+	scoped = (char *) xmlStrdup((const xmlChar *) "scoped");
+	memarena_end();
+
+	assert( MEM_HEADER(heap)->chunk == NULL );
+	assert( (MEM_HEADER(scoped)->chunk != NULL) && (MEM_HEADER(scoped)->chunk->arena == arena) );
+	assert( (MEM_HEADER(own)->chunk != NULL) && (MEM_HEADER(own)->chunk->arena == arena) );
+
+	xmlFree(heap);
+	xmlFree(scoped);
+	free_arena(own);
+	memarena_reset(arena);
+	assert( (arena->chunks == NULL) && (arena->pinned == NULL) );
+	memarena_activate(NULL);
+}
+
+
+/**
+ * A document parsed and freed within the job leaves nothing behind after a reset
+ */
+static void test_parse(MemArena *arena)
+{
+	xmlDoc *doc = NULL;
+
+	memarena_activate(arena);
+	memarena_begin();
+	doc = xmlReadMemory(test_doc, sizeof(test_doc) - 1, "test.xml", NULL, XML_PARSE_NONET);
+	memarena_end();
+	assert( doc != NULL );
+	assert( arena->inuse > 0 );
+	xmlFreeDoc(doc);
+
+	memarena_reset(arena);
+	assert( (arena->chunks == NULL) && (arena->pinned == NULL) );
+	memarena_activate(NULL);
+}
+
+
+/**
+ * Memory still referenced at reset stays mapped and is not handed out again.  The chunk
+ * is unmapped by the first reset after the memory is freed.
+ */
+static void test_pinned(MemArena *arena)
+{
+	char *kept = NULL, *next = NULL;
+	MemChunk *c = NULL;
+
+	memarena_activate(arena);
+	memarena_begin();
+	kept = (char *) xmlStrdup((const xmlChar *) "outlives the job");
+	memarena_end();
+	c = MEM_HEADER(kept)->chunk;
+
+	memarena_reset(arena);
+	assert( (arena->pinned == c) && c->pinned && (c->live == 1) );
+	assert( arena->chunks == NULL );
+
+	next = strdup_arena("next job");
+	assert( MEM_HEADER(next)->chunk != c );
+	assert( strcmp(kept, "outlives the job") == 0 );
+	free_arena(next);
+
+	xmlFree(kept);
+	assert( c->live == 0 );
+	memarena_reset(arena);
+	assert( arena->pinned == NULL );
+	memarena_activate(NULL);
+}
+
+
+int main(int argc, char **argv)
+{
+	LogContext *log = NULL;
+	MemArena *arena = NULL;
+
+	log = init_log("stderr:", "emerg", 0);
+	assert( memarena_setup(log) == 1 );
+	xmlInitParser();
+
+	arena = memarena_new(65536, 65536);
+	assert( arena != NULL );
+
+	test_scope(arena);
+	test_parse(arena);
+	test_pinned(arena);
+	printf("test_memarena: all tests passed\n");
+
+	memarena_destroy(arena);
+	xmlCleanupParser();
+	close_log(log);
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   test_scheduler.c
+ * @date   Tue Oct 20 10:12:44 2026
+ *
+ * @brief  Tests of the job scheduler, run by 'make check'
+ *
+ * The scheduler is included directly, so the tests can look at the client table.
+ * The submission queue is replaced by the test_queue array.
+ *
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "scheduler.c"
+
+static parseJob_t *test_queue = NULL;  /**< Waiting submissions returned to the scheduler */
+static unsigned int test_count = 0;    /**< Number of submissions in test_queue */
+
+
+/**
+ * Replaces the submission queue query, returns a copy of test_queue
+ */
+parseJob_t *db_get_submissionqueue_candidates(dbconn *dbc, unsigned int window,
+					      unsigned int max, unsigned int *count)
+{
+	parseJob_t *jobs = NULL;
+
+	*count = (test_count < max ? test_count : max);
+	jobs = malloc_nullsafe(dbc->log, (*count + 1) * sizeof(parseJob_t));
+	memcpy(jobs, test_queue, *count * sizeof(parseJob_t));
+	return jobs;
+}
+
+
+/**
+ * Replaces the submission queue update, always succeeds
+ */
+int db_update_submissionqueue(dbconn *dbc, unsigned int submid, int status)
+{
+	return 1;
+}
+
+
+/**
+ * Puts submissions from the given clients into test_queue, one per client
+ *
+ * @param prefix  Client ID prefix
+ * @param first   Number of the first client
+ * @param count   Number of clients
+ */
+static void test_fill_queue(const char *prefix, unsigned int first, unsigned int count)
+{
+	unsigned int i;
+
+	free_nullsafe(test_queue);
+	test_queue = calloc(count, sizeof(parseJob_t));
+	for( i = 0; i < count; i++ ) {
+		test_queue[i].status = jbAVAIL;
+		test_queue[i].submid = first + i + 1;
+		test_queue[i].size = 1024;
+		snprintf(test_queue[i].clientid, 255, "%s-%u", prefix, first + i);
+		snprintf(test_queue[i].filename, 4095, "/queue/%s-%u.xml", prefix, first + i);
+	}
+	test_count = count;
+}
+
+
+/**
+ * Fills the client table to SCHED_MAX_CLIENTS, and picks a job from a batch with
+ * a known idle client followed by several new clients.  The clients of the batch must
+ * survive the purge of the client table, and the picked client is updated.
+ */
+static void test_purge_during_pick(LogContext *log, eurephiaVALUES *cfg)
+{
+	JobScheduler *sched = NULL;
+	SchedClient *c = NULL;
+	parseJob_t *job = NULL;
+	dbconn dbc;
+
+	memset(&dbc, 0, sizeof(dbconn));
+	dbc.log = log;
+	sched = sched_init(log, cfg);
+	assert( sched != NULL );
+
+	// Every client of the first batch gets a client state
+	test_fill_queue("client", 0, SCHED_MAX_CLIENTS);
+	job = sched_next_job(sched, &dbc);
+	assert( (job != NULL) && (job->status == jbAVAIL) );
+	assert( strcmp(job->clientid, "client-0") == 0 );
+	assert( sched->nclients == SCHED_MAX_CLIENTS );
+	free(job);
+
+	// client-1 is idle and first in the batch, the new clients come after it
+	test_fill_queue("new", 0, 4);
+	snprintf(test_queue[0].clientid, 255, "client-1");
+	sched_invalidate(sched);
+	job = sched_next_job(sched, &dbc);
+	assert( (job != NULL) && (job->status == jbAVAIL) );
+	assert( strcmp(job->clientid, "client-1") == 0 );
+	free(job);
+
+	c = sched_find_client(sched, "client-1");
+	assert( (c != NULL) && (c->dispatched == 1) && (c->finish > sched->vtime) );
+	assert( sched_find_client(sched, "new-1") != NULL );
+	assert( sched_find_client(sched, "client-2") == NULL );
+	// client-0 is ahead of the virtual time, client-1 and the new clients are kept
+	assert( sched->nclients == 5 );
+
+	// The remaining candidates are picked from the same batch
+	job = sched_next_job(sched, &dbc);
+	assert( (job != NULL) && (strncmp(job->clientid, "new-", 4) == 0) );
+	free(job);
+
+	sched_free(sched);
+}
+
+
+int main(int argc, char **argv)
+{
+	LogContext *log = NULL;
+	eurephiaVALUES *cfg = NULL;
+
+	log = init_log("stderr:", "warning", 0);
+	cfg = eCreate_value_space(log, 0);
+	eAdd_value(cfg, "sched_max_candidates", "8192");
+	eAdd_value(cfg, "sched_client_window", "4");
+
+	test_purge_during_pick(log, cfg);
+	printf("test_scheduler: all tests passed\n");
+
+	free_nullsafe(test_queue);
+	eFree_values(cfg);
+	close_log(log);
+	return 0;
+}
@@ -24,22 +24,46 @@
 #define _THREADINFO_H
 
 #include <mqueue.h>
+#include <libxml/dict.h>
 #include <libxslt/transform.h>
+#include <memarena.h>
+#include <archive.h>
+
+struct _WorkerPool;
+struct _JobScheduler;
+struct _DbPool;
+struct _RetryPolicy;
+struct _JobWatchdog;
+struct _JobGuard;
+struct _AffinityMap;
+struct _SettingsStore;
+struct _JobSettings;
+struct _ShardMap;
 
 /**
  *  Thread slot information.  Each thread slot is assigned with one threadData_t element.
  */
 typedef struct {
         int *shutdown;                /**< If set to 1, the thread should shut down */
-        int *threadcount;             /**< Number of active worker threads */
-        pthread_mutex_t *mtx_thrcnt;  /**< Mutex lock for updating active worker threads */
+        struct _WorkerPool *pool;     /**< The worker pool this thread belongs to */
+        struct _JobScheduler *sched;  /**< Job scheduler, collecting the queue wait statistics */
+        struct _RetryPolicy *retry;   /**< Retry policy for failed submissions */
+        struct _JobWatchdog *watchdog; /**< Watchdog enforcing the processing limits */
+        struct _JobGuard *guard;      /**< Watchdog state of this thread */
+        struct _AffinityMap *affinity; /**< CPU placement of the worker threads */
+        unsigned int idle_timeout;    /**< Seconds idle before the thread may retire (config: thread_idle_timeout) */
         mqd_t msgq;                   /**< POSIX MQ descriptor */
         pthread_mutex_t *mtx_sysreg;  /**< Mutex locking, to avoid clashes with registering systems */
         unsigned int id;              /**< Numeric ID for this thread */
-        dbconn *dbc;                  /**< Database connection assigned to this thread */
-        xsltStylesheet *xslt;         /**< XSLT stylesheet assigned to this thread */
-        const char *destdir;          /**< Directory where to put the parsed reports */
-        unsigned int max_report_size; /**< Maximum accepted file size of reports (config: max_report_size) */
+        LogContext *log;              /**< Log context */
+        struct _DbPool *dbpool;       /**< Database connections shared by all worker threads */
+        dbconn *dbc;                  /**< Database connection checked out from dbpool, NULL when none */
+        struct _ShardMap *shards;     /**< Shard databases where the reports are stored */
+        struct _SettingsStore *settings_store; /**< Published settings, replaced when the configuration is reloaded */
+        struct _JobSettings *settings; /**< Settings of the report being processed, NULL when idle */
+        ReportArchive *archive;       /**< Report archive, moving the parsed reports into the report directory */
+        MemArena *arena;              /**< Memory arena used while processing a report, may be NULL */
+        xmlDict *xmldict;             /**< XML name dictionary, shared by all reports parsed by this thread */
 } threadData_t;
 
 #endif
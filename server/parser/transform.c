@@ -0,0 +1,756 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   transform.c
+ * @date   Mon Oct 19 03:46:52 2026
+ *
+ * @brief  Transforms reports into COPY load files, without a database
+ *
+ * The transform-only mode runs the measurement tables of a set of reports
+ * through the same XSLT transformation as when they are registered, but
+ * writes the records to one load file per table instead of connecting to
+ * the database.  The load files use the COPY text format, and are written
+ * to <table>.copy in the output directory, together with a manifest listing
+ * the columns and record count of each file and the rterid each report got.
+ * This is used for offline bulk loads, where the files are loaded later with
+ * COPY ... FROM, and for measuring the throughput of the transformation.
+ *
+ * The rterid of an archived report-<rterid>[-<snapshot>].xml file is taken
+ * from the file name.  Other reports are numbered after the highest rterid
+ * found.  Only the latest snapshot of an rteval run provides the
+ * cyclic_statistics records, the histogram buckets of each snapshot are
+ * written as they are, and must be summed up after loading.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <xmlparser.h>
+#include <settings.h>
+#include <parsestats.h>
+#include <reportfile.h>
+#include <reingest.h>
+#include <transform.h>
+
+/**
+ * What happened to a report
+ */
+typedef enum { tfPENDING, tfDONE, tfFAILED } TransformStatus;
+
+/**
+ * One report to transform
+ */
+typedef struct {
+	char *fname;               /**< Path of the report file */
+	int rterid;                /**< rteval run ID the records are written with */
+	unsigned int seq;          /**< Snapshot sequence number, 0 if not a snapshot */
+	int latest;                /**< Set if this is the latest report of the rteval run */
+	TransformStatus status;    /**< What happened to the report */
+} TransformFile;
+
+/**
+ * A load file
+ */
+typedef struct {
+	const char *name;          /**< Table name */
+	char *fname;               /**< Path of the load file */
+	FILE *fp;                  /**< The opened load file */
+	char *columns;             /**< Columns of the records, set by the first report with records */
+	unsigned int schemaver;    /**< Highest SQL schema version needed by the records */
+	unsigned long rows;        /**< Records written */
+	pthread_mutex_t mtx;       /**< Protects everything but name and fname */
+} TransformTable;
+
+/**
+ * Counters and timers, collected per report and summed up for the whole job
+ */
+typedef struct {
+	unsigned long reports;     /**< Reports transformed */
+	unsigned long rows;        /**< Records written */
+	unsigned long long bytes;  /**< Bytes read from the report files */
+	unsigned long long written; /**< Bytes written to the load files */
+	double transform_time;     /**< Seconds spent in the XSLT transformation */
+	double encode_time;        /**< Seconds spent encoding the records */
+	double write_time;         /**< Seconds spent writing the load files */
+} TransformCounters;
+
+/**
+ * The transform job
+ */
+typedef struct {
+	LogContext *log;           /**< Log context */
+	JobSettings *settings;     /**< Settings, for the XSLT template, size limit and tables */
+	TransformTable *tables;    /**< One load file per measurement table */
+	unsigned int ntables;      /**< Number of measurement tables */
+	TransformFile *files;      /**< All reports, sorted by rterid and snapshot */
+	unsigned int nfiles;       /**< Number of reports */
+	unsigned int allocated;    /**< Allocated size of files */
+	unsigned int next;         /**< Index of the next report to transform */
+	unsigned int failed;       /**< Reports which failed */
+	TransformCounters total;   /**< Counters of all transformed reports */
+	struct timespec started;   /**< When the worker threads were started */
+	unsigned int running;      /**< Number of running worker threads */
+	int stop;                  /**< Set when the transformation is to be stopped */
+	pthread_mutex_t mtx;       /**< Protects the counters, next, stop and the report status */
+} Transform;
+
+/**
+ * A worker thread
+ */
+typedef struct {
+	Transform *tf;             /**< The transform job */
+	unsigned int id;           /**< Worker number, used in the log */
+	pthread_t thread;          /**< The thread */
+} TransformWorker;
+
+
+/**
+ * Adds a report file.  The rterid is taken from archived report file names.
+ *
+ * @param tf     Transform
+ * @param fname  Path of the report file
+ */
+static void transform_add_file(Transform *tf, const char *fname)
+{
+	const char *base = strrchr(fname, '/');
+	int rterid = 0;
+	unsigned int seq = 0;
+
+	if( !reingest_parse_name((base ? base + 1 : fname), &rterid, &seq) ) {
+		rterid = 0;
+		seq = 0;
+	}
+	if( tf->nfiles == tf->allocated ) {
+		tf->allocated = (tf->allocated ? tf->allocated * 2 : 1024);
+		tf->files = realloc(tf->files, tf->allocated * sizeof(TransformFile));
+	}
+	memset(&tf->files[tf->nfiles], 0, sizeof(TransformFile));
+	tf->files[tf->nfiles].fname = strdup(fname);
+	tf->files[tf->nfiles].rterid = rterid;
+	tf->files[tf->nfiles].seq = seq;
+	tf->files[tf->nfiles].status = tfPENDING;
+	tf->nfiles++;
+}
+
+
+/**
+ * Finds all archived report files in a directory and its sub directories
+ *
+ * @param tf    Transform
+ * @param path  Directory to search
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int transform_scan(Transform *tf, const char *path)
+{
+	DIR *dir = NULL;
+	struct dirent *de = NULL;
+	struct stat st;
+	char *fname = NULL;
+	int ret = 1;
+
+	if( (dir = opendir(path)) == NULL ) {
+		writelog(tf->log, LOG_EMERG, "Could not read directory %s: %s", path, strerror(errno));
+		return -1;
+	}
+	while( (ret > 0) && ((de = readdir(dir)) != NULL) ) {
+		int rterid;
+		unsigned int seq;
+
+		if( de->d_name[0] == '.' ) {
+			continue;
+		}
+		fname = malloc_nullsafe(tf->log, strlen(path) + strlen(de->d_name) + 2);
+		sprintf(fname, "%s/%s", path, de->d_name);
+		if( lstat(fname, &st) == 0 ) {
+			if( S_ISDIR(st.st_mode) ) {
+				ret = transform_scan(tf, fname);
+			} else if( S_ISREG(st.st_mode) && reingest_parse_name(de->d_name, &rterid, &seq) ) {
+				transform_add_file(tf, fname);
+			}
+		}
+		free_nullsafe(fname);
+	}
+	closedir(dir);
+	return ret;
+}
+
+
+/**
+ * Adds the reports of an input argument: a report file, a directory with archived
+ * reports, or '-' to read a list of report files and directories from stdin
+ *
+ * @param tf     Transform
+ * @param input  The input argument
+ * @param list   Set when the input is read from the list on stdin
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int transform_add_input(Transform *tf, const char *input, int list)
+{
+	struct stat st;
+
+	if( !list && (strcmp(input, "-") == 0) ) {
+		char line[4096];
+
+		while( fgets(line, sizeof(line), stdin) ) {
+			line[strcspn(line, "\r\n")] = '\0';
+			if( (line[0] != '\0') && (transform_add_input(tf, line, 1) < 0) ) {
+				return -1;
+			}
+		}
+		return 1;
+	}
+
+	if( stat(input, &st) < 0 ) {
+		writelog(tf->log, LOG_EMERG, "Could not find %s: %s", input, strerror(errno));
+		return -1;
+	}
+	if( S_ISDIR(st.st_mode) ) {
+		return transform_scan(tf, input);
+	}
+	transform_add_file(tf, input);
+	return 1;
+}
+
+
+/**
+ * Sort function for the report files, by rterid and then by snapshot
+ */
+static int transform_cmp_files(const void *a, const void *b)
+{
+	const TransformFile *fa = (const TransformFile *) a, *fb = (const TransformFile *) b;
+
+	if( fa->rterid != fb->rterid ) {
+		return (fa->rterid < fb->rterid ? -1 : 1);
+	}
+	return (fa->seq < fb->seq ? -1 : (fa->seq > fb->seq ? 1 : 0));
+}
+
+
+/**
+ * Numbers the reports without an rterid after the highest rterid found, sorts the
+ * reports and marks the latest report of each rteval run
+ *
+ * @param tf  Transform
+ *
+ * @return Returns the number of rteval runs
+ */
+static unsigned int transform_order(Transform *tf)
+{
+	unsigned int i, runs = 0;
+	int maxid = 0;
+
+	for( i = 0; i < tf->nfiles; i++ ) {
+		maxid = (tf->files[i].rterid > maxid ? tf->files[i].rterid : maxid);
+	}
+	for( i = 0; i < tf->nfiles; i++ ) {
+		if( tf->files[i].rterid == 0 ) {
+			tf->files[i].rterid = ++maxid;
+		}
+	}
+	qsort(tf->files, tf->nfiles, sizeof(TransformFile), transform_cmp_files);
+	for( i = 0; i < tf->nfiles; i++ ) {
+		if( (i == 0) || (tf->files[i].rterid != tf->files[i-1].rterid) ) {
+			runs++;
+		}
+		tf->files[i].latest = ((i == (tf->nfiles - 1))
+				       || (tf->files[i+1].rterid != tf->files[i].rterid));
+	}
+	return runs;
+}
+
+
+/**
+ * Creates the output directory and opens one load file per measurement table.  The
+ * table names are used in file names and in the COPY statements of the loader, so
+ * only lower case letters, digits and underscores are accepted.
+ *
+ * @param tf      Transform
+ * @param outdir  Output directory
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int transform_open_tables(Transform *tf, const char *outdir)
+{
+	array_str_t *tbls = tf->settings->measurement_tbls;
+	unsigned int i;
+
+	if( (mkdir(outdir, 0755) < 0) && (errno != EEXIST) ) {
+		writelog(tf->log, LOG_EMERG, "Could not create directory %s: %s", outdir, strerror(errno));
+		return -1;
+	}
+
+	tf->ntables = strSize(tbls);
+	tf->tables = malloc_nullsafe(tf->log, (tf->ntables + 1) * sizeof(TransformTable));
+	for( i = 0; i < tf->ntables; i++ ) {
+		TransformTable *tbl = &tf->tables[i];
+		const char *p = NULL;
+
+		tbl->name = strGet(tbls, i);
+		pthread_mutex_init(&tbl->mtx, NULL);
+		for( p = tbl->name; p && *p; p++ ) {
+			if( !(((*p >= 'a') && (*p <= 'z')) || ((*p >= '0') && (*p <= '9'))
+			      || (*p == '_')) ) {
+				writelog(tf->log, LOG_EMERG, "Invalid table name '%s'", tbl->name);
+				tf->ntables = i + 1;
+				return -1;
+			}
+		}
+
+		tbl->fname = malloc_nullsafe(tf->log, strlen(outdir) + strlen(tbl->name)
+					     + strlen(TRANSFORM_SUFFIX) + 2);
+		sprintf(tbl->fname, "%s/%s%s", outdir, tbl->name, TRANSFORM_SUFFIX);
+		if( (tbl->fp = fopen(tbl->fname, "w")) == NULL ) {
+			writelog(tf->log, LOG_EMERG, "Could not open %s: %s", tbl->fname, strerror(errno));
+			tf->ntables = i + 1;
+			return -1;
+		}
+	}
+	return (tf->ntables > 0 ? 1 : -1);
+}
+
+
+/**
+ * Hands out the next report to a worker thread
+ *
+ * @param tf   Transform
+ * @param idx  Returns the index of the report
+ *
+ * @return Returns 1 if a report is handed out, 0 when all are handed out or on stop
+ */
+static int transform_next(Transform *tf, unsigned int *idx)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&tf->mtx);
+	if( !tf->stop && (tf->next < tf->nfiles) ) {
+		*idx = tf->next++;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&tf->mtx);
+	return ret;
+}
+
+
+/**
+ * Transforms the measurement tables of one report and appends the records to the load
+ * files.  Nothing is written unless all tables are transformed and their columns match
+ * the records already written.
+ *
+ * @param tf     Transform
+ * @param id     Worker number
+ * @param tfile  The report
+ * @param cnt    The counters and timers of the report are added here
+ *
+ * @return Returns 1 on success, otherwise 0
+ */
+static int transform_process(Transform *tf, unsigned int id, TransformFile *tfile,
+			     TransformCounters *cnt)
+{
+	reportFile rf;
+	xmlDoc *repxml = NULL, *sqld = NULL;
+	copyData *cds = NULL;
+	parseParams prms;
+	struct timespec tstart;
+	unsigned int i;
+	int res, ret = 0;
+
+	res = reportfile_open(tf->log, &rf, tfile->fname, tf->settings->max_report_size);
+	if( res == 0 ) {
+		writelog(tf->log, LOG_ERR, "[Worker %i] Report file '%s' is too big", id, tfile->fname);
+		return 0;
+	} else if( res < 0 ) {
+		return 0;
+	}
+	repxml = reportfile_parse(tf->log, &rf, NULL);
+	cnt->bytes += rf.size;
+	reportfile_close(&rf);
+	if( !repxml ) {
+		writelog(tf->log, LOG_ERR, "[Worker %i] Could not parse XML file: %s", id, tfile->fname);
+		return 0;
+	}
+
+	cds = malloc_nullsafe(tf->log, (tf->ntables + 1) * sizeof(copyData));
+	memset(&prms, 0, sizeof(parseParams));
+	prms.rterid = tfile->rterid;
+	for( i = 0; i < tf->ntables; i++ ) {
+		TransformTable *tbl = &tf->tables[i];
+
+		// Only the latest snapshot of an rteval run provides the statistics
+		if( !tfile->latest && (strcmp(tbl->name, "cyclic_statistics") == 0) ) {
+			continue;
+		}
+		prms.table = tbl->name;
+		parsestats_timer_start(&tstart);
+		sqld = parseToSQLdata(tf->log, tf->settings->xslt, repxml, &prms);
+		cnt->transform_time += parsestats_elapsed(&tstart);
+		if( !sqld || !sqld->children ) {
+			if( sqld ) {
+				xmlFreeDoc(sqld);
+			}
+			continue;
+		}
+
+		parsestats_timer_start(&tstart);
+		res = db_encode_copydata(tf->log, sqld, &cds[i]);
+		cnt->encode_time += parsestats_elapsed(&tstart);
+		cds[i].table = tbl->name;  // The name in the sqldata document is released below
+		xmlFreeDoc(sqld);
+		if( res < 0 ) {
+			writelog(tf->log, LOG_ERR, "[Worker %i] Could not transform the %s records of %s",
+				 id, tbl->name, tfile->fname);
+			goto exit;
+		}
+	}
+
+	// The first report with records decides the columns of a load file
+	for( i = 0; i < tf->ntables; i++ ) {
+		TransformTable *tbl = &tf->tables[i];
+
+		if( cds[i].rows == 0 ) {
+			continue;
+		}
+		pthread_mutex_lock(&tbl->mtx);
+		if( !tbl->columns ) {
+			tbl->columns = strdup(cds[i].columns);
+			res = 0;
+		} else {
+			res = strcmp(tbl->columns, cds[i].columns);
+		}
+		pthread_mutex_unlock(&tbl->mtx);
+		if( res != 0 ) {
+			writelog(tf->log, LOG_ERR,
+				 "[Worker %i] The %s columns of %s (%s) differ from the load file (%s)",
+				 id, tbl->name, tfile->fname, cds[i].columns, tbl->columns);
+			goto exit;
+		}
+	}
+
+	parsestats_timer_start(&tstart);
+	for( i = 0; i < tf->ntables; i++ ) {
+		TransformTable *tbl = &tf->tables[i];
+
+		if( cds[i].rows == 0 ) {
+			continue;
+		}
+		pthread_mutex_lock(&tbl->mtx);
+		if( fwrite(cds[i].data, 1, cds[i].len, tbl->fp) != cds[i].len ) {
+			writelog(tf->log, LOG_EMERG, "[Worker %i] Could not write to %s: %s",
+				 id, tbl->fname, strerror(errno));
+			pthread_mutex_unlock(&tbl->mtx);
+
+			// The load files are incomplete, no point in continuing
+			pthread_mutex_lock(&tf->mtx);
+			tf->stop = 1;
+			pthread_mutex_unlock(&tf->mtx);
+			goto exit;
+		}
+		tbl->rows += cds[i].rows;
+		tbl->schemaver = (cds[i].schemaver > tbl->schemaver ? cds[i].schemaver : tbl->schemaver);
+		pthread_mutex_unlock(&tbl->mtx);
+		cnt->rows += cds[i].rows;
+		cnt->written += cds[i].len;
+	}
+	cnt->write_time += parsestats_elapsed(&tstart);
+	cnt->reports++;
+	ret = 1;
+
+ exit:
+	for( i = 0; i < tf->ntables; i++ ) {
+		db_free_copydata(&cds[i]);
+	}
+	free_nullsafe(cds);
+	xmlFreeDoc(repxml);
+	return ret;
+}
+
+
+/**
+ * Worker thread, transforming reports until all are handed out
+ *
+ * @param data  TransformWorker
+ *
+ * @return Returns NULL
+ */
+static void *transform_worker(void *data)
+{
+	TransformWorker *w = (TransformWorker *) data;
+	Transform *tf = w->tf;
+	unsigned int idx;
+
+	while( transform_next(tf, &idx) ) {
+		TransformCounters cnt;
+		int res;
+
+		memset(&cnt, 0, sizeof(TransformCounters));
+		res = transform_process(tf, w->id, &tf->files[idx], &cnt);
+
+		pthread_mutex_lock(&tf->mtx);
+		tf->files[idx].status = (res ? tfDONE : tfFAILED);
+		tf->failed += (res ? 0 : 1);
+		tf->total.reports += cnt.reports;
+		tf->total.rows += cnt.rows;
+		tf->total.bytes += cnt.bytes;
+		tf->total.written += cnt.written;
+		tf->total.transform_time += cnt.transform_time;
+		tf->total.encode_time += cnt.encode_time;
+		tf->total.write_time += cnt.write_time;
+		pthread_mutex_unlock(&tf->mtx);
+	}
+
+	pthread_mutex_lock(&tf->mtx);
+	tf->running--;
+	pthread_mutex_unlock(&tf->mtx);
+	return NULL;
+}
+
+
+/**
+ * Writes the progress and throughput to the log
+ *
+ * @param tf     Transform
+ * @param final  Set when the transformation is completed
+ */
+static void transform_log_progress(Transform *tf, int final)
+{
+	double elapsed = parsestats_elapsed(&tf->started);
+
+	elapsed = (elapsed > 0.001 ? elapsed : 0.001);
+	pthread_mutex_lock(&tf->mtx);
+	writelog(tf->log, (final ? LOG_NOTICE : LOG_INFO),
+		 "Transform%s: %lu of %i reports (%i failed) in %.0f seconds; %.1f reports/s, "
+		 "%.0f records/s, %.1f MB/s read, %.1f MB/s written",
+		 (final ? " completed" : ""), tf->total.reports + tf->failed, tf->nfiles,
+		 tf->failed, elapsed, tf->total.reports / elapsed, tf->total.rows / elapsed,
+		 tf->total.bytes / elapsed / (1024.0 * 1024.0),
+		 tf->total.written / elapsed / (1024.0 * 1024.0));
+	if( final ) {
+		writelog(tf->log, LOG_INFO,
+			 "Worker time: %.2f seconds transforming, %.2f seconds encoding, "
+			 "%.2f seconds writing",
+			 tf->total.transform_time, tf->total.encode_time, tf->total.write_time);
+	}
+	pthread_mutex_unlock(&tf->mtx);
+}
+
+
+/**
+ * Closes the load files and writes the manifest
+ *
+ * @param tf      Transform
+ * @param outdir  Output directory
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int transform_finish(Transform *tf, const char *outdir)
+{
+	static const char *status[] = { "skipped", "ok", "failed" };
+	char *fname = NULL;
+	FILE *fp = NULL;
+	unsigned int i;
+	int ret = 1;
+
+	for( i = 0; i < tf->ntables; i++ ) {
+		if( tf->tables[i].fp && (fclose(tf->tables[i].fp) != 0) ) {
+			writelog(tf->log, LOG_EMERG, "Could not write %s: %s",
+				 tf->tables[i].fname, strerror(errno));
+			ret = -1;
+		}
+		tf->tables[i].fp = NULL;
+	}
+
+	fname = malloc_nullsafe(tf->log, strlen(outdir) + strlen(TRANSFORM_MANIFEST) + 2);
+	sprintf(fname, "%s/%s", outdir, TRANSFORM_MANIFEST);
+	if( (fp = fopen(fname, "w")) == NULL ) {
+		writelog(tf->log, LOG_EMERG, "Could not open %s: %s", fname, strerror(errno));
+		free_nullsafe(fname);
+		return -1;
+	}
+	fprintf(fp, "# table\t<table>\t<load file>\t<records>\t<SQL schema version>\t<columns>\n"
+		"# report\t<rterid>\t<snapshot>\t<status>\t<report file>\n");
+	for( i = 0; i < tf->ntables; i++ ) {
+		TransformTable *tbl = &tf->tables[i];
+
+		fprintf(fp, "table\t%s\t%s%s\t%lu\t%i.%i\t%s\n", tbl->name, tbl->name, TRANSFORM_SUFFIX,
+			tbl->rows, tbl->schemaver / 100, tbl->schemaver % 100,
+			(tbl->columns ? tbl->columns : "-"));
+	}
+	for( i = 0; i < tf->nfiles; i++ ) {
+		TransformFile *tfile = &tf->files[i];
+
+		fprintf(fp, "report\t%i\t%i\t%s\t%s\n", tfile->rterid, tfile->seq,
+			status[tfile->status], tfile->fname);
+	}
+	if( fclose(fp) != 0 ) {
+		writelog(tf->log, LOG_EMERG, "Could not write %s: %s", fname, strerror(errno));
+		ret = -1;
+	}
+	free_nullsafe(fname);
+	return ret;
+}
+
+
+/**
+ * Releases the transform job
+ *
+ * @param tf     Transform
+ * @param store  SettingsStore the settings were acquired from
+ */
+static void transform_free(Transform *tf, SettingsStore *store)
+{
+	unsigned int i;
+
+	for( i = 0; i < tf->nfiles; i++ ) {
+		free_nullsafe(tf->files[i].fname);
+	}
+	free_nullsafe(tf->files);
+	for( i = 0; tf->tables && (i < tf->ntables); i++ ) {
+		if( tf->tables[i].fp ) {
+			fclose(tf->tables[i].fp);
+		}
+		free_nullsafe(tf->tables[i].fname);
+		free_nullsafe(tf->tables[i].columns);
+		pthread_mutex_destroy(&tf->tables[i].mtx);
+	}
+	free_nullsafe(tf->tables);
+	settings_release(store, tf->settings);
+	pthread_mutex_destroy(&tf->mtx);
+	free_nullsafe(tf);
+}
+
+
+/**
+ * Transforms the measurement tables of a set of reports into COPY load files, using
+ * several worker threads, without connecting to the database.  Stops when all reports
+ * are processed, or when SIGINT or SIGTERM is received.
+ *
+ * @param log      Log context
+ * @param cfg      Configuration, the output directory is found in 'transform_only'
+ * @param store    SettingsStore, providing the XSLT template and the measurement tables
+ * @param ninputs  Number of input arguments
+ * @param inputs   Report files, directories with archived reports, or '-' for a list on stdin
+ * @param sigs     Signals blocked by the calling thread
+ *
+ * @return Returns 1 if all reports were transformed, 0 if some failed or the
+ *         transformation was stopped, otherwise -1
+ */
+int transform_reports(LogContext *log, eurephiaVALUES *cfg, SettingsStore *store,
+		      int ninputs, char **inputs, const sigset_t *sigs)
+{
+	Transform *tf = NULL;
+	TransformWorker *workers = NULL;
+	const char *outdir = eGet_value(cfg, "transform_only");
+	unsigned int i, runs, nworkers, started = 0;
+	struct timespec lastlog;
+	int rc, ret = -1;
+
+	tf = malloc_nullsafe(log, sizeof(Transform));
+	tf->log = log;
+	tf->settings = settings_acquire(store);
+	pthread_mutex_init(&tf->mtx, NULL);
+
+	for( i = 0; i < (unsigned int) ninputs; i++ ) {
+		if( transform_add_input(tf, inputs[i], 0) < 0 ) {
+			goto exit;
+		}
+	}
+	if( tf->nfiles == 0 ) {
+		writelog(log, LOG_EMERG, "No reports to transform");
+		goto exit;
+	}
+	runs = transform_order(tf);
+	if( transform_open_tables(tf, outdir) < 0 ) {
+		goto exit;
+	}
+	writelog(log, LOG_INFO, "Transforming %i reports of %i rteval runs into %s, tables: %s",
+		 tf->nfiles, runs, outdir, eGet_value(cfg, "measurement_tables"));
+
+	// The xmlparser needs the PostgreSQL helpers, normally set up when connecting
+	db_init_offline();
+
+	// Start the worker threads
+	nworkers = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "threads")), 4);
+	workers = malloc_nullsafe(log, nworkers * sizeof(TransformWorker));
+	parsestats_timer_start(&tf->started);
+	for( i = 0; i < nworkers; i++ ) {
+		workers[i].tf = tf;
+		workers[i].id = i + 1;
+		pthread_mutex_lock(&tf->mtx);
+		tf->running++;
+		pthread_mutex_unlock(&tf->mtx);
+		if( (rc = pthread_create(&workers[i].thread, NULL, transform_worker, &workers[i])) != 0 ) {
+			writelog(log, LOG_CRIT, "Could not start worker thread %i: %s", i + 1, strerror(rc));
+			pthread_mutex_lock(&tf->mtx);
+			tf->running--;
+			pthread_mutex_unlock(&tf->mtx);
+			break;
+		}
+		started++;
+	}
+	if( started == 0 ) {
+		goto exit;
+	}
+
+	// Report the progress until all worker threads are done
+	parsestats_timer_start(&lastlog);
+	while( 1 ) {
+		struct timespec wait = { 1, 0 };
+		unsigned int running;
+		int sig = sigtimedwait(sigs, NULL, &wait);
+
+		if( ((sig == SIGINT) || (sig == SIGTERM)) && !tf->stop ) {
+			writelog(log, LOG_WARNING, "Stopping, the load files will be incomplete");
+			pthread_mutex_lock(&tf->mtx);
+			tf->stop = 1;
+			pthread_mutex_unlock(&tf->mtx);
+		}
+		pthread_mutex_lock(&tf->mtx);
+		running = tf->running;
+		pthread_mutex_unlock(&tf->mtx);
+		if( running == 0 ) {
+			break;
+		}
+		if( parsestats_elapsed(&lastlog) >= TRANSFORM_PROGRESS_INTERVAL ) {
+			transform_log_progress(tf, 0);
+			parsestats_timer_start(&lastlog);
+		}
+	}
+	for( i = 0; i < started; i++ ) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	transform_log_progress(tf, 1);
+	if( transform_finish(tf, outdir) < 0 ) {
+		goto exit;
+	}
+	ret = ((tf->failed == 0) && !tf->stop ? 1 : 0);
+
+ exit:
+	free_nullsafe(workers);
+	transform_free(tf, store);
+	return ret;
+}
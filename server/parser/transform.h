@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   transform.h
+ * @date   Mon Oct 19 03:46:52 2026
+ *
+ * @brief  Transforms reports into COPY load files, without a database
+ *
+ */
+
+#ifndef _RTEVAL_TRANSFORM_H
+#define _RTEVAL_TRANSFORM_H
+
+#include <signal.h>
+
+#include <eurephia_values.h>
+#include <log.h>
+#include <settings.h>
+
+#define TRANSFORM_MANIFEST "manifest"      /**< File name of the manifest, in the output directory */
+#define TRANSFORM_SUFFIX ".copy"           /**< Suffix of the load files, after the table name */
+#define TRANSFORM_PROGRESS_INTERVAL 10     /**< Seconds between each progress report in the log */
+
+int transform_reports(LogContext *log, eurephiaVALUES *cfg, SettingsStore *store,
+		      int ninputs, char **inputs, const sigset_t *sigs);
+
+#endif
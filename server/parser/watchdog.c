@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   watchdog.c
+ * @date   Mon Oct 19 00:41:22 2026
+ *
+ * @brief  Aborts reports exceeding the processing limits
+ *
+ * Each worker thread registers a guard, which keeps track of the report the
+ * thread is processing.  The watchdog thread checks the guards every second.
+ * When a report has been processed for more than job_timeout seconds, the guard
+ * is marked as expired.  A running XSLT transformation is then stopped by setting
+ * its state to XSLT_STATE_STOPPED, which libxslt checks between the instructions.
+ * Reading of the XML report stops on the next block.
+ * Database operations are not interrupted.
+ *
+ * The XSLT transformations are also limited in template recursion depth
+ * (xslt_max_depth), number of variables (xslt_max_vars) and, if libxslt
+ * supports it, the number of XPath operations (xslt_max_steps).
+ *
+ * The guard of the calling thread is kept in a thread local variable, so the
+ * XML parser and the XSLT code can check it without knowing about the worker.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <libxslt/xsltInternals.h>
+
+#include <config.h>
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <watchdog.h>
+
+/**
+ * Processing state of one worker thread
+ */
+struct _JobGuard {
+	JobWatchdog *wd;           /**< The watchdog this guard is registered with */
+	unsigned int thread_id;    /**< ID of the worker thread, used in the log */
+	unsigned int submid;       /**< Submission ID of the report being processed */
+	time_t deadline;           /**< When the report must be completed, 0 when idle */
+	volatile int expired;      /**< Set by the watchdog thread when the deadline passed */
+	int limited;               /**< Set when an XSLT limit stopped a transformation */
+	xsltTransformContext *xsltctxt; /**< Running XSLT transformation, NULL if none */
+	struct _JobGuard *next;    /**< Next registered guard */
+};
+
+/**
+ * The watchdog
+ */
+struct _JobWatchdog {
+	LogContext *log;           /**< Log context */
+	unsigned int timeout;      /**< Seconds a report may be processed (config: job_timeout) */
+	int max_depth;             /**< XSLT template recursion limit (config: xslt_max_depth) */
+	int max_vars;              /**< XSLT variable limit (config: xslt_max_vars) */
+	unsigned long max_steps;   /**< XPath operation limit (config: xslt_max_steps) */
+	JobGuard *guards;          /**< All registered guards */
+	pthread_mutex_t mtx;       /**< Protects the guards */
+	pthread_cond_t cond;       /**< Wakes up the watchdog thread when stopping */
+	int stop;                  /**< Set by watchdog_stop() */
+	int running;               /**< Set when the watchdog thread is started */
+	pthread_t thread;          /**< The watchdog thread */
+};
+
+static __thread JobGuard *current_guard = NULL; /**< The guard registered by this thread */
+
+
+/**
+ * Returns the current time of the monotonic clock, in seconds
+ */
+static time_t watchdog_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+
+/**
+ * The watchdog thread.  Marks the jobs exceeding the deadline as expired.
+ *
+ * @param data  JobWatchdog
+ *
+ * @return Returns NULL
+ */
+static void *watchdog_thread(void *data)
+{
+	JobWatchdog *wd = (JobWatchdog *) data;
+	JobGuard *g = NULL;
+	struct timeval now;
+	struct timespec wakeup;
+	time_t t;
+
+	pthread_mutex_lock(&wd->mtx);
+	while( !wd->stop ) {
+		t = watchdog_now();
+		for( g = wd->guards; g; g = g->next ) {
+			if( !g->deadline || g->expired || (t < g->deadline) ) {
+				continue;
+			}
+			writelog(wd->log, LOG_ERR,
+				 "[Thread %i] (submid: %i) Processing exceeded %i seconds, aborting",
+				 g->thread_id, g->submid, wd->timeout);
+			g->expired = 1;
+			if( g->xsltctxt ) {
+				g->xsltctxt->state = XSLT_STATE_STOPPED;
+			}
+		}
+
+		gettimeofday(&now, NULL);
+		wakeup.tv_sec = now.tv_sec + WATCHDOG_INTERVAL;
+		wakeup.tv_nsec = now.tv_usec * 1000;
+		pthread_cond_timedwait(&wd->cond, &wd->mtx, &wakeup);
+	}
+	pthread_mutex_unlock(&wd->mtx);
+	return NULL;
+}
+
+
+/**
+ * Prepares the processing limits and starts the watchdog thread
+ *
+ * @param log  Log context
+ * @param cfg  Configuration
+ *
+ * @return Returns a JobWatchdog on success, otherwise NULL
+ */
+JobWatchdog *watchdog_start(LogContext *log, eurephiaVALUES *cfg)
+{
+	JobWatchdog *wd = NULL;
+	int rc;
+
+	wd = malloc_nullsafe(log, sizeof(JobWatchdog));
+	wd->log = log;
+	wd->timeout = atoi_nullsafe(eGet_value(cfg, "job_timeout"));
+	wd->max_depth = atoi_nullsafe(eGet_value(cfg, "xslt_max_depth"));
+	wd->max_vars = atoi_nullsafe(eGet_value(cfg, "xslt_max_vars"));
+	wd->max_steps = atoi_nullsafe(eGet_value(cfg, "xslt_max_steps"));
+	pthread_mutex_init(&wd->mtx, NULL);
+	pthread_cond_init(&wd->cond, NULL);
+
+#ifndef HAVE_STRUCT__XSLTTRANSFORMCONTEXT_OPLIMIT
+	if( wd->max_steps > 0 ) {
+		writelog(log, LOG_WARNING, "xslt_max_steps is not supported by this libxslt version");
+	}
+#endif
+
+	if( wd->timeout > 0 ) {
+		if( (rc = pthread_create(&wd->thread, NULL, watchdog_thread, wd)) != 0 ) {
+			writelog(log, LOG_EMERG, "Could not start the watchdog thread: %s",
+				 strerror(rc));
+			watchdog_stop(wd);
+			return NULL;
+		}
+		wd->running = 1;
+	}
+	writelog(log, LOG_DEBUG, "Watchdog: job timeout %i seconds, XSLT depth %i, variables %i",
+		 wd->timeout, wd->max_depth, wd->max_vars);
+	return wd;
+}
+
+
+/**
+ * Stops the watchdog thread.  All guards must be unregistered first.
+ *
+ * @param wd  JobWatchdog
+ */
+void watchdog_stop(JobWatchdog *wd)
+{
+	if( !wd ) {
+		return;
+	}
+
+	pthread_mutex_lock(&wd->mtx);
+	wd->stop = 1;
+	pthread_cond_signal(&wd->cond);
+	pthread_mutex_unlock(&wd->mtx);
+	if( wd->running ) {
+		pthread_join(wd->thread, NULL);
+	}
+	pthread_cond_destroy(&wd->cond);
+	pthread_mutex_destroy(&wd->mtx);
+	free_nullsafe(wd);
+}
+
+
+/**
+ * Registers the calling worker thread with the watchdog
+ *
+ * @param wd         JobWatchdog
+ * @param thread_id  ID of the worker thread
+ *
+ * @return Returns the guard of the worker thread
+ */
+JobGuard *watchdog_register(JobWatchdog *wd, unsigned int thread_id)
+{
+	JobGuard *guard = NULL;
+
+	guard = malloc_nullsafe(wd->log, sizeof(JobGuard));
+	guard->wd = wd;
+	guard->thread_id = thread_id;
+
+	pthread_mutex_lock(&wd->mtx);
+	guard->next = wd->guards;
+	wd->guards = guard;
+	pthread_mutex_unlock(&wd->mtx);
+
+	current_guard = guard;
+	return guard;
+}
+
+
+/**
+ * Unregisters a worker thread from the watchdog.  Must be called by the same thread
+ * which registered it.
+ *
+ * @param wd     JobWatchdog
+ * @param guard  The guard of the worker thread
+ */
+void watchdog_unregister(JobWatchdog *wd, JobGuard *guard)
+{
+	JobGuard **pp = NULL;
+
+	if( !guard ) {
+		return;
+	}
+
+	pthread_mutex_lock(&wd->mtx);
+	for( pp = &wd->guards; *pp; pp = &(*pp)->next ) {
+		if( *pp == guard ) {
+			*pp = guard->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&wd->mtx);
+
+	current_guard = NULL;
+	free_nullsafe(guard);
+}
+
+
+/**
+ * Starts the clock for a report
+ *
+ * @param guard   The guard of the worker thread
+ * @param submid  Submission ID of the report
+ */
+void watchdog_job_start(JobGuard *guard, unsigned int submid)
+{
+	pthread_mutex_lock(&guard->wd->mtx);
+	guard->submid = submid;
+	guard->expired = 0;
+	guard->limited = 0;
+	guard->deadline = (guard->wd->timeout > 0 ? watchdog_now() + guard->wd->timeout : 0);
+	pthread_mutex_unlock(&guard->wd->mtx);
+}
+
+
+/**
+ * Stops the clock for a report
+ *
+ * @param guard  The guard of the worker thread
+ *
+ * @return Returns 1 if the report exceeded any of the limits, otherwise 0
+ */
+int watchdog_job_done(JobGuard *guard)
+{
+	int aborted;
+
+	pthread_mutex_lock(&guard->wd->mtx);
+	aborted = (guard->expired || guard->limited);
+	guard->deadline = 0;
+	guard->xsltctxt = NULL;
+	pthread_mutex_unlock(&guard->wd->mtx);
+	return aborted;
+}
+
+
+/**
+ * Checks if the report processed by the calling thread has exceeded the job_timeout
+ *
+ * @return Returns 1 if the processing should stop, otherwise 0
+ */
+int watchdog_expired(void)
+{
+	return (current_guard && current_guard->expired);
+}
+
+
+/**
+ * Applies the XSLT limits to a transformation, and makes it possible for the watchdog
+ * to stop it.  Does nothing in threads not registered with the watchdog.
+ *
+ * @param ctxt  XSLT transformation context, before the transformation starts
+ */
+void watchdog_xslt_begin(xsltTransformContext *ctxt)
+{
+	JobGuard *guard = current_guard;
+
+	if( !guard ) {
+		return;
+	}
+	if( guard->wd->max_depth > 0 ) {
+		ctxt->maxTemplateDepth = guard->wd->max_depth;
+	}
+	if( guard->wd->max_vars > 0 ) {
+		ctxt->maxTemplateVars = guard->wd->max_vars;
+	}
+#ifdef HAVE_STRUCT__XSLTTRANSFORMCONTEXT_OPLIMIT
+	ctxt->opLimit = guard->wd->max_steps;
+#endif
+
+	pthread_mutex_lock(&guard->wd->mtx);
+	guard->xsltctxt = ctxt;
+	if( guard->expired ) {
+		ctxt->state = XSLT_STATE_STOPPED;
+	}
+	pthread_mutex_unlock(&guard->wd->mtx);
+}
+
+
+/**
+ * Unregisters a transformation from the watchdog, and records if it was stopped
+ *
+ * @param ctxt  XSLT transformation context, after the transformation
+ */
+void watchdog_xslt_end(xsltTransformContext *ctxt)
+{
+	JobGuard *guard = current_guard;
+
+	if( !guard ) {
+		return;
+	}
+
+	pthread_mutex_lock(&guard->wd->mtx);
+	guard->xsltctxt = NULL;
+	pthread_mutex_unlock(&guard->wd->mtx);
+
+	// libxslt stops the transformation when a limit is exceeded
+	if( ctxt->state == XSLT_STATE_STOPPED ) {
+		if( !guard->expired ) {
+			writelog(guard->wd->log, LOG_ERR,
+				 "[Thread %i] (submid: %i) XSLT processing limits exceeded",
+				 guard->thread_id, guard->submid);
+		}
+		guard->limited = 1;
+	}
+}
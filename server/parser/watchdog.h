@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   watchdog.h
+ * @date   Mon Oct 19 00:41:22 2026
+ *
+ * @brief  Aborts reports exceeding the processing limits
+ *
+ */
+
+#ifndef _RTEVAL_WATCHDOG_H
+#define _RTEVAL_WATCHDOG_H
+
+#include <libxslt/xsltInternals.h>
+
+#include <eurephia_values.h>
+#include <log.h>
+
+#define WATCHDOG_INTERVAL 1   /**< Seconds between each check of the running jobs */
+
+typedef struct _JobWatchdog JobWatchdog;
+typedef struct _JobGuard JobGuard;
+
+JobWatchdog *watchdog_start(LogContext *log, eurephiaVALUES *cfg);
+void watchdog_stop(JobWatchdog *wd);
+JobGuard *watchdog_register(JobWatchdog *wd, unsigned int thread_id);
+void watchdog_unregister(JobWatchdog *wd, JobGuard *guard);
+void watchdog_job_start(JobGuard *guard, unsigned int submid);
+int watchdog_job_done(JobGuard *guard);
+int watchdog_expired(void);
+void watchdog_xslt_begin(xsltTransformContext *ctxt);
+void watchdog_xslt_end(xsltTransformContext *ctxt);
+
+#endif
@@ -0,0 +1,785 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   workerpool.c
+ * @date   Sun Oct 18 21:04:12 2026
+ *
+ * @brief  Starts and stops worker threads according to the load
+ *
+ * The pool keeps between min_threads and threads worker threads running.  A
+ * manager thread checks the number of queued jobs every second, and starts
+ * another worker when there are more queued jobs than idle workers, or when a
+ * worker reports that a job waited longer than thread_grow_wait seconds.
+ * Workers which have been idle for thread_idle_timeout seconds retire, and their
+ * database connection is closed.  Workers which die, for example when losing
+ * the database connection, are replaced.
+ *
+ * The upper bound is also limited by the number of CPU cores.  The workers share
+ * the database connections of the connection pool (dbpool.c).
+ *
+ * Each new worker opens another pooled database connection in its own thread,
+ * so several connections are opened at the same time.  When the daemon starts,
+ * the pool waits until the min_threads workers are ready.
+ *
+ * The pool also provides the flow control for the jobs sent to the POSIX MQ.  A
+ * job slot must be claimed before a job is sent, and slots are only available
+ * while the jobs queued or being processed are fewer than the running workers
+ * plus dispatch_ahead, and while the POSIX MQ has room for the job.  The pool
+ * signals an eventfd whenever a slot may have become available, which the
+ * submission queue checker waits for before it picks the next submission.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/eventfd.h>
+
+#include <eurephia_nullsafe.h>
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <memarena.h>
+#include <threadinfo.h>
+#include <parsethread.h>
+#include <workerpool.h>
+#include <dbpool.h>
+#include <shard.h>
+#include <affinity.h>
+
+/**
+ * States of a worker slot
+ */
+typedef enum { wsFREE, wsRUNNING, wsRETIRING, wsEXITED } WorkerState;
+
+/**
+ * One worker thread
+ */
+typedef struct {
+	WorkerState state;         /**< State of this slot */
+	pthread_t thread;          /**< The worker thread */
+	threadData_t *thrdata;     /**< Thread data, including the database connection */
+} WorkerSlot;
+
+/**
+ * The worker pool
+ */
+struct _WorkerPool {
+	LogContext *log;           /**< Log context */
+	eurephiaVALUES *cfg;       /**< Configuration, used for new database connections */
+	threadData_t tmpl;         /**< Settings shared by all the worker threads */
+	int worker_arena;          /**< If set, each worker gets its own memory arena */
+	size_t arena_chunk;        /**< Worker arena chunk size */
+	size_t arena_retain;       /**< Worker arena memory kept between reports */
+	size_t arena_limit;        /**< Worker arena memory allowed per report, 0 for no limit */
+	unsigned int min_workers;  /**< Workers always kept running */
+	unsigned int max_workers;  /**< Upper bound of running workers */
+	unsigned int nslots;       /**< Size of slots, the upper bound of max_workers */
+	unsigned int grow_wait;    /**< Seconds a job may wait before another worker is started */
+	unsigned int running;      /**< Workers running, not counting the retiring ones */
+	unsigned int busy;         /**< Workers processing a report */
+	unsigned int queued;       /**< Jobs sent to the POSIX MQ, not yet picked up by a worker */
+	unsigned int queue_max;    /**< Size of the POSIX MQ */
+	unsigned int ahead;        /**< Jobs allowed in flight beyond the running workers */
+	unsigned int connected;    /**< Workers which have connected to the database */
+	unsigned int failed;       /**< Workers which failed to connect to the database */
+	int grow;                  /**< Set when a job waited longer than grow_wait */
+	double spawn_after;        /**< No new workers are started before this time */
+	WorkerSlot *slots;         /**< All worker slots */
+	pthread_mutex_t mtx;       /**< Protects the counters and the slot states */
+	pthread_cond_t cond;       /**< Wakes up the manager thread */
+	int slotfd;                /**< eventfd, signalled when a job slot may have become available */
+	int stop;                  /**< Set by workerpool_stop() */
+	int manager_running;       /**< Set when the manager thread is started */
+	pthread_t manager;         /**< The manager thread */
+};
+
+
+/**
+ * Returns the current time in seconds, from a monotonic clock.  Used for the
+ * queue time stamp of the parse jobs.
+ *
+ * @return Returns the number of seconds since an unspecified point in time
+ */
+double workerpool_clock()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + ((double) ts.tv_nsec / 1000000000.0);
+}
+
+
+/**
+ * Signals the job slot eventfd
+ *
+ * @param pool  WorkerPool
+ */
+static void workerpool_notify_slot(WorkerPool *pool)
+{
+	uint64_t one = 1;
+
+	if( write(pool->slotfd, &one, sizeof(one)) < 0 ) {
+		// EAGAIN, the counter is already far from zero
+	}
+}
+
+
+/**
+ * Releases the thread data of a worker
+ *
+ * @param thrdata  Thread data of the worker
+ */
+static void workerpool_free_thrdata(threadData_t *thrdata)
+{
+	memarena_destroy(thrdata->arena);
+	free_nullsafe(thrdata);
+}
+
+
+/**
+ * Prepares the memory arena of a new worker, and opens another database connection
+ * in the connection pool if not all are opened yet.  Runs in the worker thread, so
+ * several workers can connect at the same time.
+ *
+ * @param pool     WorkerPool
+ * @param thrdata  Thread data of the worker
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int workerpool_connect(WorkerPool *pool, threadData_t *thrdata)
+{
+	if( dbpool_warmup(thrdata->dbpool) < 0 ) {
+		writelog(pool->log, LOG_CRIT,
+			 "Could not connect to the database for thread %i", thrdata->id);
+		return -1;
+	}
+
+	if( pool->worker_arena ) {
+		thrdata->arena = memarena_new(pool->arena_chunk, pool->arena_retain);
+		if( !thrdata->arena ) {
+			writelog(pool->log, LOG_CRIT,
+				 "Could not allocate memory arena for thread %i", thrdata->id);
+			return -1;
+		}
+		memarena_set_limit(thrdata->arena, pool->arena_limit);
+	}
+	return 1;
+}
+
+
+/**
+ * Start function of the worker threads.  Moves to its CPUs, connects to the database,
+ * reports the result to the pool and then runs the parser thread.
+ *
+ * @param data  threadData_t of the worker
+ *
+ * @return Returns the result of parsethread(), or NULL if the worker could not connect
+ */
+static void *workerpool_thread(void *data)
+{
+	threadData_t *thrdata = (threadData_t *) data;
+	WorkerPool *pool = thrdata->pool;
+
+	// Move to the CPUs of this slot first, so the memory allocated below is node local
+	affinity_pin_worker(thrdata->affinity, thrdata->id);
+
+	if( workerpool_connect(pool, thrdata) < 0 ) {
+		pthread_mutex_lock(&pool->mtx);
+		pool->failed++;
+		pool->spawn_after = workerpool_clock() + WORKERPOOL_SPAWN_BACKOFF;
+		pool->running--;
+		pool->slots[thrdata->id].state = wsEXITED;
+		if( (pool->running == 0) && pool->manager_running && !pool->stop ) {
+			writelog(pool->log, LOG_EMERG,
+				 "No more worker threads available.  "
+				 "Signaling for complete shutdown!");
+			kill(getpid(), SIGUSR1);
+		}
+		pthread_cond_broadcast(&pool->cond);
+		workerpool_notify_slot(pool);
+		pthread_mutex_unlock(&pool->mtx);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->connected++;
+	writelog(pool->log, LOG_INFO, "Worker thread %i ready (%i running, %i busy)",
+		 thrdata->id, pool->running, pool->busy);
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mtx);
+
+	return parsethread(thrdata);
+}
+
+
+/**
+ * Starts a worker thread in a free slot.  The worker connects to the database in its
+ * own thread, so this returns without waiting for the database.  Must be called with
+ * the pool mutex held.
+ *
+ * @param pool  WorkerPool
+ * @param idx   Index of a free slot
+ *
+ * @return Returns 1 on success, otherwise -1
+ */
+static int workerpool_spawn(WorkerPool *pool, unsigned int idx)
+{
+	threadData_t *thrdata = NULL;
+	int rc;
+
+	thrdata = malloc_nullsafe(pool->log, sizeof(threadData_t));
+	if( !thrdata ) {
+		return -1;
+	}
+	memcpy(thrdata, &pool->tmpl, sizeof(threadData_t));
+	thrdata->id = idx;
+
+	// A connecting worker counts as running, to not start more workers than needed
+	pool->slots[idx].thrdata = thrdata;
+	pool->slots[idx].state = wsRUNNING;
+	pool->running++;
+	if( (rc = pthread_create(&pool->slots[idx].thread, NULL, workerpool_thread, thrdata)) != 0 ) {
+		pool->slots[idx].thrdata = NULL;
+		pool->slots[idx].state = wsFREE;
+		pool->running--;
+		writelog(pool->log, LOG_CRIT, "Failed to start thread %i: %s", idx, strerror(rc));
+		free_nullsafe(thrdata);
+		return -1;
+	}
+	workerpool_notify_slot(pool);
+	return 1;
+}
+
+
+/**
+ * Waits for an exited worker thread and releases its database connection
+ *
+ * @param pool  WorkerPool
+ * @param slot  Slot of a worker which has exited
+ */
+static void workerpool_reap(WorkerPool *pool, WorkerSlot *slot)
+{
+	int rc;
+
+	if( (rc = pthread_join(slot->thread, NULL)) != 0 ) {
+		writelog(pool->log, LOG_CRIT, "Failed to join thread %i: %s",
+			 slot->thrdata->id, strerror(rc));
+	}
+	workerpool_free_thrdata(slot->thrdata);
+	slot->thrdata = NULL;
+	slot->state = wsFREE;
+}
+
+
+/**
+ * Checks if another worker thread should be started.  Must be called with the pool mutex held.
+ *
+ * @param pool  WorkerPool
+ *
+ * @return Returns the index of a free slot to start a worker in, or -1 if no worker is needed
+ */
+static int workerpool_want_worker(WorkerPool *pool)
+{
+	unsigned int i, idle;
+	int grow = pool->grow;
+
+	pool->grow = 0;
+	if( (pool->running >= pool->max_workers) || (workerpool_clock() < pool->spawn_after) ) {
+		return -1;
+	}
+
+	if( pool->running >= pool->min_workers ) {
+		// More queued jobs than idle workers, or the jobs wait too long
+		idle = pool->running - pool->busy;
+		if( !grow && (pool->queued <= idle) ) {
+			return -1;
+		}
+	}
+
+	for( i = 0; i < pool->nslots; i++ ) {
+		if( pool->slots[i].state == wsFREE ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+/**
+ * The manager thread.  Starts new workers when needed, and cleans up after the
+ * workers which have exited.
+ *
+ * @param data  WorkerPool
+ *
+ * @return Returns NULL
+ */
+static void *workerpool_manager(void *data)
+{
+	WorkerPool *pool = (WorkerPool *) data;
+	struct timeval now;
+	struct timespec wakeup;
+	unsigned int i;
+	int idx;
+
+	pthread_mutex_lock(&pool->mtx);
+	while( !pool->stop ) {
+		for( i = 0; i < pool->nslots; i++ ) {
+			if( pool->slots[i].state == wsEXITED ) {
+				workerpool_reap(pool, &pool->slots[i]);
+			}
+		}
+
+		if( (idx = workerpool_want_worker(pool)) >= 0 ) {
+			if( workerpool_spawn(pool, idx) > 0 ) {
+				writelog(pool->log, LOG_INFO,
+					 "Starting worker thread %i (%i running, %i busy)",
+					 idx, pool->running, pool->busy);
+				continue;
+			}
+			pool->spawn_after = workerpool_clock() + WORKERPOOL_SPAWN_BACKOFF;
+			if( pool->running == 0 ) {
+				writelog(pool->log, LOG_EMERG,
+					 "No more worker threads available.  "
+					 "Signaling for complete shutdown!");
+				kill(getpid(), SIGUSR1);
+			}
+		}
+
+		gettimeofday(&now, NULL);
+		wakeup.tv_sec = now.tv_sec + WORKERPOOL_CHECK_INTERVAL;
+		wakeup.tv_nsec = now.tv_usec * 1000;
+		pthread_cond_timedwait(&pool->cond, &pool->mtx, &wakeup);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return NULL;
+}
+
+
+/**
+ * Checks if another job may be sent to the POSIX MQ.  Must be called with the pool mutex held.
+ *
+ * @param pool  WorkerPool
+ *
+ * @return Returns 1 if a job slot is available, otherwise 0
+ */
+static int workerpool_slot_free(WorkerPool *pool)
+{
+	return ((pool->queued < pool->queue_max)
+		&& ((pool->queued + pool->busy) < (pool->running + pool->ahead)));
+}
+
+
+/**
+ * Claims a job slot, which must be done before a job is sent to the POSIX MQ.  The
+ * slot is released when a worker picks up the job, or by workerpool_release_slot()
+ * if the job could not be sent.  This function does not block, wait for the
+ * workerpool_slot_fd() descriptor to become readable and try again.
+ *
+ * @param pool     WorkerPool
+ *
+ * @return Returns 1 when a slot is claimed, otherwise 0.  0 is also returned when
+ *         the shutdown flag is set.
+ */
+int workerpool_claim_slot(WorkerPool *pool)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&pool->mtx);
+	if( !pool->stop && (*(pool->tmpl.shutdown) == 0) && workerpool_slot_free(pool) ) {
+		pool->queued++;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return ret;
+}
+
+
+/**
+ * Returns the eventfd which becomes readable when a job slot may have become
+ * available.  Use workerpool_slot_ack() to reset it.
+ *
+ * @param pool  WorkerPool
+ *
+ * @return Returns a file descriptor to poll for reading
+ */
+int workerpool_slot_fd(WorkerPool *pool)
+{
+	return pool->slotfd;
+}
+
+
+/**
+ * Resets the job slot eventfd, after it became readable
+ *
+ * @param pool  WorkerPool
+ */
+void workerpool_slot_ack(WorkerPool *pool)
+{
+	uint64_t count;
+
+	if( read(pool->slotfd, &count, sizeof(count)) < 0 ) {
+		// EAGAIN, already reset
+	}
+}
+
+
+/**
+ * Releases a claimed job slot, when the job was not sent to the POSIX MQ
+ *
+ * @param pool  WorkerPool
+ */
+void workerpool_release_slot(WorkerPool *pool)
+{
+	pthread_mutex_lock(&pool->mtx);
+	if( pool->queued > 0 ) {
+		pool->queued--;
+	}
+	workerpool_notify_slot(pool);
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+
+/**
+ * Called by a worker when it starts processing a job
+ *
+ * @param pool    WorkerPool
+ * @param queued  The time the job was put on the parse queue, from workerpool_clock().
+ *                0 if unknown.
+ */
+void workerpool_job_started(WorkerPool *pool, double queued)
+{
+	pthread_mutex_lock(&pool->mtx);
+	if( pool->queued > 0 ) {
+		pool->queued--;
+	}
+	pool->busy++;
+	workerpool_notify_slot(pool);
+	if( queued && ((workerpool_clock() - queued) >= pool->grow_wait)
+	    && (pool->running < pool->max_workers) ) {
+		pool->grow = 1;
+		pthread_cond_signal(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+
+/**
+ * Called by a worker when it has completed a job
+ *
+ * @param pool    WorkerPool
+ * @param id      Worker ID
+ *
+ * @return Returns 1 if the worker should exit, as the pool has been made smaller, otherwise 0
+ */
+int workerpool_job_done(WorkerPool *pool, unsigned int id)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&pool->mtx);
+	pool->busy--;
+	if( !pool->stop && (pool->running > pool->max_workers) ) {
+		pool->slots[id].state = wsRETIRING;
+		pool->running--;
+		ret = 1;
+	}
+	workerpool_notify_slot(pool);
+	pthread_mutex_unlock(&pool->mtx);
+	return ret;
+}
+
+
+/**
+ * Writes the worker pool counters to the log
+ *
+ * @param pool  WorkerPool
+ */
+void workerpool_log_stats(WorkerPool *pool)
+{
+	unsigned int running, busy, queued;
+
+	if( !pool ) {
+		return;
+	}
+	pthread_mutex_lock(&pool->mtx);
+	running = pool->running;
+	busy = pool->busy;
+	queued = pool->queued;
+	pthread_mutex_unlock(&pool->mtx);
+	writelog(pool->log, LOG_INFO, "Worker pool: %i running, %i busy, %i queued, %i-%i allowed",
+		 running, busy, queued, pool->min_workers, pool->max_workers);
+	dbpool_log_stats(pool->tmpl.dbpool);
+	shard_log_stats(pool->tmpl.shards);
+}
+
+
+/**
+ * Called by an idle worker, to check if it may exit
+ *
+ * @param pool  WorkerPool
+ * @param id    Worker ID
+ *
+ * @return Returns 1 if the worker should exit, otherwise 0
+ */
+int workerpool_retire(WorkerPool *pool, unsigned int id)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&pool->mtx);
+	if( !pool->stop && (pool->running > pool->min_workers) ) {
+		pool->slots[id].state = wsRETIRING;
+		pool->running--;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&pool->mtx);
+	return ret;
+}
+
+
+/**
+ * Called by a worker as the last thing before it exits
+ *
+ * @param pool  WorkerPool
+ * @param id    Worker ID
+ */
+void workerpool_exited(WorkerPool *pool, unsigned int id)
+{
+	pthread_mutex_lock(&pool->mtx);
+	if( pool->slots[id].state == wsRUNNING ) {
+		// Not retired, the worker will be replaced if needed
+		pool->running--;
+	}
+	pool->slots[id].state = wsEXITED;
+	pthread_cond_signal(&pool->cond);
+	workerpool_notify_slot(pool);
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+
+/**
+ * Sets the number of worker threads from the configuration.  Must be called with the pool
+ * mutex held, once the pool is started.
+ *
+ * @param pool  WorkerPool
+ * @param cfg   Configuration
+ */
+static void workerpool_set_size(WorkerPool *pool, eurephiaVALUES *cfg)
+{
+	pool->max_workers = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "threads")), 4);
+	pool->min_workers = defaultIntValue(atoi_nullsafe(eGet_value(cfg, "min_threads")), 1);
+	if( pool->max_workers > pool->nslots ) {
+		writelog(pool->log, LOG_NOTICE,
+			 "Limiting the worker threads to %i, %i per CPU core",
+			 pool->nslots, WORKERPOOL_CPU_FACTOR);
+		pool->max_workers = pool->nslots;
+	}
+	if( pool->min_workers > pool->max_workers ) {
+		pool->min_workers = pool->max_workers;
+	}
+}
+
+
+/**
+ * Changes the number of worker threads (config: threads, min_threads).  Missing workers are
+ * started by the manager thread.  Surplus workers exit when they complete their current
+ * report, or when they have been idle for thread_idle_timeout seconds.
+ *
+ * @param pool  WorkerPool
+ * @param cfg   Configuration with the new settings
+ */
+void workerpool_resize(WorkerPool *pool, eurephiaVALUES *cfg)
+{
+	pthread_mutex_lock(&pool->mtx);
+	workerpool_set_size(pool, cfg);
+	writelog(pool->log, LOG_INFO, "Worker pool resized to %i-%i worker threads (%i running)",
+		 pool->min_workers, pool->max_workers, pool->running);
+	pthread_cond_signal(&pool->cond);
+	workerpool_notify_slot(pool);
+	pthread_mutex_unlock(&pool->mtx);
+}
+
+
+/**
+ * Prepares the worker pool, starts the minimum number of worker threads and the manager thread
+ *
+ * @param log           Log context
+ * @param cfg           Configuration
+ * @param tmpl          Settings shared by all workers.  The id and arena fields are set per worker.
+ * @param worker_arena  If set, each worker gets its own memory arena
+ * @param arena_chunk   Worker arena chunk size
+ * @param arena_retain  Worker arena memory kept between reports
+ *
+ * @return Returns a WorkerPool on success, otherwise NULL
+ */
+WorkerPool *workerpool_start(LogContext *log, eurephiaVALUES *cfg,
+			     threadData_t *tmpl, int worker_arena,
+			     size_t arena_chunk, size_t arena_retain)
+{
+	WorkerPool *pool = NULL;
+	struct mq_attr attr;
+	unsigned int i;
+	long ncpu;
+	int rc;
+
+	pool = malloc_nullsafe(log, sizeof(WorkerPool));
+	if( !pool ) {
+		return NULL;
+	}
+	pool->log = log;
+	pool->cfg = cfg;
+	memcpy(&pool->tmpl, tmpl, sizeof(threadData_t));
+	pool->tmpl.pool = pool;
+	pool->worker_arena = worker_arena;
+	pool->arena_chunk = arena_chunk;
+	pool->arena_retain = arena_retain;
+	pool->arena_limit = atoi_nullsafe(eGet_value(cfg, "worker_arena_limit"));
+	pool->grow_wait = atoi_nullsafe(eGet_value(cfg, "thread_grow_wait"));
+	pool->ahead = atoi_nullsafe(eGet_value(cfg, "dispatch_ahead"));
+	pthread_mutex_init(&pool->mtx, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->slotfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if( pool->slotfd < 0 ) {
+		writelog(log, LOG_EMERG, "Could not create the job slot eventfd: %s",
+			 strerror(errno));
+		goto error;
+	}
+
+	// Never send more jobs than the POSIX MQ can hold, the sender would block
+	memset(&attr, 0, sizeof(struct mq_attr));
+	if( mq_getattr(tmpl->msgq, &attr) < 0 ) {
+		writelog(log, LOG_EMERG, "Could not get the size of the message queue: %s",
+			 strerror(errno));
+		goto error;
+	}
+	pool->queue_max = attr.mq_maxmsg;
+
+	// More workers than CPU cores only helps while the workers wait for the database.
+	// The slots are allocated for the most workers allowed, so the pool can grow later.
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	pool->nslots = (ncpu > 0 ? ncpu * WORKERPOOL_CPU_FACTOR
+			: defaultIntValue(atoi_nullsafe(eGet_value(cfg, "threads")), 4));
+	workerpool_set_size(pool, cfg);
+
+	pool->slots = calloc(pool->nslots, sizeof(WorkerSlot));
+	if( !pool->slots ) {
+		writelog(log, LOG_EMERG, "Could not allocate memory for the worker threads");
+		goto error;
+	}
+
+	// The workers connect to the database in parallel.  Wait until all of them
+	// have connected or failed, the rest of the workers are started when needed.
+	writelog(log, LOG_INFO, "Starting %i worker threads, up to %i when needed",
+		 pool->min_workers, pool->max_workers);
+	pthread_mutex_lock(&pool->mtx);
+	for( i = 0; i < pool->min_workers; i++ ) {
+		if( workerpool_spawn(pool, i) < 0 ) {
+			pthread_mutex_unlock(&pool->mtx);
+			goto error;
+		}
+	}
+	while( (pool->connected + pool->failed) < pool->min_workers ) {
+		pthread_cond_wait(&pool->cond, &pool->mtx);
+	}
+	if( pool->connected == 0 ) {
+		pthread_mutex_unlock(&pool->mtx);
+		writelog(log, LOG_EMERG, "None of the worker threads could connect to the database");
+		goto error;
+	} else if( pool->failed > 0 ) {
+		writelog(log, LOG_WARNING, "Only %i of %i worker threads connected to the database",
+			 pool->connected, pool->min_workers);
+	}
+
+	if( (rc = pthread_create(&pool->manager, NULL, workerpool_manager, pool)) != 0 ) {
+		pthread_mutex_unlock(&pool->mtx);
+		writelog(log, LOG_EMERG, "Could not start the worker pool manager: %s",
+			 strerror(rc));
+		goto error;
+	}
+	pool->manager_running = 1;
+	pthread_mutex_unlock(&pool->mtx);
+	return pool;
+
+ error:
+	// Make the workers already started exit
+	*(pool->tmpl.shutdown) = 1;
+	workerpool_stop(pool);
+	return NULL;
+}
+
+
+/**
+ * Stops all worker threads and the manager thread.  The shutdown flag must be set
+ * before calling this function.
+ *
+ * @param pool  WorkerPool
+ */
+void workerpool_stop(WorkerPool *pool)
+{
+	parseJob_t job;
+	struct timeval now;
+	struct timespec timeout;
+	unsigned int i, nwake;
+
+	if( !pool ) {
+		return;
+	}
+
+	if( pool->manager_running ) {
+		pthread_mutex_lock(&pool->mtx);
+		pool->stop = 1;
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->mtx);
+		pthread_join(pool->manager, NULL);
+	}
+
+	// Send empty messages to the workers, to make them have a look at the shutdown flag.
+	// Workers which do not get a message notice it when their receive times out.
+	memset(&job, 0, sizeof(parseJob_t));
+	pthread_mutex_lock(&pool->mtx);
+	pool->stop = 1;
+	nwake = pool->running;
+	workerpool_notify_slot(pool);
+	pthread_mutex_unlock(&pool->mtx);
+	for( i = 0; i < nwake; i++ ) {
+		writelog(pool->log, LOG_DEBUG, "Sending shutdown message %i of %i", i+1, nwake);
+		gettimeofday(&now, NULL);
+		timeout.tv_sec = now.tv_sec + 10;
+		timeout.tv_nsec = now.tv_usec * 1000;
+		if( mq_timedsend(pool->tmpl.msgq, (char *) &job, sizeof(parseJob_t), 1, &timeout) < 0 ) {
+			writelog(pool->log, LOG_WARNING,
+				 "Could not send shutdown notification to the queue: %s",
+				 strerror(errno));
+			break;
+		}
+	}
+
+	for( i = 0; pool->slots && (i < pool->nslots); i++ ) {
+		if( pool->slots[i].state != wsFREE ) {
+			workerpool_reap(pool, &pool->slots[i]);
+		}
+	}
+
+	pthread_cond_destroy(&pool->cond);
+	if( pool->slotfd >= 0 ) {
+		close(pool->slotfd);
+	}
+	pthread_mutex_destroy(&pool->mtx);
+	free_nullsafe(pool->slots);
+	free(pool);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2013 Red Hat Inc.
+ *
+ * This application is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/**
+ * @file   workerpool.h
+ * @date   Sun Oct 18 21:04:12 2026
+ *
+ * @brief  Starts and stops worker threads according to the load
+ *
+ */
+
+#ifndef _RTEVAL_WORKERPOOL_H
+#define _RTEVAL_WORKERPOOL_H
+
+#include <time.h>
+#include <mqueue.h>
+
+#include <eurephia_values.h>
+#include <log.h>
+#include <pgsql.h>
+#include <threadinfo.h>
+
+#define WORKERPOOL_CHECK_INTERVAL 1   /**< Seconds between each check of the queue depth */
+#define WORKERPOOL_SPAWN_BACKOFF  30  /**< Seconds to wait after a worker could not be started */
+#define WORKERPOOL_CPU_FACTOR     2   /**< Maximum number of worker threads per CPU core */
+
+typedef struct _WorkerPool WorkerPool;
+
+WorkerPool *workerpool_start(LogContext *log, eurephiaVALUES *cfg,
+			     threadData_t *tmpl, int worker_arena,
+			     size_t arena_chunk, size_t arena_retain);
+void workerpool_resize(WorkerPool *pool, eurephiaVALUES *cfg);
+void workerpool_stop(WorkerPool *pool);
+double workerpool_clock();
+int workerpool_claim_slot(WorkerPool *pool);
+int workerpool_slot_fd(WorkerPool *pool);
+void workerpool_slot_ack(WorkerPool *pool);
+void workerpool_release_slot(WorkerPool *pool);
+void workerpool_job_started(WorkerPool *pool, double queued);
+int workerpool_job_done(WorkerPool *pool, unsigned int id);
+void workerpool_log_stats(WorkerPool *pool);
+int workerpool_retire(WorkerPool *pool, unsigned int id);
+void workerpool_exited(WorkerPool *pool, unsigned int id);
+
+#endif
@@ -32,6 +32,7 @@
 #include <assert.h>
 
 #include <libxml/tree.h>
+#include <libxml/parser.h>
 #include <libxslt/xsltInternals.h>
 #include <libxslt/transform.h>
 #include <libxslt/xsltutils.h>
@@ -42,6 +43,10 @@
 #include <xmlparser.h>
 #include <sha1.h>
 #include <log.h>
+#include <probes.h>
+#include <memarena.h>
+#include <watchdog.h>
+#include <reportfile.h>
 
 static dbhelper_func const * xmlparser_dbhelpers = NULL;
 
@@ -60,8 +65,7 @@ static char *encapsString(const char *str) {
                 return NULL;
         }
 
-        ret = (char *) calloc(1, strlen(str)+4);
-        assert( ret != NULL );
+        ret = (char *) malloc_arena(NULL, strlen(str)+4);
 
         snprintf(ret, strlen(str)+3, "'%s'", str);
         return ret;
@@ -75,12 +79,12 @@ static char *encapsString(const char *str) {
  * @param val Integer value to encapsulate
  *
  * @return Returns a pointer to a new buffer with the encapsulated integer value.  This
- *         buffer must be free'd after usage.
+ *         buffer must be free'd with free_arena() after usage.
  */
 static char *encapsInt(const unsigned int val) {
         char *buf = NULL;
 
-        buf = (char *) calloc(1, 130);
+        buf = (char *) malloc_arena(NULL, 130);
         snprintf(buf, 128, "'%i'", val);
         return buf;
 }
@@ -216,11 +220,12 @@ void init_xmlparser(dbhelper_func const * dbhelpers)
  */
 xmlDoc *parseToSQLdata(LogContext *log, xsltStylesheet *xslt, xmlDoc *indata_d, parseParams *params) {
         xmlDoc *result_d = NULL;
+        xsltTransformContext *ctxt = NULL;
         char **xsltparams = NULL;
         unsigned int idx = 0, idx_table = 0, idx_submid = 0,
 		idx_syskey = 0, idx_rterid = 0, idx_repfname = 0;
 
-        xsltparams = calloc(10, sizeof(char *));
+        xsltparams = malloc_arena(log, 10 * sizeof(char *));
 
         if( xmlparser_dbhelpers == NULL ) {
                 writelog(log, LOG_ERR, "Programming error: xmlparser is not initialised");
@@ -262,32 +267,148 @@ xmlDoc *parseToSQLdata(LogContext *log, xsltStylesheet *xslt, xmlDoc *indata_d,
         }
         xsltparams[idx] = NULL;
 
-        // Apply the XSLT template to the input XML data
-        result_d = xsltApplyStylesheet(xslt, indata_d, (const char **)xsltparams);
+        // Apply the XSLT template to the input XML data, within the processing limits
+        PROBE3(transform__start, params->table, params->submid, params->rterid);
+        memarena_begin();
+        ctxt = xsltNewTransformContext(xslt, indata_d);
+        if( ctxt ) {
+                watchdog_xslt_begin(ctxt);
+                result_d = xsltApplyStylesheetUser(xslt, indata_d, (const char **)xsltparams,
+                                                   NULL, NULL, ctxt);
+                watchdog_xslt_end(ctxt);
+                xsltFreeTransformContext(ctxt);
+        }
+        memarena_end();
+        PROBE3(transform__done, params->table, params->submid, (result_d != NULL));
         if( result_d == NULL ) {
                 writelog(log, LOG_CRIT, "Failed applying XSLT template to input XML");
         }
 
         // Free memory we allocated via encapsString()/encapsInt()
-        free(xsltparams[idx_table]);
+        free_arena(xsltparams[idx_table]);
         if( params->submid ) {
-                free(xsltparams[idx_submid]);
+                free_arena(xsltparams[idx_submid]);
         }
         if( params->syskey ) {
-                free(xsltparams[idx_syskey]);
+                free_arena(xsltparams[idx_syskey]);
         }
         if( params->rterid ) {
-                free(xsltparams[idx_rterid]);
+                free_arena(xsltparams[idx_rterid]);
         }
         if( params->report_filename ) {
-                free(xsltparams[idx_repfname]);
+                free_arena(xsltparams[idx_repfname]);
         }
 
-        free(xsltparams);
+        free_arena(xsltparams);
         return result_d;
 }
 
 
+/**
+ * A small report covering the parts of a rteval report used by each table template.
+ * Used by xmlparser_warmup().
+ */
+static const char warmup_report[] =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<rteval version=\"2.14\">"
+        "<run_info days=\"0\" hours=\"1\" minutes=\"2\" seconds=\"3\">"
+        "<date>2020-01-01</date><time>12:00:00</time><annotate>warmup</annotate></run_info>"
+        "<loads load_average=\"1.5\"><command_line name=\"kcompile\">make</command_line></loads>"
+        "<SystemInfo>"
+        "<DMIinfo><HardwareInfo SystemUUID=\"00000000-0000-0000-0000-000000000000\" SerialNo=\"0\">"
+        "<GeneralInfo><Manufacturer>rteval</Manufacturer></GeneralInfo></HardwareInfo></DMIinfo>"
+        "<uname><node>warmup</node><kernel is_RT=\"1\">4.0.0-rt1</kernel><arch>x86_64</arch>"
+        "<baseos>Linux</baseos></uname>"
+        "<NetworkConfig><interface device=\"eth0\">"
+        "<IPv4 ipaddr=\"127.0.0.1\" netmask=\"255.0.0.0\" defaultgw=\"1\"/></interface></NetworkConfig>"
+        "<Kernel><ClockSource><source current=\"1\">tsc</source></ClockSource>"
+        "<kthreads><thread name=\"ksoftirqd/0\" policy=\"SCHED_FIFO\" priority=\"1\"/></kthreads></Kernel>"
+        "<Services><service state=\"running\">sshd</service></Services>"
+        "<Memory><numa_nodes>1</numa_nodes><memory_size unit=\"GB\">1.0</memory_size></Memory>"
+        "<CPUtopology num_cpu_cores=\"2\" num_cpu_sockets=\"1\">"
+        "<cpu name=\"cpu0\" physical_package_id=\"0\"/><cpu name=\"cpu1\" physical_package_id=\"0\"/>"
+        "</CPUtopology></SystemInfo>"
+        "<Measurements><Profile loads=\"1\" parallel=\"1\">"
+        "<cyclictest command_line=\"cyclictest -q\">"
+        "<timestamps><runloop_start>0</runloop_start></timestamps>"
+        "<core><cpu id=\"0\" priority=\"95\">"
+        "<statistics><samples>2</samples><minimum>1</minimum><maximum>2</maximum><mean>1.5</mean>"
+        "<mode>1</mode><range>1</range><median>1.5</median><standard_deviation>0.5</standard_deviation>"
+        "<mean_absolute_deviation>0.5</mean_absolute_deviation></statistics>"
+        "<histogram nbuckets=\"2\"><bucket index=\"1\" value=\"1\"/><bucket index=\"2\" value=\"1\"/>"
+        "</histogram></cpu></core>"
+        "<system description=\"(1 threads)\">"
+        "<statistics><samples>2</samples><minimum>1</minimum><maximum>2</maximum><mean>1.5</mean>"
+        "<mode>1</mode><range>1</range><median>1.5</median><standard_deviation>0.5</standard_deviation>"
+        "<mean_absolute_deviation>0.5</mean_absolute_deviation></statistics>"
+        "<histogram nbuckets=\"1\"><bucket index=\"1\" value=\"2\"/></histogram></system>"
+        "</cyclictest>"
+        "<hwlatdetect format=\"1.0\"><RunParams duration=\"60\" threshold=\"10\" window=\"1000\" width=\"500\"/>"
+        "<samples count=\"2\"><sample timestamp=\"1.0\" duration=\"11\"/>"
+        "<sample timestamp=\"2.0\" duration=\"12\"/></samples></hwlatdetect>"
+        "</Profile></Measurements>"
+        "</rteval>";
+
+
+/**
+ * Runs every table template of the XSLT template once against a small report.  libxslt,
+ * libexslt and libxml2 initialise some global state and parts of a compiled stylesheet
+ * on first use.  As these are shared by all worker threads, this must happen before the
+ * worker threads allocate memory from their own arenas.  The report is parsed the same
+ * way as the reports processed by the worker threads.
+ *
+ * @param log     Log context
+ * @param xslt    XSLT template to prepare
+ * @param tables  Measurement tables processed by the worker threads
+ */
+void xmlparser_warmup(LogContext *log, xsltStylesheet *xslt, array_str_t *tables)
+{
+        static const char *basetables[] = {
+                "systems", "systems_hostname", "rtevalruns", "rtevalruns_details", NULL
+        };
+        xmlDoc *report_d = NULL, *result_d = NULL;
+        reportFile rf;
+        parseParams prms;
+        char *tbl = NULL;
+        int i;
+
+        memset(&rf, 0, sizeof(reportFile));
+        rf.fname = "warmup.xml";
+        rf.data = (void *) warmup_report;
+        rf.size = sizeof(warmup_report) - 1;
+        rf.maxsize = rf.size;
+        rf.compression = rfcNONE;
+        report_d = reportfile_parse(log, &rf, NULL);
+        if( !report_d ) {
+                writelog(log, LOG_WARNING, "Could not parse the XSLT warm-up report");
+                return;
+        }
+
+        memset(&prms, 0, sizeof(parseParams));
+        prms.submid = 1;
+        prms.syskey = 1;
+        prms.rterid = 1;
+        prms.report_filename = rf.fname;
+        for( i = 0; basetables[i]; i++ ) {
+                prms.table = basetables[i];
+                result_d = parseToSQLdata(log, xslt, report_d, &prms);
+                if( result_d ) {
+                        xmlFreeDoc(result_d);
+                }
+        }
+
+        i = 0;
+        for_array_str(tbl, i, tables) {
+                prms.table = tbl;
+                result_d = parseToSQLdata(log, xslt, report_d, &prms);
+                if( result_d ) {
+                        xmlFreeDoc(result_d);
+                }
+        }
+        xmlFreeDoc(report_d);
+}
+
+
 /**
  * Internal xmlparser function.   Extracts the value from a '//sqldata/records/record/value'
  * node and hashes the value if the 'hash' attribute is set.  Otherwise the value is extracted
@@ -296,7 +417,7 @@ xmlDoc *parseToSQLdata(LogContext *log, xsltStylesheet *xslt, xmlDoc *indata_d,
  * @param sql_n sqldata values node containing the value to extract.
  *
  * @return Returns a pointer to a new buffer containing the value on success, otherwise NULL.
- *         This memory buffer must be free'd after usage.
+ *         This memory buffer must be free'd with free_arena() after usage.
  */
 char * sqldataValueHash(LogContext *log, xmlNode *sql_n) {
 	const char *hash = NULL, *isnull = NULL;
@@ -319,7 +440,7 @@ char * sqldataValueHash(LogContext *log, xmlNode *sql_n) {
 	hash = xmlGetAttrValue(sql_n->properties, "hash");
 	if( !hash ) {
 		// If no hash attribute is found, just use the raw data
-		ret = strdup_nullsafe(xmlExtractContent(sql_n));
+		ret = strdup_arena(xmlExtractContent(sql_n));
 	} else if( strcasecmp(hash, "sha1") == 0 ) {
 		const char *indata = xmlExtractContent(sql_n);
 		// SHA1 hashing requested
@@ -328,14 +449,14 @@ char * sqldataValueHash(LogContext *log, xmlNode *sql_n) {
 		SHA1Final(&shactx, shahash);
 
 		// "Convert" to a readable format
-		ret = malloc_nullsafe(log, (SHA1_HASH_SIZE * 2) + 3);
+		ret = malloc_arena(log, (SHA1_HASH_SIZE * 2) + 3);
 		ptr = ret;
 		for( i = 0; i < SHA1_HASH_SIZE; i++ ) {
 			sprintf(ptr, "%02x", shahash[i]);
 			ptr += 2;
 		}
 	} else {
-		ret = strdup("<Unsupported hashing algorithm>");
+		ret = strdup_arena("<Unsupported hashing algorithm>");
 	}
 
 	return ret;
@@ -350,7 +471,7 @@ char * sqldataValueHash(LogContext *log, xmlNode *sql_n) {
  * @param sql_n sqldata values node containing the value to extract and format as an array.
  *
  * @return Returns a pointer to a new memory buffer containing the value as a string.
- *         On errors, NULL is returned.  This memory buffer must be free'd after usage.
+ *         On errors, NULL is returned.  This memory buffer must be free'd with free_arena() after usage.
  */
 static char * sqldataValueArray(LogContext *log, xmlNode *sql_n)
 {
@@ -371,7 +492,7 @@ static char * sqldataValueArray(LogContext *log, xmlNode *sql_n)
  * @param sql_n  Pointer to a value node of a sqldata XML document.
  *
  * @return Returns a pointer to a new memory buffer containing the value as a string.
- *         On errors, NULL is returned.  This memory buffer must be free'd after usage.
+ *         On errors, NULL is returned.  This memory buffer must be free'd with free_arena() after usage.
  */
 char *sqldataExtractContent(LogContext *log, xmlNode *sql_n) {
 	const char *valtype = xmlGetAttrValue(sql_n->properties, "type");
@@ -541,7 +662,7 @@ char *sqldataGetValue(LogContext *log, xmlDoc *sqld, const char *fname, int reci
  * @param ipaddr     Return pointer for where the IP address will be saved.
  *
  * @return Returns a sqldata XML document on success.  In this case the hostname and ipaddr will point
- *         at memory buffers containing hostname and ipaddress.  These values must be free'd after usage.
+ *         at memory buffers containing hostname and ipaddress.  These values must be free'd with free_arena() after usage.
  *         On errors the function will return NULL and hostname and ipaddr will not have been touched
  *         at all.
  */
@@ -582,7 +703,7 @@ xmlDoc *sqldataGetHostInfo(LogContext *log, xsltStylesheet *xslt, xmlDoc *summar
 	if( !ipaddr ) {
 		writelog(log, LOG_ERR,
 			"sqldatGetHostInfo: Could not retrieve the IP address field from the input XML");
-		free_nullsafe(hostname);
+		free_arena(*hostname);
 		xmlFreeDoc(hostinfo_d);
 		goto exit;
 	}
@@ -625,3 +746,48 @@ int sqldataGetRequiredSchemaVer(LogContext *log, xmlNode *sqldata_root)
 
 	return (majv * 100) + minv;
 }
+
+
+/**
+ * Checks if a report is a snapshot of a longer rteval run, identified by a
+ * <snapshot runid="..." seq="..." final="0|1"/> tag inside the run_info tag.
+ *
+ * @param log     Log context
+ * @param report  rteval XML report document
+ * @param snap    Return pointer, where the snapshot information is saved
+ *
+ * @return Returns 1 if the report is a snapshot, 0 if it is a complete report and -1 if
+ *         the snapshot information is invalid.
+ */
+int reportGetSnapshot(LogContext *log, xmlDoc *report, reportSnapshot *snap)
+{
+	xmlNode *snap_n = NULL;
+	char *runid = NULL, *seq = NULL, *final = NULL;
+	size_t len = 0;
+
+	memset(snap, 0, sizeof(reportSnapshot));
+	snap_n = xmlFindNode(xmlFindNode(xmlDocGetRootElement(report), "run_info"), "snapshot");
+	if( !snap_n ) {
+		return 0;
+	}
+
+	runid = xmlGetAttrValue(snap_n->properties, "runid");
+	seq = xmlGetAttrValue(snap_n->properties, "seq");
+	final = xmlGetAttrValue(snap_n->properties, "final");
+	len = strlen_nullsafe(runid);
+	if( (len < 1) || (len >= sizeof(snap->runid) - 1)
+	    || (strspn(runid, "0123456789abcdefghijklmnopqrstuvwxyz"
+			      "ABCDEFGHIJKLMNOPQRSTUVWXYZ-_") != len) ) {
+		writelog(log, LOG_ERR, "reportGetSnapshot: Invalid run ID '%s'", runid);
+		return -1;
+	}
+	if( atoi_nullsafe(seq) < 1 ) {
+		writelog(log, LOG_ERR, "reportGetSnapshot: Invalid sequence number '%s'", seq);
+		return -1;
+	}
+
+	strncpy(snap->runid, runid, sizeof(snap->runid) - 1);
+	snap->seq = atoi_nullsafe(seq);
+	snap->final = (atoi_nullsafe(final) == 1);
+	return 1;
+}
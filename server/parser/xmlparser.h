@@ -39,6 +39,15 @@ typedef struct {
         unsigned int rterid;          /**< References rtevalruns.rterid */
 } parseParams;
 
+/**
+ * Identifies a snapshot report, submitted while a long rteval run is still going on
+ */
+typedef struct {
+        char runid[66];               /**< Run ID, the same for all snapshots of a run */
+        unsigned int seq;             /**< Sequence number of the snapshot, starting on 1 */
+        int final;                    /**< Set if this is the last snapshot of the run */
+} reportSnapshot;
+
 /**
  * Container for string arrays
  */
@@ -72,11 +81,13 @@ typedef struct {
 void init_xmlparser(dbhelper_func const * dbhelpers);
 char * sqldataValueHash(LogContext *log, xmlNode *sql_n);
 xmlDoc *parseToSQLdata(LogContext *log, xsltStylesheet *xslt, xmlDoc *indata_d, parseParams *params);
+void xmlparser_warmup(LogContext *log, xsltStylesheet *xslt, array_str_t *tables);
 char *sqldataExtractContent(LogContext *log, xmlNode *sql_n);
 int sqldataGetFid(LogContext *log, xmlNode *sqld, const char *fname);
 char *sqldataGetValue(LogContext *log, xmlDoc *sqld, const char *fname, int recid);
 xmlDoc *sqldataGetHostInfo(LogContext *log, xsltStylesheet *xslt, xmlDoc *summaryxml,
 			   int syskey, char **hostname, char **ipaddr);
 int sqldataGetRequiredSchemaVer(LogContext *log, xmlNode *sqldata_root);
+int reportGetSnapshot(LogContext *log, xmlDoc *report, reportSnapshot *snap);
 
 #endif
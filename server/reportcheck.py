@@ -0,0 +1,87 @@
+#
+#   reportcheck.py
+#   Light weight checking of compressed rteval reports
+#
+#   Copyright 2009 - 2013   David Sommerseth <davids@redhat.com>
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License along
+#   with this program; if not, write to the Free Software Foundation, Inc.,
+#   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+#   For the avoidance of doubt the "preferred form" of this code is one which
+#   is in an open unpatent encumbered format. Where cryptographic key signing
+#   forms part of the process of creating an executable the information
+#   including keys needed to generate an equivalently functional executable
+#   are deemed to be part of the source code.
+#
+
+import bz2
+import zlib
+import xml.parsers.expat
+
+BLOCKSIZE = 65536
+
+
+class ReportChecker(object):
+    """Checks that a bzip2 or gzip compressed report is well-formed XML and not
+    bigger than maxsize bytes when decompressed.  The report is fed block by block,
+    and neither the decompressed report nor any document tree is kept in memory"""
+
+    def __init__(self, maxsize):
+        self.__maxsize = maxsize
+        self.__decomp = None
+        self.__xmlchk = xml.parsers.expat.ParserCreate()
+        self.xmlsize = 0
+
+
+    def Feed(self, block):
+        "Checks the next block of the compressed report.  Raises ValueError on errors"
+        try:
+            if self.__decomp is None:
+                if block[:3] == 'BZh':
+                    self.__decomp = bz2.BZ2Decompressor()
+                elif block[:2] == '\x1f\x8b':
+                    # 16 + MAX_WBITS: expect a gzip header
+                    self.__decomp = zlib.decompressobj(16 + zlib.MAX_WBITS)
+                else:
+                    raise ValueError("The report is not bzip2 or gzip compressed")
+
+            data = self.__decomp.decompress(block)
+            self.xmlsize += len(data)
+            if self.xmlsize > self.__maxsize:
+                raise ValueError("more than %i bytes uncompressed" % self.__maxsize)
+            self.__xmlchk.Parse(data, False)
+        except (EOFError, IOError, zlib.error, xml.parsers.expat.ExpatError), err:
+            raise ValueError(str(err))
+
+
+    def Close(self):
+        "Completes the check, raises ValueError if the report is incomplete"
+        try:
+            self.__xmlchk.Parse('', True)
+        except xml.parsers.expat.ExpatError, err:
+            raise ValueError(str(err))
+
+
+def CheckFile(fname, maxsize):
+    "Checks a compressed report saved in a file.  Raises ValueError on errors"
+    chk = ReportChecker(maxsize)
+    f = open(fname, 'rb')
+    try:
+        block = f.read(BLOCKSIZE)
+        while block:
+            chk.Feed(block)
+            block = f.read(BLOCKSIZE)
+        chk.Close()
+    finally:
+        f.close()
@@ -1,6 +1,6 @@
 Name:		rteval-parser
 Version:	1.6
-%define sqlschemaver 1.5
+%define sqlschemaver 1.6
 Release:	1%{?dist}
 Summary:	Report parser daemon for  rteval XML-RPC
 %define pkgname rteval-xmlrpc-%{version}
@@ -11,7 +11,7 @@ URL:		http://git.kernel.org/?p=linux/kernel/git/clrkwllms/rteval.git
 Source0:	%{pkgname}.tar.gz
 BuildRoot:	%{_tmppath}/%{name}-%{version}-%{release}-root-%(%{__id_u} -n)
 
-BuildRequires:	postgresql-devel libxml2-devel libxslt-devel
+BuildRequires:	postgresql-devel libxml2-devel libxslt-devel systemtap-sdt-devel zlib-devel bzip2-devel libzstd-devel
 Requires:	postgresql httpd mod_wsgi
 Requires(post): chkconfig
 Requires(preun): chkconfig
@@ -72,7 +72,7 @@ rm -rf $RPM_BUILD_ROOT
 
 %files
 %defattr(-,root,root,-)
-%doc COPYING parser/README.parser sql/rteval-%{sqlschemaver}.sql sql/delta-*_*.sql
+%doc COPYING parser/README.parser sql/rteval-%{sqlschemaver}.sql sql/shard-%{sqlschemaver}.sql sql/delta-*_*.sql
 %config(noreplace) %{_sysconfdir}/sysconfig/rteval-parserd
 %attr(0755,root,root) %{_sysconfdir}/init.d/rteval-parserd
 %{_bindir}/rteval-parserd
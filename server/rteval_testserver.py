@@ -28,11 +28,14 @@
 import os
 import sys
 import signal
+import cgi
+import urlparse
 from SimpleXMLRPCServer import SimpleXMLRPCServer
 from SimpleXMLRPCServer import SimpleXMLRPCRequestHandler
 from optparse import OptionParser
 
 import xmlrpc_API1
+import upload_API2
 from Logger import Logger
 
 # Default values
@@ -42,6 +45,31 @@ PORT=65432
 # Restrict to a particular path.
 class RequestHandler(SimpleXMLRPCRequestHandler):
     rpc_paths = ('/rteval/API1/',)
+    upload = None   # UploadAPI2 object, handling the API2 requests
+
+    def __api2(self):
+        url = urlparse.urlparse(self.path)
+        if not url.path.startswith('/rteval/API2/'):
+            self.report_404()
+            return
+
+        size = int(self.headers.get('Content-Length', 0))
+        (code, text) = self.upload.Handle(self.command, url.path[len('/rteval/API2'):],
+                                          cgi.parse_qs(url.query),
+                                          self.headers.get('Content-Range'),
+                                          size > 0 and self.rfile.read(size) or '')
+        text += '\n'
+        self.send_response(code)
+        self.send_header("Content-type", "text/plain")
+        self.send_header("Content-length", str(len(text)))
+        self.end_headers()
+        self.wfile.write(text)
+
+    def do_GET(self):
+        self.__api2()
+
+    def do_PUT(self):
+        self.__api2()
 
 
 class RTevald_config(object):
@@ -51,7 +79,12 @@ class RTevald_config(object):
                        'db_port': 5432,
                        'database': 'dummy',
                        'db_username': None,
-                       'db_password': None}
+                       'db_password': None,
+                       'db_pool_size': 8,
+                       'db_shards': None,
+                       'max_report_size': 2097152,
+                       'upload_expire': 604800,
+                       'max_batch_reports': 64}
         self.__update_vars()
 
     def __update_vars(self):
@@ -86,6 +119,7 @@ class RTevald():
 
         # setup a class to handle requests
         self.server.register_instance(xmlrpc_API1.XMLRPC_API1(self.config, nodbaction=True, debug=True))
+        RequestHandler.upload = upload_API2.UploadAPI2(self.config, nodbaction=True, debug=True)
 
         # Run the server's main loop
         self.log.Log("StartServer", "Listening on %s:%i" % (self.options.listen, self.options.port))
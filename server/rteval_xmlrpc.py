@@ -39,7 +39,12 @@ def Dispatch(req, method, args):
                                  'db_port':     5432,
                                  'database':    'rteval',
                                  'db_username': 'rtevxmlrpc',
-                                 'db_password': 'rtevaldb'
+                                 'db_password': 'rtevaldb',
+                                 'db_pool_size': 8,
+                                 'db_shards':   '',
+                                 'max_report_size': 2097152,
+                                 'upload_expire': 604800,
+                                 'max_batch_reports': 64
                                  }
               }
 
@@ -26,51 +26,188 @@
 #
 
 import os
-from database import Database
+import threading
+import psycopg2
+from psycopg2.pool import ThreadedConnectionPool, PoolError
+from database import Database, BuildDSN
 
-def register_submission(config, clientid, filename, debug=False, noaction=False):
-    "Registers a submission of a rteval report which signalises the rteval_parserd process"
+# Database connection pools, shared by all requests handled by this process.
+# One pool per database server, database and user name.
+_pools = {}
+_poollock = threading.Lock()
 
-    dbc = Database(host=config.db_server, port=config.db_port, database=config.database,
-                   user=config.db_username, password=config.db_password,
-                   debug=debug, noaction=noaction)
 
-    submvars = {"table": "submissionqueue",
-                "fields": ["clientid", "filename"],
-                "records": [[clientid, filename]],
-                "returning": "submid"
-                }
+def _getpool(config):
+    "Returns the connection pool for the database given in the configuration"
+    key = (config.db_server, str(config.db_port), config.database, config.db_username)
+
+    _poollock.acquire()
+    try:
+        if not _pools.has_key(key):
+            dsn = BuildDSN(host=config.db_server, port=config.db_port, database=config.database,
+                           user=config.db_username, password=config.db_password)
+            _pools[key] = ThreadedConnectionPool(1, int(config.db_pool_size or 8), dsn)
+        return _pools[key]
+    finally:
+        _poollock.release()
+
+
+class _ShardConfig(object):
+    """Connection settings of a shard database, given as <host>[:<port>]/<database> in
+    db_shards.  All other settings are taken from the main configuration"""
+
+    def __init__(self, config, entry):
+        (hostport, database) = entry.split('/', 1)
+        if hostport.find(':') > -1:
+            (host, port) = hostport.split(':', 1)
+        else:
+            (host, port) = (hostport, config.db_port)
+        if not host or not database:
+            raise ValueError("Invalid db_shards entry '%s'" % entry)
+
+        self.shard = entry
+        self.db_server = host
+        self.db_port = port
+        self.database = database
+        self.__config = config
+
+    def __getattr__(self, name):
+        return getattr(self.__config, name)
+
+
+def _shards(config):
+    "Returns the connection settings of each shard database, empty if not sharded"
+    if not config.db_shards:
+        return []
+    return [_ShardConfig(config, e) for e in config.db_shards.replace(',', ' ').split()]
+
+
+def _run(config, func, debug=False, noaction=False):
+    """Calls func() with a Database object using a pooled connection.  If the pooled
+    connection turns out to be dead, it is discarded and func() is called once more
+    on a new connection"""
+
+    if noaction:
+        return func(Database(debug=debug, noaction=noaction))
+
+    pool = _getpool(config)
+    for attempt in (1, 2):
+        try:
+            conn = pool.getconn()
+            pooled = True
+        except PoolError:
+            # All pooled connections are in use, use a temporary connection
+            conn = psycopg2.connect(BuildDSN(host=config.db_server, port=config.db_port,
+                                             database=config.database,
+                                             user=config.db_username,
+                                             password=config.db_password))
+            pooled = False
 
-    res = dbc.INSERT(submvars)
-    if len(res) != 1:
-        raise Exception("Could not register the submission")
+        broken = False
+        try:
+            try:
+                return func(Database(conn=conn, debug=debug))
+            except (psycopg2.OperationalError, psycopg2.InterfaceError):
+                broken = True
+                if not pooled or attempt == 2:
+                    raise
+        finally:
+            if not broken and not conn.closed:
+                try:
+                    # Never leave a transaction open on a pooled connection
+                    conn.rollback()
+                except psycopg2.Error:
+                    broken = True
+            if pooled:
+                pool.putconn(conn, close=(broken or conn.closed != 0))
+            else:
+                conn.close()
+
+
+def register_submissions(config, submissions, debug=False, noaction=False):
+    """Registers several rteval reports in one INSERT, which signalises the rteval_parserd
+    process once.  submissions is a list of [clientid, filename, size] lists, where size
+    is the size of the report file in bytes.  The submission IDs are returned in the
+    same order"""
+
+    def __register(dbc):
+        submvars = {"table": "submissionqueue",
+                    "fields": ["clientid", "filename", "report_size"],
+                    "records": [[clientid, filename, size]
+                                for (clientid, filename, size) in submissions],
+                    "returning": "submid"
+                    }
+
+        res = dbc.INSERT(submvars)
+        if len(res) != len(submissions):
+            raise Exception("Could not register the submissions")
+
+        dbc.COMMIT()
+        # submid is a serial, assigned in the order of the records
+        if not noaction:
+            res.sort()
+        return res
+
+    return _run(config, __register, debug=debug, noaction=noaction)
+
+
+def register_submission(config, clientid, filename, size, debug=False, noaction=False):
+    "Registers a submission of a rteval report which signalises the rteval_parserd process"
+
+    return register_submissions(config, [[clientid, filename, size]],
+                                debug=debug, noaction=noaction)[0]
 
-    dbc.COMMIT()
-    return res[0]
 
 def database_status(config, debug=False, noaction=False):
-    dbc = Database(host=config.db_server, port=config.db_port, database=config.database,
-                   user=config.db_username, password=config.db_password,
-                   debug=debug, noaction=noaction)
-    if not dbc:
-        return {"status": "No connection to pgsql://%s:%s/%s" % (config.db_server,
-                                                                 config.db_port,
-                                                                 config.database)}
-
-    res = dbc.SELECT('rtevalruns',
-                     ["to_char(CURRENT_TIMESTAMP, 'YYYY-MM-DD HH24:MI:SS') AS server_time",
-                      "max(rterid) AS last_rterid",
-                      "max(submid) AS last_submid"]
-                     )
-    if len(res) != 3:
-        return {"status": "Could not query database pgsql://%s:%s/%s" % (config.db_server,
-                                                                         config.db_port,
-                                                                         config.database)}
-    last_rterid = res['records'][0][1] and res['records'][0][1] or "(None)"
-    last_submid = res['records'][0][1] and res['records'][0][2] or "(None)"
-    return {"status": "OK",
-            "server_time": res['records'][0][0],
-            "last_rterid": last_rterid,
-            "last_submid": last_submid
-            }
+    """Returns the status of the database.  When the reports are stored on shard databases,
+    the last rterid and submid are the highest found on any shard, and the status of each
+    shard is returned in 'shards'"""
+
+    def __status(dbc):
+        res = dbc.SELECT('rtevalruns',
+                         ["to_char(CURRENT_TIMESTAMP, 'YYYY-MM-DD HH24:MI:SS') AS server_time",
+                          "max(rterid) AS last_rterid",
+                          "max(submid) AS last_submid"]
+                         )
+        if len(res) != 3:
+            return {"status": "Could not query database pgsql://%s:%s/%s" % (config.db_server,
+                                                                             config.db_port,
+                                                                             config.database)}
+        last_rterid = res['records'][0][1] and res['records'][0][1] or "(None)"
+        last_submid = res['records'][0][1] and res['records'][0][2] or "(None)"
+        return {"status": "OK",
+                "server_time": res['records'][0][0],
+                "last_rterid": last_rterid,
+                "last_submid": last_submid
+                }
+
+    def __try_status(cfg):
+        try:
+            return _run(cfg, __status, debug=debug, noaction=noaction)
+        except psycopg2.OperationalError:
+            return {"status": "No connection to pgsql://%s:%s/%s" % (cfg.db_server,
+                                                                     cfg.db_port,
+                                                                     cfg.database)}
+
+    shards = _shards(config)
+    ret = __try_status(config)
+    if not shards or ret["status"] != "OK":
+        return ret
 
+    # The report data is found on the shards, the main database gives the server time
+    ret["shards"] = []
+    last_rterid = last_submid = None
+    for shard in shards:
+        st = __try_status(shard)
+        st["shard"] = shard.shard
+        ret["shards"].append(st)
+        if st["status"] != "OK":
+            ret["status"] = "Shard %s: %s" % (shard.shard, st["status"])
+            continue
+        if st["last_rterid"] != "(None)":
+            last_rterid = max(last_rterid, st["last_rterid"])
+        if st["last_submid"] != "(None)":
+            last_submid = max(last_submid, st["last_submid"])
+    ret["last_rterid"] = last_rterid and last_rterid or "(None)"
+    ret["last_submid"] = last_submid and last_submid or "(None)"
+    return ret
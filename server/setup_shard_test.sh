@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+#   setup_shard_test.sh - local PostgreSQL shard instances for testing db_shards
+#
+#   Copyright 2013   Red Hat Inc.
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   Usage: setup_shard_test.sh start|stop [<directory> [<shards> [<first port>]]]
+#
+#   start creates and starts <shards> PostgreSQL instances (default 2) below
+#   <directory> (default /tmp/rteval-shards), listening on localhost from
+#   <first port> (default 5433).  Each gets the rteval database schema followed
+#   by shard-<version>.sql, and the db_shards setting to use is printed.
+#   stop stops the instances and removes <directory>.
+#
+
+CMD="$1"
+BASEDIR="${2:-/tmp/rteval-shards}"
+SHARDS="${3:-2}"
+FIRSTPORT="${4:-5433}"
+SQLDIR="$(cd "$(dirname "$0")/sql" && pwd)"
+SQLSCHEMAVER="1.6"
+
+case "$CMD" in
+    start)
+        if [ -e "${BASEDIR}" ]; then
+            echo "${BASEDIR} exists, run '$0 stop ${BASEDIR}' first" 1>&2
+            exit 1
+        fi
+        mkdir -p "${BASEDIR}" || exit 1
+        shards=""
+        i=1
+        while [ $i -le $SHARDS ]; do
+            port=$((FIRSTPORT + i - 1))
+            dir="${BASEDIR}/shard$i"
+            echo "Creating shard $i in ${dir}, port ${port}"
+            initdb -D "${dir}" -A trust > "${BASEDIR}/initdb$i.log" 2>&1 || exit 1
+            pg_ctl -D "${dir}" -l "${dir}/postgresql.log" -w \
+                   -o "-p ${port} -k ${dir} -c listen_addresses=localhost" start > /dev/null || exit 1
+
+            # rteval-${SQLSCHEMAVER}.sql creates the database users and the rteval database itself
+            psql -q -h localhost -p ${port} -d postgres \
+                 -f "${SQLDIR}/rteval-${SQLSCHEMAVER}.sql" > "${BASEDIR}/schema$i.log" 2>&1
+            psql -q -h localhost -p ${port} -d rteval -v ON_ERROR_STOP=1 \
+                 -f "${SQLDIR}/shard-${SQLSCHEMAVER}.sql" >> "${BASEDIR}/schema$i.log" 2>&1
+            if [ $? -ne 0 ]; then
+                echo "Could not prepare the rteval database of shard $i, see ${BASEDIR}/schema$i.log" 1>&2
+                exit 1
+            fi
+            shards="${shards}${shards:+, }localhost:${port}/rteval"
+            i=$((i + 1))
+        done
+        echo
+        echo "Add this to the xmlrpc_parser section of the rteval configuration file:"
+        echo
+        echo "    db_shards: ${shards}"
+        ;;
+
+    stop)
+        for dir in "${BASEDIR}"/shard*; do
+            [ -d "${dir}" ] && pg_ctl -D "${dir}" -w -m fast stop > /dev/null
+        done
+        rm -rf "${BASEDIR}"
+        ;;
+
+    *)
+        echo "Usage: $0 start|stop [<directory> [<shards> [<first port>]]]" 1>&2
+        exit 1
+        ;;
+esac
+exit 0
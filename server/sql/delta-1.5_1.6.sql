@@ -0,0 +1,71 @@
+-- SQL delta update from rteval-1.5.sql to rteval-1.6.sql
+
+UPDATE rteval_info SET value = '1.6' WHERE key = 'sql_schema_ver';
+
+-- rteval-parserd retries submissions which failed for a transient reason
+    ALTER TABLE submissionqueue ADD COLUMN attempts INTEGER NOT NULL DEFAULT 0;
+    ALTER TABLE submissionqueue ADD COLUMN retry_after TIMESTAMP WITH TIME ZONE;
+
+-- The size of the report is registered with the submission, for the job scheduler
+    ALTER TABLE submissionqueue ADD COLUMN report_size BIGINT;
+
+-- rteval-parserd may register submissions received directly (ingest_listen)
+    GRANT INSERT ON submissionqueue TO rtevparser;
+    GRANT USAGE ON submissionqueue_submid_seq TO rtevparser;
+    GRANT EXECUTE ON FUNCTION trgfnc_submqueue_notify() TO rtevparser;
+
+-- TABLE: submission_stats
+-- Timing and volume information collected by rteval-parserd while
+-- processing a submission.  All times are in seconds.  The tables and
+-- table_rows arrays are paired, table_rows[n] is the number of records
+-- inserted into tables[n].  lane is the scheduler lane the submission was
+-- dispatched in (0: normal, 1: short) and queue_wait the time it waited
+-- for a worker thread.  attempt is the number of failed attempts of the
+-- submission before this one.
+--
+    CREATE TABLE submission_stats (
+           submid         INTEGER REFERENCES submissionqueue(submid) NOT NULL,
+           status         INTEGER NOT NULL,
+           report_size    BIGINT NOT NULL,
+           parse_time     REAL NOT NULL,
+           transform_time REAL NOT NULL,
+           insert_time    REAL NOT NULL,
+           commit_time    REAL NOT NULL,
+           total_rows     INTEGER NOT NULL,
+           tables         VARCHAR(64)[],
+           table_rows     INTEGER[],
+           lane           SMALLINT NOT NULL DEFAULT 0,
+           queue_wait     REAL NOT NULL DEFAULT 0,
+           attempt        SMALLINT NOT NULL DEFAULT 0,
+           registered     TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT NOW(),
+           sstid          SERIAL,
+           PRIMARY KEY(sstid)
+    );
+    CREATE INDEX submission_stats_submid ON submission_stats(submid);
+
+    GRANT INSERT ON submission_stats TO rtevparser;
+    GRANT USAGE ON submission_stats_sstid_seq TO rtevparser;
+    GRANT SELECT ON submission_stats TO rtevxmlrpc;
+
+-- rteval-parserd adds snapshots of long rteval runs to already registered runs
+    GRANT UPDATE ON rtevalruns TO rtevparser;
+    GRANT DELETE ON cyclic_statistics TO rtevparser;
+    GRANT DELETE ON cyclic_histogram TO rtevparser;
+
+-- TABLE: rtevalrun_snapshots
+-- Long rteval runs may be submitted as several snapshots, which are all
+-- added to the same rteval run.  Each snapshot is registered here.
+--
+    CREATE TABLE rtevalrun_snapshots (
+        runid           VARCHAR(64) NOT NULL, -- Run ID, assigned by rteval
+        seq             INTEGER NOT NULL,
+        rterid          INTEGER REFERENCES rtevalruns(rterid) NOT NULL,
+        submid          INTEGER REFERENCES submissionqueue(submid) NOT NULL,
+        final           BOOLEAN NOT NULL DEFAULT false,
+        PRIMARY KEY(runid, seq)
+    );
+    CREATE INDEX rtevalrun_snapshots_rterid ON rtevalrun_snapshots(rterid);
+    CREATE INDEX rtevalrun_snapshots_submid ON rtevalrun_snapshots(submid);
+
+    GRANT SELECT, INSERT ON rtevalrun_snapshots TO rtevparser;
+    GRANT SELECT ON rtevalrun_snapshots TO rtevxmlrpc;
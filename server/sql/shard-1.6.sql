@@ -0,0 +1,9 @@
+-- SQL changes for an rteval shard database, applied after rteval-1.6.sql
+--
+-- With db_shards configured, rteval-parserd registers the rteval runs and
+-- their snapshots in the shard databases, while the submission queue is
+-- only kept in the main database.  The submissionqueue table of a shard is
+-- always empty, so the submid columns cannot reference it.
+
+    ALTER TABLE rtevalruns DROP CONSTRAINT rtevalruns_submid_fkey;
+    ALTER TABLE rtevalrun_snapshots DROP CONSTRAINT rtevalrun_snapshots_submid_fkey;
@@ -58,6 +58,16 @@ class ClientTest(object):
             print "** Client test [1]: Hello(): %s" % str(self.client.Hello())
             status = self.client.SendReport(self.testdoc)
             print "** Client test [2]; SendReport(xmlDoc): %s" % str(status)
+            upload = self.client.PrepareReport(self.testdoc)
+            status = self.client.UploadReport(upload, chunksize=64)
+            print "** Client test [3]; UploadReport(upload): %s" % str(status)
+            if self.client.UploadReport(upload) != status:
+                raise Exception("Repeated UploadReport() did not return the same submission id")
+            print "** Client test [4]; UploadReport(upload) repeated: %s" % str(status)
+            status = self.client.SendReports([('host1', self.testdoc), ('host2', self.testdoc)])
+            if len(status) != 2:
+                raise Exception("SendReports() did not return two submission ids")
+            print "** Client test [5]; SendReports([...]): %s" % str(status)
         except Exception, e:
             raise Exception("XML-RPC client test failed: %s" % str(e))
 
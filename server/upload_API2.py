@@ -0,0 +1,243 @@
+#
+#   upload_API2.py
+#   Resumable report uploads, supported by the API2 version for the rteval server
+#
+#   Copyright 2009 - 2013   David Sommerseth <davids@redhat.com>
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License along
+#   with this program; if not, write to the Free Software Foundation, Inc.,
+#   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+#   For the avoidance of doubt the "preferred form" of this code is one which
+#   is in an open unpatent encumbered format. Where cryptographic key signing
+#   forms part of the process of creating an executable the information
+#   including keys needed to generate an equivalently functional executable
+#   are deemed to be part of the source code.
+#
+#
+#   The API2 interface takes the compressed report as a raw HTTP body, instead
+#   of base64 encoded inside an XML-RPC call.  The report may be sent in several
+#   chunks, and an interrupted upload can be resumed.  Each upload is identified
+#   by an upload ID generated by the client.
+#
+#     GET /rteval/API2/upload/<uploadid>
+#         Returns "offset <n>", the number of bytes received so far, or
+#         "submid <n>" if the upload is completed.
+#
+#     PUT /rteval/API2/upload/<uploadid>?clientid=<clientid>
+#     Content-Range: bytes <first>-<last>/<total>
+#         Appends a chunk to the upload, <first> must be the current offset.
+#         Returns "offset <n>" (200) until the last chunk is received.  The
+#         complete report is then checked and registered, and "submid <n>" (201)
+#         is returned.  If <first> is not the current offset, the chunk is
+#         rejected with 409 and "offset <n>".  "Content-Range: bytes */<total>"
+#         with an empty body retries the registration of a complete upload.
+#
+
+import os
+import re
+import time
+import fcntl
+import string
+import rtevaldb
+import reportcheck
+
+UPLOAD_MAX_CHUNK = 4194304         # Largest accepted chunk, in bytes
+UPLOAD_EXPIRE = 7*24*3600          # Incomplete uploads are removed after this many seconds
+
+
+class UploadAPI2():
+    def __init__(self, config=None, debug=False, nodbaction=False):
+        self.apiversion = 2
+        self.fnametrans = string.maketrans("/\\.", "::_") # replace path delimiters in filenames
+        self.debug = debug
+        self.nodbaction = nodbaction
+        self.config = config
+        self.__re_uploadid = re.compile(r'^[0-9A-Za-z_-]{8,64}$')
+        self.__re_range = re.compile(r'^bytes (?:(\d+)-(\d+)|\*)/(\d+)$')
+
+
+    def __mkdir(self, dirpath):
+        if not os.path.exists(dirpath):
+            os.makedirs(dirpath, 0700)
+
+
+    def __files(self, uploadid):
+        "Returns the file names used by an upload: received data, upload info, completion info"
+        updir = os.path.join(self.config.datadir, 'uploads')
+        self.__mkdir(updir)
+        return (os.path.join(updir, "%s.part" % uploadid),
+                os.path.join(updir, "%s.info" % uploadid),
+                os.path.join(updir, "%s.done" % uploadid))
+
+
+    def __expire(self):
+        "Removes incomplete and completed uploads which have not been touched for a long time"
+        updir = os.path.join(self.config.datadir, 'uploads')
+        limit = time.time() - int(self.config.upload_expire or UPLOAD_EXPIRE)
+        for f in os.listdir(updir):
+            try:
+                fname = os.path.join(updir, f)
+                if os.path.getmtime(fname) < limit:
+                    os.unlink(fname)
+            except OSError:
+                pass
+
+
+    def __readfile(self, fname):
+        try:
+            f = open(fname, 'r')
+            try:
+                return f.read().split('\n')
+            finally:
+                f.close()
+        except IOError:
+            return None
+
+
+    def __samefile(self, f, fname):
+        "Checks if the opened file f is still the file named fname"
+        try:
+            return os.path.samestat(os.fstat(f.fileno()), os.stat(fname))
+        except OSError:
+            return False
+
+
+    def __complete(self, uploadid, clientid, size, partf, infof, donef):
+        "Checks a completely received report, and registers it in the submission queue"
+        try:
+            reportcheck.CheckFile(partf, int(self.config.max_report_size or 2097152))
+        except ValueError, err:
+            os.unlink(partf)
+            os.unlink(infof)
+            return (400, "Invalid report: %s" % str(err))
+
+        # Move the report into the submission queue, where rteval-parserd will find it
+        f = open(partf, 'rb')
+        compsuffix = f.read(3) == 'BZh' and '.bz2' or '.gz'
+        f.close()
+        self.__mkdir(os.path.join(self.config.datadir, 'queue'))
+        qfname = os.path.join(self.config.datadir, 'queue', "%s-%s.xml%s"
+                              % (clientid.translate(self.fnametrans), uploadid, compsuffix))
+        os.rename(partf, qfname)
+        if self.debug:
+            print "Copy of report: %s" % qfname
+
+        try:
+            submid = rtevaldb.register_submission(self.config, clientid, qfname, size,
+                                                  debug=self.debug, noaction=self.nodbaction)
+            if self.nodbaction:
+                submid = 999999999 # Fake ID when no database registration is done
+        except:
+            # Keep the upload, the registration can be retried by the client
+            os.rename(qfname, partf)
+            raise
+
+        f = open(donef, 'w')
+        f.write("%i\n" % submid)
+        f.close()
+        os.unlink(infof)
+        return (201, "submid %i" % submid)
+
+
+    def Status(self, uploadid):
+        "Returns the status of an upload"
+        (partf, infof, donef) = self.__files(uploadid)
+
+        done = self.__readfile(donef)
+        if done:
+            return (200, "submid %s" % done[0])
+        if os.path.exists(partf):
+            return (200, "offset %i" % os.path.getsize(partf))
+        return (200, "offset 0")
+
+
+    def PutChunk(self, uploadid, clientid, crange, data):
+        "Receives a chunk of an upload"
+        m = crange and self.__re_range.match(crange) or None
+        if not m or not clientid or len(clientid) > 128:
+            return (400, "Missing or invalid Content-Range or clientid")
+        total = int(m.group(3))
+        if m.group(1) is not None:
+            (first, last) = (int(m.group(1)), int(m.group(2)))
+            if (last < first) or (last >= total) or (len(data) != (last - first + 1)):
+                return (400, "Content-Range does not match the data")
+        else:
+            (first, last) = (None, None)
+            if len(data) > 0:
+                return (400, "Content-Range does not match the data")
+        if len(data) > UPLOAD_MAX_CHUNK:
+            return (413, "Chunks are limited to %i bytes" % UPLOAD_MAX_CHUNK)
+        if total > int(self.config.max_report_size or 2097152):
+            return (413, "The report is too big")
+
+        (partf, infof, donef) = self.__files(uploadid)
+        done = self.__readfile(donef)
+        if done:
+            # Completed earlier, the client did not get the reply
+            return (201, "submid %s" % done[0])
+
+        # Describe the upload on the first chunk, and verify it on the following ones
+        info = self.__readfile(infof)
+        if info is None:
+            self.__expire()
+            f = open(infof, 'w')
+            f.write("%s\n%i\n" % (clientid, total))
+            f.close()
+        elif info[0] != clientid or int(info[1]) != total:
+            return (400, "The upload %s was started with a different clientid or size" % uploadid)
+
+        # Append the chunk, only one request may update the upload at the time
+        f = open(partf, 'ab')
+        try:
+            fcntl.lockf(f, fcntl.LOCK_EX)
+
+            # Another request may have completed or removed the upload while waiting for the lock
+            done = self.__readfile(donef)
+            if done:
+                if self.__samefile(f, partf) and os.fstat(f.fileno()).st_size == 0:
+                    os.unlink(partf) # Created by the open() above, after the upload completed
+                return (201, "submid %s" % done[0])
+            if not self.__samefile(f, partf):
+                return (409, "offset %i" % (os.path.exists(partf) and os.path.getsize(partf) or 0))
+
+            offset = os.fstat(f.fileno()).st_size
+            if first is not None:
+                if first != offset:
+                    return (409, "offset %i" % offset)
+                f.write(data)
+                f.flush()
+                os.fsync(f.fileno())
+                offset += len(data)
+            if offset < total:
+                return (200, "offset %i" % offset)
+
+            # The last chunk is received
+            return self.__complete(uploadid, clientid, total, partf, infof, donef)
+        finally:
+            f.close()
+
+
+    def Handle(self, method, path, params, crange, data):
+        """Processes an API2 request, independent of the web server interface.
+        Returns a tuple of the HTTP status code and a text reply"""
+        m = re.match(r'^/upload/([^/]+)$', path or '')
+        if not m or not self.__re_uploadid.match(m.group(1)):
+            return (404, "Unknown API2 resource")
+
+        if method in ('GET', 'HEAD'):
+            return self.Status(m.group(1))
+        elif method == 'PUT':
+            clientid = params.has_key('clientid') and params['clientid'][0] or None
+            return self.PutChunk(m.group(1), clientid, crange, data)
+        return (405, "Method not allowed")
@@ -26,12 +26,11 @@
 #
 
 import os
-import bz2
 import base64
-import libxml2
 import string
 import platform
 import rtevaldb
+import reportcheck
 
 
 class XMLRPC_API1():
@@ -69,8 +68,8 @@ class XMLRPC_API1():
                 return filename
             idx += 1
             if comp:
-                filename = "%s/%s/%s-{%i}.bz2" % (self.config.datadir, dir,
-                                                  fname.translate(self.fnametrans), idx)
+                filename = "%s/%s/%s-{%i}%s.bz2" % (self.config.datadir, dir,
+                                                    fname.translate(self.fnametrans), idx, ext)
             else:
                 filename = "%s/%s/%s-{%i}" % (self.config.datadir, dir,
                                               fname.translate(self.fnametrans), idx)
@@ -88,27 +87,86 @@ class XMLRPC_API1():
         return self.Dispatch(method, params)
 
 
-    def SendReport(self, clientid, xmlbzb64):
-        decompr = bz2.BZ2Decompressor()
-        xmldoc = libxml2.parseDoc(decompr.decompress(base64.b64decode(xmlbzb64)))
-
-        # Save a copy of the report on the file system
+    def __spool_report(self, fname, xmlbz):
+        """Saves a bzip2 compressed report as it is.  While saving it, the report is
+        checked to be well-formed XML within the max_report_size limit, without
+        building any document tree"""
+        chk = reportcheck.ReportChecker(int(self.config.max_report_size or 2097152))
+
+        f = open(fname, 'wb')
+        try:
+            for pos in xrange(0, len(xmlbz), reportcheck.BLOCKSIZE):
+                block = xmlbz[pos:pos+reportcheck.BLOCKSIZE]
+                f.write(block)
+                chk.Feed(block)
+            chk.Close()
+        except ValueError, err:
+            f.close()
+            os.unlink(fname)
+            raise ValueError("Invalid report: %s" % str(err))
+        f.close()
+
+
+    def __save_report(self, clientid, xmlbzb64):
+        """Decodes a report and saves it in the queue directory.  Returns the file name
+        and the size of the saved report"""
+        xmlbz = base64.b64decode(xmlbzb64)
+        if xmlbz[:3] != 'BZh':
+            raise ValueError("The report is not bzip2 compressed")
+
+        # Save the report on the file system, still compressed.  rteval-parserd
+        # decompresses it while parsing it.
         # Make sure we have a directory to write files into
         self.__mkdatadir(os.path.join(self.config.datadir, 'queue'))
-        fname = self.__getfilename('queue/', ('%s' % clientid), '.xml', False)
-        xmldoc.saveFormatFileEnc(fname,'UTF-8',1)
+        fname = self.__getfilename('queue/', ('%s' % clientid), '.xml', True)
+        self.__spool_report(fname, xmlbz)
         if self.debug:
             print "Copy of report: %s" % fname
+        return (fname, len(xmlbz))
+
+
+    def SendReport(self, clientid, xmlbzb64):
+        (fname, size) = self.__save_report(clientid, xmlbzb64)
 
         # Register the submission and put it in a parse queue
-        rterid = rtevaldb.register_submission(self.config, clientid, fname,
-                                                        debug=self.debug, noaction=self.nodbaction)
+        rterid = rtevaldb.register_submission(self.config, clientid, fname, size,
+                                              debug=self.debug, noaction=self.nodbaction)
         if self.nodbaction:
             rterid = 999999999 # Fake ID when no database registration is done
 
         return rterid
 
 
+    def SendReports(self, reports):
+        """Receives several reports in one call, as a list of [clientid, report] pairs
+        where each report is encoded like for SendReport().  All reports are registered
+        at once, and a list of submission IDs is returned in the same order.  If one
+        report is invalid, none of them are registered.  An empty list gives an empty result"""
+        if len(reports) == 0:
+            return []
+        if len(reports) > int(self.config.max_batch_reports or 64):
+            raise ValueError("Too many reports, the limit is %s" % self.config.max_batch_reports)
+
+        saved = []
+        try:
+            for (clientid, xmlbzb64) in reports:
+                (fname, size) = self.__save_report(clientid, xmlbzb64)
+                saved.append([clientid, fname, size])
+
+            # Register all submissions in one go
+            submids = rtevaldb.register_submissions(self.config, saved,
+                                                    debug=self.debug, noaction=self.nodbaction)
+        except:
+            for (clientid, fname, size) in saved:
+                os.unlink(fname)
+            raise
+
+        if self.nodbaction:
+            submids = [999999999 for s in saved] # Fake IDs when no database registration is done
+
+        return submids
+
+
     def Hello(self, clientid):
         return {"greeting": "Hello %s" % clientid,
                 "server": platform.node(),